@@ -110,7 +110,8 @@ class Module;
     Expected<std::unique_ptr<ModuleSummaryIndex>> getSummary();
 
     /// Parse the specified bitcode buffer and merge its module summary index
-    /// into CombinedIndex.
+    /// into CombinedIndex. The summaries of several modules may be read
+    /// concurrently if CombinedIndex is thread safe.
     Error readSummary(ModuleSummaryIndex &CombinedIndex, StringRef ModulePath,
                       uint64_t ModuleId);
   };
@@ -125,6 +126,12 @@ class Module;
   /// symbol table should prefer to use irsymtab::read instead of this function
   /// because it creates a reader for the irsymtab and handles upgrading bitcode
   /// files without a symbol table or with an old symbol table.
+  ///
+  /// The contents refer to \p Buffer rather than copying it, and so do the
+  /// modules read from them. The buffer needs neither a null terminator nor
+  /// any particular alignment, so it can be a region of a mapped file, such as
+  /// an archive member or the .llvmbc section of an object file, which must
+  /// stay mapped while the modules are read.
   Expected<BitcodeFileContents> getBitcodeFileContents(MemoryBufferRef Buffer);
 
   /// Returns a list of modules in the specified bitcode buffer.
@@ -35,13 +35,18 @@ class raw_pwrite_stream;
 /// Writes bitcode for individual partitions into output streams in BCOSs, if
 /// BCOSs is not empty.
 ///
+/// The partitions are balanced by their estimated codegen cost. By default
+/// each partition gets its own thread. If ThreadCount is not 0, the partitions
+/// are instead generated on ThreadCount threads, most expensive first, so OSs
+/// may have many more streams than there are threads.
+///
 /// \returns M if OSs.size() == 1, otherwise returns std::unique_ptr<Module>().
 std::unique_ptr<Module>
 splitCodeGen(std::unique_ptr<Module> M, ArrayRef<raw_pwrite_stream *> OSs,
              ArrayRef<llvm::raw_pwrite_stream *> BCOSs,
              const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
              TargetMachine::CodeGenFileType FT = TargetMachine::CGFT_ObjectFile,
-             bool PreserveLocals = false);
+             bool PreserveLocals = false, unsigned ThreadCount = 0);
 
 } // namespace llvm
 
@@ -15,6 +15,7 @@
 
 #include "llvm/DebugInfo/DIContext.h"
 #include <cstdint>
+#include <vector>
 
 namespace llvm {
 namespace symbolize {
@@ -39,6 +40,17 @@ public:
   // Returns the preferred base of the module, i.e. where the loader would place
   // it in memory assuming there were no conflicts.
   virtual uint64_t getModulePreferredBase() const = 0;
+
+  // Return true if code lookups may be performed concurrently from several
+  // threads.
+  virtual bool supportsConcurrentQueries() const { return false; }
+
+  // Appends to Boundaries every address at which the results of symbolizeCode()
+  // and symbolizeInlinedCode() may change. Returns false if the module can't
+  // enumerate them.
+  virtual bool getCodeBoundaries(std::vector<uint64_t> &Boundaries) const {
+    return false;
+  }
 };
 
 } // end namespace symbolize
@@ -14,6 +14,7 @@
 #ifndef LLVM_DEBUGINFO_SYMBOLIZE_SYMBOLIZE_H
 #define LLVM_DEBUGINFO_SYMBOLIZE_SYMBOLIZE_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/DebugInfo/Symbolize/SymbolizableModule.h"
 #include "llvm/Object/Binary.h"
 #include "llvm/Object/ObjectFile.h"
@@ -27,6 +28,9 @@
 #include <vector>
 
 namespace llvm {
+
+class ThreadPool;
+
 namespace symbolize {
 
 using namespace object;
@@ -42,6 +46,11 @@ public:
     bool RelativeAddresses : 1;
     std::string DefaultArch;
     std::vector<std::string> DsymHints;
+    /// If non-empty, code lookups for modules with a build ID are answered
+    /// from memory-mapped indexes kept in this directory, without parsing the
+    /// debug info. A missing index is built on a background thread from the
+    /// first use on, while lookups keep using the debug info.
+    std::string IndexDirectory;
 
     Options(FunctionNameKind PrintFunctions = FunctionNameKind::LinkageName,
             bool UseSymbolTable = true, bool Demangle = true,
@@ -51,11 +60,9 @@ public:
           DefaultArch(std::move(DefaultArch)) {}
   };
 
-  LLVMSymbolizer(const Options &Opts = Options()) : Opts(Opts) {}
+  LLVMSymbolizer(const Options &Opts = Options());
 
-  ~LLVMSymbolizer() {
-    flush();
-  }
+  ~LLVMSymbolizer();
 
   Expected<DILineInfo> symbolizeCode(const std::string &ModuleName,
                                      uint64_t ModuleOffset,
@@ -65,6 +72,28 @@ public:
                                                 StringRef DWPName = "");
   Expected<DIGlobal> symbolizeData(const std::string &ModuleName,
                                    uint64_t ModuleOffset);
+
+  /// A (module name, module offset) pair to symbolize.
+  using CodeRequest = std::pair<std::string, uint64_t>;
+
+  /// Symbolizes every request in \p Requests like symbolizeCode() and
+  /// symbolizeInlinedCode() do, using up to \p Threads threads. Modules are
+  /// loaded once. Different modules are symbolized in parallel, as are
+  /// different ranges of addresses within a module. An indexed module (see
+  /// Options::IndexDirectory) is shared by all threads. A module with many
+  /// requests that is backed by DWARF gets one DWARF context per thread, each
+  /// of which parses the debug info it needs by itself. Repeated requests are
+  /// only symbolized once. The results are in the order of \p Requests.
+  ///
+  /// The symbolizer itself is not thread-safe: it must not be used from other
+  /// threads while a batch is being symbolized.
+  std::vector<Expected<DILineInfo>>
+  symbolizeCodeBatch(ArrayRef<CodeRequest> Requests, unsigned Threads,
+                     StringRef DWPName = "");
+  std::vector<Expected<DIInliningInfo>>
+  symbolizeInlinedCodeBatch(ArrayRef<CodeRequest> Requests, unsigned Threads,
+                            StringRef DWPName = "");
+
   void flush();
 
   static std::string
@@ -83,6 +112,20 @@ private:
   Expected<SymbolizableModule *>
   getOrCreateModuleInfo(const std::string &ModuleName, StringRef DWPName = "");
 
+  /// Returns a SymbolizableModule for code lookups. This is an index mapped
+  /// from Opts.IndexDirectory when possible, and the module returned by
+  /// getOrCreateModuleInfo() otherwise.
+  Expected<SymbolizableModule *>
+  getOrCreateCodeModuleInfo(const std::string &ModuleName,
+                            StringRef DWPName = "");
+
+  /// Returns another instance of the DWARF-backed module \p ModuleName, with
+  /// a DWARF context of its own, so that it can be queried concurrently with
+  /// the one returned by getOrCreateModuleInfo(). Returns null if the module
+  /// isn't backed by DWARF or fails to load.
+  std::unique_ptr<SymbolizableModule>
+  createModuleReplica(const std::string &ModuleName, StringRef DWPName);
+
   ObjectFile *lookUpDsymFile(const std::string &Path,
                              const MachOObjectFile *ExeObj,
                              const std::string &ArchName);
@@ -90,6 +133,15 @@ private:
                                     const ObjectFile *Obj,
                                     const std::string &ArchName);
 
+  /// Loads the modules of a batch of requests. \p Modules receives the module
+  /// of every request, or null if it failed to load. The loading error, if
+  /// any, is reported in \p Errors for the first request of the module only,
+  /// like repeated calls to symbolizeCode() would.
+  void getOrCreateBatchModuleInfo(ArrayRef<CodeRequest> Requests,
+                                  StringRef DWPName,
+                                  std::vector<SymbolizableModule *> &Modules,
+                                  std::vector<Error> &Errors);
+
   /// \brief Returns pair of pointers to object and debug object.
   Expected<ObjectPair> getOrCreateObjectPair(const std::string &Path,
                                             const std::string &ArchName);
@@ -102,6 +154,10 @@ private:
 
   std::map<std::string, std::unique_ptr<SymbolizableModule>> Modules;
 
+  /// \brief Indexes mapped by getOrCreateCodeModuleInfo(). A null entry means
+  /// the module has no usable index and Modules is used instead.
+  std::map<std::string, std::unique_ptr<SymbolizableModule>> IndexedModules;
+
   /// \brief Contains cached results of getOrCreateObjectPair().
   std::map<std::pair<std::string, std::string>, ObjectPair>
       ObjectPairForPathArch;
@@ -115,6 +171,10 @@ private:
       ObjectForUBPathAndArch;
 
   Options Opts;
+
+  /// \brief Builds the indexes that getOrCreateCodeModuleInfo() didn't find.
+  /// Created on first use; flush() waits for it.
+  std::unique_ptr<ThreadPool> IndexBuilder;
 };
 
 } // end namespace symbolize
@@ -17,6 +17,8 @@
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
@@ -46,6 +48,7 @@
 #include <iterator>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <utility>
@@ -57,6 +60,29 @@ class Value;
 
 namespace orc {
 
+/// @brief Speculation policy for CompileOnDemandLayer::setSpeculation that
+///        picks the functions that F calls directly and that are defined in
+///        F's module, in the order they are first called.
+SetVector<Function*> speculateDirectCallees(Function &F);
+
+/// @brief Speculation policy for CompileOnDemandLayer::setSpeculation that
+///        picks the direct callees of a function that were called at least
+///        MinCallCount times according to recorded call counts, e.g. from an
+///        earlier run of the same program. The counts are keyed by IR function
+///        name.
+class CallCountSpeculator {
+public:
+  CallCountSpeculator(StringMap<uint64_t> CallCounts, uint64_t MinCallCount)
+      : CallCounts(std::make_shared<StringMap<uint64_t>>(std::move(CallCounts))),
+        MinCallCount(MinCallCount) {}
+
+  SetVector<Function*> operator()(Function &F) const;
+
+private:
+  std::shared_ptr<const StringMap<uint64_t>> CallCounts;
+  uint64_t MinCallCount;
+};
+
 /// @brief Compile-on-demand layer.
 ///
 ///   When a module is added to this layer a stub is created for each of its
@@ -209,6 +235,14 @@ public:
   using SymbolResolverSetter =
       std::function<void(VModuleKey K, std::shared_ptr<SymbolResolver> R)>;
 
+  /// @brief Speculation functor. Returns the functions that are likely to be
+  ///        called soon after the given function. They are compiled in the
+  ///        order they are returned in.
+  using SpeculationFtor = std::function<SetVector<Function*>(Function&)>;
+
+  /// @brief Runs a speculative compilation task, e.g. on a background thread.
+  using SpeculationDispatcher = std::function<void(std::function<void()>)>;
+
   /// @brief Construct a compile-on-demand layer instance.
   CompileOnDemandLayer(ExecutionSession &ES, BaseLayerT &BaseLayer,
                        SymbolResolverGetter GetSymbolResolver,
@@ -230,8 +264,31 @@ public:
       consumeError(removeModule(LogicalDylibs.begin()->first));
   }
 
+  /// @brief Compile functions speculatively, ahead of their first call.
+  ///
+  ///   Once a function has been compiled, the functions that Speculate picks
+  /// for it are compiled by tasks passed to Dispatch, so that their stubs may
+  /// already point at their bodies by the time they are called. Speculation
+  /// continues from the speculatively compiled functions.
+  ///
+  ///   The layer serializes its compiles, but the base layer and the context
+  /// of the added modules are used from the threads that run the tasks, so
+  /// clients must only use them through this layer, or while holding lock().
+  /// Looking up a stub doesn't wait for a compile, but looking up any other
+  /// symbol does, as does calling a stub whose function hasn't been compiled
+  /// yet. All dispatched tasks must have run or been dropped before the layer
+  /// is destroyed.
+  void setSpeculation(SpeculationFtor Speculate,
+                      SpeculationDispatcher Dispatch) {
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+    this->Speculate = std::move(Speculate);
+    this->DispatchSpeculation = std::move(Dispatch);
+  }
+
   /// @brief Add a module to the compile-on-demand layer.
   Error addModule(VModuleKey K, std::unique_ptr<Module> M) {
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+    std::lock_guard<std::recursive_mutex> DylibsLock(DylibsMutex);
 
     assert(!LogicalDylibs.count(K) && "VModuleKey K already in use");
     auto I = LogicalDylibs.insert(
@@ -244,6 +301,8 @@ public:
 
   /// @brief Add extra modules to an existing logical module.
   Error addExtraModule(VModuleKey K, std::unique_ptr<Module> M) {
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+    std::lock_guard<std::recursive_mutex> DylibsLock(DylibsMutex);
     return addLogicalModule(LogicalDylibs[K], std::move(M));
   }
 
@@ -252,6 +311,8 @@ public:
   ///   This will remove all modules in the layers below that were derived from
   /// the module represented by K.
   Error removeModule(VModuleKey K) {
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+    std::lock_guard<std::recursive_mutex> DylibsLock(DylibsMutex);
     auto I = LogicalDylibs.find(K);
     assert(I != LogicalDylibs.end() && "VModuleKey K not valid here");
     auto Err = I->second.removeModulesFromBaseLayer(BaseLayer);
@@ -264,50 +325,71 @@ public:
   /// @param ExportedSymbolsOnly If true, search only for exported symbols.
   /// @return A handle for the given named symbol, if it exists.
   JITSymbol findSymbol(StringRef Name, bool ExportedSymbolsOnly) {
+    {
+      std::lock_guard<std::recursive_mutex> DylibsLock(DylibsMutex);
+      for (auto &KV : LogicalDylibs)
+        if (auto Sym = KV.second.StubsMgr->findStub(Name, ExportedSymbolsOnly))
+          return Sym;
+    }
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
     for (auto &KV : LogicalDylibs) {
-      if (auto Sym = KV.second.StubsMgr->findStub(Name, ExportedSymbolsOnly))
-        return Sym;
       if (auto Sym = findSymbolIn(KV.first, Name, ExportedSymbolsOnly))
         return Sym;
       else if (auto Err = Sym.takeError())
         return std::move(Err);
     }
-    return BaseLayer.findSymbol(Name, ExportedSymbolsOnly);
+    return lockSymbol(BaseLayer.findSymbol(Name, ExportedSymbolsOnly));
   }
 
   /// @brief Get the address of a symbol provided by this layer, or some layer
   ///        below this one.
   JITSymbol findSymbolIn(VModuleKey K, const std::string &Name,
                          bool ExportedSymbolsOnly) {
-    assert(LogicalDylibs.count(K) && "VModuleKey K is not valid here");
-    return LogicalDylibs[K].findSymbol(BaseLayer, Name, ExportedSymbolsOnly);
+    {
+      std::lock_guard<std::recursive_mutex> DylibsLock(DylibsMutex);
+      assert(LogicalDylibs.count(K) && "VModuleKey K is not valid here");
+      if (auto Sym =
+              LogicalDylibs[K].StubsMgr->findStub(Name, ExportedSymbolsOnly))
+        return Sym;
+    }
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+    return lockSymbol(
+        LogicalDylibs[K].findSymbol(BaseLayer, Name, ExportedSymbolsOnly));
   }
 
   /// @brief Update the stub for the given function to point at FnBodyAddr.
   /// This can be used to support re-optimization.
-  /// @return true if the function exists and the stub is updated, false
-  ///         otherwise.
+  /// @param FuncName The IR name of the function, before mangling.
+  /// @return A JITSymbolNotFound error if no logical dylib has a stub for the
+  ///         function.
   //
   // FIXME: We should track and free associated resources (unused compile
   //        callbacks, uncompiled IR, and no-longer-needed/reachable function
   //        implementations).
   Error updatePointer(std::string FuncName, JITTargetAddress FnBodyAddr) {
+    std::lock_guard<std::recursive_mutex> DylibsLock(DylibsMutex);
     //Find out which logical dylib contains our symbol
-    auto LDI = LogicalDylibs.begin();
-    for (auto LDE = LogicalDylibs.end(); LDI != LDE; ++LDI) {
-      if (auto LMResources =
-            LDI->getLogicalModuleResourcesForSymbol(FuncName, false)) {
-        Module &SrcM = LMResources->SourceModule->getResource();
-        std::string CalledFnName = mangle(FuncName, SrcM.getDataLayout());
-        if (auto Err = LMResources->StubsMgr->updatePointer(CalledFnName,
-                                                            FnBodyAddr))
-          return Err;
-        return Error::success();
-      }
+    for (auto &KV : LogicalDylibs) {
+      LogicalDylib &LD = KV.second;
+      if (LD.SourceModules.empty())
+        continue;
+      const DataLayout &DL = LD.getSourceModule(0).getDataLayout();
+      std::string CalledFnName = mangle(FuncName, DL);
+      if (LD.StubsMgr->findStub(CalledFnName, false))
+        return LD.StubsMgr->updatePointer(CalledFnName, FnBodyAddr);
     }
     return make_error<JITSymbolNotFound>(FuncName);
   }
 
+  /// @brief Lock the layer against compiles.
+  ///
+  ///   While the lock is held no other thread can compile through this layer,
+  /// so the holder may use the base layer and the context of the added
+  /// modules directly. Stub lookups and updatePointer don't take this lock.
+  std::unique_lock<std::recursive_mutex> lock() {
+    return std::unique_lock<std::recursive_mutex>(CompileMutex);
+  }
+
 private:
   Error addLogicalModule(LogicalDylib &LD, std::unique_ptr<Module> SrcMPtr) {
 
@@ -355,6 +437,7 @@ private:
             std::make_pair(CCInfo.getAddress(),
                            JITSymbolFlags::fromGlobalValue(F));
           CCInfo.setCompileAction([this, &LD, LMId, &F]() -> JITTargetAddress {
+              std::lock_guard<std::recursive_mutex> Lock(this->CompileMutex);
               if (auto FnImplAddrOrErr = this->extractAndCompile(LD, LMId, F))
                 return *FnImplAddrOrErr;
               else {
@@ -522,15 +605,43 @@ private:
                     Function &F) {
     Module &SrcM = LD.getSourceModule(LMId);
 
-    // If F is a declaration we must already have compiled it.
-    if (F.isDeclaration())
-      return 0;
-
     // Grab the name of the function being called here.
     std::string CalledFnName = mangle(F.getName(), SrcM.getDataLayout());
 
+    // If F is a declaration we must already have compiled it, e.g.
+    // speculatively while its callback was pending. Its body is in one of the
+    // partitions.
+    if (F.isDeclaration()) {
+      for (auto BLK : reverse(LD.BaseLayerVModuleKeys))
+        if (auto FnBodySym = BaseLayer.findSymbolIn(BLK, CalledFnName, false))
+          return FnBodySym.getAddress();
+        else if (auto Err = FnBodySym.takeError())
+          return std::move(Err);
+      return 0;
+    }
+
     JITTargetAddress CalledAddr = 0;
     auto Part = Partition(F);
+
+    // Pick the functions to compile speculatively before the bodies of the
+    // partition are moved out of the source module. A partition of several
+    // functions is visited in module order, so that the speculative compiles
+    // are dispatched in the same order on every run.
+    SetVector<Function*> SpeculativeFns;
+    if (Speculate) {
+      auto AddSpeculativeFns = [&](Function &SubF) {
+        for (auto *SpecF : Speculate(SubF))
+          if (SpecF->getParent() == &SrcM && !SpecF->isDeclaration() &&
+              !Part.count(SpecF))
+            SpeculativeFns.insert(SpecF);
+      };
+      if (Part.size() == 1)
+        AddSpeculativeFns(**Part.begin());
+      else
+        for (auto &SubF : SrcM)
+          if (Part.count(&SubF))
+            AddSpeculativeFns(SubF);
+    }
     if (auto PartKeyOrErr = emitPartition(LD, LMId, Part)) {
       auto &PartKey = *PartKeyOrErr;
       for (auto *SubF : Part) {
@@ -560,9 +671,53 @@ private:
     } else
       return PartKeyOrErr.takeError();
 
+    VModuleKey K = LD.K;
+    for (auto *SpecF : SpeculativeFns)
+      DispatchSpeculation([this, K, LMId, SpecF]() {
+        compileSpeculatively(K, LMId, *SpecF);
+      });
+
     return CalledAddr;
   }
 
+  void compileSpeculatively(VModuleKey K,
+                            typename LogicalDylib::SourceModuleHandle LMId,
+                            Function &F) {
+    std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+
+    // Skip functions whose module was removed in the meantime, functions
+    // that were compiled in the meantime, and functions without a stub.
+    auto I = LogicalDylibs.find(K);
+    if (I == LogicalDylibs.end() || F.isDeclaration())
+      return;
+    LogicalDylib &LD = I->second;
+    if (!LD.StubsMgr->findStub(
+            mangle(F.getName(), LD.getSourceModule(LMId).getDataLayout()),
+            false))
+      return;
+
+    // FIXME: Report error.
+    if (auto Err = extractAndCompile(LD, LMId, F).takeError())
+      consumeError(std::move(Err));
+  }
+
+  /// Wrap a symbol of the base layer so that its address is only computed
+  /// while the layer is locked, since the base layer may be compiling
+  /// speculatively on another thread.
+  JITSymbol lockSymbol(JITSymbol Sym) {
+    if (!Speculate || !Sym)
+      return Sym;
+    auto Flags = Sym.getFlags();
+    // FIXME: Use move capture once we move to C++14.
+    auto SharedSym = std::make_shared<JITSymbol>(std::move(Sym));
+    return JITSymbol(
+        [this, SharedSym]() -> Expected<JITTargetAddress> {
+          std::lock_guard<std::recursive_mutex> Lock(CompileMutex);
+          return SharedSym->getAddress();
+        },
+        Flags);
+  }
+
   template <typename PartitionT>
   Expected<VModuleKey>
   emitPartition(LogicalDylib &LD,
@@ -672,6 +827,17 @@ private:
 
   std::map<VModuleKey, LogicalDylib> LogicalDylibs;
   bool CloneStubsIntoPartitions;
+
+  SpeculationFtor Speculate;
+  SpeculationDispatcher DispatchSpeculation;
+
+  // Compiles, i.e. any use of the base layer or of the source modules, hold
+  // CompileMutex. LogicalDylibs and the stubs managers' stub maps are only
+  // changed while holding both mutexes, so either one is enough to read them.
+  // Stub lookups take the short-held DylibsMutex alone, so they don't wait
+  // for a compile on another thread. CompileMutex is always taken first.
+  std::recursive_mutex CompileMutex;
+  std::recursive_mutex DylibsMutex;
 };
 
 } // end namespace orc
@@ -19,6 +19,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <vector>
 
@@ -46,6 +47,10 @@ using SymbolFlagsMap = std::map<SymbolStringPtr, JITSymbolFlags>;
 ///        ready.
 ///
 /// makes a callback when all symbols are available.
+///
+/// The methods of a query may be called concurrently, e.g. by VSOs whose
+/// symbols are materialized on different threads. The callbacks are made while
+/// the query is locked, so they must not call back into the query.
 class AsynchronousSymbolQuery {
 public:
   /// @brief Callback to notify client that symbols have been resolved.
@@ -85,6 +90,7 @@ public:
   void notifySymbolFinalized();
 
 private:
+  std::mutex QueryMutex;
   SymbolMap Symbols;
   size_t OutstandingResolutions = 0;
   size_t OutstandingFinalizations = 0;
@@ -192,6 +198,10 @@ private:
 /// VSO acts as a symbol table (symbol definitions can be set and the dylib
 /// queried to find symbol addresses) and as a key for tracking resources
 /// (since a VSO's address is fixed).
+///
+/// The methods of a VSO may be called concurrently, e.g. by materializers
+/// running on different threads. The VSO stays locked while it calls into
+/// MaterializationUnits and queries, which may call back into the same VSO.
 class VSO {
   friend class ExecutionSession;
 
@@ -315,6 +325,7 @@ private:
     };
   };
 
+  mutable std::recursive_mutex SymbolsMutex;
   std::map<SymbolStringPtr, SymbolTableEntry> Symbols;
   MaterializationInfoSet MaterializationInfos;
 };
@@ -373,6 +384,34 @@ private:
   ExecutionSession &ES;
 };
 
+/// Runs Materializers on a pool of threads and reports errors to the given
+/// ExecutionSession, so that independent MaterializationUnits are materialized
+/// concurrently.
+///
+/// A MaterializationUnit that is dispatched from one of the pool's threads,
+/// e.g. while a materializer looks up its dependencies, is materialized on
+/// that thread. While the lookup waits for materializers that were already
+/// queued, the thread runs queued materializers. Otherwise materializers
+/// waiting for each other could occupy every thread of the pool.
+///
+/// Copies of a MaterializeOnThreadPool share the pool, which waits for the
+/// outstanding materializations when the last copy is destroyed.
+class MaterializeOnThreadPool {
+public:
+  MaterializeOnThreadPool(ExecutionSession &ES, unsigned ThreadCount);
+
+  void operator()(VSO &V, std::unique_ptr<MaterializationUnit> MU);
+
+  /// Wait for all the materializations dispatched so far to complete.
+  void wait();
+
+private:
+  class Pool;
+
+  ExecutionSession &ES;
+  std::shared_ptr<Pool> P;
+};
+
 /// Materialization function object wrapper for the lookup method.
 using MaterializationDispatcher =
     std::function<void(VSO &V, std::unique_ptr<MaterializationUnit> S)>;
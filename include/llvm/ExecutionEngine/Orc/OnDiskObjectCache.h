@@ -0,0 +1,73 @@
+//===- OnDiskObjectCache.h - ObjectCache backed by a directory --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Contains an ObjectCache that keeps the objects it is notified of in a cache
+// directory, so that they survive the process that compiled them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_EXECUTIONENGINE_ORC_ONDISKOBJECTCACHE_H
+#define LLVM_EXECUTIONENGINE_ORC_ONDISKOBJECTCACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/Error.h"
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace llvm {
+
+class TargetMachine;
+
+namespace orc {
+
+/// @brief An ObjectCache that stores objects in a directory on disk.
+///
+/// Objects are keyed by a hash of the module's bitcode together with
+/// everything about the TargetMachine that can change the generated code
+/// (the LLVM version, triple, CPU, features, optimization level, relocation
+/// and code model, and the codegen-relevant TargetOptions), so a cache
+/// directory can be shared between processes and configurations. Entries are
+/// named "llvmcache-<key>" and recorded in the directory's manifest, so the
+/// directory can be pruned with pruneCache().
+///
+/// The key of a module is computed when it is looked up with getObject, and
+/// is used when the compiled object is handed back with notifyObjectCompiled,
+/// since code generation may modify the module in between. The cache may be
+/// shared by several compile threads.
+class OnDiskObjectCache : public ObjectCache {
+public:
+  /// @brief Create a cache in \p CacheDir for objects compiled by \p TM.
+  ///
+  /// The directory and its manifest are created if they do not exist.
+  static Expected<std::unique_ptr<OnDiskObjectCache>>
+  create(StringRef CacheDir, const TargetMachine &TM);
+
+  void notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) override;
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module *M) override;
+
+private:
+  OnDiskObjectCache(StringRef CacheDir, std::string TargetKey)
+      : CacheDir(CacheDir), TargetKey(std::move(TargetKey)) {}
+
+  std::string computeKey(const Module &M) const;
+
+  std::string CacheDir;
+  std::string TargetKey;
+  std::mutex PendingKeysMutex;
+  DenseMap<const Module *, std::string> PendingKeys;
+};
+
+} // end namespace orc
+} // end namespace llvm
+
+#endif // LLVM_EXECUTIONENGINE_ORC_ONDISKOBJECTCACHE_H
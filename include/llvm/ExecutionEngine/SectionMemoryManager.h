@@ -20,8 +20,12 @@
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/Support/Memory.h"
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <system_error>
+#include <vector>
 
 namespace llvm {
 
@@ -188,6 +192,76 @@ private:
   MemoryMapper &MMapper;
 };
 
+/// A SectionMemoryManager::MemoryMapper that carves the blocks it hands out
+/// from large reservations, "slabs", instead of mapping each of them
+/// separately.
+///
+/// Sharing one SlabMemoryMapper between the SectionMemoryManagers of many
+/// modules packs their sections contiguously into a few mappings, with
+/// separate slabs for code, read-only data and read-write data. This keeps
+/// the number of mappings, and the instruction TLB footprint of a large JIT'd
+/// program, small. Blocks are page aligned and sized, so that their
+/// permissions can be set independently of their neighbours'. A block goes
+/// back to its slab to be reused when the SectionMemoryManager that allocated
+/// it is destroyed, e.g. when its module is removed from the JIT. The slabs
+/// are only unmapped when the mapper is destroyed, so the mapper must outlive
+/// the SectionMemoryManagers that use it.
+///
+/// The mapper may be shared by SectionMemoryManagers used on several threads.
+class SlabMemoryMapper final : public SectionMemoryManager::MemoryMapper {
+public:
+  /// Creates a mapper that reserves slabs of \p SlabSize bytes, or larger
+  /// ones for blocks that don't fit in one. If \p UseHugePages is set, slabs
+  /// are aligned to and sized in multiples of 2MB, and the system is asked to
+  /// back them with transparent huge pages (see sys::Memory::MF_HUGE_HINT).
+  /// Changing the permissions of part of a huge page splits it on most
+  /// systems, so huge pages help most when code is finalized in large
+  /// batches.
+  explicit SlabMemoryMapper(size_t SlabSize = 32 * 1024 * 1024,
+                            bool UseHugePages = false);
+  SlabMemoryMapper(const SlabMemoryMapper &) = delete;
+  void operator=(const SlabMemoryMapper &) = delete;
+  ~SlabMemoryMapper() override;
+
+  sys::MemoryBlock
+  allocateMappedMemory(SectionMemoryManager::AllocationPurpose Purpose,
+                       size_t NumBytes, const sys::MemoryBlock *const NearBlock,
+                       unsigned Flags, std::error_code &EC) override;
+
+  std::error_code protectMappedMemory(const sys::MemoryBlock &Block,
+                                      unsigned Flags) override;
+
+  std::error_code releaseMappedMemory(sys::MemoryBlock &M) override;
+
+  /// Returns the number of slabs mapped so far.
+  unsigned getNumSlabs() const;
+
+  /// Returns the number of bytes currently handed out.
+  size_t getAllocatedSize() const;
+
+private:
+  struct Slab {
+    // The mapping, and the part of it that blocks are handed out from.
+    sys::MemoryBlock Mapping;
+    uintptr_t Start;
+    uintptr_t End;
+    // The free ranges of [Start, End), by start address. Adjacent free ranges
+    // are always merged.
+    std::map<uintptr_t, size_t> FreeRanges;
+  };
+
+  Slab *createSlab(SectionMemoryManager::AllocationPurpose Purpose,
+                   size_t MinSize, std::error_code &EC);
+
+  mutable std::mutex SlabsMutex;
+  size_t SlabSize;
+  bool UseHugePages;
+  // The slabs of each AllocationPurpose.
+  std::vector<std::unique_ptr<Slab>> Slabs[3];
+  sys::MemoryBlock LastSlabMapping;
+  size_t AllocatedSize = 0;
+};
+
 } // end namespace llvm
 
 #endif // LLVM_EXECUTION_ENGINE_SECTION_MEMORY_MANAGER_H
@@ -33,6 +33,7 @@ namespace llvm {
 
 class BasicBlock;
 class FastMathFlags;
+class MDAttachmentMap;
 class MDNode;
 class Module;
 struct AAMDNodes;
@@ -46,11 +47,10 @@ class Instruction : public User,
   BasicBlock *Parent;
   DebugLoc DbgLoc;                         // 'dbg' Metadata cache.
 
-  enum {
-    /// This is a bit stored in the SubClassData field which indicates whether
-    /// this instruction has metadata attached to it or not.
-    HasMetadataBit = 1 << 15
-  };
+  /// The metadata attached to this instruction other than its debug location,
+  /// or null if there is none. Owned by the instruction, so that looking up an
+  /// attachment doesn't have to go through the context.
+  MDAttachmentMap *Attachments = nullptr;
 
 protected:
   ~Instruction(); // Use deleteValue() to delete a generic Instruction.
@@ -182,13 +182,11 @@ public:
   //===--------------------------------------------------------------------===//
 
   /// Return true if this instruction has any metadata attached to it.
-  bool hasMetadata() const { return DbgLoc || hasMetadataHashEntry(); }
+  bool hasMetadata() const { return DbgLoc || Attachments; }
 
   /// Return true if this instruction has metadata attached to it other than a
   /// debug location.
-  bool hasMetadataOtherThanDebugLoc() const {
-    return hasMetadataHashEntry();
-  }
+  bool hasMetadataOtherThanDebugLoc() const { return Attachments; }
 
   /// Get the metadata of given kind attached to this Instruction.
   /// If the metadata is not found then return null.
@@ -410,11 +408,6 @@ public:
   void applyMergedLocation(const DILocation *LocA, const DILocation *LocB);
 
 private:
-  /// Return true if we have an entry in the on-the-side metadata hash.
-  bool hasMetadataHashEntry() const {
-    return (getSubclassDataFromValue() & HasMetadataBit) != 0;
-  }
-
   // These are all implemented in Metadata.cpp.
   MDNode *getMetadataImpl(unsigned KindID) const;
   MDNode *getMetadataImpl(StringRef Kind) const;
@@ -422,8 +415,9 @@ private:
   getAllMetadataImpl(SmallVectorImpl<std::pair<unsigned, MDNode *>> &) const;
   void getAllMetadataOtherThanDebugLocImpl(
       SmallVectorImpl<std::pair<unsigned, MDNode *>> &) const;
-  /// Clear all hashtable-based metadata from this instruction.
-  void clearMetadataHashEntries();
+  /// Clear all metadata attachments other than the debug location from this
+  /// instruction.
+  void clearMetadataAttachments();
 
 public:
   //===--------------------------------------------------------------------===//
@@ -662,25 +656,17 @@ private:
     return Value::getSubclassDataFromValue();
   }
 
-  void setHasMetadataHashEntry(bool V) {
-    setValueSubclassData((getSubclassDataFromValue() & ~HasMetadataBit) |
-                         (V ? HasMetadataBit : 0));
-  }
-
   void setParent(BasicBlock *P);
 
 protected:
-  // Instruction subclasses can stick up to 15 bits of stuff into the
+  // Instruction subclasses can stick up to 16 bits of stuff into the
   // SubclassData field of instruction with these members.
-
-  // Verify that only the low 15 bits are used.
   void setInstructionSubclassData(unsigned short D) {
-    assert((D & HasMetadataBit) == 0 && "Out of range value put into field");
-    setValueSubclassData((getSubclassDataFromValue() & HasMetadataBit) | D);
+    setValueSubclassData(D);
   }
 
   unsigned getSubclassDataFromInstruction() const {
-    return getSubclassDataFromValue() & ~HasMetadataBit;
+    return getSubclassDataFromValue();
   }
 
   Instruction(Type *Ty, unsigned iType, Use *Ops, unsigned NumOps,
@@ -34,6 +34,7 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <utility>
@@ -754,11 +755,30 @@ private:
   std::set<std::string> CfiFunctionDefs;
   std::set<std::string> CfiFunctionDecls;
 
+  /// The locks of a thread safe index, see setThreadSafe().
+  struct IndexLocks {
+    /// Guards everything but the summary lists.
+    std::mutex Mutex;
+    /// Guard the summary lists, sharded by GUID so that the readers of
+    /// different modules rarely wait for each other.
+    std::mutex SummaryListMutexes[16];
+  };
+  std::unique_ptr<IndexLocks> Locks;
+
   // YAML I/O support.
   friend yaml::MappingTraits<ModuleSummaryIndex>;
 
+  std::unique_lock<std::mutex> lockSummaryList(GlobalValue::GUID GUID) const {
+    if (!Locks)
+      return std::unique_lock<std::mutex>();
+    auto &Mutexes = Locks->SummaryListMutexes;
+    return std::unique_lock<std::mutex>(
+        Mutexes[GUID % array_lengthof(Mutexes)]);
+  }
+
   GlobalValueSummaryMapTy::value_type *
   getOrInsertValuePtr(GlobalValue::GUID GUID) {
+    auto Lock = lock();
     return &*GlobalValueMap.emplace(GUID, GlobalValueSummaryInfo(IsAnalysis)).first;
   }
 
@@ -769,6 +789,30 @@ public:
 
   bool isPerformingAnalysis() const { return IsAnalysis; }
 
+  /// Allow summaries to be added concurrently from several threads, e.g. by
+  /// reading the summaries of several modules with
+  /// BitcodeModule::readSummary(). Each summary list is then in the order in
+  /// which its summaries happened to be added; sortSummaryLists() restores a
+  /// deterministic order. Only the functions that add to the index and the
+  /// lookups that readers of summaries need, getValueInfo() and
+  /// findSummaryInModule(), are thread safe.
+  void setThreadSafe(bool ThreadSafe) {
+    Locks = ThreadSafe ? llvm::make_unique<IndexLocks>() : nullptr;
+  }
+  bool isThreadSafe() const { return Locks != nullptr; }
+
+  /// Lock the index if it is thread safe, e.g. to update the sets returned
+  /// by cfiFunctionDefs() and cfiFunctionDecls().
+  std::unique_lock<std::mutex> lock() const {
+    if (!Locks)
+      return std::unique_lock<std::mutex>();
+    return std::unique_lock<std::mutex>(Locks->Mutex);
+  }
+
+  /// Sort the summaries of each value by the ID of their module, keeping
+  /// summaries of the same module in the order in which they were added.
+  void sortSummaryLists();
+
   gvsummary_iterator begin() { return GlobalValueMap.begin(); }
   const_gvsummary_iterator begin() const { return GlobalValueMap.begin(); }
   gvsummary_iterator end() { return GlobalValueMap.end(); }
@@ -858,7 +902,11 @@ public:
   bool isGUIDLive(GlobalValue::GUID GUID) const;
 
   /// Return a ValueInfo for GUID if it exists, otherwise return ValueInfo().
+  /// This locks the index while it is thread safe: readers of summaries look
+  /// up values, e.g. through findSummaryInModule(), while other readers
+  /// insert them.
   ValueInfo getValueInfo(GlobalValue::GUID GUID) const {
+    auto Lock = lock();
     auto I = GlobalValueMap.find(GUID);
     return ValueInfo(IsAnalysis, I == GlobalValueMap.end() ? nullptr : &*I);
   }
@@ -872,6 +920,7 @@ public:
   ValueInfo getOrInsertValueInfo(GlobalValue::GUID GUID, StringRef Name) {
     assert(!IsAnalysis);
     auto VP = getOrInsertValuePtr(GUID);
+    auto Lock = lock();
     VP->second.U.Name = Name;
     return ValueInfo(IsAnalysis, VP);
   }
@@ -907,6 +956,7 @@ public:
   void addGlobalValueSummary(ValueInfo VI,
                              std::unique_ptr<GlobalValueSummary> Summary) {
     addOriginalName(VI.getGUID(), Summary->getOriginalName());
+    auto Lock = lockSummaryList(VI.getGUID());
     // Here we have a notionally const VI, but the value it points to is owned
     // by the non-const *this.
     const_cast<GlobalValueSummaryMapTy::value_type *>(VI.getRef())
@@ -918,6 +968,7 @@ public:
                        GlobalValue::GUID OrigGUID) {
     if (OrigGUID == 0 || ValueGUID == OrigGUID)
       return;
+    auto Lock = lock();
     if (OidGuidMap.count(OrigGUID) && OidGuidMap[OrigGUID] != ValueGUID)
       OidGuidMap[OrigGUID] = 0;
     else
@@ -932,6 +983,7 @@ public:
     if (!CalleeInfo) {
       return nullptr; // This function does not have a summary
     }
+    auto Lock = lockSummaryList(ValueGUID);
     auto Summary =
         llvm::find_if(CalleeInfo.getSummaryList(),
                       [&](const std::unique_ptr<GlobalValueSummary> &Summary) {
@@ -1002,6 +1054,7 @@ public:
   /// ModID, and return a reference to the module.
   ModuleInfo *addModule(StringRef ModPath, uint64_t ModId,
                         ModuleHash Hash = ModuleHash{{0}}) {
+    auto Lock = lock();
     return &*ModulePathStringTable.insert({ModPath, {ModId, Hash}}).first;
   }
 
@@ -1019,6 +1072,7 @@ public:
   /// This accessor should only be used when exporting because it can mutate the
   /// map.
   TypeIdSummary &getOrInsertTypeIdSummary(StringRef TypeId) {
+    auto Lock = lock();
     return TypeIdMap[TypeId];
   }
 
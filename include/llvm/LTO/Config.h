@@ -52,6 +52,10 @@ struct Config {
   /// Disable entirely the optimizer, including importing for ThinLTO
   bool CodeGenOnly = false;
 
+  /// The number of threads that the partitions of a parallel code generation
+  /// are generated on, most expensive first. 0 means one thread per partition.
+  unsigned CodeGenThreads = 0;
+
   /// If this field is set, the set of passes run in the middle-end optimizer
   /// will be the one specified by the string. Only works with the new pass
   /// manager as the old one doesn't have this ability.
@@ -17,6 +17,7 @@
 #define LLVM_LTO_LTO_H
 
 #include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/IR/DiagnosticInfo.h"
@@ -29,6 +30,7 @@
 #include "llvm/Support/thread.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Transforms/IPO/FunctionImport.h"
+#include <deque>
 
 namespace llvm {
 
@@ -38,6 +40,7 @@ class LLVMContext;
 class MemoryBufferRef;
 class Module;
 class Target;
+class ThreadPool;
 class raw_pwrite_stream;
 
 /// Resolve Weak and LinkOnce values in the \p Index. Linkage changes recorded
@@ -46,19 +49,28 @@ class raw_pwrite_stream;
 ///
 /// This is done for correctness (if value exported, ensure we always
 /// emit a copy), and compile-time optimization (allow drop of duplicates).
+///
+/// If \p ThreadCount is greater than 1, the values are resolved on that many
+/// threads, and \p isPrevailing and \p recordNewLinkage are called
+/// concurrently for different values.
 void thinLTOResolveWeakForLinkerInIndex(
     ModuleSummaryIndex &Index,
     function_ref<bool(GlobalValue::GUID, const GlobalValueSummary *)>
         isPrevailing,
     function_ref<void(StringRef, GlobalValue::GUID, GlobalValue::LinkageTypes)>
-        recordNewLinkage);
+        recordNewLinkage,
+    unsigned ThreadCount = 1);
 
 /// Update the linkages in the given \p Index to mark exported values
 /// as external and non-exported values as internal. The ThinLTO backends
 /// must apply the changes to the Module via thinLTOInternalizeModule.
+///
+/// If \p ThreadCount is greater than 1, the values are updated on that many
+/// threads, and \p isExported is called concurrently for different values.
 void thinLTOInternalizeAndPromoteInIndex(
     ModuleSummaryIndex &Index,
-    function_ref<bool(StringRef, GlobalValue::GUID)> isExported);
+    function_ref<bool(StringRef, GlobalValue::GUID)> isExported,
+    unsigned ThreadCount = 1);
 
 namespace lto {
 
@@ -305,6 +317,12 @@ private:
     ModuleSummaryIndex CombinedIndex;
     MapVector<StringRef, BitcodeModule> ModuleMap;
     DenseMap<GlobalValue::GUID, StringRef> PrevailingModuleForGUID;
+
+    /// Reads the summaries of the added modules into CombinedIndex while more
+    /// modules are added, if -thinlto-index-threads is greater than 1.
+    std::unique_ptr<ThreadPool> SummaryReaders;
+    /// The results of the reads of SummaryReaders, in module order.
+    std::deque<Optional<Error>> SummaryErrors;
   } ThinLTO;
 
   // The global resolution for a particular (mangled) symbol name. This is in
@@ -382,6 +400,7 @@ private:
 
   Error addThinLTO(BitcodeModule BM, ArrayRef<InputFile::Symbol> Syms,
                    const SymbolResolution *&ResI, const SymbolResolution *ResE);
+  Error waitForSummaries();
 
   Error runRegularLTO(AddStreamFn AddStream);
   Error runThinLTO(AddStreamFn AddStream, NativeObjectCache Cache);
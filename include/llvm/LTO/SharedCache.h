@@ -0,0 +1,129 @@
+//===- SharedCache.h - ThinLTO cache shared between links -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the sharedCache function, which allows clients to add a
+// cache of native objects that is shared between links, e.g. by several
+// machines through a cache server, to ThinLTO. It also defines the protocol
+// spoken by the reference cache server, llvm-lto-cache-server.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LTO_SHAREDCACHE_H
+#define LLVM_LTO_SHAREDCACHE_H
+
+#include "llvm/LTO/Caching.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+
+class raw_ostream;
+
+namespace lto {
+
+/// A store of native objects shared between links. Implementations must be
+/// thread safe.
+class SharedCacheStore {
+public:
+  virtual ~SharedCacheStore();
+
+  /// Returns the object stored under \p Key, or null if there is none.
+  virtual Expected<std::unique_ptr<MemoryBuffer>> get(StringRef Key) = 0;
+
+  /// Stores \p Object under \p Key.
+  virtual Error put(StringRef Key, StringRef Object) = 0;
+};
+
+/// Statistics about the use of a shared cache.
+struct SharedCacheStats {
+  std::atomic<uint64_t> Hits{0};
+  std::atomic<uint64_t> Misses{0};
+  std::atomic<uint64_t> LookupErrors{0};
+  std::atomic<uint64_t> Stores{0};
+  std::atomic<uint64_t> StoreErrors{0};
+  std::atomic<uint64_t> BytesFetched{0};
+  std::atomic<uint64_t> BytesStored{0};
+  /// Total time spent in SharedCacheStore::get() and put().
+  std::atomic<uint64_t> LookupMicroseconds{0};
+  std::atomic<uint64_t> StoreMicroseconds{0};
+
+  void print(raw_ostream &OS) const;
+};
+
+/// Create a cache that looks objects up in \p Local first, if it is set (see
+/// localCache()), and then in \p Store. Objects found in \p Store are added to
+/// \p Local. Objects that have to be built are added to \p Local, and are
+/// stored in \p Store asynchronously; these stores are complete once every
+/// copy of the returned cache has been destroyed.
+///
+/// Errors from \p Store are counted in \p Stats, if it is set, and otherwise
+/// ignored: a lookup that fails is a miss.
+Expected<NativeObjectCache> sharedCache(std::shared_ptr<SharedCacheStore> Store,
+                                        AddBufferFn AddBuffer,
+                                        NativeObjectCache Local = nullptr,
+                                        SharedCacheStats *Stats = nullptr);
+
+/// The largest object that the cache server accepts from a client, and that a
+/// client accepts from the server, unless told otherwise.
+const uint64_t DefaultMaxCacheObjectSize = 1ULL << 30;
+
+/// Returns a store that talks to the cache server listening on the Unix domain
+/// socket \p SocketPath (see tools/llvm-lto-cache-server). A connection is
+/// made for each request. An object larger than \p MaxObjectSize bytes that
+/// the server sends back is rejected before anything is allocated for it, and
+/// the lookup fails.
+Expected<std::unique_ptr<SharedCacheStore>>
+connectToCacheServer(StringRef SocketPath,
+                     uint64_t MaxObjectSize = DefaultMaxCacheObjectSize);
+
+/// The protocol spoken by the cache server. A client sends one request on a
+/// connection, and the server answers it. All integers are little endian.
+///
+///   request:  u8 opcode, u32 key size, key, then for Put: u64 size, object
+///   response: u8 status, then for a successful Get: u64 size, object
+namespace cacheserver {
+
+enum Opcode : uint8_t { Get = 'G', Put = 'P' };
+enum Status : uint8_t { Success = 0, NotFound = 1, Failure = 2 };
+
+struct Request {
+  Opcode Op;
+  std::string Key;
+  std::string Object;
+};
+
+/// Returns true if \p Key is a valid cache key. Keys are used as file names by
+/// the server, so they may only contain alphanumeric characters.
+bool isValidKey(StringRef Key);
+
+/// Create a Unix domain socket listening at \p SocketPath.
+Expected<int> listen(StringRef SocketPath);
+
+/// The longest key that readRequest() accepts. Keys are hashes, which are much
+/// shorter than this.
+const uint32_t MaxKeySize = 1024;
+
+/// Reads a request from the connection \p FD. A request whose key is longer
+/// than MaxKeySize, or whose object is larger than \p MaxObjectSize bytes, is
+/// rejected before anything is allocated for it.
+Expected<Request> readRequest(int FD, uint64_t MaxObjectSize);
+
+/// Answers a request on the connection \p FD with status \p S, or with
+/// \p Object for a Get request that succeeded.
+Error writeResponse(int FD, Status S);
+Error writeObjectResponse(int FD, StringRef Object);
+
+} // namespace cacheserver
+
+} // namespace lto
+} // namespace llvm
+
+#endif
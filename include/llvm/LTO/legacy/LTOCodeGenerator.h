@@ -111,6 +111,11 @@ struct LTOCodeGenerator {
     ShouldRestoreGlobalsLinkage = Value;
   }
 
+  /// Set the number of threads that the partitions of a parallel code
+  /// generation are generated on. The default of 0 uses one thread per
+  /// partition.
+  void setCodeGenThreads(unsigned Count) { CodeGenThreads = Count; }
+
   void addMustPreserveSymbol(StringRef Sym) { MustPreserveSymbols[Sym] = 1; }
 
   /// Pass options to the driver and optimization passes.
@@ -236,6 +241,7 @@ private:
   bool ShouldInternalize = true;
   bool ShouldEmbedUselists = false;
   bool ShouldRestoreGlobalsLinkage = false;
+  unsigned CodeGenThreads = 0;
   TargetMachine::CodeGenFileType FileType = TargetMachine::CGFT_ObjectFile;
   std::unique_ptr<ToolOutputFile> DiagnosticOutputFile;
   bool Freestanding = false;
@@ -19,6 +19,7 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/None.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/iterator.h"
@@ -506,8 +507,15 @@ public:
 /// This is the main interface to get coverage information, using a profile to
 /// fill out execution counts.
 class CoverageMapping {
+public:
+  /// The result of evaluating a coverage mapping record with a profile, while
+  /// loading.
+  struct EvaluatedRecord;
+
+private:
   StringSet<> FunctionNames;
   std::vector<FunctionRecord> Functions;
+  DenseMap<size_t, SmallVector<unsigned, 0>> FilenameHash2RecordIndices;
   std::vector<std::pair<std::string, uint64_t>> FuncHashMismatches;
   std::vector<std::pair<std::string, uint64_t>> FuncCounterMismatches;
 
@@ -517,6 +525,18 @@ class CoverageMapping {
   Error loadFunctionRecord(const CoverageMappingRecord &Record,
                            IndexedInstrProfReader &ProfileReader);
 
+  /// Add the function record, or the mismatch, described by \p Record.
+  void addEvaluatedRecord(EvaluatedRecord &&Record);
+
+  /// Add \p Function, and index it by the files it is defined in.
+  void addFunctionRecord(FunctionRecord &&Function);
+
+  /// Look up the indices of the function records which are at least partly
+  /// defined in \p Filename. Records of other files may be included if their
+  /// filenames have the same hash.
+  ArrayRef<unsigned>
+  getImpreciseRecordIndicesForFilename(StringRef Filename) const;
+
 public:
   CoverageMapping(const CoverageMapping &) = delete;
   CoverageMapping &operator=(const CoverageMapping &) = delete;
@@ -528,9 +548,17 @@ public:
 
   /// Load the coverage mapping from the given object files and profile. If
   /// \p Arches is non-empty, it must specify an architecture for each object.
+  /// The objects are decoded on \p NumThreads threads (0 = number of hardware
+  /// threads); the result doesn't depend on it.
   static Expected<std::unique_ptr<CoverageMapping>>
   load(ArrayRef<StringRef> ObjectFilenames, StringRef ProfileFilename,
-       ArrayRef<StringRef> Arches = None);
+       ArrayRef<StringRef> Arches = None, unsigned NumThreads = 1);
+
+  /// Create a coverage mapping from function records that were already
+  /// evaluated, e.g. saved from another coverage mapping. Only the first
+  /// record of each function is used.
+  static std::unique_ptr<CoverageMapping>
+  create(std::vector<FunctionRecord> Records);
 
   /// The number of functions that couldn't have their profiles mapped.
   ///
@@ -432,13 +432,19 @@ public:
   /// Return the maximum of all known function counts.
   uint64_t getMaximumFunctionCount() { return Summary->getMaxFunctionCount(); }
 
-  /// Factory method to create an indexed reader.
+  /// Factory method to create an indexed reader. The file is mapped, and
+  /// records are only read when they are looked up.
   static Expected<std::unique_ptr<IndexedInstrProfReader>>
   create(const Twine &Path);
 
   static Expected<std::unique_ptr<IndexedInstrProfReader>>
   create(std::unique_ptr<MemoryBuffer> Buffer);
 
+  // Used for testing purpose only.
+  MemoryBuffer::BufferKind getBufferKind() const {
+    return DataBuffer->getBufferKind();
+  }
+
   // Used for testing purpose only.
   void setValueProfDataEndianness(support::endianness Endianness) {
     Index->setValueProfDataEndianness(Endianness);
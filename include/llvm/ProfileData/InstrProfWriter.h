@@ -40,6 +40,8 @@ private:
   bool Sparse;
   StringMap<ProfilingData> FunctionData;
   ProfKind ProfileKind = PF_Unknown;
+  /// An estimate of the memory used by FunctionData, in bytes.
+  uint64_t ApproximateSize = 0;
   // Use raw pointer here for the incomplete type object.
   InstrProfRecordWriterTrait *InfoObj;
 
@@ -60,6 +62,10 @@ public:
   void mergeRecordsFromWriter(InstrProfWriter &&IPW,
                               function_ref<void(Error)> Warn);
 
+  /// Returns an estimate of the memory used by the profile data added to this
+  /// writer so far, in bytes.
+  uint64_t getApproximateSize() const { return ApproximateSize; }
+
   /// Write the profile to \c OS
   void write(raw_fd_ostream &OS);
 
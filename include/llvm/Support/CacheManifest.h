@@ -0,0 +1,150 @@
+//===- CacheManifest.h - Manifest of a cache directory ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the manifest of a cache directory. It lists the
+// "llvmcache-*" entries of the directory in least recently used order, with
+// their sizes. It lets pruneCache() find the least recently used entries and
+// the size of the cache without walking the directory, so that pruning a large
+// cache costs time in the number of entries evicted rather than the number of
+// entries in the cache.
+//
+// The manifest is a snapshot, "llvmcache.manifest", and a journal,
+// "llvmcache.journal", of the insertions, accesses and removals since the
+// snapshot was written. Loading the manifest reads the journal and the
+// snapshot's header; the snapshot's entries, least recently used first, are
+// only read as eviction reaches them. The journal is folded into the snapshot
+// once it gets longer than a quarter of it, so its length stays proportional
+// to the work done since.
+//
+// Entries that were never recorded, e.g. because a process died between
+// moving an entry into place and recording it, are picked up by a walk of the
+// directory that compaction does at most once a day.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_SUPPORT_CACHEMANIFEST_H
+#define LLVM_SUPPORT_CACHEMANIFEST_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <cstdint>
+#include <list>
+#include <string>
+
+namespace llvm {
+
+class CacheManifest {
+public:
+  /// Returns true if the cache directory \p CacheDir has a manifest.
+  static bool exists(StringRef CacheDir);
+
+  /// Writes a manifest describing the entries that \p CacheDir currently
+  /// contains, replacing any existing one. This walks the directory, and is
+  /// meant to be done once when a cache directory starts being used with a
+  /// manifest.
+  static Error create(StringRef CacheDir);
+
+  /// Record that the entry "llvmcache-<Key>" of \p CacheDir, of \p Size bytes,
+  /// was written or was read. These only append to the journal, so they are
+  /// cheap and may be called concurrently from several threads or processes.
+  /// Insertions must be recorded after the entry is moved into place: a pruner
+  /// that evicts an older copy of the entry in between then can't leave the
+  /// new one unrecorded. \p CacheDir must have a manifest.
+  static void recordInsert(StringRef CacheDir, StringRef Key, uint64_t Size);
+  static void recordAccess(StringRef CacheDir, StringRef Key, uint64_t Size);
+
+  /// Opens the manifest of \p CacheDir. This reads the journal and the header
+  /// of the snapshot; the entries of the snapshot are read as they are
+  /// evicted.
+  static Expected<CacheManifest> load(StringRef CacheDir);
+
+  CacheManifest(CacheManifest &&) = default;
+  CacheManifest &operator=(CacheManifest &&) = default;
+
+  /// Returns the number of entries and their total size. An entry that the
+  /// journal inserts again is counted twice, and one that the journal reads or
+  /// removes without the snapshot listing it is not counted, until eviction
+  /// has read the snapshot up to it or to the end.
+  size_t getNumEntries() const { return NumEntries > 0 ? NumEntries : 0; }
+  uint64_t getTotalSize() const { return TotalSize > 0 ? TotalSize : 0; }
+
+  /// Returns true if there are no entries left to evict.
+  bool empty() { return !peekOldest(); }
+
+  /// Returns the last access time of the least recently used entry. The
+  /// manifest must not be empty.
+  sys::TimePoint<> getOldestAccessTime();
+
+  /// Removes the least recently used entry from the cache directory and the
+  /// manifest. The manifest must not be empty.
+  void evictLeastRecentlyUsed();
+
+  /// Folds the journal into the snapshot if the journal has grown longer than
+  /// a quarter of the snapshot, walking the directory for entries that were
+  /// never recorded if that wasn't done for a day. If another process is
+  /// already doing so, this does nothing.
+  void compactIfNeeded();
+
+private:
+  struct Entry {
+    std::string Key;
+    uint64_t Size;
+    std::time_t AccessTime;
+  };
+
+  /// What the journal says about a key.
+  struct JournaledKey {
+    /// The entry in Journaled, if Present.
+    std::list<Entry>::iterator E;
+    bool Present = false;
+    /// Set if the first record of the key was an access or a removal, which
+    /// suggests that the snapshot lists it with AssumedSize bytes; its entry
+    /// in the snapshot is then not counted.
+    bool AssumedInSnapshot = false;
+    uint64_t AssumedSize = 0;
+    bool FoundInSnapshot = false;
+  };
+
+  explicit CacheManifest(StringRef CacheDir) : CacheDir(CacheDir) {}
+
+  void replayJournal(StringRef Records);
+  /// Returns the least recently used entry, or null if there are none left.
+  const Entry *peekOldest();
+  /// Reads the snapshot up to the next entry that the journal doesn't
+  /// supersede, and makes it NextSnapshotEntry. Returns false at the end.
+  bool readSnapshotEntry();
+
+  std::string CacheDir;
+  /// The snapshot, and the part of it that hasn't been read yet.
+  std::unique_ptr<MemoryBuffer> Snapshot;
+  StringRef UnreadSnapshot;
+  bool SnapshotRead = false;
+  /// The least recently used entry of the snapshot, once it has been read.
+  Optional<Entry> NextSnapshotEntry;
+  /// The entries recorded in the journal, least recently used first. They are
+  /// all more recent than the ones in the snapshot.
+  std::list<Entry> Journaled;
+  StringMap<JournaledKey> JournaledKeys;
+  int64_t NumEntries = 0;
+  int64_t TotalSize = 0;
+  /// The number of entries in the snapshot, and when the directory was last
+  /// walked for unrecorded entries.
+  uint64_t NumSnapshotEntries = 0;
+  std::time_t ScanTime = 0;
+  /// The number of records in the journal, including a journal set aside.
+  uint64_t NumJournalRecords = 0;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_SUPPORT_CACHEMANIFEST_H
@@ -71,6 +71,10 @@ Expected<CachePruningPolicy> parseCachePruningPolicy(StringRef PolicyStr);
 /// As a safeguard against data loss if the user specifies the wrong directory
 /// as their cache directory, this function will ignore files not matching the
 /// pattern "llvmcache-*".
+///
+/// If the directory has a manifest (see CacheManifest.h), the entries are
+/// pruned least recently used first using the manifest, and the directory is
+/// not walked. Otherwise size-based pruning removes the largest files first.
 bool pruneCache(StringRef Path, CachePruningPolicy Policy);
 
 } // namespace llvm
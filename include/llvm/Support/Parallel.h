@@ -70,15 +70,25 @@ public:
     std::unique_lock<std::mutex> lock(Mutex);
     Cond.wait(lock, [&] { return Count == 0; });
   }
+
+  bool isDone() const {
+    std::lock_guard<std::mutex> lock(Mutex);
+    return Count == 0;
+  }
 };
 
 class TaskGroup {
   Latch L;
 
 public:
+  ~TaskGroup() { sync(); }
+
   void spawn(std::function<void()> f);
 
-  void sync() const { L.sync(); }
+  /// \brief Waits for all spawned tasks to finish. When called from a worker
+  ///   thread, the worker runs pending tasks while it waits, so task groups
+  ///   may be nested.
+  void sync() const;
 };
 
 #if defined(_MSC_VER)
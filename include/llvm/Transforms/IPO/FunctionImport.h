@@ -84,11 +84,15 @@ public:
 /// \p ExportLists contains for each Module the set of globals (GUID) that will
 /// be imported by another module, or referenced by such a function. I.e. this
 /// is the set of globals that need to be promoted/renamed appropriately.
+///
+/// If \p ThreadCount is greater than 1, the imports of the modules are
+/// computed on that many threads.
 void ComputeCrossModuleImport(
     const ModuleSummaryIndex &Index,
     const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
     StringMap<FunctionImporter::ImportMapTy> &ImportLists,
-    StringMap<FunctionImporter::ExportSetTy> &ExportLists);
+    StringMap<FunctionImporter::ExportSetTy> &ExportLists,
+    unsigned ThreadCount = 1);
 
 /// Compute all the imports for the given module using the Index.
 ///
@@ -117,10 +121,15 @@ enum class PrevailingType { Yes, No, Unknown };
 /// \p GUIDPreservedSymbols. Non-prevailing symbols are symbols without a
 /// prevailing copy anywhere in IR and are normally dead, \p isPrevailing
 /// predicate returns status of symbol.
+///
+/// If \p ThreadCount is greater than 1, the references of the live symbols
+/// are followed on that many threads, and \p isPrevailing is called
+/// concurrently.
 void computeDeadSymbols(
     ModuleSummaryIndex &Index,
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
-    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing);
+    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
+    unsigned ThreadCount = 1);
 
 /// Converts value \p GV to declaration, or replaces with a declaration if
 /// it is an alias. Returns true if converted, false if replaced.
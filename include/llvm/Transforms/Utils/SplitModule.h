@@ -26,6 +26,12 @@ class Module;
 /// Splits the module M into N linkable partitions. The function ModuleCallback
 /// is called N times passing each individual partition as the MPart argument.
 ///
+/// If BalanceByCost is set, the partitions are balanced by an estimate of the
+/// time that the backend spends on them rather than by hashing the names of
+/// globals, functions are kept with their only caller where that doesn't
+/// unbalance the partitions, and the partitions are passed to ModuleCallback
+/// in order of decreasing cost.
+///
 /// FIXME: This function does not deal with the somewhat subtle symbol
 /// visibility issues around module splitting, including (but not limited to):
 ///
@@ -36,7 +42,7 @@ class Module;
 void SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
-    bool PreserveLocals = false);
+    bool PreserveLocals = false, bool BalanceByCost = false);
 
 } // end namespace llvm
 
@@ -14,9 +14,12 @@
 #define LLVM_XRAY_TRACE_H
 
 #include <cstdint>
+#include <iterator>
+#include <memory>
 #include <vector>
 
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/iterator_range.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/XRay/XRayRecord.h"
@@ -65,6 +68,93 @@ public:
 /// |Filename|.
 Expected<Trace> loadTraceFile(StringRef Filename, bool Sort = false);
 
+class TraceDecoder;
+
+/// A TraceStream provides the records of an XRay log file without loading all
+/// of them up-front. The file is mapped into memory and its records are decoded
+/// a chunk at a time as the stream is iterated over: FDR mode logs are decoded
+/// one thread buffer at a time, and "naive" mode logs a fixed number of records
+/// at a time, so only the records of the current chunk are held in memory. YAML
+/// logs are still parsed in one go.
+///
+/// The records come in the order they appear in the file, and can only be
+/// iterated over once. Errors in the log are reported when the chunk they are
+/// in is decoded, so callers must check the Error passed to records() once the
+/// loop is done.
+///
+/// Usage:
+///
+///   if (auto StreamOrErr = openTraceFile("xray-log.something.xray")) {
+///     auto &S = **StreamOrErr;
+///     Error Err = Error::success();
+///     for (const XRayRecord &R : S.records(Err)) {
+///       // ... do something with R here.
+///     }
+///     if (Err)
+///       // Handle the error here.
+///   }
+///
+class TraceStream {
+  std::unique_ptr<sys::fs::mapped_file_region> MappedFile;
+  XRayFileHeader FileHeader;
+  std::unique_ptr<TraceDecoder> Decoder;
+  std::vector<XRayRecord> Chunk;
+
+  TraceStream();
+
+  friend Expected<std::unique_ptr<TraceStream>> openTraceFile(StringRef);
+
+public:
+  /// An input iterator over the records of a TraceStream. Incrementing it may
+  /// decode the next chunk of the log; if that fails, the iterator becomes the
+  /// end iterator and the error is stored in the Error passed to records().
+  class record_iterator
+      : public std::iterator<std::input_iterator_tag, const XRayRecord> {
+    TraceStream *Stream = nullptr;
+    size_t Index = 0;
+    Error *E = nullptr;
+
+    void decodeNextChunk();
+
+  public:
+    record_iterator() = default;
+    record_iterator(TraceStream *Stream, Error *E) : Stream(Stream), E(E) {
+      decodeNextChunk();
+    }
+
+    const XRayRecord &operator*() const { return Stream->Chunk[Index]; }
+    const XRayRecord *operator->() const { return &Stream->Chunk[Index]; }
+
+    bool operator==(const record_iterator &Other) const {
+      return Stream == Other.Stream && Index == Other.Index;
+    }
+
+    bool operator!=(const record_iterator &Other) const {
+      return !(*this == Other);
+    }
+
+    record_iterator &operator++() {
+      assert(Stream && "Can't increment the end iterator");
+      if (++Index == Stream->Chunk.size())
+        decodeNextChunk();
+      return *this;
+    }
+  };
+
+  ~TraceStream();
+
+  /// Provides access to the XRay trace file header.
+  const XRayFileHeader &getFileHeader() const { return FileHeader; }
+
+  /// Returns the records of the log. \p Err is set if decoding the log fails
+  /// part way through, in which case the iteration stops early.
+  iterator_range<record_iterator> records(Error &Err);
+};
+
+/// This function will attempt to open the provided |Filename| as an XRay trace
+/// to be read through a TraceStream.
+Expected<std::unique_ptr<TraceStream>> openTraceFile(StringRef Filename);
+
 } // namespace xray
 } // namespace llvm
 
@@ -440,6 +440,28 @@ class MetadataLoader::MetadataLoaderImpl {
   /// populated.
   void lazyLoadOneMetadata(unsigned Idx, PlaceholderQueue &Placeholders);
 
+  /// Read the record of a single metadata from the index above, without
+  /// loading it. Returns the record code.
+  unsigned peekOneMetadata(unsigned Idx, SmallVectorImpl<uint64_t> &Record);
+
+  /// Return the metadata \p Idx if it is loaded and isn't a temporary.
+  Metadata *lookupLoaded(unsigned Idx);
+
+  /// Whether the metadata \p Idx is a DILocalScope, without loading it.
+  bool isLocalScope(unsigned Idx);
+
+  /// Whether the metadata \p Idx is in the index above.
+  bool isIndexed(unsigned Idx) const {
+    return Idx >= MDStringRef.size() &&
+           Idx < MDStringRef.size() + GlobalMetadataBitPosIndex.size();
+  }
+
+  /// On-demand loading of the imported entities of the tuple \p Idx whose
+  /// scope is local to a function. Returns a tuple of them, or nullptr if
+  /// there are none.
+  Expected<MDTuple *>
+  lazyLoadLocalImportedEntities(unsigned Idx, PlaceholderQueue &Placeholders);
+
   // Keep mapping of seens pair of old-style CU <-> SP, and update pointers to
   // point from SP to CU after a block is completly parsed.
   std::vector<std::pair<DICompileUnit *, Metadata *>> CUSubprograms;
@@ -459,6 +481,11 @@ class MetadataLoader::MetadataLoaderImpl {
   /// True if metadata is being parsed for a module being ThinLTO imported.
   bool IsImporting = false;
 
+  /// True if metadata is lazy-loaded for a module being ThinLTO imported.
+  bool isLazyImporting() const {
+    return IsImporting && !GlobalMetadataBitPosIndex.empty();
+  }
+
   Error parseOneMetadata(SmallVectorImpl<uint64_t> &Record, unsigned Code,
                          PlaceholderQueue &Placeholders, StringRef Blob,
                          unsigned &NextMetadataNo);
@@ -941,6 +968,95 @@ void MetadataLoader::MetadataLoaderImpl::lazyLoadOneMetadata(
     report_fatal_error("Can't lazyload MD");
 }
 
+unsigned MetadataLoader::MetadataLoaderImpl::peekOneMetadata(
+    unsigned ID, SmallVectorImpl<uint64_t> &Record) {
+  assert(ID >= MDStringRef.size() &&
+         ID < MDStringRef.size() + GlobalMetadataBitPosIndex.size() &&
+         "Unexpected peek at metadata outside of the index");
+  Record.clear();
+  IndexCursor.JumpToBit(GlobalMetadataBitPosIndex[ID - MDStringRef.size()]);
+  auto Entry = IndexCursor.advanceSkippingSubblocks();
+  return IndexCursor.readRecord(Entry.ID, Record);
+}
+
+Metadata *MetadataLoader::MetadataLoaderImpl::lookupLoaded(unsigned ID) {
+  Metadata *MD = MetadataList.lookup(ID);
+  if (auto *N = dyn_cast_or_null<MDNode>(MD))
+    if (N->isTemporary())
+      return nullptr;
+  return MD;
+}
+
+bool MetadataLoader::MetadataLoaderImpl::isLocalScope(unsigned ID) {
+  if (Metadata *MD = lookupLoaded(ID))
+    return isa<DILocalScope>(MD);
+  if (!isIndexed(ID))
+    return false;
+  SmallVector<uint64_t, 64> Record;
+  switch (peekOneMetadata(ID, Record)) {
+  case bitc::METADATA_SUBPROGRAM:
+  case bitc::METADATA_LEXICAL_BLOCK:
+  case bitc::METADATA_LEXICAL_BLOCK_FILE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+Expected<MDTuple *>
+MetadataLoader::MetadataLoaderImpl::lazyLoadLocalImportedEntities(
+    unsigned ID, PlaceholderQueue &Placeholders) {
+  // Find the entities from their records, so that those that aren't needed,
+  // and everything that they refer to, aren't loaded.
+  SmallVector<uint64_t, 64> Record;
+  SmallVector<unsigned, 8> EntityIDs;
+  bool IsIndexed = isIndexed(ID);
+  if (!lookupLoaded(ID) && IsIndexed) {
+    unsigned Code = peekOneMetadata(ID, Record);
+    if (Code == bitc::METADATA_NODE || Code == bitc::METADATA_DISTINCT_NODE)
+      for (uint64_t EltID : Record)
+        if (EltID)
+          EntityIDs.push_back(EltID - 1);
+  }
+  if (EntityIDs.empty()) {
+    // The tuple is already loaded, or isn't a plain tuple: load it, and let
+    // the IRMover filter it.
+    if (IsIndexed && !lookupLoaded(ID))
+      lazyLoadOneMetadata(ID, Placeholders);
+    return dyn_cast_or_null<MDTuple>(MetadataList.lookup(ID));
+  }
+
+  SmallVector<Metadata *, 8> Entities;
+  for (unsigned EntityID : EntityIDs) {
+    bool IsLocal;
+    if (auto *IE = dyn_cast_or_null<DIImportedEntity>(lookupLoaded(EntityID)))
+      IsLocal = isa<DILocalScope>(IE->getScope());
+    else if (isIndexed(EntityID) &&
+             peekOneMetadata(EntityID, Record) ==
+                 bitc::METADATA_IMPORTED_ENTITY &&
+             Record.size() > 2)
+      IsLocal = Record[2] && isLocalScope(Record[2] - 1);
+    else if (EntityID >= MDStringRef.size() && !isIndexed(EntityID) &&
+             !lookupLoaded(EntityID))
+      return error("Invalid record"); // Refers past the end of the index.
+    else
+      IsLocal = true; // Not an imported entity: keep it for the verifier.
+    if (!IsLocal)
+      continue;
+    if (Metadata *MD = lookupLoaded(EntityID)) {
+      Entities.push_back(MD);
+    } else if (isIndexed(EntityID)) {
+      lazyLoadOneMetadata(EntityID, Placeholders);
+      Entities.push_back(MetadataList.lookup(EntityID));
+    } else {
+      Entities.push_back(lazyLoadOneMDString(EntityID));
+    }
+  }
+  if (Entities.empty())
+    return nullptr;
+  return MDTuple::get(Context, Entities);
+}
+
 /// Ensure that all forward-references and placeholders are resolved.
 /// Iteratively lazy-loading metadata on-demand if needed.
 void MetadataLoader::MetadataLoaderImpl::resolveForwardRefsAndPlaceholders(
@@ -1380,12 +1496,22 @@ Error MetadataLoader::MetadataLoaderImpl::parseOneMetadata(
     // Ignore Record[0], which indicates whether this compile unit is
     // distinct.  It's always distinct.
     IsDistinct = true;
+
+    // When importing, the enums, retained types, global variables and macros
+    // of the compile unit aren't linked in, nor are the imported entities that
+    // aren't local to a function (see IRLinker::prepareCompileUnitsForImport).
+    // These lists span the module, and would pull in most of its type graph,
+    // so only load what is reachable from the imported globals.
+    bool LoadModuleLists = !isLazyImporting();
+    auto getListOrNull = [&](unsigned ID) {
+      return LoadModuleLists ? getMDOrNull(ID) : nullptr;
+    };
     auto *CU = DICompileUnit::getDistinct(
         Context, Record[1], getMDOrNull(Record[2]), getMDString(Record[3]),
         Record[4], getMDString(Record[5]), Record[6], getMDString(Record[7]),
-        Record[8], getMDOrNull(Record[9]), getMDOrNull(Record[10]),
-        getMDOrNull(Record[12]), getMDOrNull(Record[13]),
-        Record.size() <= 15 ? nullptr : getMDOrNull(Record[15]),
+        Record[8], getListOrNull(Record[9]), getListOrNull(Record[10]),
+        getListOrNull(Record[12]), getListOrNull(Record[13]),
+        Record.size() <= 15 ? nullptr : getListOrNull(Record[15]),
         Record.size() <= 14 ? 0 : Record[14],
         Record.size() <= 16 ? true : Record[16],
         Record.size() <= 17 ? false : Record[17],
@@ -1394,6 +1520,14 @@ Error MetadataLoader::MetadataLoaderImpl::parseOneMetadata(
     MetadataList.assignValue(CU, NextMetadataNo);
     NextMetadataNo++;
 
+    if (!LoadModuleLists && Record[13]) {
+      Expected<MDTuple *> ImportsOrErr =
+          lazyLoadLocalImportedEntities(Record[13] - 1, Placeholders);
+      if (!ImportsOrErr)
+        return ImportsOrErr.takeError();
+      CU->replaceImportedEntities(*ImportsOrErr);
+    }
+
     // Move the Upgrade the list of subprograms.
     if (Metadata *SPs = getMDOrNullWithoutPlaceholders(Record[11]))
       CUSubprograms.push_back({CU, SPs});
@@ -39,7 +39,8 @@ std::unique_ptr<Module> llvm::splitCodeGen(
     std::unique_ptr<Module> M, ArrayRef<llvm::raw_pwrite_stream *> OSs,
     ArrayRef<llvm::raw_pwrite_stream *> BCOSs,
     const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
-    TargetMachine::CodeGenFileType FileType, bool PreserveLocals) {
+    TargetMachine::CodeGenFileType FileType, bool PreserveLocals,
+    unsigned ThreadCount) {
   assert(BCOSs.empty() || BCOSs.size() == OSs.size());
 
   if (OSs.size() == 1) {
@@ -52,8 +53,8 @@ std::unique_ptr<Module> llvm::splitCodeGen(
   // Create ThreadPool in nested scope so that threads will be joined
   // on destruction.
   {
-    ThreadPool CodegenThreadPool(OSs.size());
-    int ThreadCount = 0;
+    ThreadPool CodegenThreadPool(ThreadCount ? ThreadCount : OSs.size());
+    unsigned PartitionCount = 0;
 
     SplitModule(
         std::move(M), OSs.size(),
@@ -69,11 +70,11 @@ std::unique_ptr<Module> llvm::splitCodeGen(
           WriteBitcodeToFile(*MPart, BCOS);
 
           if (!BCOSs.empty()) {
-            BCOSs[ThreadCount]->write(BC.begin(), BC.size());
-            BCOSs[ThreadCount]->flush();
+            BCOSs[PartitionCount]->write(BC.begin(), BC.size());
+            BCOSs[PartitionCount]->flush();
           }
 
-          llvm::raw_pwrite_stream *ThreadOS = OSs[ThreadCount++];
+          llvm::raw_pwrite_stream *ThreadOS = OSs[PartitionCount++];
           // Enqueue the task
           CodegenThreadPool.async(
               [TMFactory, FileType, ThreadOS](const SmallString<0> &BC) {
@@ -92,7 +93,7 @@ std::unique_ptr<Module> llvm::splitCodeGen(
               // copied into the thread's context.
               std::move(BC));
         },
-        PreserveLocals);
+        PreserveLocals, /*BalanceByCost=*/true);
   }
 
   return {};
@@ -186,6 +186,39 @@ uint64_t SymbolizableObjectFile::getModulePreferredBase() const {
   return 0;
 }
 
+bool SymbolizableObjectFile::getCodeBoundaries(
+    std::vector<uint64_t> &Boundaries) const {
+  if (DebugInfoContext) {
+    auto *DICtx = dyn_cast<DWARFContext>(DebugInfoContext.get());
+    if (!DICtx)
+      return false;
+    for (const auto &CU : DICtx->compile_units()) {
+      // The subprograms of a split unit live in the .dwo file.
+      if (CU->getDWOId())
+        return false;
+      if (const DWARFDebugLine::LineTable *LineTable =
+              DICtx->getLineTableForUnit(CU.get()))
+        for (const DWARFDebugLine::Row &Row : LineTable->Rows)
+          Boundaries.push_back(Row.Address);
+      // Compile unit, subprogram and inlined subroutine ranges decide which
+      // function names and inlined frames are reported.
+      for (const DWARFDebugInfoEntry &Entry : CU->dies()) {
+        for (const DWARFAddressRange &Range :
+             DWARFDie(CU.get(), &Entry).getAddressRanges()) {
+          Boundaries.push_back(Range.LowPC);
+          Boundaries.push_back(Range.HighPC);
+        }
+      }
+    }
+  }
+  for (const auto &Function : Functions) {
+    Boundaries.push_back(Function.first.Addr);
+    if (Function.first.Size != 0)
+      Boundaries.push_back(Function.first.Addr + Function.first.Size);
+  }
+  return true;
+}
+
 bool SymbolizableObjectFile::getNameFromSymbolTable(SymbolRef::Type Type,
                                                     uint64_t Address,
                                                     std::string &Name,
@@ -48,6 +48,9 @@ public:
   // it in memory assuming there were no conflicts.
   uint64_t getModulePreferredBase() const override;
 
+  // PDB and split DWARF don't allow enumerating the boundaries.
+  bool getCodeBoundaries(std::vector<uint64_t> &Boundaries) const override;
+
 private:
   bool shouldOverrideWithSymbolTable(FunctionNameKind FNKind,
                                      bool UseSymbolTable) const;
@@ -14,6 +14,7 @@
 #include "llvm/DebugInfo/Symbolize/Symbolize.h"
 
 #include "SymbolizableObjectFile.h"
+#include "SymbolizerIndex.h"
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/BinaryFormat/COFF.h"
@@ -32,10 +33,13 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
+#include <mutex>
 
 #if defined(_MSC_VER)
 #include <Windows.h>
@@ -57,7 +61,7 @@ Expected<DILineInfo>
 LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
                               uint64_t ModuleOffset, StringRef DWPName) {
   SymbolizableModule *Info;
-  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName, DWPName))
+  if (auto InfoOrErr = getOrCreateCodeModuleInfo(ModuleName, DWPName))
     Info = InfoOrErr.get();
   else
     return InfoOrErr.takeError();
@@ -83,7 +87,7 @@ Expected<DIInliningInfo>
 LLVMSymbolizer::symbolizeInlinedCode(const std::string &ModuleName,
                                      uint64_t ModuleOffset, StringRef DWPName) {
   SymbolizableModule *Info;
-  if (auto InfoOrErr = getOrCreateModuleInfo(ModuleName, DWPName))
+  if (auto InfoOrErr = getOrCreateCodeModuleInfo(ModuleName, DWPName))
     Info = InfoOrErr.get();
   else
     return InfoOrErr.takeError();
@@ -134,11 +138,197 @@ Expected<DIGlobal> LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
   return Global;
 }
 
+namespace {
+
+/// Runs \p Query for every request whose module loaded, spreading the work
+/// over \p Threads threads. \p CreateReplica is called on this thread to get
+/// more instances of a module that doesn't support concurrent queries, and
+/// may return null.
+template <typename ResultT>
+std::vector<Expected<ResultT>> symbolizeBatch(
+    ArrayRef<SymbolizableModule *> Modules, std::vector<Error> &Errors,
+    ArrayRef<LLVMSymbolizer::CodeRequest> Requests, unsigned Threads,
+    std::function<ResultT(const SymbolizableModule &, uint64_t)> Query,
+    std::function<std::unique_ptr<SymbolizableModule>(const std::string &)>
+        CreateReplica) {
+  // Group the requests by module and sort them by offset, so that repeated
+  // addresses are adjacent and only symbolized once.
+  std::map<SymbolizableModule *, std::vector<std::pair<uint64_t, size_t>>>
+      RequestsByModule;
+  for (size_t I = 0, E = Requests.size(); I != E; ++I)
+    if (Modules[I])
+      RequestsByModule[Modules[I]].emplace_back(Requests[I].second, I);
+
+  // Every request is written by exactly one task.
+  std::vector<ResultT> Results(Requests.size());
+  auto Run = [&](const SymbolizableModule &Info,
+                 ArrayRef<std::pair<uint64_t, size_t>> Chunk) {
+    for (size_t I = 0, E = Chunk.size(); I != E;) {
+      ResultT Result = Query(Info, Chunk[I].first);
+      size_t J = I;
+      for (; J != E && Chunk[J].first == Chunk[I].first; ++J)
+        Results[Chunk[J].second] = Result;
+      I = J;
+    }
+  };
+
+  // Splits off the first requests of Remaining, about Size of them, without
+  // splitting a run of identical offsets.
+  auto TakeChunk = [](ArrayRef<std::pair<uint64_t, size_t>> &Remaining,
+                      size_t Size) {
+    Size = std::min(Size, Remaining.size());
+    while (Size != Remaining.size() &&
+           Remaining[Size].first == Remaining[Size - 1].first)
+      ++Size;
+    auto Chunk = Remaining.take_front(Size);
+    Remaining = Remaining.drop_front(Size);
+    return Chunk;
+  };
+
+  std::vector<std::unique_ptr<SymbolizableModule>> Replicas;
+  {
+    Threads = std::max(1u, Threads);
+    ThreadPool Pool(Threads);
+    const size_t ChunkSize = 4096;
+    for (auto &Entry : RequestsByModule) {
+      const SymbolizableModule &Info = *Entry.first;
+      std::vector<std::pair<uint64_t, size_t>> &Sorted = Entry.second;
+      llvm::sort(Sorted.begin(), Sorted.end());
+      ArrayRef<std::pair<uint64_t, size_t>> Remaining = Sorted;
+      if (Info.supportsConcurrentQueries()) {
+        while (!Remaining.empty()) {
+          auto Chunk = TakeChunk(Remaining, ChunkSize);
+          Pool.async([&Info, Chunk, &Run] { Run(Info, Chunk); });
+        }
+        continue;
+      }
+
+      // Otherwise each thread needs an instance of its own. Instances don't
+      // share what they have parsed, so give each one a contiguous range of
+      // addresses, and only split modules with many requests.
+      size_t NumRanges = std::min<size_t>(
+          Threads, std::max<size_t>(1, Remaining.size() / ChunkSize));
+      size_t RangeSize = (Remaining.size() + NumRanges - 1) / NumRanges;
+      const std::string &ModuleName = Requests[Remaining[0].second].first;
+      const SymbolizableModule *Instance = &Info;
+      while (!Remaining.empty()) {
+        auto Range = TakeChunk(Remaining, RangeSize);
+        std::unique_ptr<SymbolizableModule> Next;
+        if (!Remaining.empty() && !(Next = CreateReplica(ModuleName))) {
+          // There are no more instances, so this one takes the rest.
+          Range = makeArrayRef(Range.begin(), Remaining.end());
+          Remaining = None;
+        }
+        Pool.async([Instance, Range, &Run] { Run(*Instance, Range); });
+        if (Next) {
+          Instance = Next.get();
+          Replicas.push_back(std::move(Next));
+        }
+      }
+    }
+    Pool.wait();
+  }
+
+  std::vector<Expected<ResultT>> Res;
+  Res.reserve(Requests.size());
+  for (size_t I = 0, E = Requests.size(); I != E; ++I) {
+    if (Errors[I])
+      Res.emplace_back(std::move(Errors[I]));
+    else
+      Res.emplace_back(std::move(Results[I]));
+  }
+  return Res;
+}
+
+} // end anonymous namespace
+
+void LLVMSymbolizer::getOrCreateBatchModuleInfo(
+    ArrayRef<CodeRequest> Requests, StringRef DWPName,
+    std::vector<SymbolizableModule *> &Modules, std::vector<Error> &Errors) {
+  std::map<std::string, SymbolizableModule *> Loaded;
+  for (const CodeRequest &Request : Requests) {
+    auto I = Loaded.find(Request.first);
+    if (I != Loaded.end()) {
+      Modules.push_back(I->second);
+      Errors.push_back(Error::success());
+      continue;
+    }
+    SymbolizableModule *Info = nullptr;
+    if (auto InfoOrErr = getOrCreateCodeModuleInfo(Request.first, DWPName)) {
+      Info = InfoOrErr.get();
+      Errors.push_back(Error::success());
+    } else {
+      Errors.push_back(InfoOrErr.takeError());
+    }
+    Loaded[Request.first] = Info;
+    Modules.push_back(Info);
+  }
+}
+
+std::vector<Expected<DILineInfo>>
+LLVMSymbolizer::symbolizeCodeBatch(ArrayRef<CodeRequest> Requests,
+                                   unsigned Threads, StringRef DWPName) {
+  std::vector<SymbolizableModule *> Modules;
+  std::vector<Error> Errors;
+  getOrCreateBatchModuleInfo(Requests, DWPName, Modules, Errors);
+  return symbolizeBatch<DILineInfo>(
+      Modules, Errors, Requests, Threads,
+      [&](const SymbolizableModule &Info, uint64_t ModuleOffset) {
+        if (Opts.RelativeAddresses)
+          ModuleOffset += Info.getModulePreferredBase();
+        DILineInfo LineInfo = Info.symbolizeCode(
+            ModuleOffset, Opts.PrintFunctions, Opts.UseSymbolTable);
+        if (Opts.Demangle)
+          LineInfo.FunctionName = DemangleName(LineInfo.FunctionName, &Info);
+        return LineInfo;
+      },
+      [&](const std::string &ModuleName) {
+        return createModuleReplica(ModuleName, DWPName);
+      });
+}
+
+std::vector<Expected<DIInliningInfo>>
+LLVMSymbolizer::symbolizeInlinedCodeBatch(ArrayRef<CodeRequest> Requests,
+                                          unsigned Threads,
+                                          StringRef DWPName) {
+  std::vector<SymbolizableModule *> Modules;
+  std::vector<Error> Errors;
+  getOrCreateBatchModuleInfo(Requests, DWPName, Modules, Errors);
+  return symbolizeBatch<DIInliningInfo>(
+      Modules, Errors, Requests, Threads,
+      [&](const SymbolizableModule &Info, uint64_t ModuleOffset) {
+        if (Opts.RelativeAddresses)
+          ModuleOffset += Info.getModulePreferredBase();
+        DIInliningInfo InlinedContext = Info.symbolizeInlinedCode(
+            ModuleOffset, Opts.PrintFunctions, Opts.UseSymbolTable);
+        if (Opts.Demangle) {
+          for (int i = 0, n = InlinedContext.getNumberOfFrames(); i < n; i++) {
+            auto *Frame = InlinedContext.getMutableFrame(i);
+            Frame->FunctionName = DemangleName(Frame->FunctionName, &Info);
+          }
+        }
+        return InlinedContext;
+      },
+      [&](const std::string &ModuleName) {
+        return createModuleReplica(ModuleName, DWPName);
+      });
+}
+
+LLVMSymbolizer::LLVMSymbolizer(const Options &Opts) : Opts(Opts) {}
+
+LLVMSymbolizer::~LLVMSymbolizer() {
+  flush();
+}
+
 void LLVMSymbolizer::flush() {
+  // The index builders use the objects.
+  if (IndexBuilder)
+    IndexBuilder->wait();
   ObjectForUBPathAndArch.clear();
   BinaryForPath.clear();
   ObjectPairForPathArch.clear();
   Modules.clear();
+  IndexedModules.clear();
 }
 
 namespace {
@@ -364,6 +554,99 @@ LLVMSymbolizer::getOrCreateObject(const std::string &Path,
   return errorCodeToError(object_error::arch_not_found);
 }
 
+namespace {
+
+// Splits "path/to/binary:arch" into the binary name and the architecture.
+std::pair<std::string, std::string>
+splitModuleName(const std::string &ModuleName, const std::string &DefaultArch) {
+  size_t ColonPos = ModuleName.find_last_of(':');
+  // Verify that substring after colon form a valid arch name.
+  if (ColonPos != std::string::npos) {
+    std::string ArchStr = ModuleName.substr(ColonPos + 1);
+    if (Triple(ArchStr).getArch() != Triple::UnknownArch)
+      return std::make_pair(ModuleName.substr(0, ColonPos), ArchStr);
+  }
+  return std::make_pair(ModuleName, DefaultArch);
+}
+
+} // end anonymous namespace
+
+Expected<SymbolizableModule *>
+LLVMSymbolizer::getOrCreateCodeModuleInfo(const std::string &ModuleName,
+                                          StringRef DWPName) {
+  if (Opts.IndexDirectory.empty())
+    return getOrCreateModuleInfo(ModuleName, DWPName);
+
+  const auto &I = IndexedModules.find(ModuleName);
+  if (I != IndexedModules.end()) {
+    if (I->second)
+      return I->second.get();
+    return getOrCreateModuleInfo(ModuleName, DWPName);
+  }
+  // Until proven otherwise, this module has no index.
+  std::unique_ptr<SymbolizableModule> &Indexed = IndexedModules[ModuleName];
+
+  std::string BinaryName, ArchName;
+  std::tie(BinaryName, ArchName) =
+      splitModuleName(ModuleName, Opts.DefaultArch);
+  auto ObjOrErr = getOrCreateObject(BinaryName, ArchName);
+  if (!ObjOrErr || !*ObjOrErr) {
+    // The object cache now remembers the failure as an empty binary, which
+    // getOrCreateModuleInfo() can't cope with, so record the module as
+    // missing here, the way it would.
+    Modules.insert(
+        std::make_pair(ModuleName, std::unique_ptr<SymbolizableModule>()));
+    if (!ObjOrErr)
+      return ObjOrErr.takeError();
+    return nullptr;
+  }
+  // Finding the debug object opens dSYM bundles and debuglink targets, but
+  // doesn't parse their debug info.
+  auto ObjectsOrErr = getOrCreateObjectPair(BinaryName, ArchName);
+  if (!ObjectsOrErr) {
+    consumeError(ObjectsOrErr.takeError());
+    return getOrCreateModuleInfo(ModuleName, DWPName);
+  }
+  std::string IndexName = getSymbolizerIndexName(
+      *ObjectsOrErr->first, *ObjectsOrErr->second, Opts.PrintFunctions,
+      Opts.UseSymbolTable, DWPName, Opts.DsymHints);
+  if (IndexName.empty())
+    return getOrCreateModuleInfo(ModuleName, DWPName);
+
+  SmallString<128> IndexPath(Opts.IndexDirectory);
+  sys::path::append(IndexPath, IndexName);
+  auto IndexOrErr = IndexedSymbolizableModule::load(
+      IndexPath, Opts.PrintFunctions, Opts.UseSymbolTable);
+  if (IndexOrErr) {
+    Indexed = std::move(*IndexOrErr);
+    return Indexed.get();
+  }
+  consumeError(IndexOrErr.takeError());
+
+  // There is no usable index yet. Answer from the debug info, and write an
+  // index for the next process that needs this module from an instance of the
+  // module of its own, on another thread. The index is only a cache, so
+  // failing to write it is not an error.
+  auto InfoOrErr = getOrCreateModuleInfo(ModuleName, DWPName);
+  if (!InfoOrErr || !*InfoOrErr)
+    return InfoOrErr;
+  std::shared_ptr<SymbolizableModule> Replica =
+      createModuleReplica(ModuleName, DWPName);
+  if (!Replica)
+    return InfoOrErr;
+  if (!IndexBuilder)
+    IndexBuilder = llvm::make_unique<ThreadPool>(1);
+  std::string IndexDirectory = Opts.IndexDirectory;
+  std::string Path = IndexPath.str();
+  FunctionNameKind FNKind = Opts.PrintFunctions;
+  bool UseSymbolTable = Opts.UseSymbolTable;
+  IndexBuilder->async([=] {
+    sys::fs::create_directories(IndexDirectory);
+    consumeError(writeSymbolizerIndex(Path, *Replica, FNKind, UseSymbolTable));
+  });
+  return InfoOrErr;
+}
+
 Expected<SymbolizableModule *>
 LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName,
                                       StringRef DWPName) {
@@ -371,17 +654,9 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName,
   if (I != Modules.end()) {
     return I->second.get();
   }
-  std::string BinaryName = ModuleName;
-  std::string ArchName = Opts.DefaultArch;
-  size_t ColonPos = ModuleName.find_last_of(':');
-  // Verify that substring after colon form a valid arch name.
-  if (ColonPos != std::string::npos) {
-    std::string ArchStr = ModuleName.substr(ColonPos + 1);
-    if (Triple(ArchStr).getArch() != Triple::UnknownArch) {
-      BinaryName = ModuleName.substr(0, ColonPos);
-      ArchName = ArchStr;
-    }
-  }
+  std::string BinaryName, ArchName;
+  std::tie(BinaryName, ArchName) =
+      splitModuleName(ModuleName, Opts.DefaultArch);
   auto ObjectsOrErr = getOrCreateObjectPair(BinaryName, ArchName);
   if (!ObjectsOrErr) {
     // Failed to find valid object file.
@@ -427,6 +702,31 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName,
   return InsertResult.first->second.get();
 }
 
+std::unique_ptr<SymbolizableModule>
+LLVMSymbolizer::createModuleReplica(const std::string &ModuleName,
+                                    StringRef DWPName) {
+  std::string BinaryName, ArchName;
+  std::tie(BinaryName, ArchName) =
+      splitModuleName(ModuleName, Opts.DefaultArch);
+  auto ObjectsOrErr = getOrCreateObjectPair(BinaryName, ArchName);
+  if (!ObjectsOrErr) {
+    consumeError(ObjectsOrErr.takeError());
+    return nullptr;
+  }
+  ObjectPair Objects = ObjectsOrErr.get();
+
+  // Only DWARF contexts are known to be independent of each other.
+  if (isa<COFFObjectFile>(Objects.first))
+    return nullptr;
+  auto InfoOrErr = SymbolizableObjectFile::create(
+      Objects.first,
+      DWARFContext::create(*Objects.second, nullptr,
+                           DWARFContext::defaultErrorHandler, DWPName));
+  if (!InfoOrErr)
+    return nullptr;
+  return std::move(InfoOrErr.get());
+}
+
 namespace {
 
 // Undo these various manglings for Win32 extern "C" functions:
@@ -477,7 +777,11 @@ LLVMSymbolizer::DemangleName(const std::string &Name,
 
 #if defined(_MSC_VER)
   if (!Name.empty() && Name.front() == '?') {
-    // Only do MSVC C++ demangling on symbols starting with '?'.
+    // Only do MSVC C++ demangling on symbols starting with '?'. DbgHelp
+    // functions are not thread-safe, and symbolizeCodeBatch() demangles from
+    // several threads.
+    static std::mutex DbgHelpMutex;
+    std::lock_guard<std::mutex> Lock(DbgHelpMutex);
     char DemangledName[1024] = {0};
     DWORD result = ::UnDecorateSymbolName(
         Name.c_str(), DemangledName, 1023,
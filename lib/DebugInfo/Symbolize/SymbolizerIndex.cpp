@@ -0,0 +1,388 @@
+//===- SymbolizerIndex.cpp ------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Implementation of the on-disk symbolization index.
+//
+// An index file starts with a fixed-size header, followed by the range table,
+// the entry table and the string table. All integers are little-endian.
+//
+//   Header:
+//     char     Magic[8]
+//     uint32_t Version
+//     uint32_t Flags          (FunctionNameKind, UseSymbolTable, Win32)
+//     uint64_t PreferredBase
+//     uint64_t NumRanges
+//     uint64_t EntriesOffset, EntriesSize
+//     uint64_t StringsOffset, StringsSize
+//
+//   Range table, sorted by start address, one element per address range in
+//   which the symbolization results are constant:
+//     uint64_t Start
+//     uint64_t EntryOffset    (relative to the entry table)
+//
+//   Entry table. Entries are shared by all ranges with identical results:
+//     Frame    Code           (the result of symbolizeCode())
+//     uint32_t NumFrames
+//     Frame    Frames[]       (the result of symbolizeInlinedCode())
+//   where a Frame is six uint32_t: FunctionName and FileName (offsets into
+//   the string table), Line, Column, StartLine, Discriminator.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolizerIndex.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Object/MachO.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+using namespace object;
+using namespace symbolize;
+
+namespace {
+
+const char IndexMagic[8] = {'L', 'L', 'V', 'M', 'S', 'Y', 'M', 'I'};
+const uint32_t IndexVersion = 1;
+const uint64_t HeaderSize = 64;
+const uint64_t RangeSize = 16;
+const uint64_t FrameWords = 6;
+
+const uint32_t FlagUseSymbolTable = 1 << 4;
+const uint32_t FlagWin32Module = 1 << 5;
+
+uint32_t getFlags(FunctionNameKind FNKind, bool UseSymbolTable) {
+  uint32_t Flags = static_cast<uint32_t>(FNKind);
+  if (UseSymbolTable)
+    Flags |= FlagUseSymbolTable;
+  return Flags;
+}
+
+/// Serializes symbolization results, sharing identical entries and strings.
+class IndexBuilder {
+public:
+  /// Returns the offset of the entry describing \p Code and \p Inlined.
+  uint64_t addEntry(const DILineInfo &Code, const DIInliningInfo &Inlined) {
+    std::vector<uint32_t> Words;
+    addFrame(Words, Code);
+    Words.push_back(Inlined.getNumberOfFrames());
+    for (uint32_t I = 0, E = Inlined.getNumberOfFrames(); I != E; ++I)
+      addFrame(Words, Inlined.getFrame(I));
+
+    StringRef Key(reinterpret_cast<const char *>(Words.data()),
+                  Words.size() * sizeof(uint32_t));
+    auto Inserted = Entries.insert({Key, EntryWords.size() * sizeof(uint32_t)});
+    if (Inserted.second)
+      EntryWords.insert(EntryWords.end(), Words.begin(), Words.end());
+    return Inserted.first->second;
+  }
+
+  void write(raw_ostream &OS, uint32_t Flags, uint64_t PreferredBase,
+             ArrayRef<std::pair<uint64_t, uint64_t>> Ranges) const {
+    uint64_t EntriesOffset = HeaderSize + Ranges.size() * RangeSize;
+    uint64_t EntriesSize = EntryWords.size() * sizeof(uint32_t);
+    uint64_t StringsOffset = EntriesOffset + EntriesSize;
+
+    support::endian::Writer<support::little> W(OS);
+    OS.write(IndexMagic, sizeof(IndexMagic));
+    W.write<uint32_t>(IndexVersion);
+    W.write<uint32_t>(Flags);
+    W.write<uint64_t>(PreferredBase);
+    W.write<uint64_t>(Ranges.size());
+    W.write<uint64_t>(EntriesOffset);
+    W.write<uint64_t>(EntriesSize);
+    W.write<uint64_t>(StringsOffset);
+    W.write<uint64_t>(StringTable.size());
+    for (const auto &R : Ranges) {
+      W.write<uint64_t>(R.first);
+      W.write<uint64_t>(R.second);
+    }
+    W.write(makeArrayRef(EntryWords));
+    OS << StringTable;
+  }
+
+private:
+  void addFrame(std::vector<uint32_t> &Words, const DILineInfo &Frame) {
+    Words.push_back(addString(Frame.FunctionName));
+    Words.push_back(addString(Frame.FileName));
+    Words.push_back(Frame.Line);
+    Words.push_back(Frame.Column);
+    Words.push_back(Frame.StartLine);
+    Words.push_back(Frame.Discriminator);
+  }
+
+  uint32_t addString(StringRef S) {
+    auto Inserted = Strings.insert({S, StringTable.size()});
+    if (Inserted.second) {
+      StringTable += S;
+      StringTable.push_back('\0');
+    }
+    return Inserted.first->second;
+  }
+
+  StringMap<uint64_t> Entries;
+  std::vector<uint32_t> EntryWords;
+  StringMap<uint32_t> Strings;
+  std::string StringTable;
+};
+
+} // end anonymous namespace
+
+std::string symbolize::getBuildIDString(const ObjectFile &Obj) {
+  if (auto *MachO = dyn_cast<MachOObjectFile>(&Obj))
+    return toHex(MachO->getUuid());
+  if (!Obj.isELF())
+    return "";
+
+  for (const SectionRef &Section : Obj.sections()) {
+    StringRef Name;
+    if (Section.getName(Name) || Name != ".note.gnu.build-id")
+      continue;
+    StringRef Data;
+    if (Section.getContents(Data))
+      return "";
+    // Walk the notes: namesz, descsz, type, then the 4-byte aligned name and
+    // descriptor.
+    bool IsLE = Obj.isLittleEndian();
+    auto Read32 = [&](size_t Offset) {
+      return IsLE ? support::endian::read32le(Data.data() + Offset)
+                  : support::endian::read32be(Data.data() + Offset);
+    };
+    size_t Offset = 0;
+    while (Offset + 12 <= Data.size()) {
+      uint32_t NameSize = Read32(Offset);
+      uint32_t DescSize = Read32(Offset + 4);
+      uint32_t Type = Read32(Offset + 8);
+      size_t DescOffset = Offset + 12 + alignTo(NameSize, 4);
+      if (DescOffset + DescSize > Data.size())
+        return "";
+      if (Type == ELF::NT_GNU_BUILD_ID &&
+          Data.substr(Offset + 12, NameSize).startswith("GNU"))
+        return toHex(Data.substr(DescOffset, DescSize));
+      Offset = DescOffset + alignTo(DescSize, 4);
+    }
+  }
+  return "";
+}
+
+std::string symbolize::getSymbolizerIndexName(
+    const ObjectFile &Obj, const ObjectFile &DebugObj, FunctionNameKind FNKind,
+    bool UseSymbolTable, StringRef DWPName, ArrayRef<std::string> DsymHints) {
+  std::string BuildID = getBuildIDString(Obj);
+  if (BuildID.empty())
+    return "";
+
+  // A rebuilt dSYM or debuglink target usually keeps the build ID, so also
+  // hash where the debug info was found and which version of it that was.
+  MD5 Hash;
+  auto AddField = [&](StringRef S) {
+    Hash.update(S);
+    Hash.update(StringRef("\0", 1));
+  };
+  AddField(std::to_string(getFlags(FNKind, UseSymbolTable)));
+  AddField(DWPName);
+  for (const std::string &Hint : DsymHints)
+    AddField(Hint);
+  StringRef DebugPath = DebugObj.getFileName();
+  AddField(DebugPath);
+  AddField(getBuildIDString(DebugObj));
+  sys::fs::file_status Status;
+  if (!sys::fs::status(DebugPath, Status)) {
+    AddField(std::to_string(Status.getSize()));
+    AddField(std::to_string(sys::toTimeT(Status.getLastModificationTime())));
+  }
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  return (BuildID + "-" + Result.digest().str().substr(0, 16) + ".symidx")
+      .str();
+}
+
+Error symbolize::writeSymbolizerIndex(StringRef Path,
+                                      const SymbolizableModule &Module,
+                                      FunctionNameKind FNKind,
+                                      bool UseSymbolTable) {
+  std::vector<uint64_t> Boundaries;
+  if (!Module.getCodeBoundaries(Boundaries))
+    return errorCodeToError(errc::function_not_supported);
+  // Addresses below the first boundary have no symbolization results either.
+  Boundaries.push_back(0);
+  llvm::sort(Boundaries.begin(), Boundaries.end());
+  Boundaries.erase(std::unique(Boundaries.begin(), Boundaries.end()),
+                   Boundaries.end());
+
+  IndexBuilder Builder;
+  std::vector<std::pair<uint64_t, uint64_t>> Ranges;
+  for (uint64_t Address : Boundaries) {
+    uint64_t Entry = Builder.addEntry(
+        Module.symbolizeCode(Address, FNKind, UseSymbolTable),
+        Module.symbolizeInlinedCode(Address, FNKind, UseSymbolTable));
+    // Merge adjacent ranges with the same results.
+    if (Ranges.empty() || Ranges.back().second != Entry)
+      Ranges.emplace_back(Address, Entry);
+  }
+
+  uint32_t Flags = getFlags(FNKind, UseSymbolTable);
+  if (Module.isWin32Module())
+    Flags |= FlagWin32Module;
+
+  // Write to a temporary file and rename it in place, so that concurrent
+  // readers never see a partially written index.
+  int FD;
+  SmallString<128> TempPath;
+  if (auto EC =
+          sys::fs::createUniqueFile(Path + ".tmp%%%%%%", FD, TempPath))
+    return errorCodeToError(EC);
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    Builder.write(OS, Flags, Module.getModulePreferredBase(), Ranges);
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return errorCodeToError(errc::io_error);
+    }
+  }
+  if (auto EC = sys::fs::rename(TempPath, Path)) {
+    sys::fs::remove(TempPath);
+    return errorCodeToError(EC);
+  }
+  return Error::success();
+}
+
+Expected<std::unique_ptr<IndexedSymbolizableModule>>
+IndexedSymbolizableModule::load(StringRef Path, FunctionNameKind FNKind,
+                                bool UseSymbolTable) {
+  auto BufferOrErr = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                           /*RequiresNullTerminator=*/false);
+  if (!BufferOrErr)
+    return errorCodeToError(BufferOrErr.getError());
+
+  std::unique_ptr<IndexedSymbolizableModule> Index(
+      new IndexedSymbolizableModule(std::move(*BufferOrErr)));
+  StringRef Data = Index->Buffer->getBuffer();
+  auto Invalid = [] { return errorCodeToError(errc::invalid_argument); };
+  if (Data.size() < HeaderSize ||
+      !Data.startswith(StringRef(IndexMagic, sizeof(IndexMagic))))
+    return Invalid();
+
+  const char *P = Data.data();
+  using namespace support::endian;
+  if (read32le(P + 8) != IndexVersion)
+    return Invalid();
+  uint32_t Flags = read32le(P + 12);
+  if ((Flags & ~FlagWin32Module) != getFlags(FNKind, UseSymbolTable))
+    return Invalid();
+  Index->IsWin32Module = Flags & FlagWin32Module;
+  Index->PreferredBase = read64le(P + 16);
+  Index->NumRanges = read64le(P + 24);
+  Index->EntriesOffset = read64le(P + 32);
+  Index->EntriesSize = read64le(P + 40);
+  uint64_t StringsOffset = read64le(P + 48);
+  uint64_t StringsSize = read64le(P + 56);
+
+  if (Index->NumRanges == 0 ||
+      Index->NumRanges > (Data.size() - HeaderSize) / RangeSize ||
+      Index->EntriesOffset < HeaderSize + Index->NumRanges * RangeSize ||
+      Index->EntriesOffset > Data.size() ||
+      Index->EntriesSize > Data.size() - Index->EntriesOffset ||
+      StringsOffset > Data.size() || StringsSize > Data.size() - StringsOffset)
+    return Invalid();
+  Index->Strings = Data.substr(StringsOffset, StringsSize);
+  if (!Index->Strings.empty() && Index->Strings.back() != '\0')
+    return Invalid();
+  return std::move(Index);
+}
+
+uint32_t IndexedSymbolizableModule::readWord(uint64_t Offset) const {
+  return support::endian::read32le(Buffer->getBufferStart() + EntriesOffset +
+                                   Offset);
+}
+
+Optional<uint64_t>
+IndexedSymbolizableModule::lookup(uint64_t ModuleOffset) const {
+  // Find the last range starting at or before ModuleOffset. The first range
+  // always starts at 0.
+  const char *Ranges = Buffer->getBufferStart() + HeaderSize;
+  uint64_t Lo = 0, Hi = NumRanges;
+  while (Hi - Lo > 1) {
+    uint64_t Mid = Lo + (Hi - Lo) / 2;
+    if (support::endian::read64le(Ranges + Mid * RangeSize) <= ModuleOffset)
+      Lo = Mid;
+    else
+      Hi = Mid;
+  }
+  uint64_t Entry = support::endian::read64le(Ranges + Lo * RangeSize + 8);
+  if (Entry >= EntriesSize)
+    return None;
+  return Entry;
+}
+
+bool IndexedSymbolizableModule::readFrame(uint64_t &Offset,
+                                          DILineInfo &Frame) const {
+  if (FrameWords * sizeof(uint32_t) > EntriesSize - Offset)
+    return false;
+  uint32_t FunctionName = readWord(Offset);
+  uint32_t FileName = readWord(Offset + 4);
+  if (FunctionName >= Strings.size() || FileName >= Strings.size())
+    return false;
+  Frame.FunctionName = Strings.data() + FunctionName;
+  Frame.FileName = Strings.data() + FileName;
+  Frame.Line = readWord(Offset + 8);
+  Frame.Column = readWord(Offset + 12);
+  Frame.StartLine = readWord(Offset + 16);
+  Frame.Discriminator = readWord(Offset + 20);
+  Offset += FrameWords * sizeof(uint32_t);
+  return true;
+}
+
+DILineInfo IndexedSymbolizableModule::symbolizeCode(uint64_t ModuleOffset,
+                                                    FunctionNameKind FNKind,
+                                                    bool UseSymbolTable) const {
+  DILineInfo Code;
+  if (Optional<uint64_t> Offset = lookup(ModuleOffset))
+    if (!readFrame(*Offset, Code))
+      return DILineInfo();
+  return Code;
+}
+
+DIInliningInfo IndexedSymbolizableModule::symbolizeInlinedCode(
+    uint64_t ModuleOffset, FunctionNameKind FNKind, bool UseSymbolTable) const {
+  DIInliningInfo Inlined;
+  Optional<uint64_t> Offset = lookup(ModuleOffset);
+  DILineInfo Frame;
+  if (!Offset || !readFrame(*Offset, Frame) || *Offset + 4 > EntriesSize) {
+    Inlined.addFrame(DILineInfo());
+    return Inlined;
+  }
+  uint32_t NumFrames = readWord(*Offset);
+  *Offset += 4;
+  for (uint32_t I = 0; I != NumFrames; ++I) {
+    if (!readFrame(*Offset, Frame))
+      break;
+    Inlined.addFrame(Frame);
+  }
+  // Keep the guarantee of SymbolizableObjectFile that there is at least one
+  // frame.
+  if (Inlined.getNumberOfFrames() == 0)
+    Inlined.addFrame(DILineInfo());
+  return Inlined;
+}
+
+DIGlobal IndexedSymbolizableModule::symbolizeData(uint64_t ModuleOffset) const {
+  return DIGlobal();
+}
@@ -0,0 +1,105 @@
+//===- SymbolizerIndex.h ----------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the on-disk symbolization index. An index maps every
+// address range of a module to the results SymbolizableObjectFile gives for
+// it, so that code lookups can be answered from a memory-mapped file with a
+// binary search instead of parsing the debug info.
+//
+//===----------------------------------------------------------------------===//
+#ifndef LLVM_LIB_DEBUGINFO_SYMBOLIZE_SYMBOLIZERINDEX_H
+#define LLVM_LIB_DEBUGINFO_SYMBOLIZE_SYMBOLIZERINDEX_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/DebugInfo/DIContext.h"
+#include "llvm/DebugInfo/Symbolize/SymbolizableModule.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llvm {
+
+namespace object {
+class ObjectFile;
+} // end namespace object
+
+namespace symbolize {
+
+/// Returns the hex-encoded build ID of \p Obj (the GNU build ID note for ELF,
+/// the UUID for Mach-O), or an empty string if it has none.
+std::string getBuildIDString(const object::ObjectFile &Obj);
+
+/// Returns the file name of the index of a module whose code is in \p Obj and
+/// whose debug info is in \p DebugObj, or an empty string if \p Obj has no
+/// build ID. The name is derived from everything the index depends on: the
+/// build ID of \p Obj; the path, size, modification time and build ID of
+/// \p DebugObj, which may have been found through a dSYM bundle or a
+/// .gnu_debuglink section; and the symbolizer options.
+std::string getSymbolizerIndexName(const object::ObjectFile &Obj,
+                                   const object::ObjectFile &DebugObj,
+                                   FunctionNameKind FNKind, bool UseSymbolTable,
+                                   StringRef DWPName,
+                                   ArrayRef<std::string> DsymHints);
+
+/// Writes an index of \p Module to \p Path. The index captures the results of
+/// symbolizeCode() and symbolizeInlinedCode() for the given \p FNKind and
+/// \p UseSymbolTable. Fails if \p Module can't enumerate the addresses at
+/// which they change.
+Error writeSymbolizerIndex(StringRef Path, const SymbolizableModule &Module,
+                           FunctionNameKind FNKind, bool UseSymbolTable);
+
+/// A SymbolizableModule that answers code queries from an index written by
+/// writeSymbolizerIndex(). Data queries are not supported.
+class IndexedSymbolizableModule : public SymbolizableModule {
+public:
+  /// Maps the index at \p Path. Fails if the file is missing, malformed, or
+  /// was written for a different \p FNKind or \p UseSymbolTable.
+  static Expected<std::unique_ptr<IndexedSymbolizableModule>>
+  load(StringRef Path, FunctionNameKind FNKind, bool UseSymbolTable);
+
+  DILineInfo symbolizeCode(uint64_t ModuleOffset, FunctionNameKind FNKind,
+                           bool UseSymbolTable) const override;
+  DIInliningInfo symbolizeInlinedCode(uint64_t ModuleOffset,
+                                      FunctionNameKind FNKind,
+                                      bool UseSymbolTable) const override;
+  DIGlobal symbolizeData(uint64_t ModuleOffset) const override;
+
+  bool isWin32Module() const override { return IsWin32Module; }
+  uint64_t getModulePreferredBase() const override { return PreferredBase; }
+
+  // Lookups only read the mapped file.
+  bool supportsConcurrentQueries() const override { return true; }
+
+private:
+  IndexedSymbolizableModule(std::unique_ptr<MemoryBuffer> Buffer)
+      : Buffer(std::move(Buffer)) {}
+
+  /// Returns the offset of the entry describing \p ModuleOffset in the
+  /// entry table, or None if the index is corrupt.
+  Optional<uint64_t> lookup(uint64_t ModuleOffset) const;
+  bool readFrame(uint64_t &Offset, DILineInfo &Frame) const;
+  uint32_t readWord(uint64_t Offset) const;
+
+  std::unique_ptr<MemoryBuffer> Buffer;
+  bool IsWin32Module = false;
+  uint64_t PreferredBase = 0;
+  uint64_t NumRanges = 0;
+  uint64_t EntriesOffset = 0;
+  uint64_t EntriesSize = 0;
+  StringRef Strings;
+};
+
+} // end namespace symbolize
+} // end namespace llvm
+
+#endif // LLVM_LIB_DEBUGINFO_SYMBOLIZE_SYMBOLIZERINDEX_H
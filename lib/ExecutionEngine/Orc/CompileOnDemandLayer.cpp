@@ -0,0 +1,41 @@
+//===----- CompileOnDemandLayer.cpp - Speculation policies for the COD ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/InstIterator.h"
+
+namespace llvm {
+namespace orc {
+
+SetVector<Function*> speculateDirectCallees(Function &F) {
+  SetVector<Function*> Callees;
+  for (auto &I : instructions(F)) {
+    CallSite CS(&I);
+    if (!CS)
+      continue;
+    if (auto *Callee = dyn_cast_or_null<Function>(
+            CS.getCalledValue()->stripPointerCasts()))
+      if (!Callee->isDeclaration() && Callee->getParent() == F.getParent())
+        Callees.insert(Callee);
+  }
+  return Callees;
+}
+
+SetVector<Function*> CallCountSpeculator::operator()(Function &F) const {
+  SetVector<Function*> Callees = speculateDirectCallees(F);
+  Callees.remove_if([this](Function *Callee) {
+    auto CountI = CallCounts->find(Callee->getName());
+    return CountI == CallCounts->end() || CountI->second < MinCallCount;
+  });
+  return Callees;
+}
+
+} // End namespace orc.
+} // End namespace llvm.
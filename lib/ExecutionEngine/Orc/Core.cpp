@@ -8,10 +8,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ExecutionEngine/Orc/OrcError.h"
+#include "llvm/Support/ThreadPool.h"
 
 #if LLVM_ENABLE_THREADS
+#include <condition_variable>
 #include <future>
+#include <list>
 #endif
 
 namespace llvm {
@@ -32,6 +36,7 @@ AsynchronousSymbolQuery::AsynchronousSymbolQuery(
 }
 
 void AsynchronousSymbolQuery::setFailed(Error Err) {
+  std::lock_guard<std::mutex> Lock(QueryMutex);
   OutstandingResolutions = OutstandingFinalizations = 0;
   if (NotifySymbolsResolved)
     NotifySymbolsResolved(std::move(Err));
@@ -41,6 +46,7 @@ void AsynchronousSymbolQuery::setFailed(Error Err) {
 
 void AsynchronousSymbolQuery::setDefinition(SymbolStringPtr Name,
                                             JITEvaluatedSymbol Sym) {
+  std::lock_guard<std::mutex> Lock(QueryMutex);
   // If OutstandingResolutions is zero we must have errored out already. Just
   // ignore this.
   if (OutstandingResolutions == 0)
@@ -57,6 +63,7 @@ void AsynchronousSymbolQuery::setDefinition(SymbolStringPtr Name,
 }
 
 void AsynchronousSymbolQuery::notifySymbolFinalized() {
+  std::lock_guard<std::mutex> Lock(QueryMutex);
   // If OutstandingFinalizations is zero we must have errored out already. Just
   // ignore this.
   if (OutstandingFinalizations == 0)
@@ -257,6 +264,7 @@ VSO::RelativeLinkageStrength VSO::compareLinkage(Optional<JITSymbolFlags> Old,
 
 VSO::RelativeLinkageStrength
 VSO::compareLinkage(SymbolStringPtr Name, JITSymbolFlags NewFlags) const {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
   auto I = Symbols.find(Name);
   return compareLinkage(I == Symbols.end()
                             ? None
@@ -265,6 +273,7 @@ VSO::compareLinkage(SymbolStringPtr Name, JITSymbolFlags NewFlags) const {
 }
 
 Error VSO::define(SymbolMap NewSymbols) {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
   Error Err = Error::success();
   for (auto &KV : NewSymbols) {
     auto I = Symbols.find(KV.first);
@@ -295,6 +304,7 @@ Error VSO::define(SymbolMap NewSymbols) {
 }
 
 Error VSO::defineLazy(std::unique_ptr<MaterializationUnit> MU) {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
 
   auto NewSymbols = MU->getSymbols();
 
@@ -350,6 +360,7 @@ Error VSO::defineLazy(std::unique_ptr<MaterializationUnit> MU) {
 }
 
 void VSO::resolve(SymbolMap SymbolValues) {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
   for (auto &KV : SymbolValues) {
     auto I = Symbols.find(KV.first);
     assert(I != Symbols.end() && "Resolving symbol not present in this dylib");
@@ -358,6 +369,7 @@ void VSO::resolve(SymbolMap SymbolValues) {
 }
 
 void VSO::finalize(SymbolNameSet SymbolsToFinalize) {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
   for (auto &S : SymbolsToFinalize) {
     auto I = Symbols.find(S);
     assert(I != Symbols.end() && "Finalizing symbol not present in this dylib");
@@ -366,6 +378,7 @@ void VSO::finalize(SymbolNameSet SymbolsToFinalize) {
 }
 
 SymbolNameSet VSO::lookupFlags(SymbolFlagsMap &Flags, SymbolNameSet Names) {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
 
   for (SymbolNameSet::iterator I = Names.begin(), E = Names.end(); I != E;) {
     auto Tmp = I++;
@@ -386,6 +399,7 @@ SymbolNameSet VSO::lookupFlags(SymbolFlagsMap &Flags, SymbolNameSet Names) {
 
 VSO::LookupResult VSO::lookup(std::shared_ptr<AsynchronousSymbolQuery> Query,
                               SymbolNameSet Names) {
+  std::lock_guard<std::recursive_mutex> Lock(SymbolsMutex);
   MaterializationUnitList MaterializationUnits;
 
   for (SymbolNameSet::iterator I = Names.begin(), E = Names.end(); I != E;) {
@@ -409,6 +423,167 @@ VSO::LookupResult VSO::lookup(std::shared_ptr<AsynchronousSymbolQuery> Query,
   return {std::move(MaterializationUnits), std::move(Names)};
 }
 
+#if LLVM_ENABLE_THREADS
+namespace {
+
+/// The symbols of a VSO that a lookup waits for.
+using VSOSymbols = std::pair<VSO *, SymbolNameSet>;
+
+/// The materializations that a MaterializeOnThreadPool has dispatched but that
+/// no thread has started yet.
+///
+/// A worker that waits for a lookup runs the queued materializers of the
+/// symbols it waits for. Otherwise, if those were queued behind the
+/// materializers of the waiting workers, every thread of the pool could end up
+/// waiting for work that no thread is free to run. Other queued materializers
+/// are left alone: they could wait for the materializer that this worker was
+/// running before the lookup.
+class MaterializationQueue {
+public:
+  /// Queues \p Task, which materializes \p Symbols of \p V.
+  void push(VSO &V, SymbolNameSet Symbols, std::function<void()> Task) {
+    {
+      std::lock_guard<std::mutex> Lock(TasksMutex);
+      Tasks.push_back({&V, std::move(Symbols), std::move(Task)});
+    }
+    TasksChanged.notify_all();
+  }
+
+  /// Runs the oldest queued task, if any.
+  void runOldest() {
+    std::unique_lock<std::mutex> Lock(TasksMutex);
+    if (!Tasks.empty())
+      run(Lock, Tasks.begin());
+  }
+
+  /// Runs the queued tasks that materialize \p Needed until \p F is ready.
+  /// Whatever makes \p F ready must call notify() afterwards.
+  template <typename FutureT>
+  void runUntilReady(FutureT &F, const std::vector<VSOSymbols> &Needed) {
+    auto IsReady = [&F]() {
+      return F.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    std::unique_lock<std::mutex> Lock(TasksMutex);
+    while (!IsReady()) {
+      auto I = findNeeded(Needed);
+      if (I != Tasks.end()) {
+        run(Lock, I);
+        continue;
+      }
+      TasksChanged.wait(Lock);
+    }
+  }
+
+  /// Wakes up the threads in runUntilReady().
+  void notify() {
+    // Lock the mutex, so that a thread that has just found its future not
+    // ready is waiting by the time it is notified.
+    { std::lock_guard<std::mutex> Lock(TasksMutex); }
+    TasksChanged.notify_all();
+  }
+
+private:
+  struct QueuedTask {
+    VSO *V;
+    SymbolNameSet Symbols;
+    std::function<void()> Task;
+  };
+
+  std::list<QueuedTask>::iterator
+  findNeeded(const std::vector<VSOSymbols> &Needed) {
+    for (auto I = Tasks.begin(), E = Tasks.end(); I != E; ++I)
+      for (auto &VS : Needed)
+        if (I->V == VS.first &&
+            llvm::any_of(VS.second, [&](const SymbolStringPtr &Name) {
+              return I->Symbols.count(Name);
+            }))
+          return I;
+    return Tasks.end();
+  }
+
+  /// Removes \p I from the queue and runs it without holding \p Lock.
+  void run(std::unique_lock<std::mutex> &Lock,
+           std::list<QueuedTask>::iterator I) {
+    std::function<void()> Task = std::move(I->Task);
+    Tasks.erase(I);
+    Lock.unlock();
+    Task();
+    Lock.lock();
+  }
+
+  std::mutex TasksMutex;
+  std::condition_variable TasksChanged;
+  std::list<QueuedTask> Tasks;
+};
+
+} // end anonymous namespace
+
+/// The queue of the MaterializeOnThreadPool that runs a materializer on this
+/// thread, or null if this thread is not a worker of any such pool.
+static LLVM_THREAD_LOCAL MaterializationQueue *CurrentMaterializationQueue =
+    nullptr;
+#endif
+
+class MaterializeOnThreadPool::Pool {
+  std::mutex ReportErrorMutex;
+
+public:
+  Pool(unsigned ThreadCount) : Threads(ThreadCount) {}
+
+  void materialize(ExecutionSession &ES, VSO &V, MaterializationUnit &MU) {
+    if (auto Err = MU.materialize(V)) {
+      // The error reporter is not required to be thread safe.
+      std::lock_guard<std::mutex> Lock(ReportErrorMutex);
+      ES.reportError(std::move(Err));
+    }
+  }
+
+#if LLVM_ENABLE_THREADS
+  MaterializationQueue Queue;
+#endif
+  // Declared last, so that ~ThreadPool joins the workers before the members
+  // they use are destroyed.
+  ThreadPool Threads;
+};
+
+MaterializeOnThreadPool::MaterializeOnThreadPool(ExecutionSession &ES,
+                                                 unsigned ThreadCount)
+    : ES(ES), P(std::make_shared<Pool>(ThreadCount)) {}
+
+void MaterializeOnThreadPool::
+operator()(VSO &V, std::unique_ptr<MaterializationUnit> MU) {
+#if LLVM_ENABLE_THREADS
+  if (CurrentMaterializationQueue != &P->Queue) {
+    // The task must not share ownership of the pool: it would join its own
+    // thread if it released the last reference.
+    Pool *ThePool = P.get();
+    ExecutionSession *TheES = &ES;
+    // FIXME: Use move capture once we move to C++14.
+    std::shared_ptr<MaterializationUnit> SharedMU = std::move(MU);
+    SymbolNameSet Symbols;
+    for (auto &KV : SharedMU->getSymbols())
+      Symbols.insert(KV.first);
+    P->Queue.push(V, std::move(Symbols), [ThePool, TheES, &V, SharedMU]() {
+      ThePool->materialize(*TheES, V, *SharedMU);
+    });
+    // Each task runs the oldest materialization that a waiting worker hasn't
+    // already run.
+    P->Threads.async([ThePool]() {
+      CurrentMaterializationQueue = &ThePool->Queue;
+      ThePool->Queue.runOldest();
+      CurrentMaterializationQueue = nullptr;
+    });
+    return;
+  }
+#endif
+  // Nested materializations run on the current thread, and so does everything
+  // without threads, where lookup() expects the symbols to be materialized by
+  // the time the dispatcher returns.
+  P->materialize(ES, V, *MU);
+}
+
+void MaterializeOnThreadPool::wait() { P->Threads.wait(); }
+
 Expected<SymbolMap> lookup(const std::vector<VSO *> &VSOs, SymbolNameSet Names,
                            MaterializationDispatcher DispatchMaterialization) {
 #if LLVM_ENABLE_THREADS
@@ -418,7 +593,12 @@ Expected<SymbolMap> lookup(const std::vector<VSO *> &VSOs, SymbolNameSet Names,
   Error ResolutionError = Error::success();
   std::promise<void> PromisedReady;
   Error ReadyError = Error::success();
-  auto OnResolve = [&](Expected<SymbolMap> Result) {
+  // A worker of a MaterializeOnThreadPool runs queued materializations until
+  // the results are ready, and has to be woken up when they are. The queue is
+  // captured by value: this frame may be gone once the promise is set.
+  MaterializationQueue *WaitingQueue = CurrentMaterializationQueue;
+  std::vector<VSOSymbols> Needed;
+  auto OnResolve = [&, WaitingQueue](Expected<SymbolMap> Result) {
     if (Result)
       PromisedResult.set_value(std::move(*Result));
     else {
@@ -429,14 +609,18 @@ Expected<SymbolMap> lookup(const std::vector<VSO *> &VSOs, SymbolNameSet Names,
       }
       PromisedResult.set_value(SymbolMap());
     }
+    if (WaitingQueue)
+      WaitingQueue->notify();
   };
-  auto OnReady = [&](Error Err) {
+  auto OnReady = [&, WaitingQueue](Error Err) {
     if (Err) {
       ErrorAsOutParameter _(&ReadyError);
       std::lock_guard<std::mutex> Lock(ErrMutex);
       ReadyError = std::move(Err);
     }
     PromisedReady.set_value();
+    if (WaitingQueue)
+      WaitingQueue->notify();
   };
 #else
   SymbolMap Result;
@@ -468,6 +652,15 @@ Expected<SymbolMap> lookup(const std::vector<VSO *> &VSOs, SymbolNameSet Names,
 
     assert(V && "VSO pointers in VSOs list should be non-null");
     auto LR = V->lookup(Query, UnresolvedSymbols);
+#if LLVM_ENABLE_THREADS
+    if (WaitingQueue) {
+      SymbolNameSet Found;
+      for (auto &Name : UnresolvedSymbols)
+        if (!LR.UnresolvedSymbols.count(Name))
+          Found.insert(Name);
+      Needed.push_back({V, std::move(Found)});
+    }
+#endif
     UnresolvedSymbols = std::move(LR.UnresolvedSymbols);
 
     for (auto &MU : LR.MaterializationUnits)
@@ -476,6 +669,8 @@ Expected<SymbolMap> lookup(const std::vector<VSO *> &VSOs, SymbolNameSet Names,
 
 #if LLVM_ENABLE_THREADS
   auto ResultFuture = PromisedResult.get_future();
+  if (WaitingQueue)
+    WaitingQueue->runUntilReady(ResultFuture, Needed);
   auto Result = ResultFuture.get();
 
   {
@@ -488,6 +683,8 @@ Expected<SymbolMap> lookup(const std::vector<VSO *> &VSOs, SymbolNameSet Names,
   }
 
   auto ReadyFuture = PromisedReady.get_future();
+  if (WaitingQueue)
+    WaitingQueue->runUntilReady(ReadyFuture, Needed);
   ReadyFuture.get();
 
   {
@@ -0,0 +1,145 @@
+//===---- OnDiskObjectCache.cpp - ObjectCache backed by a directory -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/Orc/OnDiskObjectCache.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CacheManifest.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+#define DEBUG_TYPE "orc"
+
+STATISTIC(NumObjectsLoaded, "Number of objects loaded from the object cache");
+STATISTIC(NumObjectsWritten, "Number of objects written to the object cache");
+
+static std::string computeTargetKey(const TargetMachine &TM) {
+  std::string Key;
+  raw_string_ostream OS(Key);
+  const TargetOptions &Opts = TM.Options;
+  OS << LLVM_VERSION_STRING << ';' << TM.getTargetTriple().str() << ';'
+     << TM.getTargetCPU() << ';' << TM.getTargetFeatureString() << ';'
+     << unsigned(TM.getOptLevel()) << ';' << unsigned(TM.getRelocationModel())
+     << ';' << unsigned(TM.getCodeModel()) << ';' << Opts.UnsafeFPMath
+     << Opts.NoInfsFPMath << Opts.NoNaNsFPMath << Opts.NoTrappingFPMath
+     << Opts.NoSignedZerosFPMath << Opts.HonorSignDependentRoundingFPMathOption
+     << Opts.GuaranteedTailCallOpt << Opts.EnableFastISel
+     << Opts.EnableGlobalISel << Opts.FunctionSections << Opts.DataSections
+     << Opts.TrapUnreachable << Opts.EmulatedTLS << Opts.EnableIPRA << ';'
+     << unsigned(Opts.FloatABIType) << ';' << unsigned(Opts.AllowFPOpFusion)
+     << ';' << unsigned(Opts.ThreadModel);
+  return OS.str();
+}
+
+Expected<std::unique_ptr<OnDiskObjectCache>>
+OnDiskObjectCache::create(StringRef CacheDir, const TargetMachine &TM) {
+  if (std::error_code EC = sys::fs::create_directories(CacheDir))
+    return errorCodeToError(EC);
+  if (!CacheManifest::exists(CacheDir))
+    if (Error E = CacheManifest::create(CacheDir))
+      return std::move(E);
+  return std::unique_ptr<OnDiskObjectCache>(
+      new OnDiskObjectCache(CacheDir, computeTargetKey(TM)));
+}
+
+std::string OnDiskObjectCache::computeKey(const Module &M) const {
+  SmallVector<char, 0> Bitcode;
+  {
+    raw_svector_ostream OS(Bitcode);
+    WriteBitcodeToFile(M, OS);
+  }
+
+  SHA1 Hasher;
+  Hasher.update(TargetKey);
+  Hasher.update(ArrayRef<uint8_t>((const uint8_t *)Bitcode.data(),
+                                  Bitcode.size()));
+  return toHex(Hasher.result());
+}
+
+std::unique_ptr<MemoryBuffer> OnDiskObjectCache::getObject(const Module *M) {
+  // The bitcode of a module that is still being loaded lazily doesn't
+  // describe what will be compiled; just let it be compiled.
+  if (!M->isMaterialized())
+    return nullptr;
+
+  std::string Key = computeKey(*M);
+
+  // This choice of file name allows the cache to be pruned (see pruneCache()
+  // in include/llvm/Support/CachePruning.h).
+  SmallString<128> EntryPath;
+  sys::path::append(EntryPath, CacheDir, "llvmcache-" + Key);
+
+  // Take a copy of the entry rather than mapping it, so that a concurrent
+  // pruner can't pull it out from under the JIT'd code.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getFile(EntryPath, /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
+  if (MBOrErr) {
+    CacheManifest::recordAccess(CacheDir, Key, (*MBOrErr)->getBufferSize());
+    ++NumObjectsLoaded;
+    return MemoryBuffer::getMemBufferCopy((*MBOrErr)->getBuffer(),
+                                          (*MBOrErr)->getBufferIdentifier());
+  }
+
+  std::lock_guard<std::mutex> Lock(PendingKeysMutex);
+  PendingKeys[M] = std::move(Key);
+  return nullptr;
+}
+
+void OnDiskObjectCache::notifyObjectCompiled(const Module *M,
+                                             MemoryBufferRef Obj) {
+  std::string Key;
+  {
+    std::lock_guard<std::mutex> Lock(PendingKeysMutex);
+    auto I = PendingKeys.find(M);
+    // A module that was compiled without being looked up first has no key
+    // that still describes the IR it was compiled from; don't cache it.
+    if (I == PendingKeys.end())
+      return;
+    Key = std::move(I->second);
+    PendingKeys.erase(I);
+  }
+
+  // Write to a temporary and rename it into place, so that concurrent readers
+  // never see a partial entry. Failing to write the cache isn't fatal: the
+  // object has been compiled either way.
+  SmallString<128> TempFilenameModel;
+  sys::path::append(TempFilenameModel, CacheDir, "JIT-%%%%%%.tmp.o");
+  Expected<sys::fs::TempFile> Temp = sys::fs::TempFile::create(
+      TempFilenameModel, sys::fs::owner_read | sys::fs::owner_write);
+  if (!Temp) {
+    consumeError(Temp.takeError());
+    return;
+  }
+
+  {
+    raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+    OS << Obj.getBuffer();
+  }
+
+  SmallString<128> EntryPath;
+  sys::path::append(EntryPath, CacheDir, "llvmcache-" + Key);
+  // keep() removes the temporary itself if the rename fails.
+  if (Error E = Temp->keep(EntryPath)) {
+    consumeError(std::move(E));
+    return;
+  }
+  CacheManifest::recordInsert(CacheDir, Key, Obj.getBufferSize());
+  ++NumObjectsWritten;
+}
@@ -362,6 +362,8 @@ public:
     CompileLayer.getCompiler().setObjectCache(NewCache);
   }
 
+  TargetMachine *getTargetMachine() override { return TM.get(); }
+
   void setProcessAllSections(bool ProcessAllSections) override {
     ObjectLayer.setProcessAllSections(ProcessAllSections);
   }
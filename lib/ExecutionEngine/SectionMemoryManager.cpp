@@ -260,4 +260,157 @@ DefaultMMapper DefaultMMapperInstance;
 SectionMemoryManager::SectionMemoryManager(MemoryMapper *MM)
     : MMapper(MM ? *MM : DefaultMMapperInstance) {}
 
+// The size of a transparent huge page on the systems that have them.
+static const size_t HugePageSize = 2 * 1024 * 1024;
+
+SlabMemoryMapper::SlabMemoryMapper(size_t SlabSize, bool UseHugePages)
+    : SlabSize(alignTo(SlabSize, UseHugePages ? HugePageSize
+                                              : sys::Process::getPageSize())),
+      UseHugePages(UseHugePages) {}
+
+SlabMemoryMapper::~SlabMemoryMapper() {
+  for (auto &PurposeSlabs : Slabs)
+    for (auto &S : PurposeSlabs)
+      sys::Memory::releaseMappedMemory(S->Mapping);
+}
+
+SlabMemoryMapper::Slab *
+SlabMemoryMapper::createSlab(SectionMemoryManager::AllocationPurpose Purpose,
+                             size_t MinSize, std::error_code &EC) {
+  size_t Size = std::max(
+      SlabSize, UseHugePages ? (size_t)alignTo(MinSize, HugePageSize) : MinSize);
+  unsigned Flags = sys::Memory::MF_READ | sys::Memory::MF_WRITE;
+  size_t MappingSize = Size;
+  if (UseHugePages) {
+    // Map an extra huge page so that the slab can start on a huge page
+    // boundary.
+    Flags |= sys::Memory::MF_HUGE_HINT;
+    MappingSize += HugePageSize;
+  }
+
+  // Keep the slabs near each other, so that code can reach its data.
+  sys::MemoryBlock Mapping = sys::Memory::allocateMappedMemory(
+      MappingSize, LastSlabMapping.base() ? &LastSlabMapping : nullptr, Flags,
+      EC);
+  if (EC)
+    return nullptr;
+  LastSlabMapping = Mapping;
+
+  auto S = llvm::make_unique<Slab>();
+  S->Mapping = Mapping;
+  S->Start = (uintptr_t)Mapping.base();
+  if (UseHugePages)
+    S->Start = alignTo(S->Start, HugePageSize);
+  S->End = S->Start + Size;
+  S->FreeRanges[S->Start] = Size;
+
+  auto &PurposeSlabs = Slabs[static_cast<unsigned>(Purpose)];
+  PurposeSlabs.push_back(std::move(S));
+  return PurposeSlabs.back().get();
+}
+
+sys::MemoryBlock SlabMemoryMapper::allocateMappedMemory(
+    SectionMemoryManager::AllocationPurpose Purpose, size_t NumBytes,
+    const sys::MemoryBlock *const NearBlock, unsigned Flags,
+    std::error_code &EC) {
+  // NearBlock is ignored: blocks of the same purpose share slabs, and the
+  // slabs are mapped near each other.
+  EC = std::error_code();
+  if (NumBytes == 0)
+    return sys::MemoryBlock();
+  size_t Size = alignTo(NumBytes, sys::Process::getPageSize());
+
+  std::lock_guard<std::mutex> Lock(SlabsMutex);
+
+  // Take the first free range that fits, from the oldest slab, to keep the
+  // blocks in use packed together.
+  Slab *S = nullptr;
+  std::map<uintptr_t, size_t>::iterator Range;
+  for (auto &Candidate : Slabs[static_cast<unsigned>(Purpose)]) {
+    Range = find_if(Candidate->FreeRanges,
+                    [Size](const std::pair<const uintptr_t, size_t> &R) {
+                      return R.second >= Size;
+                    });
+    if (Range != Candidate->FreeRanges.end()) {
+      S = Candidate.get();
+      break;
+    }
+  }
+  if (!S) {
+    S = createSlab(Purpose, Size, EC);
+    if (!S)
+      return sys::MemoryBlock();
+    Range = S->FreeRanges.begin();
+  }
+
+  // The range may have been handed out, and its permissions changed, before.
+  uintptr_t Addr = Range->first;
+  sys::MemoryBlock Block((void *)Addr, Size);
+  EC = sys::Memory::protectMappedMemory(Block,
+                                        Flags & ~sys::Memory::MF_HUGE_HINT);
+  if (EC)
+    return sys::MemoryBlock();
+
+  size_t Remaining = Range->second - Size;
+  S->FreeRanges.erase(Range);
+  if (Remaining)
+    S->FreeRanges[Addr + Size] = Remaining;
+
+  AllocatedSize += Size;
+  return Block;
+}
+
+std::error_code
+SlabMemoryMapper::protectMappedMemory(const sys::MemoryBlock &Block,
+                                      unsigned Flags) {
+  return sys::Memory::protectMappedMemory(Block, Flags);
+}
+
+std::error_code SlabMemoryMapper::releaseMappedMemory(sys::MemoryBlock &M) {
+  std::lock_guard<std::mutex> Lock(SlabsMutex);
+
+  uintptr_t Addr = (uintptr_t)M.base();
+  size_t Size = M.size();
+  for (auto &PurposeSlabs : Slabs)
+    for (auto &S : PurposeSlabs) {
+      if (Addr < S->Start || Addr >= S->End)
+        continue;
+
+      // Merge the block with the free ranges on either side of it.
+      auto Next = S->FreeRanges.lower_bound(Addr);
+      if (Next != S->FreeRanges.end() && Addr + Size == Next->first) {
+        Size += Next->second;
+        Next = S->FreeRanges.erase(Next);
+      }
+      if (Next != S->FreeRanges.begin()) {
+        auto Prev = std::prev(Next);
+        if (Prev->first + Prev->second == Addr) {
+          Prev->second += Size;
+          Size = 0;
+        }
+      }
+      if (Size)
+        S->FreeRanges[Addr] = Size;
+
+      AllocatedSize -= M.size();
+      M = sys::MemoryBlock();
+      return std::error_code();
+    }
+
+  return std::make_error_code(std::errc::invalid_argument);
+}
+
+unsigned SlabMemoryMapper::getNumSlabs() const {
+  std::lock_guard<std::mutex> Lock(SlabsMutex);
+  unsigned NumSlabs = 0;
+  for (auto &PurposeSlabs : Slabs)
+    NumSlabs += PurposeSlabs.size();
+  return NumSlabs;
+}
+
+size_t SlabMemoryMapper::getAllocatedSize() const {
+  std::lock_guard<std::mutex> Lock(SlabsMutex);
+  return AllocatedSize;
+}
+
 } // namespace llvm
@@ -1193,30 +1193,24 @@ MDNode *Instruction::getMetadataImpl(StringRef Kind) const {
 }
 
 void Instruction::dropUnknownNonDebugMetadata(ArrayRef<unsigned> KnownIDs) {
-  if (!hasMetadataHashEntry())
+  if (!Attachments)
     return; // Nothing to remove!
 
-  auto &InstructionMetadata = getContext().pImpl->InstructionMetadata;
-
   SmallSet<unsigned, 4> KnownSet;
   KnownSet.insert(KnownIDs.begin(), KnownIDs.end());
   if (KnownSet.empty()) {
-    // Just drop our entry at the store.
-    InstructionMetadata.erase(this);
-    setHasMetadataHashEntry(false);
+    // Just drop all of the attachments.
+    clearMetadataAttachments();
     return;
   }
 
-  auto &Info = InstructionMetadata[this];
-  Info.remove_if([&KnownSet](const std::pair<unsigned, TrackingMDNodeRef> &I) {
-    return !KnownSet.count(I.first);
-  });
+  Attachments->remove_if(
+      [&KnownSet](const std::pair<unsigned, TrackingMDNodeRef> &I) {
+        return !KnownSet.count(I.first);
+      });
 
-  if (Info.empty()) {
-    // Drop our entry at the store.
-    InstructionMetadata.erase(this);
-    setHasMetadataHashEntry(false);
-  }
+  if (Attachments->empty())
+    clearMetadataAttachments();
 }
 
 void Instruction::setMetadata(unsigned KindID, MDNode *Node) {
@@ -1231,31 +1225,21 @@ void Instruction::setMetadata(unsigned KindID, MDNode *Node) {
 
   // Handle the case when we're adding/updating metadata on an instruction.
   if (Node) {
-    auto &Info = getContext().pImpl->InstructionMetadata[this];
-    assert(!Info.empty() == hasMetadataHashEntry() &&
-           "HasMetadata bit is wonked");
-    if (Info.empty())
-      setHasMetadataHashEntry(true);
-    Info.set(KindID, *Node);
+    if (!Attachments)
+      Attachments = new MDAttachmentMap();
+    Attachments->set(KindID, *Node);
     return;
   }
 
   // Otherwise, we're removing metadata from an instruction.
-  assert((hasMetadataHashEntry() ==
-          (getContext().pImpl->InstructionMetadata.count(this) > 0)) &&
-         "HasMetadata bit out of date!");
-  if (!hasMetadataHashEntry())
+  if (!Attachments)
     return; // Nothing to remove!
-  auto &Info = getContext().pImpl->InstructionMetadata[this];
 
   // Handle removal of an existing value.
-  Info.erase(KindID);
-
-  if (!Info.empty())
-    return;
+  Attachments->erase(KindID);
 
-  getContext().pImpl->InstructionMetadata.erase(this);
-  setHasMetadataHashEntry(false);
+  if (Attachments->empty())
+    clearMetadataAttachments();
 }
 
 void Instruction::setAAMetadata(const AAMDNodes &N) {
@@ -1269,12 +1253,10 @@ MDNode *Instruction::getMetadataImpl(unsigned KindID) const {
   if (KindID == LLVMContext::MD_dbg)
     return DbgLoc.getAsMDNode();
 
-  if (!hasMetadataHashEntry())
+  if (!Attachments)
     return nullptr;
-  auto &Info = getContext().pImpl->InstructionMetadata[this];
-  assert(!Info.empty() && "bit out of sync with hash table");
-
-  return Info.lookup(KindID);
+  assert(!Attachments->empty() && "Expected attachments to be dropped");
+  return Attachments->lookup(KindID);
 }
 
 void Instruction::getAllMetadataImpl(
@@ -1285,27 +1267,19 @@ void Instruction::getAllMetadataImpl(
   if (DbgLoc) {
     Result.push_back(
         std::make_pair((unsigned)LLVMContext::MD_dbg, DbgLoc.getAsMDNode()));
-    if (!hasMetadataHashEntry())
+    if (!Attachments)
       return;
   }
 
-  assert(hasMetadataHashEntry() &&
-         getContext().pImpl->InstructionMetadata.count(this) &&
-         "Shouldn't have called this");
-  const auto &Info = getContext().pImpl->InstructionMetadata.find(this)->second;
-  assert(!Info.empty() && "Shouldn't have called this");
-  Info.getAll(Result);
+  assert(Attachments && !Attachments->empty() && "Shouldn't have called this");
+  Attachments->getAll(Result);
 }
 
 void Instruction::getAllMetadataOtherThanDebugLocImpl(
     SmallVectorImpl<std::pair<unsigned, MDNode *>> &Result) const {
   Result.clear();
-  assert(hasMetadataHashEntry() &&
-         getContext().pImpl->InstructionMetadata.count(this) &&
-         "Shouldn't have called this");
-  const auto &Info = getContext().pImpl->InstructionMetadata.find(this)->second;
-  assert(!Info.empty() && "Shouldn't have called this");
-  Info.getAll(Result);
+  assert(Attachments && !Attachments->empty() && "Shouldn't have called this");
+  Attachments->getAll(Result);
 }
 
 bool Instruction::extractProfMetadata(uint64_t &TrueVal,
@@ -1369,10 +1343,10 @@ bool Instruction::extractProfTotalWeight(uint64_t &TotalVal) const {
   return false;
 }
 
-void Instruction::clearMetadataHashEntries() {
-  assert(hasMetadataHashEntry() && "Caller should check");
-  getContext().pImpl->InstructionMetadata.erase(this);
-  setHasMetadataHashEntry(false);
+void Instruction::clearMetadataAttachments() {
+  assert(Attachments && "Caller should check");
+  delete Attachments;
+  Attachments = nullptr;
 }
 
 void GlobalObject::getMetadata(unsigned KindID,
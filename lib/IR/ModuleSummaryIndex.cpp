@@ -60,6 +60,20 @@ void ModuleSummaryIndex::collectDefinedGVSummariesPerModule(
   }
 }
 
+void ModuleSummaryIndex::sortSummaryLists() {
+  for (auto &GlobalList : *this) {
+    auto &SummaryList = GlobalList.second.SummaryList;
+    if (SummaryList.size() < 2)
+      continue;
+    std::stable_sort(SummaryList.begin(), SummaryList.end(),
+                     [&](const std::unique_ptr<GlobalValueSummary> &A,
+                         const std::unique_ptr<GlobalValueSummary> &B) {
+                       return getModuleId(A->modulePath()) <
+                              getModuleId(B->modulePath());
+                     });
+  }
+}
+
 GlobalValueSummary *
 ModuleSummaryIndex::getGlobalValueSummary(uint64_t ValueGUID,
                                           bool PerModuleIndex) const {
@@ -13,11 +13,14 @@
 
 #include "llvm/LTO/Caching.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CacheManifest.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 
 using namespace llvm;
 using namespace llvm::lto;
@@ -27,6 +30,17 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
   if (std::error_code EC = sys::fs::create_directories(CacheDirectoryPath))
     return errorCodeToError(EC);
 
+  // The cache keeps a manifest of its entries, which lets pruneCache() prune it
+  // without walking the directory (see include/llvm/Support/CacheManifest.h).
+  // A cache directory that doesn't have one yet gets it when the first entry
+  // is written to it. Hits are only recorded once it has one.
+  struct ManifestState {
+    llvm::once_flag Created;
+    std::atomic<bool> Exists;
+  };
+  auto Manifest = std::make_shared<ManifestState>();
+  Manifest->Exists = CacheManifest::exists(CacheDirectoryPath);
+
   return [=](unsigned Task, StringRef Key) -> AddStreamFn {
     // This choice of file name allows the cache to be pruned (see pruneCache()
     // in include/llvm/Support/CachePruning.h).
@@ -36,6 +50,9 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
     ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
         MemoryBuffer::getFile(EntryPath);
     if (MBOrErr) {
+      if (Manifest->Exists)
+        CacheManifest::recordAccess(CacheDirectoryPath, Key,
+                                    (*MBOrErr)->getBufferSize());
       AddBuffer(Task, std::move(*MBOrErr));
       return AddStreamFn();
     }
@@ -50,14 +67,19 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
       AddBufferFn AddBuffer;
       sys::fs::TempFile TempFile;
       std::string EntryPath;
+      std::string CacheDirectoryPath;
+      std::string Key;
+      std::shared_ptr<ManifestState> Manifest;
       unsigned Task;
 
       CacheStream(std::unique_ptr<raw_pwrite_stream> OS, AddBufferFn AddBuffer,
                   sys::fs::TempFile TempFile, std::string EntryPath,
-                  unsigned Task)
+                  std::string CacheDirectoryPath, std::string Key,
+                  std::shared_ptr<ManifestState> Manifest, unsigned Task)
           : NativeObjectStream(std::move(OS)), AddBuffer(std::move(AddBuffer)),
             TempFile(std::move(TempFile)), EntryPath(std::move(EntryPath)),
-            Task(Task) {}
+            CacheDirectoryPath(std::move(CacheDirectoryPath)),
+            Key(std::move(Key)), Manifest(std::move(Manifest)), Task(Task) {}
 
       ~CacheStream() {
         // Make sure the stream is closed before committing it.
@@ -73,6 +95,14 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
                              TempFile.TmpName + ": " +
                              MBOrErr.getError().message() + "\n");
 
+        llvm::call_once(Manifest->Created, [&] {
+          if (Manifest->Exists || CacheManifest::exists(CacheDirectoryPath))
+            Manifest->Exists = true;
+          else if (Error E = CacheManifest::create(CacheDirectoryPath))
+            consumeError(std::move(E));
+          else
+            Manifest->Exists = true;
+        });
         // On POSIX systems, this will atomically replace the destination if
         // it already exists. We try to emulate this on Windows, but this may
         // fail with a permission denied error (for example, if the destination
@@ -82,6 +112,7 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
         // AddBuffer a copy of the bytes we wrote in that case. We do this
         // instead of just using the existing file, because the pruner might
         // delete the file before we get a chance to use it.
+        bool Kept = true;
         Error E = TempFile.keep(EntryPath);
         E = handleErrors(std::move(E), [&](const ECError &E) -> Error {
           std::error_code EC = E.convertToErrorCode();
@@ -95,6 +126,7 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
           // FIXME: should we consume the discard error?
           consumeError(TempFile.discard());
 
+          Kept = false;
           return Error::success();
         });
 
@@ -103,6 +135,14 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
                              TempFile.TmpName + " to " + EntryPath + ": " +
                              toString(std::move(E)) + "\n");
 
+        // Record the entry once it is in place. Recording it first would let a
+        // pruner that evicts an older copy in between leave it unrecorded. If
+        // the process dies before recording it, the manifest's periodic walk
+        // of the directory picks it up.
+        if (Kept && Manifest->Exists)
+          CacheManifest::recordInsert(CacheDirectoryPath, Key,
+                                      (*MBOrErr)->getBufferSize());
+
         AddBuffer(Task, std::move(*MBOrErr));
       }
     };
@@ -121,7 +161,8 @@ Expected<NativeObjectCache> lto::localCache(StringRef CacheDirectoryPath,
       // This CacheStream will move the temporary file into the cache when done.
       return llvm::make_unique<CacheStream>(
           llvm::make_unique<raw_fd_ostream>(Temp->FD, /* ShouldClose */ false),
-          AddBuffer, std::move(*Temp), EntryPath.str(), Task);
+          AddBuffer, std::move(*Temp), EntryPath.str(), CacheDirectoryPath,
+          Key, Manifest, Task);
     };
   };
 }
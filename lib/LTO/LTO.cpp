@@ -42,6 +42,7 @@
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Utils/SplitModule.h"
 
+#include <mutex>
 #include <set>
 
 using namespace llvm;
@@ -54,6 +55,11 @@ static cl::opt<bool>
     DumpThinCGSCCs("dump-thin-cg-sccs", cl::init(false), cl::Hidden,
                    cl::desc("Dump the SCCs in the ThinLTO index's callgraph"));
 
+static cl::opt<unsigned> ThinLTOIndexThreads(
+    "thinlto-index-threads", cl::init(1), cl::Hidden, cl::value_desc("N"),
+    cl::desc("Read the ThinLTO summaries and run the thin link analyses on N "
+             "threads"));
+
 // The values are (type identifier, summary) pairs.
 typedef DenseMap<
     GlobalValue::GUID,
@@ -275,6 +281,37 @@ static void computeCacheKey(
   Key = toHex(Hasher.result());
 }
 
+// Call \p Fn for each value in \p Index, on \p ThreadCount threads if it is
+// greater than 1.
+static void forEachGlobalValue(
+    ModuleSummaryIndex &Index, unsigned ThreadCount,
+    function_ref<void(GlobalValueSummaryMapTy::value_type &)> Fn) {
+  if (ThreadCount <= 1) {
+    for (auto &I : Index)
+      Fn(I);
+    return;
+  }
+
+  std::vector<GlobalValueSummaryMapTy::value_type *> Values;
+  Values.reserve(Index.size());
+  for (auto &I : Index)
+    Values.push_back(&I);
+
+  // Use a few chunks per thread to even out the lengths of the summary lists.
+  size_t ChunkSize = std::max<size_t>(
+      1024, (Values.size() + 4 * ThreadCount - 1) / (4 * ThreadCount));
+  ThreadPool Pool(ThreadCount);
+  for (size_t Begin = 0; Begin < Values.size(); Begin += ChunkSize) {
+    auto Chunk = makeArrayRef(Values).slice(
+        Begin, std::min(ChunkSize, Values.size() - Begin));
+    Pool.async([Chunk, Fn] {
+      for (auto *I : Chunk)
+        Fn(*I);
+    });
+  }
+  Pool.wait();
+}
+
 static void thinLTOResolveWeakForLinkerGUID(
     GlobalValueSummaryList &GVSummaryList, GlobalValue::GUID GUID,
     DenseSet<GlobalValueSummary *> &GlobalInvolvedWithAlias,
@@ -319,7 +356,8 @@ void llvm::thinLTOResolveWeakForLinkerInIndex(
     function_ref<bool(GlobalValue::GUID, const GlobalValueSummary *)>
         isPrevailing,
     function_ref<void(StringRef, GlobalValue::GUID, GlobalValue::LinkageTypes)>
-        recordNewLinkage) {
+        recordNewLinkage,
+    unsigned ThreadCount) {
   // We won't optimize the globals that are referenced by an alias for now
   // Ideally we should turn the alias into a global and duplicate the definition
   // when needed.
@@ -329,10 +367,12 @@ void llvm::thinLTOResolveWeakForLinkerInIndex(
       if (auto AS = dyn_cast<AliasSummary>(S.get()))
         GlobalInvolvedWithAlias.insert(&AS->getAliasee());
 
-  for (auto &I : Index)
-    thinLTOResolveWeakForLinkerGUID(I.second.SummaryList, I.first,
-                                    GlobalInvolvedWithAlias, isPrevailing,
-                                    recordNewLinkage);
+  forEachGlobalValue(
+      Index, ThreadCount, [&](GlobalValueSummaryMapTy::value_type &I) {
+        thinLTOResolveWeakForLinkerGUID(I.second.SummaryList, I.first,
+                                        GlobalInvolvedWithAlias, isPrevailing,
+                                        recordNewLinkage);
+      });
 }
 
 static void thinLTOInternalizeAndPromoteGUID(
@@ -351,9 +391,13 @@ static void thinLTOInternalizeAndPromoteGUID(
 // as external and non-exported values as internal.
 void llvm::thinLTOInternalizeAndPromoteInIndex(
     ModuleSummaryIndex &Index,
-    function_ref<bool(StringRef, GlobalValue::GUID)> isExported) {
-  for (auto &I : Index)
-    thinLTOInternalizeAndPromoteGUID(I.second.SummaryList, I.first, isExported);
+    function_ref<bool(StringRef, GlobalValue::GUID)> isExported,
+    unsigned ThreadCount) {
+  forEachGlobalValue(
+      Index, ThreadCount, [&](GlobalValueSummaryMapTy::value_type &I) {
+        thinLTOInternalizeAndPromoteGUID(I.second.SummaryList, I.first,
+                                         isExported);
+      });
 }
 
 // Requires a destructor for std::vector<InputModule>.
@@ -411,7 +455,10 @@ LTO::LTO(Config Conf, ThinBackend Backend,
       ThinLTO(std::move(Backend)) {}
 
 // Requires a destructor for MapVector<BitcodeModule>.
-LTO::~LTO() = default;
+LTO::~LTO() {
+  // The summaries may still be read on the thread pool if run() wasn't called.
+  consumeError(waitForSummaries());
+}
 
 // Add the symbols in the given module to the GlobalResolutions map, and resolve
 // their partitions.
@@ -712,11 +759,9 @@ Error LTO::linkRegularLTO(RegularLTOState::AddedModule Mod,
 Error LTO::addThinLTO(BitcodeModule BM, ArrayRef<InputFile::Symbol> Syms,
                       const SymbolResolution *&ResI,
                       const SymbolResolution *ResE) {
-  if (Error Err =
-          BM.readSummary(ThinLTO.CombinedIndex, BM.getModuleIdentifier(),
-                         ThinLTO.ModuleMap.size()))
-    return Err;
-
+  // The values whose summaries in this module the resolutions change, once
+  // the summaries are read.
+  std::vector<GlobalValue::GUID> RedefinedGUIDs, LocalGUIDs;
   for (const InputFile::Symbol &Sym : Syms) {
     assert(ResI != ResE);
     SymbolResolution Res = *ResI++;
@@ -727,41 +772,95 @@ Error LTO::addThinLTO(BitcodeModule BM, ArrayRef<InputFile::Symbol> Syms,
       if (Res.Prevailing) {
         ThinLTO.PrevailingModuleForGUID[GUID] = BM.getModuleIdentifier();
 
-        // For linker redefined symbols (via --wrap or --defsym) we want to
-        // switch the linkage to `weak` to prevent IPOs from happening.
-        // Find the summary in the module for this very GV and record the new
-        // linkage so that we can switch it when we import the GV.
         if (Res.LinkerRedefined)
-          if (auto S = ThinLTO.CombinedIndex.findSummaryInModule(
-                  GUID, BM.getModuleIdentifier()))
-            S->setLinkage(GlobalValue::WeakAnyLinkage);
+          RedefinedGUIDs.push_back(GUID);
       }
 
-      // If the linker resolved the symbol to a local definition then mark it
-      // as local in the summary for the module we are adding.
-      if (Res.FinalDefinitionInLinkageUnit) {
-        if (auto S = ThinLTO.CombinedIndex.findSummaryInModule(
-                GUID, BM.getModuleIdentifier())) {
-          S->setDSOLocal(true);
-        }
-      }
+      if (Res.FinalDefinitionInLinkageUnit)
+        LocalGUIDs.push_back(GUID);
     }
   }
 
+  uint64_t ModuleId = ThinLTO.ModuleMap.size();
   if (!ThinLTO.ModuleMap.insert({BM.getModuleIdentifier(), BM}).second)
     return make_error<StringError>(
         "Expected at most one ThinLTO module per bitcode file",
         inconvertibleErrorCode());
 
+  ModuleSummaryIndex &Index = ThinLTO.CombinedIndex;
+  auto ReadSummary = [&Index, BM, ModuleId, RedefinedGUIDs,
+                      LocalGUIDs]() -> Error {
+    BitcodeModule Mod = BM;
+    StringRef ModulePath = Mod.getModuleIdentifier();
+    if (Error Err = Mod.readSummary(Index, ModulePath, ModuleId))
+      return Err;
+
+    // For linker redefined symbols (via --wrap or --defsym) we want to
+    // switch the linkage to `weak` to prevent IPOs from happening.
+    // Find the summary in the module for this very GV and record the new
+    // linkage so that we can switch it when we import the GV.
+    for (GlobalValue::GUID GUID : RedefinedGUIDs)
+      if (auto S = Index.findSummaryInModule(GUID, ModulePath))
+        S->setLinkage(GlobalValue::WeakAnyLinkage);
+
+    // If the linker resolved the symbol to a local definition then mark it
+    // as local in the summary for the module we are adding.
+    for (GlobalValue::GUID GUID : LocalGUIDs)
+      if (auto S = Index.findSummaryInModule(GUID, ModulePath))
+        S->setDSOLocal(true);
+    return Error::success();
+  };
+
+  if (ThinLTOIndexThreads <= 1)
+    return ReadSummary();
+
+  // Read the summaries on the thread pool while the linker adds the other
+  // modules. Only this module's summaries are updated after the read, so
+  // the reads don't depend on each other.
+  if (!ThinLTO.SummaryReaders) {
+    Index.setThreadSafe(true);
+    ThinLTO.SummaryReaders = llvm::make_unique<ThreadPool>(ThinLTOIndexThreads);
+  }
+  ThinLTO.SummaryErrors.emplace_back();
+  Optional<Error> &Result = ThinLTO.SummaryErrors.back();
+  ThinLTO.SummaryReaders->async(
+      [&Result, ReadSummary] { Result.emplace(ReadSummary()); });
   return Error::success();
 }
 
+// Wait for the summaries that are read on the thread pool and return the
+// error of the first module that failed to read.
+Error LTO::waitForSummaries() {
+  if (!ThinLTO.SummaryReaders)
+    return Error::success();
+  ThinLTO.SummaryReaders->wait();
+  ThinLTO.SummaryReaders.reset();
+  ThinLTO.CombinedIndex.setThreadSafe(false);
+
+  // The summary lists are in the order in which the threads added to them;
+  // sort them by module as if the summaries had been read serially.
+  ThinLTO.CombinedIndex.sortSummaryLists();
+
+  Error Err = Error::success();
+  for (Optional<Error> &Result : ThinLTO.SummaryErrors) {
+    if (Err)
+      consumeError(std::move(*Result));
+    else
+      Err = std::move(*Result);
+  }
+  ThinLTO.SummaryErrors.clear();
+  return Err;
+}
+
 unsigned LTO::getMaxTasks() const {
   CalledGetMaxTasks = true;
   return RegularLTO.ParallelCodeGenParallelismLevel + ThinLTO.ModuleMap.size();
 }
 
 Error LTO::run(AddStreamFn AddStream, NativeObjectCache Cache) {
+  if (Error Err = waitForSummaries())
+    return Err;
+
   // Compute "dead" symbols, we don't want to import/export these!
   DenseSet<GlobalValue::GUID> GUIDPreservedSymbols;
   DenseMap<GlobalValue::GUID, PrevailingType> GUIDPrevailingResolutions;
@@ -788,7 +887,8 @@ Error LTO::run(AddStreamFn AddStream, NativeObjectCache Cache) {
       return PrevailingType::Unknown;
     return It->second;
   };
-  computeDeadSymbols(ThinLTO.CombinedIndex, GUIDPreservedSymbols, isPrevailing);
+  computeDeadSymbols(ThinLTO.CombinedIndex, GUIDPreservedSymbols, isPrevailing,
+                     ThinLTOIndexThreads);
 
   if (auto E = runRegularLTO(AddStream))
     return E;
@@ -896,6 +996,13 @@ class InProcessThinBackend : public ThinBackendProc {
   Optional<Error> Err;
   std::mutex ErrMu;
 
+  /// Looks the modules up in the cache, if there is one, and hands the ones
+  /// that miss to BackendThreadPool. This keeps the backend threads busy while
+  /// a slow cache, such as a shared one (see SharedCache.h), answers lookups.
+  /// Declared last, so that lookups still running on destruction can queue
+  /// their backends.
+  std::unique_ptr<ThreadPool> CacheLookupPool;
+
 public:
   InProcessThinBackend(
       Config &Conf, ModuleSummaryIndex &CombinedIndex,
@@ -917,69 +1024,37 @@ public:
     for (auto &Name : CombinedIndex.cfiFunctionDecls())
       CfiFunctionDecls.insert(
           GlobalValue::getGUID(GlobalValue::dropLLVMManglingEscape(Name)));
+    if (this->Cache)
+      CacheLookupPool = llvm::make_unique<ThreadPool>(ThinLTOParallelismLevel);
   }
 
   Error runThinLTOBackendThread(
-      AddStreamFn AddStream, NativeObjectCache Cache, unsigned Task,
-      BitcodeModule BM, ModuleSummaryIndex &CombinedIndex,
+      AddStreamFn AddStream, unsigned Task, BitcodeModule BM,
+      ModuleSummaryIndex &CombinedIndex,
       const FunctionImporter::ImportMapTy &ImportList,
-      const FunctionImporter::ExportSetTy &ExportList,
-      const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> &ResolvedODR,
       const GVSummaryMapTy &DefinedGlobals,
-      MapVector<StringRef, BitcodeModule> &ModuleMap,
-      const TypeIdSummariesByGuidTy &TypeIdSummariesByGuid) {
-    auto RunThinBackend = [&](AddStreamFn AddStream) {
-      LTOLLVMContext BackendContext(Conf);
-      Expected<std::unique_ptr<Module>> MOrErr = BM.parseModule(BackendContext);
-      if (!MOrErr)
-        return MOrErr.takeError();
-
-      return thinBackend(Conf, Task, AddStream, **MOrErr, CombinedIndex,
-                         ImportList, DefinedGlobals, ModuleMap);
-    };
-
-    auto ModuleID = BM.getModuleIdentifier();
-
-    if (!Cache || !CombinedIndex.modulePaths().count(ModuleID) ||
-        all_of(CombinedIndex.getModuleHash(ModuleID),
-               [](uint32_t V) { return V == 0; }))
-      // Cache disabled or no entry for this module in the combined index or
-      // no module hash.
-      return RunThinBackend(AddStream);
-
-    SmallString<40> Key;
-    // The module may be cached, this helps handling it.
-    computeCacheKey(Key, Conf, CombinedIndex, ModuleID, ImportList, ExportList,
-                    ResolvedODR, DefinedGlobals, TypeIdSummariesByGuid,
-                    CfiFunctionDefs, CfiFunctionDecls);
-    if (AddStreamFn CacheAddStream = Cache(Task, Key))
-      return RunThinBackend(CacheAddStream);
-
-    return Error::success();
+      MapVector<StringRef, BitcodeModule> &ModuleMap) {
+    LTOLLVMContext BackendContext(Conf);
+    Expected<std::unique_ptr<Module>> MOrErr = BM.parseModule(BackendContext);
+    if (!MOrErr)
+      return MOrErr.takeError();
+
+    return thinBackend(Conf, Task, AddStream, **MOrErr, CombinedIndex,
+                       ImportList, DefinedGlobals, ModuleMap);
   }
 
-  Error start(
-      unsigned Task, BitcodeModule BM,
-      const FunctionImporter::ImportMapTy &ImportList,
-      const FunctionImporter::ExportSetTy &ExportList,
-      const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> &ResolvedODR,
-      MapVector<StringRef, BitcodeModule> &ModuleMap) override {
-    StringRef ModulePath = BM.getModuleIdentifier();
-    assert(ModuleToDefinedGVSummaries.count(ModulePath));
-    const GVSummaryMapTy &DefinedGlobals =
-        ModuleToDefinedGVSummaries.find(ModulePath)->second;
+  void startBackend(AddStreamFn AddStream, unsigned Task, BitcodeModule BM,
+                    const FunctionImporter::ImportMapTy &ImportList,
+                    const GVSummaryMapTy &DefinedGlobals,
+                    MapVector<StringRef, BitcodeModule> &ModuleMap) {
     BackendThreadPool.async(
         [=](BitcodeModule BM, ModuleSummaryIndex &CombinedIndex,
             const FunctionImporter::ImportMapTy &ImportList,
-            const FunctionImporter::ExportSetTy &ExportList,
-            const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes>
-                &ResolvedODR,
             const GVSummaryMapTy &DefinedGlobals,
-            MapVector<StringRef, BitcodeModule> &ModuleMap,
-            const TypeIdSummariesByGuidTy &TypeIdSummariesByGuid) {
-          Error E = runThinLTOBackendThread(
-              AddStream, Cache, Task, BM, CombinedIndex, ImportList, ExportList,
-              ResolvedODR, DefinedGlobals, ModuleMap, TypeIdSummariesByGuid);
+            MapVector<StringRef, BitcodeModule> &ModuleMap) {
+          Error E = runThinLTOBackendThread(AddStream, Task, BM, CombinedIndex,
+                                            ImportList, DefinedGlobals,
+                                            ModuleMap);
           if (E) {
             std::unique_lock<std::mutex> L(ErrMu);
             if (Err)
@@ -988,13 +1063,49 @@ public:
               Err = std::move(E);
           }
         },
-        BM, std::ref(CombinedIndex), std::ref(ImportList), std::ref(ExportList),
-        std::ref(ResolvedODR), std::ref(DefinedGlobals), std::ref(ModuleMap),
-        std::ref(TypeIdSummariesByGuid));
+        BM, std::ref(CombinedIndex), std::ref(ImportList),
+        std::ref(DefinedGlobals), std::ref(ModuleMap));
+  }
+
+  Error start(
+      unsigned Task, BitcodeModule BM,
+      const FunctionImporter::ImportMapTy &ImportList,
+      const FunctionImporter::ExportSetTy &ExportList,
+      const std::map<GlobalValue::GUID, GlobalValue::LinkageTypes> &ResolvedODR,
+      MapVector<StringRef, BitcodeModule> &ModuleMap) override {
+    StringRef ModulePath = BM.getModuleIdentifier();
+    assert(ModuleToDefinedGVSummaries.count(ModulePath));
+    const GVSummaryMapTy &DefinedGlobals =
+        ModuleToDefinedGVSummaries.find(ModulePath)->second;
+
+    if (!CacheLookupPool || !CombinedIndex.modulePaths().count(ModulePath) ||
+        all_of(CombinedIndex.getModuleHash(ModulePath),
+               [](uint32_t V) { return V == 0; })) {
+      // Cache disabled or no entry for this module in the combined index or
+      // no module hash.
+      startBackend(AddStream, Task, BM, ImportList, DefinedGlobals, ModuleMap);
+      return Error::success();
+    }
+
+    CacheLookupPool->async([=, &ImportList, &ExportList, &ResolvedODR,
+                            &DefinedGlobals, &ModuleMap] {
+      SmallString<40> Key;
+      // The module may be cached, this helps handling it.
+      computeCacheKey(Key, Conf, CombinedIndex, ModulePath, ImportList,
+                      ExportList, ResolvedODR, DefinedGlobals,
+                      TypeIdSummariesByGuid, CfiFunctionDefs,
+                      CfiFunctionDecls);
+      if (AddStreamFn CacheAddStream = Cache(Task, Key))
+        startBackend(CacheAddStream, Task, BM, ImportList, DefinedGlobals,
+                     ModuleMap);
+    });
     return Error::success();
   }
 
   Error wait() override {
+    // Lookups that miss start backends, so wait for them first.
+    if (CacheLookupPool)
+      CacheLookupPool->wait();
     BackendThreadPool.wait();
     if (Err)
       return std::move(*Err);
@@ -1138,7 +1249,7 @@ Error LTO::runThinLTO(AddStreamFn AddStream, NativeObjectCache Cache) {
 
   if (Conf.OptLevel > 0)
     ComputeCrossModuleImport(ThinLTO.CombinedIndex, ModuleToDefinedGVSummaries,
-                             ImportLists, ExportLists);
+                             ImportLists, ExportLists, ThinLTOIndexThreads);
 
   // Figure out which symbols need to be internalized. This also needs to happen
   // at -O0 because summary-based DCE is implemented using internalization, and
@@ -1170,19 +1281,22 @@ Error LTO::runThinLTO(AddStreamFn AddStream, NativeObjectCache Cache) {
             ExportList->second.count(GUID)) ||
            ExportedGUIDs.count(GUID);
   };
-  thinLTOInternalizeAndPromoteInIndex(ThinLTO.CombinedIndex, isExported);
+  thinLTOInternalizeAndPromoteInIndex(ThinLTO.CombinedIndex, isExported,
+                                      ThinLTOIndexThreads);
 
   auto isPrevailing = [&](GlobalValue::GUID GUID,
                           const GlobalValueSummary *S) {
-    return ThinLTO.PrevailingModuleForGUID[GUID] == S->modulePath();
+    return ThinLTO.PrevailingModuleForGUID.lookup(GUID) == S->modulePath();
   };
+  std::mutex ResolvedODRMutex;
   auto recordNewLinkage = [&](StringRef ModuleIdentifier,
                               GlobalValue::GUID GUID,
                               GlobalValue::LinkageTypes NewLinkage) {
+    std::lock_guard<std::mutex> Lock(ResolvedODRMutex);
     ResolvedODR[ModuleIdentifier][GUID] = NewLinkage;
   };
   thinLTOResolveWeakForLinkerInIndex(ThinLTO.CombinedIndex, isPrevailing,
-                                     recordNewLinkage);
+                                     recordNewLinkage, ThinLTOIndexThreads);
 
   std::unique_ptr<ThinBackendProc> BackendProc =
       ThinLTO.Backend(Conf, ThinLTO.CombinedIndex, ModuleToDefinedGVSummaries,
@@ -576,7 +576,7 @@ bool LTOCodeGenerator::compileOptimized(ArrayRef<raw_pwrite_stream *> Out) {
   // MergedModule.
   MergedModule = splitCodeGen(std::move(MergedModule), Out, {},
                               [&]() { return createTargetMachine(); }, FileType,
-                              ShouldRestoreGlobalsLinkage);
+                              ShouldRestoreGlobalsLinkage, CodeGenThreads);
 
   // If statistics were requested, print them out after codegen.
   if (llvm::AreStatisticsEnabled())
@@ -0,0 +1,450 @@
+//===-SharedCache.cpp - ThinLTO cache shared between links ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a ThinLTO cache backed by a store shared between links,
+// and a client for the reference cache server.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/LTO/SharedCache.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cerrno>
+#include <chrono>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+using namespace llvm::lto;
+
+SharedCacheStore::~SharedCacheStore() = default;
+
+void SharedCacheStats::print(raw_ostream &OS) const {
+  uint64_t Lookups = Hits + Misses + LookupErrors;
+  OS << "Shared cache statistics:\n"
+     << "  lookups: " << Lookups << " (" << Hits << " hits, " << Misses
+     << " misses, " << LookupErrors << " errors)\n"
+     << "  stores: " << Stores + StoreErrors << " (" << StoreErrors
+     << " errors)\n"
+     << "  bytes fetched: " << BytesFetched << '\n'
+     << "  bytes stored: " << BytesStored << '\n';
+  if (Lookups)
+    OS << "  average lookup latency: "
+       << format("%.1f", double(LookupMicroseconds) / Lookups) << "us\n";
+  if (Stores + StoreErrors)
+    OS << "  average store latency: "
+       << format("%.1f", double(StoreMicroseconds) / (Stores + StoreErrors))
+       << "us\n";
+}
+
+namespace {
+
+/// Microseconds elapsed since \p Start.
+uint64_t microsecondsSince(std::chrono::steady_clock::time_point Start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - Start)
+      .count();
+}
+
+/// The state shared by the copies of a cache returned by sharedCache().
+struct SharedCacheState {
+  std::shared_ptr<SharedCacheStore> Store;
+  AddBufferFn AddBuffer;
+  NativeObjectCache Local;
+  SharedCacheStats *Stats;
+  /// Runs the stores, so that links don't wait for them. Destroying the pool
+  /// waits for them to complete.
+  ThreadPool Uploads;
+
+  void put(std::string Key, std::string Object) {
+    std::shared_ptr<SharedCacheStore> Store = this->Store;
+    SharedCacheStats *Stats = this->Stats;
+    Uploads.async([=] {
+      auto Start = std::chrono::steady_clock::now();
+      Error E = Store->put(Key, Object);
+      if (!Stats) {
+        consumeError(std::move(E));
+        return;
+      }
+      Stats->StoreMicroseconds += microsecondsSince(Start);
+      if (E) {
+        consumeError(std::move(E));
+        ++Stats->StoreErrors;
+        return;
+      }
+      ++Stats->Stores;
+      Stats->BytesStored += Object.size();
+    });
+  }
+};
+
+/// Collects an object built by the link, then hands it to the link and to the
+/// shared store.
+struct SharedCacheStream : NativeObjectStream {
+  std::shared_ptr<SharedCacheState> State;
+  AddStreamFn LocalAddStream;
+  SmallString<0> Buffer;
+  std::string Key;
+  unsigned Task;
+
+  SharedCacheStream(std::shared_ptr<SharedCacheState> State,
+                    AddStreamFn LocalAddStream, std::string Key,
+                    unsigned Task)
+      : NativeObjectStream(nullptr), State(std::move(State)),
+        LocalAddStream(std::move(LocalAddStream)), Key(std::move(Key)),
+        Task(Task) {
+    OS = llvm::make_unique<raw_svector_ostream>(Buffer);
+  }
+
+  ~SharedCacheStream() {
+    OS.reset();
+    State->put(Key, Buffer.str());
+    if (LocalAddStream)
+      *LocalAddStream(Task)->OS << Buffer;
+    else
+      State->AddBuffer(Task, MemoryBuffer::getMemBufferCopy(Buffer));
+  }
+};
+
+} // end anonymous namespace
+
+Expected<NativeObjectCache>
+lto::sharedCache(std::shared_ptr<SharedCacheStore> Store, AddBufferFn AddBuffer,
+                 NativeObjectCache Local, SharedCacheStats *Stats) {
+  auto State = std::make_shared<SharedCacheState>();
+  State->Store = std::move(Store);
+  State->AddBuffer = std::move(AddBuffer);
+  State->Local = std::move(Local);
+  State->Stats = Stats;
+
+  return [=](unsigned Task, StringRef Key) -> AddStreamFn {
+    // A local hit adds the object to the link itself.
+    AddStreamFn LocalAddStream;
+    if (State->Local) {
+      LocalAddStream = State->Local(Task, Key);
+      if (!LocalAddStream)
+        return AddStreamFn();
+    }
+
+    auto Start = std::chrono::steady_clock::now();
+    Expected<std::unique_ptr<MemoryBuffer>> ObjectOrErr =
+        State->Store->get(Key);
+    if (Stats)
+      Stats->LookupMicroseconds += microsecondsSince(Start);
+    if (!ObjectOrErr) {
+      consumeError(ObjectOrErr.takeError());
+      if (Stats)
+        ++Stats->LookupErrors;
+    } else if (std::unique_ptr<MemoryBuffer> Object = std::move(*ObjectOrErr)) {
+      if (Stats) {
+        ++Stats->Hits;
+        Stats->BytesFetched += Object->getBufferSize();
+      }
+      if (LocalAddStream)
+        *LocalAddStream(Task)->OS << Object->getBuffer();
+      else
+        State->AddBuffer(Task, std::move(Object));
+      return AddStreamFn();
+    } else if (Stats) {
+      ++Stats->Misses;
+    }
+
+    std::string KeyStr = Key;
+    return [=](size_t Task) -> std::unique_ptr<NativeObjectStream> {
+      return llvm::make_unique<SharedCacheStream>(State, LocalAddStream,
+                                                  KeyStr, Task);
+    };
+  };
+}
+
+bool cacheserver::isValidKey(StringRef Key) {
+  return !Key.empty() && llvm::all_of(Key, isAlnum);
+}
+
+#ifdef LLVM_ON_UNIX
+
+static Error errnoError(const Twine &Msg) {
+  std::error_code EC(errno, std::generic_category());
+  return make_error<StringError>(Msg + ": " + EC.message(), EC);
+}
+
+static Error makeAddress(StringRef SocketPath, sockaddr_un &Addr) {
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Addr.sun_path))
+    return make_error<StringError>("socket path too long: " + SocketPath,
+                                   errc::filename_too_long);
+  memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+  return Error::success();
+}
+
+static Expected<int> createSocket() {
+  int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (FD < 0)
+    return errnoError("can't create socket");
+#ifdef SO_NOSIGPIPE
+  int One = 1;
+  ::setsockopt(FD, SOL_SOCKET, SO_NOSIGPIPE, &One, sizeof(One));
+#endif
+  return FD;
+}
+
+static Error writeAll(int FD, StringRef Data) {
+  // Don't get killed by SIGPIPE if the peer went away.
+#ifdef MSG_NOSIGNAL
+  const int Flags = MSG_NOSIGNAL;
+#else
+  const int Flags = 0;
+#endif
+  while (!Data.empty()) {
+    ssize_t N = ::send(FD, Data.data(), Data.size(), Flags);
+    if (N < 0) {
+      if (errno == EINTR)
+        continue;
+      return errnoError("cache server write failed");
+    }
+    Data = Data.drop_front(N);
+  }
+  return Error::success();
+}
+
+static Error readAll(int FD, char *Data, size_t Size) {
+  while (Size) {
+    ssize_t N = ::read(FD, Data, Size);
+    if (N < 0) {
+      if (errno == EINTR)
+        continue;
+      return errnoError("cache server read failed");
+    }
+    if (N == 0)
+      return make_error<StringError>("cache server connection closed",
+                                     errc::io_error);
+    Data += N;
+    Size -= N;
+  }
+  return Error::success();
+}
+
+template <typename T> static Expected<T> readInt(int FD) {
+  char Bytes[sizeof(T)];
+  if (Error E = readAll(FD, Bytes, sizeof(T)))
+    return std::move(E);
+  return support::endian::read<T, support::little>(Bytes);
+}
+
+static Error readString(int FD, uint64_t Size, std::string &S) {
+  S.resize(Size);
+  return readAll(FD, &S[0], Size);
+}
+
+Expected<int> cacheserver::listen(StringRef SocketPath) {
+  sockaddr_un Addr;
+  if (Error E = makeAddress(SocketPath, Addr))
+    return std::move(E);
+  Expected<int> FDOrErr = createSocket();
+  if (!FDOrErr)
+    return FDOrErr.takeError();
+  int FD = *FDOrErr;
+  // Remove a socket left behind by a previous server.
+  ::unlink(Addr.sun_path);
+  if (::bind(FD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0 ||
+      ::listen(FD, SOMAXCONN) < 0) {
+    Error E = errnoError("can't listen on " + SocketPath);
+    ::close(FD);
+    return std::move(E);
+  }
+  return FD;
+}
+
+Expected<cacheserver::Request> cacheserver::readRequest(int FD,
+                                                       uint64_t MaxObjectSize) {
+  Request R;
+  Expected<uint8_t> Op = readInt<uint8_t>(FD);
+  if (!Op)
+    return Op.takeError();
+  if (*Op != Get && *Op != Put)
+    return make_error<StringError>("invalid cache server request",
+                                   errc::invalid_argument);
+  R.Op = Opcode(*Op);
+  Expected<uint32_t> KeySize = readInt<uint32_t>(FD);
+  if (!KeySize)
+    return KeySize.takeError();
+  if (*KeySize > MaxKeySize)
+    return make_error<StringError>("cache server request key too long",
+                                   errc::invalid_argument);
+  if (Error E = readString(FD, *KeySize, R.Key))
+    return std::move(E);
+  if (R.Op == Put) {
+    Expected<uint64_t> Size = readInt<uint64_t>(FD);
+    if (!Size)
+      return Size.takeError();
+    if (*Size > MaxObjectSize)
+      return make_error<StringError>("cache server request object too large",
+                                     errc::invalid_argument);
+    if (Error E = readString(FD, *Size, R.Object))
+      return std::move(E);
+  }
+  return std::move(R);
+}
+
+Error cacheserver::writeResponse(int FD, Status S) {
+  char Byte = S;
+  return writeAll(FD, StringRef(&Byte, 1));
+}
+
+Error cacheserver::writeObjectResponse(int FD, StringRef Object) {
+  std::string Buffer;
+  raw_string_ostream OS(Buffer);
+  support::endian::Writer<support::little> W(OS);
+  W.write(uint8_t(Success));
+  W.write(uint64_t(Object.size()));
+  OS << Object;
+  return writeAll(FD, OS.str());
+}
+
+namespace {
+
+/// A store served by a cache server listening on a Unix domain socket.
+class CacheServerStore : public SharedCacheStore {
+public:
+  CacheServerStore(StringRef SocketPath, uint64_t MaxObjectSize)
+      : SocketPath(SocketPath), MaxObjectSize(MaxObjectSize) {}
+
+  Expected<std::unique_ptr<MemoryBuffer>> get(StringRef Key) override {
+    Expected<int> FD = sendRequest(cacheserver::Get, Key, StringRef());
+    if (!FD)
+      return FD.takeError();
+    auto CloseFD = make_scope_exit([&] { ::close(*FD); });
+
+    Expected<uint8_t> S = readInt<uint8_t>(*FD);
+    if (!S)
+      return S.takeError();
+    if (*S == cacheserver::NotFound)
+      return nullptr;
+    if (*S != cacheserver::Success)
+      return make_error<StringError>("cache server lookup failed",
+                                     errc::io_error);
+    Expected<uint64_t> Size = readInt<uint64_t>(*FD);
+    if (!Size)
+      return Size.takeError();
+    if (*Size > MaxObjectSize)
+      return make_error<StringError>("cache server response object too large",
+                                     errc::invalid_argument);
+    std::unique_ptr<WritableMemoryBuffer> MB =
+        WritableMemoryBuffer::getNewUninitMemBuffer(*Size, "llvmcache-" + Key);
+    if (Error E = readAll(*FD, MB->getBufferStart(), *Size))
+      return std::move(E);
+    return std::move(MB);
+  }
+
+  Error put(StringRef Key, StringRef Object) override {
+    Expected<int> FD = sendRequest(cacheserver::Put, Key, Object);
+    if (!FD)
+      return FD.takeError();
+    auto CloseFD = make_scope_exit([&] { ::close(*FD); });
+
+    Expected<uint8_t> S = readInt<uint8_t>(*FD);
+    if (!S)
+      return S.takeError();
+    if (*S != cacheserver::Success)
+      return make_error<StringError>("cache server store failed",
+                                     errc::io_error);
+    return Error::success();
+  }
+
+  /// Connects to the server and sends a request, returning the connection.
+  Expected<int> sendRequest(cacheserver::Opcode Op, StringRef Key,
+                            StringRef Object) {
+    sockaddr_un Addr;
+    if (Error E = makeAddress(SocketPath, Addr))
+      return std::move(E);
+    Expected<int> FDOrErr = createSocket();
+    if (!FDOrErr)
+      return FDOrErr.takeError();
+    int FD = *FDOrErr;
+    if (::connect(FD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0) {
+      Error E = errnoError("can't connect to cache server at " + SocketPath);
+      ::close(FD);
+      return std::move(E);
+    }
+
+    std::string Buffer;
+    raw_string_ostream OS(Buffer);
+    support::endian::Writer<support::little> W(OS);
+    W.write(uint8_t(Op));
+    W.write(uint32_t(Key.size()));
+    OS << Key;
+    if (Op == cacheserver::Put) {
+      W.write(uint64_t(Object.size()));
+      OS << Object;
+    }
+    if (Error E = writeAll(FD, OS.str())) {
+      ::close(FD);
+      return std::move(E);
+    }
+    return FD;
+  }
+
+private:
+  std::string SocketPath;
+  uint64_t MaxObjectSize;
+};
+
+} // end anonymous namespace
+
+Expected<std::unique_ptr<SharedCacheStore>>
+lto::connectToCacheServer(StringRef SocketPath, uint64_t MaxObjectSize) {
+  sockaddr_un Addr;
+  if (Error E = makeAddress(SocketPath, Addr))
+    return std::move(E);
+  return llvm::make_unique<CacheServerStore>(SocketPath, MaxObjectSize);
+}
+
+#else
+
+static Error notSupported() {
+  return make_error<StringError>(
+      "cache servers are only supported on Unix hosts",
+      errc::function_not_supported);
+}
+
+Expected<int> cacheserver::listen(StringRef SocketPath) {
+  return notSupported();
+}
+
+Expected<cacheserver::Request> cacheserver::readRequest(int FD,
+                                                       uint64_t MaxObjectSize) {
+  return notSupported();
+}
+
+Error cacheserver::writeResponse(int FD, Status S) { return notSupported(); }
+
+Error cacheserver::writeObjectResponse(int FD, StringRef Object) {
+  return notSupported();
+}
+
+Expected<std::unique_ptr<SharedCacheStore>>
+lto::connectToCacheServer(StringRef SocketPath, uint64_t MaxObjectSize) {
+  return notSupported();
+}
+
+#endif
@@ -34,6 +34,7 @@
 #include "llvm/LTO/LTO.h"
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Object/IRObjectFile.h"
+#include "llvm/Support/CacheManifest.h"
 #include "llvm/Support/CachePruning.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Error.h"
@@ -393,8 +394,16 @@ public:
     return MemoryBuffer::getFile(EntryPath);
   }
 
-  // Cache the Produced object file
-  void write(const MemoryBuffer &OutputBuffer) {
+  // Record a hit on \p Buffer in the manifest of the cache, which must have
+  // one (see include/llvm/Support/CacheManifest.h).
+  void recordAccess(const MemoryBuffer &Buffer) {
+    CacheManifest::recordAccess(sys::path::parent_path(EntryPath), getKey(),
+                                Buffer.getBufferSize());
+  }
+
+  // Cache the Produced object file, and record it in the manifest of the cache
+  // if \p RecordInManifest is true.
+  void write(const MemoryBuffer &OutputBuffer, bool RecordInManifest) {
     if (EntryPath.empty())
       return;
 
@@ -421,6 +430,14 @@ public:
                            " to save cached entry\n");
       OS << OutputBuffer.getBuffer();
     }
+    if (RecordInManifest)
+      CacheManifest::recordInsert(sys::path::parent_path(EntryPath), getKey(),
+                                  OutputBuffer.getBufferSize());
+  }
+
+private:
+  StringRef getKey() {
+    return sys::path::filename(EntryPath).drop_front(strlen("llvmcache-"));
   }
 };
 
@@ -957,6 +974,11 @@ void ThinLTOCodeGenerator::run() {
               return LSize > RSize;
             });
 
+  // A cache directory shared with lto::localCache() has a manifest, which
+  // must learn about the entries used and written here.
+  bool CacheHasManifest =
+      !CacheOptions.Path.empty() && CacheManifest::exists(CacheOptions.Path);
+
   // Parallel optimizer + codegen
   {
     ThreadPool Pool(ThreadCount);
@@ -984,6 +1006,8 @@ void ThinLTOCodeGenerator::run() {
 
           if (ErrOrBuffer) {
             // Cache Hit!
+            if (CacheHasManifest)
+              CacheEntry.recordAccess(*ErrOrBuffer.get());
             if (SavedObjectsDirectoryPath.empty())
               ProducedBinaries[count] = std::move(ErrOrBuffer.get());
             else
@@ -1022,7 +1046,7 @@ void ThinLTOCodeGenerator::run() {
             DisableCodeGen, SaveTempsDir, Freestanding, OptLevel, count);
 
         // Commit to the cache (if enabled)
-        CacheEntry.write(*OutputBuffer);
+        CacheEntry.write(*OutputBuffer, CacheHasManifest);
 
         if (SavedObjectsDirectoryPath.empty()) {
           // We need to generated a memory buffer for the linker.
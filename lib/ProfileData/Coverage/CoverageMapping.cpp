@@ -20,6 +20,7 @@
 #include "llvm/ADT/SmallBitVector.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ProfileData/Coverage/CoverageMappingReader.h"
 #include "llvm/ProfileData/InstrProfReader.h"
 #include "llvm/Support/Debug.h"
@@ -28,10 +29,13 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
 #include <map>
 #include <memory>
@@ -195,21 +199,36 @@ void FunctionRecordIterator::skipOtherFiles() {
     *this = FunctionRecordIterator();
 }
 
-Error CoverageMapping::loadFunctionRecord(
-    const CoverageMappingRecord &Record,
-    IndexedInstrProfReader &ProfileReader) {
+struct CoverageMapping::EvaluatedRecord {
+  enum OutcomeKind { Loaded, HashMismatch, CounterMismatch, Dropped };
+
+  OutcomeKind Outcome;
+  /// The name the function is loaded under.
+  std::string Name;
+  /// The function record, if it was loaded.
+  std::unique_ptr<FunctionRecord> Function;
+  /// The name and hash, or number of evaluated regions, of a mismatch.
+  std::pair<std::string, uint64_t> Mismatch;
+};
+
+/// Return the name the function described by \p Record is loaded under.
+static Expected<StringRef> getLoadedName(const CoverageMappingRecord &Record) {
   StringRef OrigFuncName = Record.FunctionName;
   if (OrigFuncName.empty())
     return make_error<CoverageMapError>(coveragemap_error::malformed);
 
   if (Record.Filenames.empty())
-    OrigFuncName = getFuncNameWithoutPrefix(OrigFuncName);
-  else
-    OrigFuncName = getFuncNameWithoutPrefix(OrigFuncName, Record.Filenames[0]);
+    return getFuncNameWithoutPrefix(OrigFuncName);
+  return getFuncNameWithoutPrefix(OrigFuncName, Record.Filenames[0]);
+}
 
-  // Don't load records for functions we've already seen.
-  if (!FunctionNames.insert(OrigFuncName).second)
-    return Error::success();
+/// Evaluate the regions of \p Record with the counts in \p ProfileReader.
+static Expected<CoverageMapping::EvaluatedRecord>
+evaluateRecord(const CoverageMappingRecord &Record, StringRef Name,
+               IndexedInstrProfReader &ProfileReader) {
+  using EvaluatedRecord = CoverageMapping::EvaluatedRecord;
+  EvaluatedRecord Result;
+  Result.Name = Name;
 
   CounterMappingContext Ctx(Record.Expressions);
 
@@ -218,8 +237,9 @@ Error CoverageMapping::loadFunctionRecord(
                                                 Record.FunctionHash, Counts)) {
     instrprof_error IPE = InstrProfError::take(std::move(E));
     if (IPE == instrprof_error::hash_mismatch) {
-      FuncHashMismatches.emplace_back(Record.FunctionName, Record.FunctionHash);
-      return Error::success();
+      Result.Outcome = EvaluatedRecord::HashMismatch;
+      Result.Mismatch = {Record.FunctionName, Record.FunctionHash};
+      return std::move(Result);
     } else if (IPE != instrprof_error::unknown_function)
       return make_error<InstrProfError>(IPE);
     Counts.assign(Record.MappingRegions.size(), 0);
@@ -228,23 +248,82 @@ Error CoverageMapping::loadFunctionRecord(
 
   assert(!Record.MappingRegions.empty() && "Function has no regions");
 
-  FunctionRecord Function(OrigFuncName, Record.Filenames);
+  FunctionRecord Function(Name, Record.Filenames);
   for (const auto &Region : Record.MappingRegions) {
     Expected<int64_t> ExecutionCount = Ctx.evaluate(Region.Count);
     if (auto E = ExecutionCount.takeError()) {
       consumeError(std::move(E));
-      return Error::success();
+      Result.Outcome = EvaluatedRecord::Dropped;
+      return std::move(Result);
     }
     Function.pushRegion(Region, *ExecutionCount);
   }
   if (Function.CountedRegions.size() != Record.MappingRegions.size()) {
-    FuncCounterMismatches.emplace_back(Record.FunctionName,
-                                       Function.CountedRegions.size());
+    Result.Outcome = EvaluatedRecord::CounterMismatch;
+    Result.Mismatch = {Record.FunctionName, Function.CountedRegions.size()};
+    return std::move(Result);
+  }
+
+  Result.Outcome = EvaluatedRecord::Loaded;
+  Result.Function = llvm::make_unique<FunctionRecord>(std::move(Function));
+  return std::move(Result);
+}
+
+Error CoverageMapping::loadFunctionRecord(
+    const CoverageMappingRecord &Record,
+    IndexedInstrProfReader &ProfileReader) {
+  Expected<StringRef> Name = getLoadedName(Record);
+  if (!Name)
+    return Name.takeError();
+
+  // Don't load records for functions we've already seen.
+  if (!FunctionNames.insert(*Name).second)
     return Error::success();
+
+  Expected<EvaluatedRecord> Evaluated =
+      evaluateRecord(Record, *Name, ProfileReader);
+  if (!Evaluated)
+    return Evaluated.takeError();
+  addEvaluatedRecord(std::move(*Evaluated));
+  return Error::success();
+}
+
+void CoverageMapping::addEvaluatedRecord(EvaluatedRecord &&Record) {
+  switch (Record.Outcome) {
+  case EvaluatedRecord::Loaded:
+    break;
+  case EvaluatedRecord::HashMismatch:
+    FuncHashMismatches.push_back(std::move(Record.Mismatch));
+    return;
+  case EvaluatedRecord::CounterMismatch:
+    FuncCounterMismatches.push_back(std::move(Record.Mismatch));
+    return;
+  case EvaluatedRecord::Dropped:
+    return;
   }
+  addFunctionRecord(std::move(*Record.Function));
+}
 
+void CoverageMapping::addFunctionRecord(FunctionRecord &&Function) {
   Functions.push_back(std::move(Function));
-  return Error::success();
+
+  // Index the record by the files it is defined in. A function can list a
+  // file more than once, e.g. for a macro defined in the same file.
+  unsigned RecordIndex = Functions.size() - 1;
+  for (StringRef Filename : Functions.back().Filenames) {
+    auto &RecordIndices = FilenameHash2RecordIndices[hash_value(Filename)];
+    if (RecordIndices.empty() || RecordIndices.back() != RecordIndex)
+      RecordIndices.push_back(RecordIndex);
+  }
+}
+
+std::unique_ptr<CoverageMapping>
+CoverageMapping::create(std::vector<FunctionRecord> Records) {
+  auto Coverage = std::unique_ptr<CoverageMapping>(new CoverageMapping());
+  for (FunctionRecord &Function : Records)
+    if (Coverage->FunctionNames.insert(Function.Name).second)
+      Coverage->addFunctionRecord(std::move(Function));
+  return Coverage;
 }
 
 Expected<std::unique_ptr<CoverageMapping>> CoverageMapping::load(
@@ -265,29 +344,161 @@ Expected<std::unique_ptr<CoverageMapping>> CoverageMapping::load(
   return std::move(Coverage);
 }
 
+namespace {
+
+/// The records of one object, evaluated on a worker thread.
+struct EvaluatedObject {
+  std::vector<CoverageMapping::EvaluatedRecord> Records;
+  /// Records whose counts couldn't be read, by their index in Records: they
+  /// are only an error if their function isn't loaded from an earlier record.
+  std::vector<std::pair<size_t, instrprof_error>> ProfileErrors;
+  /// An error that ends the object, after Records.
+  Error Err = Error::success();
+};
+
+} // end anonymous namespace
+
+/// Decode the coverage mapping of \p ObjectFilename and evaluate its records.
+static void evaluateObject(StringRef ObjectFilename, StringRef Arch,
+                           MemoryBufferRef ProfileBuffer,
+                           EvaluatedObject &Result) {
+  ErrorAsOutParameter ErrAsOutParam(&Result.Err);
+  auto CovMappingBufOrErr = MemoryBuffer::getFileOrSTDIN(ObjectFilename);
+  if (std::error_code EC = CovMappingBufOrErr.getError()) {
+    Result.Err = errorCodeToError(EC);
+    return;
+  }
+  auto CoverageReaderOrErr =
+      BinaryCoverageReader::create(CovMappingBufOrErr.get(), Arch);
+  if (Error E = CoverageReaderOrErr.takeError()) {
+    Result.Err = std::move(E);
+    return;
+  }
+  // Lookups in a profile reader aren't thread safe, so each object has one.
+  auto ProfileReaderOrErr = IndexedInstrProfReader::create(
+      MemoryBuffer::getMemBuffer(ProfileBuffer, /*RequiresNullTerminator=*/
+                                 false));
+  if (Error E = ProfileReaderOrErr.takeError()) {
+    Result.Err = std::move(E);
+    return;
+  }
+
+  StringSet<> Names;
+  for (auto RecordOrErr : **CoverageReaderOrErr) {
+    if (Error E = RecordOrErr.takeError()) {
+      Result.Err = std::move(E);
+      return;
+    }
+    const auto &Record = *RecordOrErr;
+    Expected<StringRef> Name = getLoadedName(Record);
+    if (!Name) {
+      Result.Err = Name.takeError();
+      return;
+    }
+    if (!Names.insert(*Name).second)
+      continue;
+
+    Expected<CoverageMapping::EvaluatedRecord> Evaluated =
+        evaluateRecord(Record, *Name, **ProfileReaderOrErr);
+    if (!Evaluated) {
+      Result.ProfileErrors.emplace_back(
+          Result.Records.size(), InstrProfError::take(Evaluated.takeError()));
+      Result.Records.emplace_back();
+      Result.Records.back().Outcome = CoverageMapping::EvaluatedRecord::Dropped;
+      Result.Records.back().Name = *Name;
+      continue;
+    }
+    Result.Records.push_back(std::move(*Evaluated));
+  }
+}
+
 Expected<std::unique_ptr<CoverageMapping>>
 CoverageMapping::load(ArrayRef<StringRef> ObjectFilenames,
-                      StringRef ProfileFilename, ArrayRef<StringRef> Arches) {
-  auto ProfileReaderOrErr = IndexedInstrProfReader::create(ProfileFilename);
+                      StringRef ProfileFilename, ArrayRef<StringRef> Arches,
+                      unsigned NumThreads) {
+  if (NumThreads == 0)
+    NumThreads = hardware_concurrency();
+  NumThreads = std::min(NumThreads, unsigned(ObjectFilenames.size()));
+
+  if (NumThreads <= 1) {
+    auto ProfileReaderOrErr = IndexedInstrProfReader::create(ProfileFilename);
+    if (Error E = ProfileReaderOrErr.takeError())
+      return std::move(E);
+    auto ProfileReader = std::move(ProfileReaderOrErr.get());
+
+    SmallVector<std::unique_ptr<CoverageMappingReader>, 4> Readers;
+    SmallVector<std::unique_ptr<MemoryBuffer>, 4> Buffers;
+    for (const auto &File : llvm::enumerate(ObjectFilenames)) {
+      auto CovMappingBufOrErr = MemoryBuffer::getFileOrSTDIN(File.value());
+      if (std::error_code EC = CovMappingBufOrErr.getError())
+        return errorCodeToError(EC);
+      StringRef Arch = Arches.empty() ? StringRef() : Arches[File.index()];
+      auto CoverageReaderOrErr =
+          BinaryCoverageReader::create(CovMappingBufOrErr.get(), Arch);
+      if (Error E = CoverageReaderOrErr.takeError())
+        return std::move(E);
+      Readers.push_back(std::move(CoverageReaderOrErr.get()));
+      Buffers.push_back(std::move(CovMappingBufOrErr.get()));
+    }
+    return load(Readers, *ProfileReader);
+  }
+
+  // Check the profile up front, as the serial path does, and share its
+  // buffer between the workers.
+  auto ProfileBufferOrErr = MemoryBuffer::getFileOrSTDIN(
+      ProfileFilename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = ProfileBufferOrErr.getError())
+    return errorCodeToError(EC);
+  std::unique_ptr<MemoryBuffer> ProfileBuffer =
+      std::move(ProfileBufferOrErr.get());
+  auto ProfileReaderOrErr = IndexedInstrProfReader::create(
+      MemoryBuffer::getMemBuffer(ProfileBuffer->getMemBufferRef(),
+                                 /*RequiresNullTerminator=*/false));
   if (Error E = ProfileReaderOrErr.takeError())
     return std::move(E);
-  auto ProfileReader = std::move(ProfileReaderOrErr.get());
-
-  SmallVector<std::unique_ptr<CoverageMappingReader>, 4> Readers;
-  SmallVector<std::unique_ptr<MemoryBuffer>, 4> Buffers;
-  for (const auto &File : llvm::enumerate(ObjectFilenames)) {
-    auto CovMappingBufOrErr = MemoryBuffer::getFileOrSTDIN(File.value());
-    if (std::error_code EC = CovMappingBufOrErr.getError())
-      return errorCodeToError(EC);
-    StringRef Arch = Arches.empty() ? StringRef() : Arches[File.index()];
-    auto CoverageReaderOrErr =
-        BinaryCoverageReader::create(CovMappingBufOrErr.get(), Arch);
-    if (Error E = CoverageReaderOrErr.takeError())
-      return std::move(E);
-    Readers.push_back(std::move(CoverageReaderOrErr.get()));
-    Buffers.push_back(std::move(CovMappingBufOrErr.get()));
+
+  // Decode the objects in parallel, then add their records in order so that
+  // the first record of each function wins, as when loading serially.
+  std::vector<EvaluatedObject> Objects(ObjectFilenames.size());
+  {
+    ThreadPool Pool(NumThreads);
+    for (const auto &File : llvm::enumerate(ObjectFilenames)) {
+      StringRef Arch = Arches.empty() ? StringRef() : Arches[File.index()];
+      Pool.async(evaluateObject, File.value(), Arch,
+                 ProfileBuffer->getMemBufferRef(),
+                 std::ref(Objects[File.index()]));
+    }
   }
-  return load(Readers, *ProfileReader);
+
+  auto Coverage = std::unique_ptr<CoverageMapping>(new CoverageMapping());
+  Error Err = Error::success();
+  for (EvaluatedObject &Object : Objects) {
+    if (Err) {
+      consumeError(std::move(Object.Err));
+      continue;
+    }
+    auto ProfileError = Object.ProfileErrors.begin();
+    for (size_t I = 0, E = Object.Records.size(); I != E && !Err; ++I) {
+      EvaluatedRecord &Record = Object.Records[I];
+      bool IsNew = Coverage->FunctionNames.insert(Record.Name).second;
+      if (ProfileError != Object.ProfileErrors.end() &&
+          ProfileError->first == I) {
+        if (IsNew)
+          Err = make_error<InstrProfError>(ProfileError->second);
+        ++ProfileError;
+        continue;
+      }
+      if (IsNew)
+        Coverage->addEvaluatedRecord(std::move(Record));
+    }
+    if (Err)
+      consumeError(std::move(Object.Err));
+    else
+      Err = std::move(Object.Err);
+  }
+  if (Err)
+    return std::move(Err);
+  return std::move(Coverage);
 }
 
 namespace {
@@ -596,11 +807,23 @@ static bool isExpansion(const CountedRegion &R, unsigned FileID) {
   return R.Kind == CounterMappingRegion::ExpansionRegion && R.FileID == FileID;
 }
 
+ArrayRef<unsigned> CoverageMapping::getImpreciseRecordIndicesForFilename(
+    StringRef Filename) const {
+  size_t FilenameHash = hash_value(Filename);
+  auto RecordIt = FilenameHash2RecordIndices.find(FilenameHash);
+  if (RecordIt == FilenameHash2RecordIndices.end())
+    return {};
+  return RecordIt->second;
+}
+
 CoverageData CoverageMapping::getCoverageForFile(StringRef Filename) const {
   CoverageData FileCoverage(Filename);
   std::vector<CountedRegion> Regions;
 
-  for (const auto &Function : Functions) {
+  // Look up the function records in the given file. Due to hash collisions on
+  // the filename, we may get back some records that are not in the file.
+  for (unsigned RecordIndex : getImpreciseRecordIndicesForFilename(Filename)) {
+    const FunctionRecord &Function = Functions[RecordIndex];
     auto MainFileID = findMainViewFileID(Filename, Function);
     auto FileIDs = gatherFileIDs(Filename, Function);
     for (const auto &CR : Function.CountedRegions)
@@ -620,7 +843,9 @@ CoverageData CoverageMapping::getCoverageForFile(StringRef Filename) const {
 std::vector<InstantiationGroup>
 CoverageMapping::getInstantiationGroups(StringRef Filename) const {
   FunctionInstantiationSetCollector InstantiationSetCollector;
-  for (const auto &Function : Functions) {
+  // Records of other files are skipped: their main view isn't in Filename.
+  for (unsigned RecordIndex : getImpreciseRecordIndicesForFilename(Filename)) {
+    const FunctionRecord &Function = Functions[RecordIndex];
     auto MainFileID = findMainViewFileID(Filename, Function);
     if (!MainFileID)
       continue;
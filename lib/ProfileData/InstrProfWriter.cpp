@@ -183,16 +183,35 @@ void InstrProfWriter::addRecord(NamedInstrProfRecord &&I, uint64_t Weight,
   addRecord(Name, Hash, std::move(I), Weight, Warn);
 }
 
+/// Returns an estimate of the memory used by \p Record, in bytes.
+static uint64_t getApproximateRecordSize(const InstrProfRecord &Record) {
+  uint64_t Size =
+      sizeof(InstrProfRecord) + Record.Counts.size() * sizeof(uint64_t);
+  for (uint32_t Kind = IPVK_First; Kind <= IPVK_Last; ++Kind) {
+    uint32_t NumValueData = Record.getNumValueData(Kind);
+    if (!NumValueData)
+      continue;
+    // Value data are kept in lists, one per site.
+    Size += Record.getNumValueSites(Kind) * sizeof(InstrProfValueSiteRecord) +
+            NumValueData * (sizeof(InstrProfValueData) + 2 * sizeof(void *));
+  }
+  return Size;
+}
+
 void InstrProfWriter::addRecord(StringRef Name, uint64_t Hash,
                                 InstrProfRecord &&I, uint64_t Weight,
                                 function_ref<void(Error)> Warn) {
-  auto &ProfileDataMap = FunctionData[Name];
+  auto Inserted = FunctionData.try_emplace(Name);
+  auto &ProfileDataMap = Inserted.first->getValue();
+  if (Inserted.second)
+    ApproximateSize += sizeof(ProfilingData) + Name.size();
 
   bool NewFunc;
   ProfilingData::iterator Where;
   std::tie(Where, NewFunc) =
       ProfileDataMap.insert(std::make_pair(Hash, InstrProfRecord()));
   InstrProfRecord &Dest = Where->second;
+  uint64_t OldSize = NewFunc ? 0 : getApproximateRecordSize(Dest);
 
   auto MapWarn = [&](instrprof_error E) {
     Warn(make_error<InstrProfError>(E));
@@ -209,6 +228,7 @@ void InstrProfWriter::addRecord(StringRef Name, uint64_t Hash,
   }
 
   Dest.sortValueData();
+  ApproximateSize += getApproximateRecordSize(Dest) - OldSize;
 }
 
 void InstrProfWriter::mergeRecordsFromWriter(InstrProfWriter &&IPW,
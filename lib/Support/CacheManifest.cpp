@@ -0,0 +1,568 @@
+//===-CacheManifest.cpp - Manifest of a cache directory -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the manifest of a cache directory.
+//
+// The snapshot and the journal are text files. The snapshot starts with a
+// header line giving the number of entries, their total size and the time of
+// the last walk of the directory. Every other line records one event, with
+// times in seconds since the epoch:
+//
+//   + <key> <size> <time>   the entry was written
+//   = <key> <size> <time>   the entry was read
+//   - <key> <size> <time>   the entry was removed
+//
+// The snapshot only holds insertions, one per entry, least recently used
+// first. Every record is appended to the journal with a single write to a file
+// opened in append mode, so several processes can share a journal. Lines that
+// can't be parsed (e.g. records torn by a crash) are ignored.
+//
+// Compaction moves the journal aside to "llvmcache.journal.compacting",
+// rewrites the snapshot with it folded in, and removes it. Records appended in
+// the meantime go to a new journal. A journal set aside by a compaction that
+// didn't finish is replayed until the next compaction folds it in.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CacheManifest.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LockFileManager.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cassert>
+#include <vector>
+
+#define DEBUG_TYPE "cache-pruning"
+
+using namespace llvm;
+
+static const char ManifestHeader[] = "llvmcache-manifest v2";
+
+/// How often compaction walks the directory for entries that were never
+/// recorded.
+static const std::time_t RescanInterval = 24 * 60 * 60;
+
+static std::time_t now() {
+  return sys::toTimeT(std::chrono::system_clock::now());
+}
+
+static SmallString<128> getPath(StringRef CacheDir, StringRef Name) {
+  SmallString<128> Path(CacheDir);
+  sys::path::append(Path, Name);
+  return Path;
+}
+
+static SmallString<128> getSnapshotPath(StringRef CacheDir) {
+  return getPath(CacheDir, "llvmcache.manifest");
+}
+
+static SmallString<128> getJournalPath(StringRef CacheDir) {
+  return getPath(CacheDir, "llvmcache.journal");
+}
+
+static SmallString<128> getCompactedJournalPath(StringRef CacheDir) {
+  return getPath(CacheDir, "llvmcache.journal.compacting");
+}
+
+/// Appends \p Record to the journal of \p CacheDir. If \p MustNotBeLost is
+/// true, this makes sure that the record wasn't written to a journal that a
+/// compaction had already set aside and may have read, by appending it again
+/// to the new journal if it was.
+static void appendRecord(StringRef CacheDir, StringRef Record,
+                         bool MustNotBeLost) {
+  SmallString<128> Path = getJournalPath(CacheDir);
+  while (true) {
+    int FD;
+    if (sys::fs::openFileForWrite(Path, FD, sys::fs::F_Append))
+      return;
+    // The stream is unbuffered so that the record is written with one write.
+    raw_fd_ostream OS(FD, /*shouldClose=*/true, /*unbuffered=*/true);
+    OS.write(Record.data(), Record.size());
+    if (OS.has_error()) {
+      OS.clear_error();
+      return;
+    }
+    if (!MustNotBeLost)
+      return;
+    sys::fs::file_status Written, Current;
+    if (sys::fs::status(FD, Written))
+      return;
+    if (!sys::fs::status(Path, Current) &&
+        Written.getUniqueID() == Current.getUniqueID())
+      return;
+  }
+}
+
+static void appendRecord(StringRef CacheDir, char Kind, StringRef Key,
+                         uint64_t Size, bool MustNotBeLost) {
+  SmallString<128> Record;
+  raw_svector_ostream(Record) << Kind << ' ' << Key << ' ' << Size << ' '
+                              << uint64_t(now()) << '\n';
+  appendRecord(CacheDir, Record, MustNotBeLost);
+}
+
+/// Reads the file at \p Path. A missing file reads as null.
+static Expected<std::unique_ptr<MemoryBuffer>> readRecords(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
+  if (!MBOrErr) {
+    if (MBOrErr.getError() == errc::no_such_file_or_directory)
+      return nullptr;
+    return errorCodeToError(MBOrErr.getError());
+  }
+  return std::move(*MBOrErr);
+}
+
+namespace {
+
+/// A line of the snapshot or the journal.
+struct Record {
+  char Kind;
+  StringRef Key;
+  uint64_t Size;
+  std::time_t Time;
+};
+
+/// The header of the snapshot.
+struct SnapshotHeader {
+  uint64_t NumEntries;
+  uint64_t TotalSize;
+  std::time_t ScanTime;
+};
+
+/// The entries of a manifest with every record applied, as compaction and
+/// create() need them.
+class EntryList {
+public:
+  struct Entry {
+    std::string Key;
+    uint64_t Size;
+    std::time_t AccessTime;
+  };
+
+  void insert(StringRef Key, uint64_t Size, std::time_t AccessTime);
+  void access(StringRef Key, std::time_t AccessTime);
+  void remove(StringRef Key);
+  void replay(StringRef Records);
+
+  /// Brings the entries in line with the files of \p CacheDir: entries whose
+  /// file is gone are removed, and files without an entry are added, except
+  /// those written since \p WrittenBefore.
+  Error reconcile(StringRef CacheDir, std::time_t WrittenBefore);
+
+  Error write(StringRef CacheDir, std::time_t ScanTime) const;
+
+private:
+  /// The entries, least recently used first.
+  std::list<Entry> Entries;
+  StringMap<std::list<Entry>::iterator> EntryForKey;
+  uint64_t TotalSize = 0;
+};
+
+} // end anonymous namespace
+
+static bool parseRecord(StringRef Line, Record &R) {
+  SmallVector<StringRef, 4> Fields;
+  Line.split(Fields, ' ');
+  uint64_t Time;
+  if (Fields.size() != 4 || Fields[0].size() != 1 ||
+      !StringRef("+=-").count(Fields[0][0]) ||
+      Fields[2].getAsInteger(10, R.Size) || Fields[3].getAsInteger(10, Time))
+    return false;
+  R.Kind = Fields[0][0];
+  R.Key = Fields[1];
+  R.Time = Time;
+  return true;
+}
+
+/// Reads the snapshot of \p CacheDir and its header. \p Rest is set to the
+/// entries that follow the header.
+static Expected<std::unique_ptr<MemoryBuffer>>
+readSnapshot(StringRef CacheDir, SnapshotHeader &Header, StringRef &Rest) {
+  Expected<std::unique_ptr<MemoryBuffer>> Snapshot =
+      readRecords(getSnapshotPath(CacheDir));
+  if (!Snapshot)
+    return Snapshot.takeError();
+  if (!*Snapshot)
+    return errorCodeToError(make_error_code(errc::no_such_file_or_directory));
+
+  StringRef Line;
+  std::tie(Line, Rest) = (*Snapshot)->getBuffer().split('\n');
+  SmallVector<StringRef, 3> Fields;
+  if (Line.consume_front(ManifestHeader) && Line.consume_front(" "))
+    Line.split(Fields, ' ');
+  uint64_t ScanTime;
+  if (Fields.size() != 3 || Fields[0].getAsInteger(10, Header.NumEntries) ||
+      Fields[1].getAsInteger(10, Header.TotalSize) ||
+      Fields[2].getAsInteger(10, ScanTime))
+    return make_error<StringError>("invalid cache manifest header",
+                                   inconvertibleErrorCode());
+  Header.ScanTime = ScanTime;
+  return Snapshot;
+}
+
+void EntryList::insert(StringRef Key, uint64_t Size, std::time_t AccessTime) {
+  remove(Key);
+  Entries.push_back({Key, Size, AccessTime});
+  EntryForKey[Key] = std::prev(Entries.end());
+  TotalSize += Size;
+}
+
+void EntryList::access(StringRef Key, std::time_t AccessTime) {
+  auto I = EntryForKey.find(Key);
+  if (I == EntryForKey.end())
+    return;
+  std::list<Entry>::iterator E = I->second;
+  E->AccessTime = AccessTime;
+  Entries.splice(Entries.end(), Entries, E);
+}
+
+void EntryList::remove(StringRef Key) {
+  auto I = EntryForKey.find(Key);
+  if (I == EntryForKey.end())
+    return;
+  TotalSize -= I->second->Size;
+  Entries.erase(I->second);
+  EntryForKey.erase(I);
+}
+
+void EntryList::replay(StringRef Records) {
+  StringRef Line;
+  while (!Records.empty()) {
+    std::tie(Line, Records) = Records.split('\n');
+    Record R;
+    if (!parseRecord(Line, R)) {
+      DEBUG(dbgs() << "Ignore malformed manifest record '" << Line << "'\n");
+      continue;
+    }
+    if (R.Kind == '+')
+      insert(R.Key, R.Size, R.Time);
+    else if (R.Kind == '=')
+      access(R.Key, R.Time);
+    else
+      remove(R.Key);
+  }
+}
+
+Error EntryList::reconcile(StringRef CacheDir, std::time_t WrittenBefore) {
+  StringSet<> Files;
+  std::vector<Entry> Unrecorded;
+  std::error_code EC;
+  SmallString<128> CacheDirNative;
+  sys::path::native(CacheDir, CacheDirNative);
+  for (sys::fs::directory_iterator File(CacheDirNative, EC), FileEnd;
+       File != FileEnd && !EC; File.increment(EC)) {
+    StringRef Name = sys::path::filename(File->path());
+    if (!Name.startswith("llvmcache-"))
+      continue;
+    StringRef Key = Name.drop_front(strlen("llvmcache-"));
+    Files.insert(Key);
+    if (EntryForKey.count(Key))
+      continue;
+    ErrorOr<sys::fs::basic_file_status> StatusOrErr = File->status();
+    if (!StatusOrErr ||
+        sys::toTimeT(StatusOrErr->getLastModificationTime()) >= WrittenBefore)
+      continue;
+    Unrecorded.push_back({Key, StatusOrErr->getSize(),
+                          sys::toTimeT(StatusOrErr->getLastAccessedTime())});
+  }
+  if (EC)
+    return errorCodeToError(EC);
+
+  for (auto I = Entries.begin(); I != Entries.end();) {
+    Entry &E = *I++;
+    if (!Files.count(E.Key)) {
+      DEBUG(dbgs() << "Cache entry " << E.Key << " is gone\n");
+      remove(E.Key);
+    }
+  }
+  // Put the entries that weren't recorded where their access time says. The
+  // sort is stable, so the recorded entries keep their order.
+  llvm::sort(Unrecorded.begin(), Unrecorded.end(),
+             [](const Entry &L, const Entry &R) {
+               return std::tie(L.AccessTime, L.Key) <
+                      std::tie(R.AccessTime, R.Key);
+             });
+  for (Entry &E : reverse(Unrecorded)) {
+    DEBUG(dbgs() << "Cache entry " << E.Key << " was never recorded\n");
+    Entries.push_front(E);
+    EntryForKey[E.Key] = Entries.begin();
+    TotalSize += E.Size;
+  }
+  if (!Unrecorded.empty())
+    Entries.sort([](const Entry &L, const Entry &R) {
+      return L.AccessTime < R.AccessTime;
+    });
+  return Error::success();
+}
+
+Error EntryList::write(StringRef CacheDir, std::time_t ScanTime) const {
+  SmallString<128> TempModel(CacheDir);
+  sys::path::append(TempModel, "llvmcache.manifest-%%%%%%.tmp");
+  Expected<sys::fs::TempFile> Temp = sys::fs::TempFile::create(TempModel);
+  if (!Temp)
+    return Temp.takeError();
+  {
+    raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+    OS << ManifestHeader << ' ' << Entries.size() << ' ' << TotalSize << ' '
+       << uint64_t(ScanTime) << '\n';
+    for (const Entry &E : Entries)
+      OS << "+ " << E.Key << ' ' << E.Size << ' ' << uint64_t(E.AccessTime)
+         << '\n';
+    OS.flush();
+    if (OS.has_error()) {
+      OS.clear_error();
+      consumeError(Temp->discard());
+      return errorCodeToError(make_error_code(errc::io_error));
+    }
+  }
+  return Temp->keep(getSnapshotPath(CacheDir));
+}
+
+bool CacheManifest::exists(StringRef CacheDir) {
+  return sys::fs::exists(getSnapshotPath(CacheDir));
+}
+
+Error CacheManifest::create(StringRef CacheDir) {
+  EntryList Entries;
+  std::time_t ScanTime = now();
+  if (Error E = Entries.reconcile(CacheDir, /*WrittenBefore=*/ScanTime + 1))
+    return E;
+  return Entries.write(CacheDir, ScanTime);
+}
+
+void CacheManifest::recordInsert(StringRef CacheDir, StringRef Key,
+                                 uint64_t Size) {
+  appendRecord(CacheDir, '+', Key, Size, /*MustNotBeLost=*/true);
+}
+
+void CacheManifest::recordAccess(StringRef CacheDir, StringRef Key,
+                                 uint64_t Size) {
+  // A lost access only makes the entry look older than it is.
+  appendRecord(CacheDir, '=', Key, Size, /*MustNotBeLost=*/false);
+}
+
+Expected<CacheManifest> CacheManifest::load(StringRef CacheDir) {
+  Expected<CacheManifest> Manifest = CacheManifest(CacheDir);
+  SnapshotHeader Header;
+  Expected<std::unique_ptr<MemoryBuffer>> Snapshot =
+      readSnapshot(CacheDir, Header, Manifest->UnreadSnapshot);
+  if (!Snapshot)
+    return Snapshot.takeError();
+  Manifest->Snapshot = std::move(*Snapshot);
+  Manifest->NumSnapshotEntries = Header.NumEntries;
+  Manifest->NumEntries = Header.NumEntries;
+  Manifest->TotalSize = Header.TotalSize;
+  Manifest->ScanTime = Header.ScanTime;
+
+  for (StringRef Path :
+       {getCompactedJournalPath(CacheDir), getJournalPath(CacheDir)}) {
+    Expected<std::unique_ptr<MemoryBuffer>> Journal = readRecords(Path);
+    if (!Journal)
+      return Journal.takeError();
+    if (*Journal)
+      Manifest->replayJournal((*Journal)->getBuffer());
+  }
+  return Manifest;
+}
+
+void CacheManifest::replayJournal(StringRef Records) {
+  StringRef Line;
+  while (!Records.empty()) {
+    std::tie(Line, Records) = Records.split('\n');
+    ++NumJournalRecords;
+    Record R;
+    if (!parseRecord(Line, R)) {
+      DEBUG(dbgs() << "Ignore malformed manifest record '" << Line << "'\n");
+      continue;
+    }
+
+    auto Inserted = JournaledKeys.insert({R.Key, JournaledKey()});
+    JournaledKey &J = Inserted.first->second;
+    if (Inserted.second && R.Kind != '+') {
+      // The entry existed before the journal mentioned it, so the snapshot
+      // presumably lists it and counted it.
+      J.AssumedInSnapshot = true;
+      J.AssumedSize = R.Size;
+      --NumEntries;
+      TotalSize -= R.Size;
+    }
+    // An access of an entry that the journal removed is stale.
+    if (R.Kind == '=' && !J.Present && !Inserted.second)
+      continue;
+    if (J.Present) {
+      --NumEntries;
+      TotalSize -= J.E->Size;
+      Journaled.erase(J.E);
+      J.Present = false;
+    }
+    if (R.Kind == '-')
+      continue;
+    Journaled.push_back({R.Key, R.Size, R.Time});
+    J.E = std::prev(Journaled.end());
+    J.Present = true;
+    ++NumEntries;
+    TotalSize += R.Size;
+  }
+}
+
+bool CacheManifest::readSnapshotEntry() {
+  StringRef Line;
+  while (!UnreadSnapshot.empty()) {
+    std::tie(Line, UnreadSnapshot) = UnreadSnapshot.split('\n');
+    Record R;
+    if (!parseRecord(Line, R) || R.Kind != '+')
+      continue;
+    auto I = JournaledKeys.find(R.Key);
+    if (I == JournaledKeys.end()) {
+      NextSnapshotEntry = Entry{R.Key, R.Size, R.Time};
+      return true;
+    }
+    // The journal supersedes this entry. Correct the counts now that it is
+    // known whether the snapshot lists it.
+    JournaledKey &J = I->second;
+    J.FoundInSnapshot = true;
+    if (J.AssumedInSnapshot) {
+      TotalSize += int64_t(J.AssumedSize) - int64_t(R.Size);
+    } else {
+      --NumEntries;
+      TotalSize -= R.Size;
+    }
+  }
+
+  if (!SnapshotRead) {
+    SnapshotRead = true;
+    for (const auto &KV : JournaledKeys) {
+      const JournaledKey &J = KV.second;
+      if (J.AssumedInSnapshot && !J.FoundInSnapshot) {
+        ++NumEntries;
+        TotalSize += J.AssumedSize;
+      }
+    }
+  }
+  return false;
+}
+
+const CacheManifest::Entry *CacheManifest::peekOldest() {
+  if (NextSnapshotEntry || readSnapshotEntry())
+    return NextSnapshotEntry.getPointer();
+  if (!Journaled.empty())
+    return &Journaled.front();
+  return nullptr;
+}
+
+sys::TimePoint<> CacheManifest::getOldestAccessTime() {
+  const Entry *E = peekOldest();
+  assert(E && "empty cache manifest");
+  return sys::toTimePoint(E->AccessTime);
+}
+
+void CacheManifest::evictLeastRecentlyUsed() {
+  const Entry *E = peekOldest();
+  assert(E && "empty cache manifest");
+  SmallString<128> EntryPath(CacheDir);
+  sys::path::append(EntryPath, "llvmcache-" + E->Key);
+  DEBUG(dbgs() << " - Remove " << EntryPath << " (size " << E->Size
+               << "), new occupancy is " << getTotalSize() - E->Size << "\n");
+  // The entry may already have been removed by another process.
+  sys::fs::remove(EntryPath);
+  appendRecord(CacheDir, '-', E->Key, E->Size, /*MustNotBeLost=*/true);
+  ++NumJournalRecords;
+
+  --NumEntries;
+  TotalSize -= E->Size;
+  if (NextSnapshotEntry) {
+    NextSnapshotEntry.reset();
+    return;
+  }
+  JournaledKeys[E->Key].Present = false;
+  Journaled.pop_front();
+}
+
+void CacheManifest::compactIfNeeded() {
+  bool RescanDue = now() - ScanTime >= RescanInterval;
+  if (NumJournalRecords <= NumSnapshotEntries / 4 + 1024 && !RescanDue)
+    return;
+
+  // Only one process compacts the manifest at a time. The others keep
+  // appending to the journal.
+  LockFileManager Lock(getSnapshotPath(CacheDir));
+  if (Lock.getState() != LockFileManager::LFS_Owned)
+    return;
+
+  // Set the journal aside, unless a compaction that didn't finish left one
+  // there. The current journal then waits for the next compaction.
+  std::time_t SetAsideTime = now();
+  SmallString<128> CompactedJournalPath = getCompactedJournalPath(CacheDir);
+  if (!sys::fs::exists(CompactedJournalPath)) {
+    std::error_code EC =
+        sys::fs::rename(getJournalPath(CacheDir), CompactedJournalPath);
+    if (EC && EC != errc::no_such_file_or_directory) {
+      DEBUG(dbgs() << "Failed to set the cache journal aside: " << EC.message()
+                   << "\n");
+      return;
+    }
+  }
+
+  // Read the snapshot again: another process may have compacted it since it
+  // was loaded.
+  SnapshotHeader Header;
+  StringRef Entries;
+  Expected<std::unique_ptr<MemoryBuffer>> Snapshot =
+      readSnapshot(CacheDir, Header, Entries);
+  if (!Snapshot) {
+    consumeError(Snapshot.takeError());
+    return;
+  }
+  EntryList Compacted;
+  Compacted.replay(Entries);
+  Expected<std::unique_ptr<MemoryBuffer>> Journal =
+      readRecords(CompactedJournalPath);
+  if (!Journal) {
+    consumeError(Journal.takeError());
+    return;
+  }
+  if (*Journal)
+    Compacted.replay((*Journal)->getBuffer());
+
+  // Entries written shortly before the journal was set aside may only be
+  // recorded in the new journal; leave them to the next walk.
+  std::time_t NewScanTime = Header.ScanTime;
+  if (SetAsideTime - Header.ScanTime >= RescanInterval) {
+    if (Error E = Compacted.reconcile(CacheDir, SetAsideTime - 60)) {
+      DEBUG(dbgs() << "Failed to walk the cache directory: "
+                   << toString(std::move(E)) << "\n");
+      consumeError(std::move(E));
+    } else {
+      NewScanTime = SetAsideTime;
+    }
+  }
+
+  if (Error E = Compacted.write(CacheDir, NewScanTime)) {
+    DEBUG(dbgs() << "Failed to rewrite cache manifest: "
+                 << toString(std::move(E)) << "\n");
+    consumeError(std::move(E));
+    return;
+  }
+  sys::fs::remove(CompactedJournalPath);
+
+  Expected<CacheManifest> ManifestOrErr = load(CacheDir);
+  if (!ManifestOrErr) {
+    consumeError(ManifestOrErr.takeError());
+    return;
+  }
+  *this = std::move(*ManifestOrErr);
+}
@@ -13,6 +13,7 @@
 
 #include "llvm/Support/CachePruning.h"
 
+#include "llvm/Support/CacheManifest.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/Error.h"
@@ -126,6 +127,55 @@ llvm::parseCachePruningPolicy(StringRef PolicyStr) {
   return Policy;
 }
 
+/// Returns the size that size-based pruning should bring a cache of
+/// \p TotalSize bytes stored in \p Path down to.
+static uint64_t getTotalSizeTarget(StringRef Path, uint64_t TotalSize,
+                                   CachePruningPolicy &Policy) {
+  auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
+  if (!ErrOrSpaceInfo) {
+    report_fatal_error("Can't get available size");
+  }
+  sys::fs::space_info SpaceInfo = ErrOrSpaceInfo.get();
+  auto AvailableSpace = TotalSize + SpaceInfo.free;
+
+  if (Policy.MaxSizePercentageOfAvailableSpace == 0)
+    Policy.MaxSizePercentageOfAvailableSpace = 100;
+  if (Policy.MaxSizeBytes == 0)
+    Policy.MaxSizeBytes = AvailableSpace;
+  auto TotalSizeTarget = std::min<uint64_t>(
+      AvailableSpace * Policy.MaxSizePercentageOfAvailableSpace / 100ull,
+      Policy.MaxSizeBytes);
+
+  DEBUG(dbgs() << "Occupancy: " << ((100 * TotalSize) / AvailableSpace)
+               << "% target is: " << Policy.MaxSizePercentageOfAvailableSpace
+               << "%, " << Policy.MaxSizeBytes << " bytes\n");
+  return TotalSizeTarget;
+}
+
+/// Prune a cache that has a manifest, evicting the least recently used entries
+/// first. Only the evicted entries are touched.
+static void pruneCacheWithManifest(StringRef Path, CacheManifest &Manifest,
+                                   CachePruningPolicy Policy,
+                                   std::chrono::system_clock::time_point Now) {
+  if (Policy.Expiration != std::chrono::seconds(0))
+    while (!Manifest.empty() &&
+           Now - Manifest.getOldestAccessTime() > Policy.Expiration)
+      Manifest.evictLeastRecentlyUsed();
+
+  if (Policy.MaxSizeFiles)
+    while (Manifest.getNumEntries() > Policy.MaxSizeFiles && !Manifest.empty())
+      Manifest.evictLeastRecentlyUsed();
+
+  if (Policy.MaxSizePercentageOfAvailableSpace > 0 || Policy.MaxSizeBytes > 0) {
+    uint64_t TotalSizeTarget =
+        getTotalSizeTarget(Path, Manifest.getTotalSize(), Policy);
+    while (Manifest.getTotalSize() > TotalSizeTarget && !Manifest.empty())
+      Manifest.evictLeastRecentlyUsed();
+  }
+
+  Manifest.compactIfNeeded();
+}
+
 /// Prune the cache of files that haven't been accessed in a long time.
 bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
   using namespace std::chrono;
@@ -185,6 +235,20 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
     writeTimestampFile(TimestampFile);
   }
 
+  // Caches written by lto::localCache() have a manifest, which is enough to
+  // prune them without walking the directory.
+  if (CacheManifest::exists(Path)) {
+    Expected<CacheManifest> ManifestOrErr = CacheManifest::load(Path);
+    if (ManifestOrErr) {
+      pruneCacheWithManifest(Path, *ManifestOrErr, Policy, CurrentTime);
+      return true;
+    }
+    Error E = ManifestOrErr.takeError();
+    DEBUG(dbgs() << "Can't load cache manifest (" << toString(std::move(E))
+                 << "), walk the directory\n");
+    consumeError(std::move(E));
+  }
+
   // Keep track of space. Needs to be kept ordered by size for determinism.
   std::set<std::pair<uint64_t, std::string>> FileSizes;
   uint64_t TotalSize = 0;
@@ -248,24 +312,7 @@ bool llvm::pruneCache(StringRef Path, CachePruningPolicy Policy) {
 
   // Prune for size now if needed
   if (Policy.MaxSizePercentageOfAvailableSpace > 0 || Policy.MaxSizeBytes > 0) {
-    auto ErrOrSpaceInfo = sys::fs::disk_space(Path);
-    if (!ErrOrSpaceInfo) {
-      report_fatal_error("Can't get available size");
-    }
-    sys::fs::space_info SpaceInfo = ErrOrSpaceInfo.get();
-    auto AvailableSpace = TotalSize + SpaceInfo.free;
-
-    if (Policy.MaxSizePercentageOfAvailableSpace == 0)
-      Policy.MaxSizePercentageOfAvailableSpace = 100;
-    if (Policy.MaxSizeBytes == 0)
-      Policy.MaxSizeBytes = AvailableSpace;
-    auto TotalSizeTarget = std::min<uint64_t>(
-        AvailableSpace * Policy.MaxSizePercentageOfAvailableSpace / 100ull,
-        Policy.MaxSizeBytes);
-
-    DEBUG(dbgs() << "Occupancy: " << ((100 * TotalSize) / AvailableSpace)
-                 << "% target is: " << Policy.MaxSizePercentageOfAvailableSpace
-                 << "%, " << Policy.MaxSizeBytes << " bytes\n");
+    uint64_t TotalSizeTarget = getTotalSizeTarget(Path, TotalSize, Policy);
 
     // Remove the oldest accessed files first, till we get below the threshold.
     while (TotalSize > TotalSizeTarget && FileAndSize != FileSizes.rend())
@@ -8,12 +8,16 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/Parallel.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Compiler.h"
 #include "llvm/Support/Threading.h"
 
 #include <atomic>
-#include <stack>
+#include <deque>
+#include <memory>
 #include <thread>
+#include <vector>
 
 using namespace llvm;
 
@@ -24,6 +28,11 @@ class Executor {
 public:
   virtual ~Executor() = default;
   virtual void add(std::function<void()> func) = 0;
+#if LLVM_ENABLE_THREADS
+  /// \brief Blocks until \p L reaches zero. Executors may run pending tasks
+  ///   on the calling thread while waiting.
+  virtual void wait(const parallel::detail::Latch &L) { L.sync(); }
+#endif
 
   static Executor *getDefaultExecutor();
 };
@@ -67,19 +76,35 @@ Executor *Executor::getDefaultExecutor() {
 }
 
 #else
-/// \brief An implementation of an Executor that runs closures on a thread pool
-///   in filo order.
+/// \brief The index of the ThreadPoolExecutor worker running on this thread,
+///   or -1 if this thread is not a worker.
+static LLVM_THREAD_LOCAL int WorkerIndex = -1;
+
+/// \brief An implementation of an Executor that runs closures on a
+///   work-stealing thread pool.
+///
+/// Every worker owns a deque of tasks. Tasks spawned from a worker are pushed
+/// to, and popped from, the back of that worker's own deque (filo order, which
+/// keeps nested work hot in cache). Idle workers steal from the front of the
+/// other deques. Tasks added from outside the pool are distributed across the
+/// deques round-robin, so there is no single lock every task has to go
+/// through.
+///
+/// A worker that waits on a TaskGroup keeps running pending tasks instead of
+/// blocking, which lets task groups nest without deadlocking the pool.
 class ThreadPoolExecutor : public Executor {
 public:
   explicit ThreadPoolExecutor(unsigned ThreadCount = hardware_concurrency())
       : Done(ThreadCount) {
+    for (unsigned I = 0; I < ThreadCount; ++I)
+      Queues.push_back(llvm::make_unique<WorkQueue>());
     // Spawn all but one of the threads in another thread as spawning threads
     // can take a while.
     std::thread([&, ThreadCount] {
-      for (size_t i = 1; i < ThreadCount; ++i) {
-        std::thread([=] { work(); }).detach();
+      for (unsigned I = 1; I < ThreadCount; ++I) {
+        std::thread([=] { work(I); }).detach();
       }
-      work();
+      work(0);
     }).detach();
   }
 
@@ -92,29 +117,108 @@ public:
   }
 
   void add(std::function<void()> F) override {
-    std::unique_lock<std::mutex> Lock(Mutex);
-    WorkStack.push(F);
-    Lock.unlock();
-    Cond.notify_one();
+    WorkQueue &Q = WorkerIndex >= 0
+                       ? *Queues[WorkerIndex]
+                       : *Queues[NextQueue.fetch_add(1) % Queues.size()];
+    {
+      std::lock_guard<std::mutex> Lock(Q.Mutex);
+      Q.Tasks.push_back(std::move(F));
+    }
+    ++Pending;
+    if (Sleepers > 0) {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Cond.notify_one();
+    }
   }
 
-private:
-  void work() {
-    while (true) {
+  void wait(const parallel::detail::Latch &L) override {
+    // Threads outside the pool have no deque to help with; just block.
+    if (WorkerIndex < 0)
+      return L.sync();
+
+    while (!L.isDone()) {
+      if (runPendingTask())
+        continue;
       std::unique_lock<std::mutex> Lock(Mutex);
-      Cond.wait(Lock, [&] { return Stop || !WorkStack.empty(); });
+      ++Sleepers;
+      ++Helpers;
+      Cond.wait(Lock, [&] { return Stop || Pending > 0 || L.isDone(); });
+      --Helpers;
+      --Sleepers;
       if (Stop)
-        break;
-      auto Task = WorkStack.top();
-      WorkStack.pop();
-      Lock.unlock();
-      Task();
+        return;
+    }
+  }
+
+private:
+  struct WorkQueue {
+    std::mutex Mutex;
+    std::deque<std::function<void()>> Tasks;
+  };
+
+  /// \brief Pops a task from this worker's own deque, or steals one from
+  ///   another worker if the own deque is empty.
+  bool popTask(std::function<void()> &Task) {
+    unsigned Size = Queues.size();
+    unsigned Self = WorkerIndex >= 0 ? WorkerIndex : 0;
+    if (WorkerIndex >= 0) {
+      WorkQueue &Q = *Queues[Self];
+      std::lock_guard<std::mutex> Lock(Q.Mutex);
+      if (!Q.Tasks.empty()) {
+        Task = std::move(Q.Tasks.back());
+        Q.Tasks.pop_back();
+        return true;
+      }
+    }
+    for (unsigned I = 1; I <= Size; ++I) {
+      WorkQueue &Q = *Queues[(Self + I) % Size];
+      std::lock_guard<std::mutex> Lock(Q.Mutex);
+      if (!Q.Tasks.empty()) {
+        Task = std::move(Q.Tasks.front());
+        Q.Tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool runPendingTask() {
+    std::function<void()> Task;
+    if (!popTask(Task))
+      return false;
+    --Pending;
+    Task();
+    // A worker blocked in wait() may be waiting for exactly this task.
+    if (Helpers > 0) {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      Cond.notify_all();
+    }
+    return true;
+  }
+
+  void work(unsigned Index) {
+    WorkerIndex = Index;
+    while (!Stop) {
+      if (runPendingTask())
+        continue;
+      std::unique_lock<std::mutex> Lock(Mutex);
+      ++Sleepers;
+      Cond.wait(Lock, [&] { return Stop || Pending > 0; });
+      --Sleepers;
     }
     Done.dec();
   }
 
   std::atomic<bool> Stop{false};
-  std::stack<std::function<void()>> WorkStack;
+  std::vector<std::unique_ptr<WorkQueue>> Queues;
+  std::atomic<unsigned> NextQueue{0};
+  // Number of queued tasks. This may briefly go negative while a task that
+  // was just pushed is stolen before the push is accounted for.
+  std::atomic<int64_t> Pending{0};
+  // Number of threads blocked on Cond, and the subset of those that are
+  // waiting on a task group.
+  std::atomic<unsigned> Sleepers{0};
+  std::atomic<unsigned> Helpers{0};
   std::mutex Mutex;
   std::condition_variable Cond;
   parallel::detail::Latch Done;
@@ -135,4 +239,8 @@ void parallel::detail::TaskGroup::spawn(std::function<void()> F) {
     L.dec();
   });
 }
+
+void parallel::detail::TaskGroup::sync() const {
+  Executor::getDefaultExecutor()->wait(L);
+}
 #endif
@@ -43,6 +43,7 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/IPO/Internalize.h"
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -451,15 +452,43 @@ void llvm::ComputeCrossModuleImport(
     const ModuleSummaryIndex &Index,
     const StringMap<GVSummaryMapTy> &ModuleToDefinedGVSummaries,
     StringMap<FunctionImporter::ImportMapTy> &ImportLists,
-    StringMap<FunctionImporter::ExportSetTy> &ExportLists) {
+    StringMap<FunctionImporter::ExportSetTy> &ExportLists,
+    unsigned ThreadCount) {
   // For each module that has function defined, compute the import/export lists.
-  for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries) {
-    auto &ImportList = ImportLists[DefinedGVSummaries.first()];
-    DEBUG(dbgs() << "Computing import for Module '"
-                 << DefinedGVSummaries.first() << "'\n");
-    ComputeImportForModule(DefinedGVSummaries.second, Index, ImportList,
-                           &ExportLists);
+  // The exports that each module causes are collected separately and merged in
+  // module order, so that the modules can be processed concurrently and the
+  // export lists don't depend on the number of threads.
+  std::vector<StringMap<FunctionImporter::ExportSetTy>> ExportListsPerModule(
+      ModuleToDefinedGVSummaries.size());
+  auto ComputeImports = [&](const StringMapEntry<GVSummaryMapTy> &Module,
+                            FunctionImporter::ImportMapTy &ImportList,
+                            StringMap<FunctionImporter::ExportSetTy> &Exports) {
+    DEBUG(dbgs() << "Computing import for Module '" << Module.first()
+                 << "'\n");
+    ComputeImportForModule(Module.second, Index, ImportList, &Exports);
+  };
+  if (ThreadCount > 1) {
+    ThreadPool Pool(ThreadCount);
+    unsigned I = 0;
+    for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries) {
+      const auto *Module = &DefinedGVSummaries;
+      auto *ImportList = &ImportLists[DefinedGVSummaries.first()];
+      auto *Exports = &ExportListsPerModule[I++];
+      Pool.async([&ComputeImports, Module, ImportList, Exports] {
+        ComputeImports(*Module, *ImportList, *Exports);
+      });
+    }
+    Pool.wait();
+  } else {
+    unsigned I = 0;
+    for (auto &DefinedGVSummaries : ModuleToDefinedGVSummaries)
+      ComputeImports(DefinedGVSummaries,
+                     ImportLists[DefinedGVSummaries.first()],
+                     ExportListsPerModule[I++]);
   }
+  for (auto &Exports : ExportListsPerModule)
+    for (auto &ELI : Exports)
+      ExportLists[ELI.first()].insert(ELI.second.begin(), ELI.second.end());
 
   // When computing imports we added all GUIDs referenced by anything
   // imported from the module to its ExportList. Now we prune each ExportList
@@ -565,7 +594,8 @@ void llvm::ComputeCrossModuleImportForModuleFromIndex(
 void llvm::computeDeadSymbols(
     ModuleSummaryIndex &Index,
     const DenseSet<GlobalValue::GUID> &GUIDPreservedSymbols,
-    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing) {
+    function_ref<PrevailingType(GlobalValue::GUID)> isPrevailing,
+    unsigned ThreadCount) {
   assert(!Index.withGlobalValueDeadStripping());
   if (!ComputeDead)
     return;
@@ -593,8 +623,10 @@ void llvm::computeDeadSymbols(
         break;
       }
 
-  // Make value live and add it to the worklist if it was not live before.
-  auto visit = [&](ValueInfo VI) {
+  // Return the value that \p VI refers to if it has to be made live, or an
+  // empty ValueInfo if it is live already or stays dead. This only reads the
+  // index, so it may be called concurrently.
+  auto getNewlyLive = [&](ValueInfo VI) -> ValueInfo {
     // FIXME: If we knew which edges were created for indirect call profiles,
     // we could skip them here. Any that are live should be reached via
     // other edges, e.g. reference edges. Otherwise, using a profile collected
@@ -605,10 +637,10 @@ void llvm::computeDeadSymbols(
     // to functions marked dead are skipped.
     VI = updateValueInfoForIndirectCalls(Index, VI);
     if (!VI)
-      return;
+      return ValueInfo();
     for (auto &S : VI.getSummaryList())
       if (S->isLive())
-        return;
+        return ValueInfo();
 
     // We only keep live symbols that are known to be non-prevailing if any are
     // available_externally. Those symbols are discarded later in the
@@ -625,29 +657,96 @@ void llvm::computeDeadSymbols(
       }
 
       if (!AvailableExternally)
-        return;
+        return ValueInfo();
 
       if (Interposable)
         report_fatal_error("Interposable and available_externally symbol");
     }
+    return VI;
+  };
 
+  auto makeLive = [&](ValueInfo VI) {
     for (auto &S : VI.getSummaryList())
       S->setLive(true);
     ++LiveSymbols;
     Worklist.push_back(VI);
   };
 
-  while (!Worklist.empty()) {
-    auto VI = Worklist.pop_back_val();
-    for (auto &Summary : VI.getSummaryList()) {
-      GlobalValueSummary *Base = Summary->getBaseObject();
-      // Set base value live in case it is an alias.
-      Base->setLive(true);
-      for (auto Ref : Base->refs())
-        visit(Ref);
-      if (auto *FS = dyn_cast<FunctionSummary>(Base))
-        for (auto Call : FS->calls())
-          visit(Call.first);
+  // Make value live and add it to the worklist if it was not live before.
+  auto visit = [&](ValueInfo VI) {
+    if (ValueInfo NewlyLive = getNewlyLive(VI))
+      makeLive(NewlyLive);
+  };
+
+  if (ThreadCount <= 1) {
+    while (!Worklist.empty()) {
+      auto VI = Worklist.pop_back_val();
+      for (auto &Summary : VI.getSummaryList()) {
+        GlobalValueSummary *Base = Summary->getBaseObject();
+        // Set base value live in case it is an alias.
+        Base->setLive(true);
+        for (auto Ref : Base->refs())
+          visit(Ref);
+        if (auto *FS = dyn_cast<FunctionSummary>(Base))
+          for (auto Call : FS->calls())
+            visit(Call.first);
+      }
+    }
+  } else {
+    // Process the worklist a generation at a time: the references of the
+    // values in the worklist are looked up on the thread pool, which only
+    // reads the index, and then the values they make live are marked live
+    // serially, in worklist order, so that the result doesn't depend on the
+    // scheduling.
+    ThreadPool Pool(ThreadCount);
+    const size_t ChunkSize = 256;
+    while (!Worklist.empty()) {
+      SmallVector<ValueInfo, 128> Generation;
+      Generation.swap(Worklist);
+      // Set base values live in case they are aliases.
+      for (ValueInfo VI : Generation)
+        for (auto &Summary : VI.getSummaryList())
+          Summary->getBaseObject()->setLive(true);
+
+      std::vector<std::vector<ValueInfo>> Found(
+          (Generation.size() + ChunkSize - 1) / ChunkSize);
+      for (size_t I = 0; I != Found.size(); ++I) {
+        size_t Begin = I * ChunkSize;
+        auto Chunk = makeArrayRef(Generation)
+                         .slice(Begin, std::min(ChunkSize,
+                                                Generation.size() - Begin));
+        auto *Out = &Found[I];
+        auto FindNewlyLive = [&getNewlyLive, Chunk, Out] {
+          auto find = [&](ValueInfo VI) {
+            if (ValueInfo NewlyLive = getNewlyLive(VI))
+              Out->push_back(NewlyLive);
+          };
+          for (ValueInfo VI : Chunk)
+            for (auto &Summary : VI.getSummaryList()) {
+              GlobalValueSummary *Base = Summary->getBaseObject();
+              for (auto Ref : Base->refs())
+                find(Ref);
+              if (auto *FS = dyn_cast<FunctionSummary>(Base))
+                for (auto Call : FS->calls())
+                  find(Call.first);
+            }
+        };
+        if (Found.size() == 1)
+          FindNewlyLive();
+        else
+          Pool.async(FindNewlyLive);
+      }
+      Pool.wait();
+
+      // A value may have been found several times, or made live by the bases
+      // above.
+      for (auto &Chunk : Found)
+        for (ValueInfo VI : Chunk)
+          if (llvm::none_of(VI.getSummaryList(),
+                            [](const std::unique_ptr<GlobalValueSummary> &S) {
+                              return S->isLive();
+                            }))
+            makeLive(VI);
     }
   }
   Index.setWithGlobalValueDeadStripping();
@@ -19,6 +19,7 @@
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Comdat.h"
 #include "llvm/IR/Constant.h"
 #include "llvm/IR/Constants.h"
@@ -29,6 +30,8 @@
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/User.h"
 #include "llvm/IR/Value.h"
@@ -41,6 +44,7 @@
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iterator>
 #include <memory>
 #include <queue>
@@ -92,6 +96,48 @@ static void addAllGlobalValueUsers(ClusterMapType &GVtoClusterMap,
   }
 }
 
+// Puts GV into the same cluster as the globals that must end up in the same
+// partition as it.
+static void recordGVSet(ClusterMapType &GVtoClusterMap,
+                        ComdatMembersType &ComdatMembers, GlobalValue &GV) {
+  if (GV.isDeclaration())
+    return;
+
+  if (!GV.hasName())
+    GV.setName("__llvmsplit_unnamed");
+
+  // Comdat groups must not be partitioned. For comdat groups that contain
+  // locals, record all their members here so we can keep them together.
+  // Comdat groups that only contain external globals are already handled by
+  // the MD5-based partitioning.
+  if (const Comdat *C = GV.getComdat()) {
+    auto &Member = ComdatMembers[C];
+    if (Member)
+      GVtoClusterMap.unionSets(Member, &GV);
+    else
+      Member = &GV;
+  }
+
+  // For aliases we should not separate them from their aliasees regardless
+  // of linkage.
+  if (auto *GIS = dyn_cast<GlobalIndirectSymbol>(&GV)) {
+    if (const GlobalObject *Base = GIS->getBaseObject())
+      GVtoClusterMap.unionSets(&GV, Base);
+  }
+
+  if (const Function *F = dyn_cast<Function>(&GV)) {
+    for (const BasicBlock &BB : *F) {
+      BlockAddress *BA = BlockAddress::lookup(&BB);
+      if (!BA || !BA->isConstantUsed())
+        continue;
+      addAllGlobalValueUsers(GVtoClusterMap, F, BA);
+    }
+  }
+
+  if (GV.hasLocalLinkage())
+    addAllGlobalValueUsers(GVtoClusterMap, &GV, &GV);
+}
+
 // Find partitions for module in the way that no locals need to be
 // globalized.
 // Try to balance pack those partitions into N files since this roughly equals
@@ -106,42 +152,7 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
   ComdatMembersType ComdatMembers;
 
   auto recordGVSet = [&GVtoClusterMap, &ComdatMembers](GlobalValue &GV) {
-    if (GV.isDeclaration())
-      return;
-
-    if (!GV.hasName())
-      GV.setName("__llvmsplit_unnamed");
-
-    // Comdat groups must not be partitioned. For comdat groups that contain
-    // locals, record all their members here so we can keep them together.
-    // Comdat groups that only contain external globals are already handled by
-    // the MD5-based partitioning.
-    if (const Comdat *C = GV.getComdat()) {
-      auto &Member = ComdatMembers[C];
-      if (Member)
-        GVtoClusterMap.unionSets(Member, &GV);
-      else
-        Member = &GV;
-    }
-
-    // For aliases we should not separate them from their aliasees regardless
-    // of linkage.
-    if (auto *GIS = dyn_cast<GlobalIndirectSymbol>(&GV)) {
-      if (const GlobalObject *Base = GIS->getBaseObject())
-        GVtoClusterMap.unionSets(&GV, Base);
-    }
-
-    if (const Function *F = dyn_cast<Function>(&GV)) {
-      for (const BasicBlock &BB : *F) {
-        BlockAddress *BA = BlockAddress::lookup(&BB);
-        if (!BA || !BA->isConstantUsed())
-          continue;
-        addAllGlobalValueUsers(GVtoClusterMap, F, BA);
-      }
-    }
-
-    if (GV.hasLocalLinkage())
-      addAllGlobalValueUsers(GVtoClusterMap, &GV, &GV);
+    ::recordGVSet(GVtoClusterMap, ComdatMembers, GV);
   };
 
   llvm::for_each(M->functions(), recordGVSet);
@@ -211,6 +222,145 @@ static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
   }
 }
 
+// Returns an estimate of the time that the backend spends on GV, in units of
+// roughly one instruction.
+static uint64_t getCodeGenCost(const GlobalValue &GV) {
+  const auto *F = dyn_cast<Function>(&GV);
+  if (!F)
+    return 1;
+
+  uint64_t Cost = 0;
+  for (const BasicBlock &BB : *F) {
+    ++Cost;
+    for (const Instruction &I : BB) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+      // Calls are lowered to many instructions and constrain register
+      // allocation.
+      Cost += isa<CallInst>(I) || isa<InvokeInst>(I) ? 4 : 1;
+    }
+  }
+  return Cost;
+}
+
+// Returns the function that F is the only direct callee of, if any.
+static const Function *getOnlyCaller(const Function &F) {
+  if (F.isDeclaration() || !F.hasOneUse())
+    return nullptr;
+  ImmutableCallSite CS(F.user_back());
+  if (!CS || !CS.isCallee(&*F.use_begin()))
+    return nullptr;
+  const Function *Caller = CS.getInstruction()->getFunction();
+  return Caller != &F ? Caller : nullptr;
+}
+
+// Find partitions whose estimated codegen costs are balanced. Globals that
+// must not be separated are clustered as in findPartitions, and functions that
+// have a single caller are kept with it while their cluster doesn't grow past
+// the average cost of a partition. The clusters are then assigned to the
+// cheapest partition, most expensive first. Partition 0 is the most expensive.
+//
+// Keeping single callers and their callees together is the only call-graph
+// locality this implements. Functions with several callers are placed by cost
+// alone, so groups of functions that call each other may still be split
+// across partitions.
+static void findCostBalancedPartitions(Module *M,
+                                       ClusterIDMapType &ClusterIDMap,
+                                       unsigned N) {
+  ClusterMapType GVtoClusterMap;
+  ComdatMembersType ComdatMembers;
+  DenseMap<const GlobalValue *, uint64_t> Costs;
+  uint64_t TotalCost = 0;
+
+  auto recordGVSet = [&](GlobalValue &GV) {
+    if (GV.isDeclaration())
+      return;
+    ::recordGVSet(GVtoClusterMap, ComdatMembers, GV);
+    GVtoClusterMap.insert(&GV);
+    uint64_t Cost = getCodeGenCost(GV);
+    Costs[&GV] = Cost;
+    TotalCost += Cost;
+  };
+
+  llvm::for_each(M->functions(), recordGVSet);
+  llvm::for_each(M->globals(), recordGVSet);
+  llvm::for_each(M->aliases(), recordGVSet);
+  llvm::for_each(M->ifuncs(), recordGVSet);
+
+  // Sum the costs of the clusters, keyed by their leaders.
+  DenseMap<const GlobalValue *, uint64_t> ClusterCosts;
+  for (const auto &GVAndCost : Costs)
+    ClusterCosts[GVtoClusterMap.getLeaderValue(GVAndCost.first)] +=
+        GVAndCost.second;
+
+  uint64_t MaxCoupledCost = std::max<uint64_t>(TotalCost / N, 1);
+  for (const Function &F : *M) {
+    const Function *Caller = getOnlyCaller(F);
+    if (!Caller)
+      continue;
+    const GlobalValue *CalleeLeader = GVtoClusterMap.getLeaderValue(&F);
+    const GlobalValue *CallerLeader = GVtoClusterMap.getLeaderValue(Caller);
+    if (CalleeLeader == CallerLeader)
+      continue;
+    uint64_t Cost = ClusterCosts[CalleeLeader] + ClusterCosts[CallerLeader];
+    if (Cost > MaxCoupledCost)
+      continue;
+    ClusterCosts.erase(CalleeLeader);
+    ClusterCosts.erase(CallerLeader);
+    ClusterCosts[*GVtoClusterMap.unionSets(&F, Caller)] = Cost;
+  }
+
+  // To guarantee determinism, sort the clusters by cost and then by the names
+  // of their leaders.
+  using SortType = std::pair<uint64_t, const GlobalValue *>;
+  std::vector<SortType> Clusters;
+  for (const auto &LeaderAndCost : ClusterCosts)
+    Clusters.emplace_back(LeaderAndCost.second, LeaderAndCost.first);
+  std::sort(Clusters.begin(), Clusters.end(),
+            [](const SortType &A, const SortType &B) {
+              if (A.first != B.first)
+                return A.first > B.first;
+              return A.second->getName() < B.second->getName();
+            });
+
+  // Assign each cluster to the partition with the lowest cost so far.
+  using PartitionType = std::pair<uint64_t, unsigned>;
+  std::priority_queue<PartitionType, std::vector<PartitionType>,
+                      std::greater<PartitionType>>
+      BalancingQueue;
+  for (unsigned I = 0; I < N; ++I)
+    BalancingQueue.push(std::make_pair(0, I));
+  std::vector<PartitionType> Partitions;
+  for (unsigned I = 0; I < N; ++I)
+    Partitions.push_back(std::make_pair(0, I));
+  DenseMap<const GlobalValue *, unsigned> ClusterPartitions;
+  for (const SortType &Cluster : Clusters) {
+    PartitionType Partition = BalancingQueue.top();
+    BalancingQueue.pop();
+    DEBUG(dbgs() << "Root[" << Partition.second << "] cluster_cost("
+                 << Cluster.first << ") ----> " << Cluster.second->getName()
+                 << "\n");
+    ClusterPartitions[Cluster.second] = Partition.second;
+    Partition.first += Cluster.first;
+    Partitions[Partition.second] = Partition;
+    BalancingQueue.push(Partition);
+  }
+
+  // Number the partitions by decreasing cost, so that a caller that runs them
+  // on a thread pool can start with the most expensive ones.
+  std::stable_sort(Partitions.begin(), Partitions.end(),
+                   [](const PartitionType &A, const PartitionType &B) {
+                     return A.first > B.first;
+                   });
+  std::vector<unsigned> Numbers(N);
+  for (unsigned I = 0; I < N; ++I)
+    Numbers[Partitions[I].second] = I;
+
+  for (const auto &GVAndCost : Costs)
+    ClusterIDMap[GVAndCost.first] = Numbers[ClusterPartitions.lookup(
+        GVtoClusterMap.getLeaderValue(GVAndCost.first))];
+}
+
 static void externalize(GlobalValue *GV) {
   if (GV->hasLocalLinkage()) {
     GV->setLinkage(GlobalValue::ExternalLinkage);
@@ -248,7 +398,7 @@ static bool isInPartition(const GlobalValue *GV, unsigned I, unsigned N) {
 void llvm::SplitModule(
     std::unique_ptr<Module> M, unsigned N,
     function_ref<void(std::unique_ptr<Module> MPart)> ModuleCallback,
-    bool PreserveLocals) {
+    bool PreserveLocals, bool BalanceByCost) {
   if (!PreserveLocals) {
     for (Function &F : *M)
       externalize(&F);
@@ -263,7 +413,10 @@ void llvm::SplitModule(
   // This performs splitting without a need for externalization, which might not
   // always be possible.
   ClusterIDMapType ClusterIDMap;
-  findPartitions(M.get(), ClusterIDMap, N);
+  if (BalanceByCost)
+    findCostBalancedPartitions(M.get(), ClusterIDMap, N);
+  else
+    findPartitions(M.get(), ClusterIDMap, N);
 
   // FIXME: We should be able to reuse M as the last partition instead of
   // cloning it.
@@ -15,12 +15,32 @@
 #include "llvm/Support/DataExtractor.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
 #include "llvm/XRay/YAMLXRayRecord.h"
 
 using namespace llvm;
 using namespace llvm::xray;
 using llvm::yaml::Input;
 
+namespace llvm {
+namespace xray {
+
+/// Decodes the records of an XRay log that has been mapped into memory, one
+/// chunk at a time.
+class TraceDecoder {
+public:
+  virtual ~TraceDecoder() = default;
+
+  /// Returns true once every record of the log has been decoded.
+  virtual bool done() const = 0;
+
+  /// Decodes the next chunk of the log, appending its records to \p Records.
+  virtual Error decodeNext(std::vector<XRayRecord> &Records) = 0;
+};
+
+} // namespace xray
+} // namespace llvm
+
 namespace {
 using XRayRecordStorage =
     std::aligned_storage<sizeof(XRayRecord), alignof(XRayRecord)>::type;
@@ -55,90 +75,117 @@ Error readBinaryFormatHeader(StringRef Data, XRayFileHeader &FileHeader) {
   return Error::success();
 }
 
-Error loadNaiveFormatLog(StringRef Data, XRayFileHeader &FileHeader,
-                         std::vector<XRayRecord> &Records) {
-  if (Data.size() < 32)
-    return make_error<StringError>(
-        "Not enough bytes for an XRay log.",
-        std::make_error_code(std::errc::invalid_argument));
+/// The number of records a NaiveDecoder decodes at a time.
+const size_t NaiveChunkRecords = 4096;
 
-  if (Data.size() - 32 == 0 || Data.size() % 32 != 0)
-    return make_error<StringError>(
-        "Invalid-sized XRay data.",
-        std::make_error_code(std::errc::invalid_argument));
+/// Decodes a "naive" mode log, where each record after the header is 32 bytes
+/// in the following format:
+///
+///   (2)   uint16 : record type
+///   (1)   uint8  : cpu id
+///   (1)   uint8  : type
+///   (4)   sint32 : function id
+///   (8)   uint64 : tsc
+///   (4)   uint32 : thread id
+///   (12)  -      : padding
+///
+/// Records are decoded NaiveChunkRecords at a time; a chunk never ends between
+/// a function record and the argument payloads that follow it.
+class NaiveDecoder final : public TraceDecoder {
+  StringRef Data;
+  StringRef Remaining;
 
-  if (auto E = readBinaryFormatHeader(Data, FileHeader))
-    return E;
+public:
+  NaiveDecoder(StringRef Data) : Data(Data), Remaining(Data.drop_front(32)) {}
 
-  // Each record after the header will be 32 bytes, in the following format:
-  //
-  //   (2)   uint16 : record type
-  //   (1)   uint8  : cpu id
-  //   (1)   uint8  : type
-  //   (4)   sint32 : function id
-  //   (8)   uint64 : tsc
-  //   (4)   uint32 : thread id
-  //   (12)  -      : padding
-  for (auto S = Data.drop_front(32); !S.empty(); S = S.drop_front(32)) {
-    DataExtractor RecordExtractor(S, true, 8);
-    uint32_t OffsetPtr = 0;
-    switch (auto RecordType = RecordExtractor.getU16(&OffsetPtr)) {
-    case 0: { // Normal records.
-      Records.emplace_back();
-      auto &Record = Records.back();
-      Record.RecordType = RecordType;
-      Record.CPU = RecordExtractor.getU8(&OffsetPtr);
-      auto Type = RecordExtractor.getU8(&OffsetPtr);
-      switch (Type) {
-      case 0:
-        Record.Type = RecordTypes::ENTER;
-        break;
-      case 1:
-        Record.Type = RecordTypes::EXIT;
-        break;
-      case 2:
-        Record.Type = RecordTypes::TAIL_EXIT;
+  static Error readHeader(StringRef Data, XRayFileHeader &FileHeader) {
+    if (Data.size() < 32)
+      return make_error<StringError>(
+          "Not enough bytes for an XRay log.",
+          std::make_error_code(std::errc::invalid_argument));
+
+    if (Data.size() - 32 == 0 || Data.size() % 32 != 0)
+      return make_error<StringError>(
+          "Invalid-sized XRay data.",
+          std::make_error_code(std::errc::invalid_argument));
+
+    return readBinaryFormatHeader(Data, FileHeader);
+  }
+
+  bool done() const override { return Remaining.empty(); }
+
+  Error decodeNext(std::vector<XRayRecord> &Records) override {
+    size_t Decoded = 0;
+    for (; !Remaining.empty(); Remaining = Remaining.drop_front(32)) {
+      StringRef S = Remaining;
+      DataExtractor RecordExtractor(S, true, 8);
+      uint32_t OffsetPtr = 0;
+      switch (auto RecordType = RecordExtractor.getU16(&OffsetPtr)) {
+      case 0: { // Normal records.
+        if (Decoded++ == NaiveChunkRecords)
+          return Error::success();
+        Records.emplace_back();
+        auto &Record = Records.back();
+        Record.RecordType = RecordType;
+        Record.CPU = RecordExtractor.getU8(&OffsetPtr);
+        auto Type = RecordExtractor.getU8(&OffsetPtr);
+        switch (Type) {
+        case 0:
+          Record.Type = RecordTypes::ENTER;
+          break;
+        case 1:
+          Record.Type = RecordTypes::EXIT;
+          break;
+        case 2:
+          Record.Type = RecordTypes::TAIL_EXIT;
+          break;
+        case 3:
+          Record.Type = RecordTypes::ENTER_ARG;
+          break;
+        default:
+          return make_error<StringError>(
+              Twine("Unknown record type '") + Twine(int{Type}) + "'",
+              std::make_error_code(std::errc::executable_format_error));
+        }
+        Record.FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
+        Record.TSC = RecordExtractor.getU64(&OffsetPtr);
+        Record.TId = RecordExtractor.getU32(&OffsetPtr);
         break;
-      case 3:
-        Record.Type = RecordTypes::ENTER_ARG;
+      }
+      case 1: { // Arg payload record.
+        if (Records.empty())
+          return make_error<StringError>(
+              Twine("Corrupted log, found arg payload without a preceding "
+                    "function record; offset: ") +
+                  Twine(S.data() - Data.data()),
+              std::make_error_code(std::errc::executable_format_error));
+        auto &Record = Records.back();
+        // Advance two bytes to avoid padding.
+        OffsetPtr += 2;
+        int32_t FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
+        auto TId = RecordExtractor.getU32(&OffsetPtr);
+        if (Record.FuncId != FuncId || Record.TId != TId)
+          return make_error<StringError>(
+              Twine("Corrupted log, found arg payload following non-matching "
+                    "function + thread record. Record for function ") +
+                  Twine(Record.FuncId) + " != " + Twine(FuncId) +
+                  "; offset: " + Twine(S.data() - Data.data()),
+              std::make_error_code(std::errc::executable_format_error));
+        // Advance another four bytes to avoid padding.
+        OffsetPtr += 4;
+        auto Arg = RecordExtractor.getU64(&OffsetPtr);
+        Record.CallArgs.push_back(Arg);
         break;
+      }
       default:
         return make_error<StringError>(
-            Twine("Unknown record type '") + Twine(int{Type}) + "'",
+            Twine("Unknown record type == ") + Twine(RecordType),
             std::make_error_code(std::errc::executable_format_error));
       }
-      Record.FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
-      Record.TSC = RecordExtractor.getU64(&OffsetPtr);
-      Record.TId = RecordExtractor.getU32(&OffsetPtr);
-      break;
-    }
-    case 1: { // Arg payload record.
-      auto &Record = Records.back();
-      // Advance two bytes to avoid padding.
-      OffsetPtr += 2;
-      int32_t FuncId = RecordExtractor.getSigned(&OffsetPtr, sizeof(int32_t));
-      auto TId = RecordExtractor.getU32(&OffsetPtr);
-      if (Record.FuncId != FuncId || Record.TId != TId)
-        return make_error<StringError>(
-            Twine("Corrupted log, found arg payload following non-matching "
-                  "function + thread record. Record for function ") +
-                Twine(Record.FuncId) + " != " + Twine(FuncId) + "; offset: " +
-                Twine(S.data() - Data.data()),
-            std::make_error_code(std::errc::executable_format_error));
-      // Advance another four bytes to avoid padding.
-      OffsetPtr += 4;
-      auto Arg = RecordExtractor.getU64(&OffsetPtr);
-      Record.CallArgs.push_back(Arg);
-      break;
-    }
-    default:
-      return make_error<StringError>(
-          Twine("Unknown record type == ") + Twine(RecordType),
-          std::make_error_code(std::errc::executable_format_error));
     }
+    return Error::success();
   }
-  return Error::success();
-}
+};
 
 /// When reading from a Flight Data Recorder mode log, metadata records are
 /// sparse compared to packed function records, so we must maintain state as we
@@ -305,6 +352,10 @@ Error processFDRCallArgumentRecord(FDRState &State, uint8_t RecordFirstByte,
                                    DataExtractor &RecordExtractor,
                                    std::vector<XRayRecord> &Records) {
   uint32_t OffsetPtr = 1; // Read starting after the first byte.
+  if (Records.empty())
+    return make_error<StringError>(
+        "CallArgument needs to be right after a function entry",
+        std::make_error_code(std::errc::executable_format_error));
   auto &Enter = Records.back();
 
   if (Enter.Type != RecordTypes::ENTER)
@@ -454,7 +505,7 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
   return Error::success();
 }
 
-/// Reads a log in FDR mode for version 1 of this binary format. FDR mode is
+/// Decodes a log in FDR mode for version 1 of this binary format. FDR mode is
 /// defined as part of the compiler-rt project in xray_fdr_logging.h, and such
 /// a log consists of the familiar 32 bit XRayHeader, followed by sequences of
 /// of interspersed 16 byte Metadata Records and 8 byte Function Records.
@@ -491,113 +542,142 @@ Error processFDRFunctionRecord(FDRState &State, uint8_t RecordFirstByte,
 ///                in the buffer. This is measured from the start of the buffer
 ///                and must always be at least 48 (bytes).
 /// EOB: *deprecated*
-Error loadFDRLog(StringRef Data, XRayFileHeader &FileHeader,
-                 std::vector<XRayRecord> &Records) {
-  if (Data.size() < 32)
-    return make_error<StringError>(
-        "Not enough bytes for an XRay log.",
-        std::make_error_code(std::errc::invalid_argument));
+///
+/// The log is decoded one ThreadBuffer at a time, so a chunk ends wherever the
+/// BufferExtents (or, in Version 1, the buffer size) say the buffer does. The
+/// State carries over from one buffer to the next.
+class FDRDecoder final : public TraceDecoder {
+  StringRef Remaining;
+  uint16_t Version;
+  uint64_t BufferSize;
+  FDRState State;
+  bool Finished = false;
+
+public:
+  FDRDecoder(StringRef Data, uint16_t Version, uint64_t BufferSize,
+             FDRState::Token InitialExpectation)
+      : Remaining(Data.drop_front(32)), Version(Version),
+        BufferSize(BufferSize),
+        State{0, 0, 0, InitialExpectation, BufferSize, 0} {}
+
+  static Expected<std::unique_ptr<FDRDecoder>>
+  create(StringRef Data, XRayFileHeader &FileHeader) {
+    if (Data.size() < 32)
+      return make_error<StringError>(
+          "Not enough bytes for an XRay log.",
+          std::make_error_code(std::errc::invalid_argument));
 
-  // For an FDR log, there are records sized 16 and 8 bytes.
-  // There actually may be no records if no non-trivial functions are
-  // instrumented.
-  if (Data.size() % 8 != 0)
-    return make_error<StringError>(
-        "Invalid-sized XRay data.",
-        std::make_error_code(std::errc::invalid_argument));
+    // For an FDR log, there are records sized 16 and 8 bytes.
+    // There actually may be no records if no non-trivial functions are
+    // instrumented.
+    if (Data.size() % 8 != 0)
+      return make_error<StringError>(
+          "Invalid-sized XRay data.",
+          std::make_error_code(std::errc::invalid_argument));
 
-  if (auto E = readBinaryFormatHeader(Data, FileHeader))
-    return E;
+    if (auto E = readBinaryFormatHeader(Data, FileHeader))
+      return std::move(E);
 
-  uint64_t BufferSize = 0;
-  {
-    StringRef ExtraDataRef(FileHeader.FreeFormData, 16);
-    DataExtractor ExtraDataExtractor(ExtraDataRef, true, 8);
-    uint32_t ExtraDataOffset = 0;
-    BufferSize = ExtraDataExtractor.getU64(&ExtraDataOffset);
-  }
+    uint64_t BufferSize = 0;
+    {
+      StringRef ExtraDataRef(FileHeader.FreeFormData, 16);
+      DataExtractor ExtraDataExtractor(ExtraDataRef, true, 8);
+      uint32_t ExtraDataOffset = 0;
+      BufferSize = ExtraDataExtractor.getU64(&ExtraDataOffset);
+    }
 
-  FDRState::Token InitialExpectation;
-  switch (FileHeader.Version) {
-  case 1:
-    InitialExpectation = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
-    break;
-  case 2:
-    InitialExpectation = FDRState::Token::BUFFER_EXTENTS;
-    break;
-  default:
-    return make_error<StringError>(
-        Twine("Unsupported version '") + Twine(FileHeader.Version) + "'",
-        std::make_error_code(std::errc::executable_format_error));
+    FDRState::Token InitialExpectation;
+    switch (FileHeader.Version) {
+    case 1:
+      InitialExpectation = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
+      break;
+    case 2:
+      InitialExpectation = FDRState::Token::BUFFER_EXTENTS;
+      break;
+    default:
+      return make_error<StringError>(
+          Twine("Unsupported version '") + Twine(FileHeader.Version) + "'",
+          std::make_error_code(std::errc::executable_format_error));
+    }
+    return llvm::make_unique<FDRDecoder>(Data, FileHeader.Version, BufferSize,
+                                         InitialExpectation);
   }
-  FDRState State{0, 0, 0, InitialExpectation, BufferSize, 0};
 
-  // RecordSize will tell the loop how far to seek ahead based on the record
-  // type that we have just read.
-  size_t RecordSize = 0;
-  for (auto S = Data.drop_front(32); !S.empty(); S = S.drop_front(RecordSize)) {
-    DataExtractor RecordExtractor(S, true, 8);
-    uint32_t OffsetPtr = 0;
-    if (State.Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF) {
-      RecordSize = State.CurrentBufferSize - State.CurrentBufferConsumed;
-      if (S.size() < RecordSize) {
-        return make_error<StringError>(
-            Twine("Incomplete thread buffer. Expected at least ") +
-                Twine(RecordSize) + " bytes but found " + Twine(S.size()),
-            make_error_code(std::errc::invalid_argument));
+  bool done() const override { return Finished; }
+
+  Error decodeNext(std::vector<XRayRecord> &Records) override {
+    // RecordSize will tell the loop how far to seek ahead based on the record
+    // type that we have just read.
+    size_t RecordSize = 0;
+    for (; !Remaining.empty(); Remaining = Remaining.drop_front(RecordSize)) {
+      StringRef S = Remaining;
+      DataExtractor RecordExtractor(S, true, 8);
+      uint32_t OffsetPtr = 0;
+      if (State.Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF) {
+        RecordSize = State.CurrentBufferSize - State.CurrentBufferConsumed;
+        if (S.size() < RecordSize) {
+          return make_error<StringError>(
+              Twine("Incomplete thread buffer. Expected at least ") +
+                  Twine(RecordSize) + " bytes but found " + Twine(S.size()),
+              make_error_code(std::errc::invalid_argument));
+        }
+        State.CurrentBufferConsumed = 0;
+        State.Expects = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
+        // That was the end of this thread buffer.
+        Remaining = Remaining.drop_front(RecordSize);
+        return Error::success();
+      }
+      uint8_t BitField = RecordExtractor.getU8(&OffsetPtr);
+      bool isMetadataRecord = BitField & 0x01uL;
+      bool isBufferExtents =
+          (BitField >> 1) == 7; // BufferExtents record kind == 7
+      if (isMetadataRecord) {
+        RecordSize = 16;
+        if (auto E = processFDRMetadataRecord(State, BitField, RecordExtractor,
+                                              RecordSize, Records, Version))
+          return E;
+      } else { // Process Function Record
+        RecordSize = 8;
+        if (auto E = processFDRFunctionRecord(State, BitField, RecordExtractor,
+                                              Records))
+          return E;
       }
-      State.CurrentBufferConsumed = 0;
-      State.Expects = FDRState::Token::NEW_BUFFER_RECORD_OR_EOF;
-      continue;
-    }
-    uint8_t BitField = RecordExtractor.getU8(&OffsetPtr);
-    bool isMetadataRecord = BitField & 0x01uL;
-    bool isBufferExtents =
-        (BitField >> 1) == 7; // BufferExtents record kind == 7
-    if (isMetadataRecord) {
-      RecordSize = 16;
-      if (auto E =
-              processFDRMetadataRecord(State, BitField, RecordExtractor,
-                                       RecordSize, Records, FileHeader.Version))
-        return E;
-    } else { // Process Function Record
-      RecordSize = 8;
-      if (auto E = processFDRFunctionRecord(State, BitField, RecordExtractor,
-                                            Records))
-        return E;
-    }
 
-    // The BufferExtents record is technically not part of the buffer, so we
-    // don't count the size of that record against the buffer's actual size.
-    if (!isBufferExtents)
-      State.CurrentBufferConsumed += RecordSize;
-    assert(State.CurrentBufferConsumed <= State.CurrentBufferSize);
-    if (FileHeader.Version == 2 &&
-        State.CurrentBufferSize == State.CurrentBufferConsumed) {
-      // In Version 2 of the log, we don't need to scan to the end of the thread
-      // buffer if we've already consumed all the bytes we need to.
-      State.Expects = FDRState::Token::BUFFER_EXTENTS;
-      State.CurrentBufferSize = BufferSize;
-      State.CurrentBufferConsumed = 0;
+      // The BufferExtents record is technically not part of the buffer, so we
+      // don't count the size of that record against the buffer's actual size.
+      if (!isBufferExtents)
+        State.CurrentBufferConsumed += RecordSize;
+      assert(State.CurrentBufferConsumed <= State.CurrentBufferSize);
+      if (Version == 2 &&
+          State.CurrentBufferSize == State.CurrentBufferConsumed) {
+        // In Version 2 of the log, we don't need to scan to the end of the
+        // thread buffer if we've already consumed all the bytes we need to.
+        State.Expects = FDRState::Token::BUFFER_EXTENTS;
+        State.CurrentBufferSize = BufferSize;
+        State.CurrentBufferConsumed = 0;
+        Remaining = Remaining.drop_front(RecordSize);
+        return Error::success();
+      }
     }
-  }
-
-  // Having iterated over everything we've been given, we've either consumed
-  // everything and ended up in the end state, or were told to skip the rest.
-  bool Finished = State.Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF &&
-                  State.CurrentBufferSize == State.CurrentBufferConsumed;
-  if ((State.Expects != FDRState::Token::NEW_BUFFER_RECORD_OR_EOF &&
-       State.Expects != FDRState::Token::BUFFER_EXTENTS) &&
-      !Finished)
-    return make_error<StringError>(
-        Twine("Encountered EOF with unexpected state expectation ") +
-            fdrStateToTwine(State.Expects) +
-            ". Remaining expected bytes in thread buffer total " +
-            Twine(State.CurrentBufferSize - State.CurrentBufferConsumed),
-        std::make_error_code(std::errc::executable_format_error));
+    Finished = true;
+
+    // Having iterated over everything we've been given, we've either consumed
+    // everything and ended up in the end state, or were told to skip the rest.
+    bool AtEnd = State.Expects == FDRState::Token::SCAN_TO_END_OF_THREAD_BUF &&
+                 State.CurrentBufferSize == State.CurrentBufferConsumed;
+    if ((State.Expects != FDRState::Token::NEW_BUFFER_RECORD_OR_EOF &&
+         State.Expects != FDRState::Token::BUFFER_EXTENTS) &&
+        !AtEnd)
+      return make_error<StringError>(
+          Twine("Encountered EOF with unexpected state expectation ") +
+              fdrStateToTwine(State.Expects) +
+              ". Remaining expected bytes in thread buffer total " +
+              Twine(State.CurrentBufferSize - State.CurrentBufferConsumed),
+          std::make_error_code(std::errc::executable_format_error));
 
-  return Error::success();
-}
+    return Error::success();
+  }
+};
 
 Error loadYAMLLog(StringRef Data, XRayFileHeader &FileHeader,
                   std::vector<XRayRecord> &Records) {
@@ -626,9 +706,34 @@ Error loadYAMLLog(StringRef Data, XRayFileHeader &FileHeader,
                  });
   return Error::success();
 }
-} // namespace
+/// YAML logs are parsed in one go, and handed out as a single chunk.
+class YAMLDecoder final : public TraceDecoder {
+  std::vector<XRayRecord> Records;
+  bool Finished = false;
+
+public:
+  static Expected<std::unique_ptr<YAMLDecoder>>
+  create(StringRef Data, XRayFileHeader &FileHeader) {
+    auto Decoder = llvm::make_unique<YAMLDecoder>();
+    if (auto E = loadYAMLLog(Data, FileHeader, Decoder->Records))
+      return std::move(E);
+    return std::move(Decoder);
+  }
 
-Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
+  bool done() const override { return Finished; }
+
+  Error decodeNext(std::vector<XRayRecord> &Out) override {
+    Out.insert(Out.end(), std::make_move_iterator(Records.begin()),
+               std::make_move_iterator(Records.end()));
+    Records.clear();
+    Finished = true;
+    return Error::success();
+  }
+};
+
+/// Maps the XRay log in |Filename| into memory.
+Expected<std::unique_ptr<sys::fs::mapped_file_region>>
+mapTraceFile(StringRef Filename) {
   int Fd;
   if (auto EC = sys::fs::openFileForRead(Filename, Fd)) {
     return make_error<StringError>(
@@ -637,25 +742,34 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
 
   uint64_t FileSize;
   if (auto EC = sys::fs::file_size(Filename, FileSize)) {
+    sys::Process::SafelyCloseFileDescriptor(Fd);
     return make_error<StringError>(
         Twine("Cannot read log from '") + Filename + "'", EC);
   }
   if (FileSize < 4) {
+    sys::Process::SafelyCloseFileDescriptor(Fd);
     return make_error<StringError>(
         Twine("File '") + Filename + "' too small for XRay.",
         std::make_error_code(std::errc::executable_format_error));
   }
 
   // Map the opened file into memory and use a StringRef to access it later.
+  // The mapping stays valid once the file is closed.
   std::error_code EC;
-  sys::fs::mapped_file_region MappedFile(
+  auto MappedFile = llvm::make_unique<sys::fs::mapped_file_region>(
       Fd, sys::fs::mapped_file_region::mapmode::readonly, FileSize, 0, EC);
+  sys::Process::SafelyCloseFileDescriptor(Fd);
   if (EC) {
     return make_error<StringError>(
         Twine("Cannot read log from '") + Filename + "'", EC);
   }
-  auto Data = StringRef(MappedFile.data(), MappedFile.size());
+  return std::move(MappedFile);
+}
 
+/// Reads the header of the XRay log in |Data| into |FileHeader|, and returns a
+/// decoder for the records that follow it.
+Expected<std::unique_ptr<TraceDecoder>>
+createDecoder(StringRef Data, XRayFileHeader &FileHeader) {
   // Attempt to detect the file type using file magic. We have a slight bias
   // towards the binary format, and we do this by making sure that the first 4
   // bytes of the binary file is some combination of the following byte
@@ -670,7 +784,7 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
   //
   // Only if we can't load either the binary or the YAML format will we yield an
   // error.
-  StringRef Magic(MappedFile.data(), 4);
+  StringRef Magic = Data.take_front(4);
   DataExtractor HeaderExtractor(Magic, true, 8);
   uint32_t OffsetPtr = 0;
   uint16_t Version = HeaderExtractor.getU16(&OffsetPtr);
@@ -678,33 +792,44 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
 
   enum BinaryFormatType { NAIVE_FORMAT = 0, FLIGHT_DATA_RECORDER_FORMAT = 1 };
 
-  Trace T;
   switch (Type) {
   case NAIVE_FORMAT:
     if (Version == 1 || Version == 2) {
-      if (auto E = loadNaiveFormatLog(Data, T.FileHeader, T.Records))
+      if (auto E = NaiveDecoder::readHeader(Data, FileHeader))
         return std::move(E);
-    } else {
-      return make_error<StringError>(
-          Twine("Unsupported version for Basic/Naive Mode logging: ") +
-              Twine(Version),
-          std::make_error_code(std::errc::executable_format_error));
+      return llvm::make_unique<NaiveDecoder>(Data);
     }
-    break;
+    return make_error<StringError>(
+        Twine("Unsupported version for Basic/Naive Mode logging: ") +
+            Twine(Version),
+        std::make_error_code(std::errc::executable_format_error));
   case FLIGHT_DATA_RECORDER_FORMAT:
-    if (Version == 1 || Version == 2) {
-      if (auto E = loadFDRLog(Data, T.FileHeader, T.Records))
-        return std::move(E);
-    } else {
-      return make_error<StringError>(
-          Twine("Unsupported version for FDR Mode logging: ") + Twine(Version),
-          std::make_error_code(std::errc::executable_format_error));
-    }
-    break;
+    if (Version == 1 || Version == 2)
+      return FDRDecoder::create(Data, FileHeader);
+    return make_error<StringError>(
+        Twine("Unsupported version for FDR Mode logging: ") + Twine(Version),
+        std::make_error_code(std::errc::executable_format_error));
   default:
-    if (auto E = loadYAMLLog(Data, T.FileHeader, T.Records))
-      return std::move(E);
+    return YAMLDecoder::create(Data, FileHeader);
   }
+}
+} // namespace
+
+Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
+  auto MappedFileOrErr = mapTraceFile(Filename);
+  if (!MappedFileOrErr)
+    return MappedFileOrErr.takeError();
+  auto &MappedFile = *MappedFileOrErr;
+
+  Trace T;
+  auto DecoderOrErr = createDecoder(
+      StringRef(MappedFile->data(), MappedFile->size()), T.FileHeader);
+  if (!DecoderOrErr)
+    return DecoderOrErr.takeError();
+  auto &Decoder = *DecoderOrErr;
+  while (!Decoder->done())
+    if (auto E = Decoder->decodeNext(T.Records))
+      return std::move(E);
 
   if (Sort)
     std::stable_sort(T.Records.begin(), T.Records.end(),
@@ -714,3 +839,47 @@ Expected<Trace> llvm::xray::loadTraceFile(StringRef Filename, bool Sort) {
 
   return std::move(T);
 }
+
+TraceStream::TraceStream() = default;
+
+TraceStream::~TraceStream() = default;
+
+void TraceStream::record_iterator::decodeNextChunk() {
+  ErrorAsOutParameter ErrAsOutParam(E);
+  Index = 0;
+  Stream->Chunk.clear();
+  // Some chunks, like thread buffers with only metadata in them, have no
+  // records; skip over those.
+  while (Stream->Chunk.empty() && !Stream->Decoder->done()) {
+    if (auto Err = Stream->Decoder->decodeNext(Stream->Chunk)) {
+      *E = std::move(Err);
+      Stream = nullptr;
+      return;
+    }
+  }
+  if (Stream->Chunk.empty())
+    Stream = nullptr;
+}
+
+iterator_range<TraceStream::record_iterator>
+TraceStream::records(Error &Err) {
+  ErrorAsOutParameter ErrAsOutParam(&Err);
+  record_iterator Begin(this, &Err);
+  return make_range(Begin, record_iterator());
+}
+
+Expected<std::unique_ptr<TraceStream>>
+llvm::xray::openTraceFile(StringRef Filename) {
+  auto MappedFileOrErr = mapTraceFile(Filename);
+  if (!MappedFileOrErr)
+    return MappedFileOrErr.takeError();
+
+  std::unique_ptr<TraceStream> S(new TraceStream());
+  S->MappedFile = std::move(*MappedFileOrErr);
+  auto DecoderOrErr = createDecoder(
+      StringRef(S->MappedFile->data(), S->MappedFile->size()), S->FileHeader);
+  if (!DecoderOrErr)
+    return DecoderOrErr.takeError();
+  S->Decoder = std::move(*DecoderOrErr);
+  return std::move(S);
+}
@@ -0,0 +1,34 @@
+; REQUIRES: asserts
+; RUN: rm -rf %t.cache
+; RUN: lli -jit-kind=orc-lazy -persistent-object-cache=%t.cache -stats %s \
+; RUN:     2>&1 | FileCheck --check-prefix=COLD %s
+; RUN: lli -jit-kind=orc-lazy -persistent-object-cache=%t.cache -stats %s \
+; RUN:     2>&1 | FileCheck --check-prefix=WARM %s
+; RUN: ls %t.cache | FileCheck --check-prefix=DIR %s
+;
+; Check that a second run of the same program loads the objects compiled by
+; the first one from the cache directory instead of compiling them again, and
+; that the cache directory can be pruned.
+;
+; COLD-NOT: objects loaded from the object cache
+; COLD: objects written to the object cache
+;
+; WARM: objects loaded from the object cache
+; WARM-NOT: objects written to the object cache
+;
+; DIR: llvmcache-{{[0-9A-F]+}}
+; DIR: llvmcache.manifest
+
+define i32 @foo(i32 %x) {
+entry:
+  %r = mul i32 %x, 2
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %r = call i32 @foo(i32 21)
+  %ok = icmp eq i32 %r, 42
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,31 @@
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-slab-memory %s
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-slab-memory -orc-lazy-huge-pages %s
+;
+; Check that partitions whose sections share slabs can call each other and
+; read each other's data. main returns zero only if the call chain computes 42.
+
+@offset = global i32 1
+@factor = constant i32 2
+
+define i32 @bar(i32 %x) {
+entry:
+  %f = load i32, i32* @factor
+  %r = mul i32 %x, %f
+  ret i32 %r
+}
+
+define i32 @foo(i32 %x) {
+entry:
+  %o = load i32, i32* @offset
+  %y = add i32 %x, %o
+  %r = call i32 @bar(i32 %y)
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %r = call i32 @foo(i32 20)
+  %ok = icmp eq i32 %r, 42
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,45 @@
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-speculate \
+; RUN:     -orc-lazy-debug=funcs-to-stdout %s | FileCheck %s
+;
+; Check that functions compiled speculatively on the background thread, or on
+; demand if their stubs are called first, give the right result. main returns
+; zero only if the call chain computes 42. Whether cold gets compiled before
+; the JIT shuts down is a race, so it isn't checked for.
+;
+; CHECK-DAG: [ main {{.*}}]
+; CHECK-DAG: [ foo {{.*}}]
+; CHECK-DAG: [ bar ]
+
+define i32 @bar(i32 %x) {
+entry:
+  %r = mul i32 %x, 2
+  ret i32 %r
+}
+
+define i32 @foo(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  %r = call i32 @bar(i32 %y)
+  ret i32 %r
+}
+
+define i32 @cold(i32 %x) {
+entry:
+  ret i32 %x
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %big = icmp sgt i32 %argc, 100
+  br i1 %big, label %unlikely, label %likely
+
+unlikely:
+  %c = call i32 @cold(i32 %argc)
+  ret i32 %c
+
+likely:
+  %r = call i32 @foo(i32 20)
+  %ok = icmp eq i32 %r, 42
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,46 @@
+; REQUIRES: asserts
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-tiered -orc-lazy-tier-up-threshold=10 \
+; RUN:     -orc-lazy-sync-tier-up -stats %s 2>&1 | FileCheck %s
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-tiered -orc-lazy-tier-up-threshold=10 \
+; RUN:     -stats %s long 2>&1 | FileCheck %s
+;
+; Check that a hot function is recompiled while the program runs, and that
+; calls keep giving the right result across the switch from the first tier's
+; body to the recompiled one. With -orc-lazy-sync-tier-up, hot is recompiled
+; during its 11th call, so that the other 89 calls run the new body. Without
+; it, hot is recompiled by a background thread that polls the call counts, so
+; given an argument main calls hot 50000000 times to leave that thread time to
+; swap the body in. main returns zero only if every call computed 42.
+;
+; CHECK: {{^ *}}1 lli {{ *}}- Number of functions recompiled by -orc-lazy-tiered
+
+define i32 @hot(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  %r = mul i32 %y, 2
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %long = icmp sgt i32 %argc, 1
+  %n = select i1 %long, i32 50000000, i32 100
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %next ]
+  %r = call i32 @hot(i32 20)
+  %ok = icmp eq i32 %r, 42
+  br i1 %ok, label %next, label %fail
+
+next:
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+fail:
+  ret i32 1
+
+exit:
+  ret i32 0
+}
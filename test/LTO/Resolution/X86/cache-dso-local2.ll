@@ -8,7 +8,7 @@
 ; RUN: llvm-lto2 run -o %t.o %t.bc -cache-dir %t.cache \
 ; RUN:   -r %t.bc,foo,plx \
 ; RUN:   -r %t.bc,bar,px
-; RUN: ls %t.cache | count 2
+; RUN: ls %t.cache | count 4
 
 target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
 target triple = "x86_64-unknown-linux-gnu"
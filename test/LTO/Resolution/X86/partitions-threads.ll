@@ -0,0 +1,43 @@
+; RUN: llvm-as -o %t.bc %s
+; RUN: llvm-lto2 run %t.bc -o %t.o -lto-partitions=4 -lto-codegen-threads=2 \
+; RUN:     -r=%t.bc,a,px -r=%t.bc,b,px -r=%t.bc,c,px -r=%t.bc,d,px
+; RUN: llvm-nm %t.o.0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-nm %t.o.1 | FileCheck --check-prefix=CHECK1 %s
+; RUN: llvm-nm %t.o.2 | FileCheck --check-prefix=CHECK2 %s
+; RUN: llvm-nm %t.o.3 | FileCheck --check-prefix=CHECK3 %s
+
+; Four partitions are generated on two threads. The partitions are numbered
+; from the most to the least expensive.
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; CHECK3: T a
+; CHECK3-NOT: T
+define i32 @a(i32 %x) {
+  ret i32 %x
+}
+
+; CHECK2: T b
+; CHECK2-NOT: T
+define i32 @b(i32 %x) {
+  %1 = add i32 %x, 1
+  ret i32 %1
+}
+
+; CHECK1: T c
+; CHECK1-NOT: T
+define i32 @c(i32 %x) {
+  %1 = add i32 %x, 1
+  %2 = mul i32 %1, 3
+  ret i32 %2
+}
+
+; CHECK0: T d
+; CHECK0-NOT: T
+define i32 @d(i32 %x) {
+  %1 = add i32 %x, 1
+  %2 = mul i32 %1, 3
+  %3 = xor i32 %2, 5
+  ret i32 %3
+}
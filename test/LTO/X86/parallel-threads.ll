@@ -0,0 +1,42 @@
+; RUN: llvm-as -o %t.bc %s
+; RUN: llvm-lto -exported-symbol=a -exported-symbol=b -exported-symbol=c \
+; RUN:     -exported-symbol=d -j4 -codegen-threads=2 -o %t.o %t.bc
+; RUN: llvm-nm %t.o.0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-nm %t.o.1 | FileCheck --check-prefix=CHECK1 %s
+; RUN: llvm-nm %t.o.2 | FileCheck --check-prefix=CHECK2 %s
+; RUN: llvm-nm %t.o.3 | FileCheck --check-prefix=CHECK3 %s
+
+; Four partitions are generated on two threads. The partitions are numbered
+; from the most to the least expensive.
+
+target triple = "x86_64-unknown-linux-gnu"
+
+; CHECK3: T a
+; CHECK3-NOT: T
+define i32 @a(i32 %x) {
+  ret i32 %x
+}
+
+; CHECK2: T b
+; CHECK2-NOT: T
+define i32 @b(i32 %x) {
+  %1 = add i32 %x, 1
+  ret i32 %1
+}
+
+; CHECK1: T c
+; CHECK1-NOT: T
+define i32 @c(i32 %x) {
+  %1 = add i32 %x, 1
+  %2 = mul i32 %1, 3
+  ret i32 %2
+}
+
+; CHECK0: T d
+; CHECK0-NOT: T
+define i32 @d(i32 %x) {
+  %1 = add i32 %x, 1
+  %2 = mul i32 %1, 3
+  %3 = xor i32 %2, 5
+  ret i32 %3
+}
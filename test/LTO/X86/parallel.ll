@@ -8,17 +8,20 @@
 
 target triple = "x86_64-unknown-linux-gnu"
 
-; CHECK0-NOT: bar
-; CHECK0: T foo
-; CHECK0-NOT: bar
+; The partitions are balanced by estimated codegen cost. foo and bar cost the
+; same, so the tie is broken by name and bar goes to the first partition.
+
+; CHECK1-NOT: bar
+; CHECK1: T foo
+; CHECK1-NOT: bar
 define void @foo() {
   call void @bar()
   ret void
 }
 
-; CHECK1-NOT: foo
-; CHECK1: T bar
-; CHECK1-NOT: foo
+; CHECK0-NOT: foo
+; CHECK0: T bar
+; CHECK0-NOT: foo
 define void @bar() {
   call void @foo()
   ret void
@@ -0,0 +1,47 @@
+# Listens on the socket given as the first argument like a cache server that
+# answers every Get request with a 4 EiB object and fails every Put request,
+# and runs the command that follows "--" against it.
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+
+def read(conn, size):
+    data = b''
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            raise EOFError()
+        data += chunk
+    return data
+
+def serve(conn):
+    try:
+        op = read(conn, 1)
+        key_size = struct.unpack('<I', read(conn, 4))[0]
+        read(conn, key_size)
+        if op == b'P':
+            read(conn, struct.unpack('<Q', read(conn, 8))[0])
+            conn.sendall(b'\x02')
+        else:
+            conn.sendall(b'\x00' + struct.pack('<Q', 1 << 62))
+    except (EOFError, socket.error):
+        pass
+    conn.close()
+
+def accept(s):
+    while True:
+        conn, _ = s.accept()
+        serve(conn)
+
+if os.path.exists(sys.argv[1]):
+    os.unlink(sys.argv[1])
+s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+s.bind(sys.argv[1])
+s.listen(16)
+t = threading.Thread(target=accept, args=(s,))
+t.daemon = True
+t.start()
+sys.exit(subprocess.call(sys.argv[sys.argv.index('--') + 1:]))
@@ -0,0 +1,15 @@
+# Sends a malformed request to the cache server listening on the socket given
+# as the first argument, and prints the status it answers with.
+import socket
+import struct
+import sys
+
+s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+s.connect(sys.argv[1])
+if sys.argv[2] == 'key':
+    # A Get request with a 4 GiB key.
+    s.sendall(b'G' + struct.pack('<I', 0xffffffff))
+else:
+    # A Put request with a valid key and a 4 EiB object.
+    s.sendall(b'P' + struct.pack('<I', 1) + b'k' + struct.pack('<Q', 1 << 62))
+print('status: %d' % bytearray(s.recv(1))[0])
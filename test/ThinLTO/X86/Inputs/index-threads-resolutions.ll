@@ -0,0 +1,25 @@
+; The RUN lines of index-threads-resolutions.ll replace NUM with a different
+; number for each module.
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@aliasNUM = alias void (), void ()* @implNUM
+
+define void @wrapNUM() {
+  ret void
+}
+
+define void @localNUM() {
+  ret void
+}
+
+define internal void @implNUM() {
+  call void @localNUM()
+  ret void
+}
+
+define void @callNUM() {
+  call void @wrapNUM()
+  call void @aliasNUM()
+  ret void
+}
@@ -0,0 +1,16 @@
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@var = global i32 42
+@local = internal global i32 1
+
+define i32 @foo() {
+  %1 = load i32, i32* @var
+  %2 = load i32, i32* @local
+  %3 = add i32 %1, %2
+  ret i32 %3
+}
+
+define linkonce_odr void @odr() {
+  ret void
+}
@@ -0,0 +1,20 @@
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@var = external global i32
+
+define void @bar() {
+  call void @odr()
+  ret void
+}
+
+define linkonce_odr void @odr() {
+  ret void
+}
+
+define internal void @helper() {
+  store i32 0, i32* @var
+  ret void
+}
+
+@baz = alias void (), void ()* @helper
@@ -0,0 +1,97 @@
+; Verify that ThinLTO backends are shared through a cache server.
+; UNSUPPORTED: windows
+
+; RUN: opt -module-hash -module-summary %s -o %t.bc
+; RUN: opt -module-hash -module-summary %p/Inputs/cache.ll -o %t2.bc
+; RUN: rm -rf %t.server %t.local %t.sock
+
+; The first link builds both objects and stores them in the server.
+; RUN: llvm-lto-cache-server -socket=%t.sock -cache-dir=%t.server -print-stats \
+; RUN:  -- llvm-lto2 run -o %t1.o %t2.bc %t.bc -cache-server=%t.sock \
+; RUN:  -print-cache-stats \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx | FileCheck %s --check-prefix=FILL
+; RUN: ls %t.server/llvmcache-* | count 2
+; RUN: ls %t.server/llvmcache.manifest
+
+; FILL: lookups: 2 (0 hits, 2 misses, 0 errors)
+; FILL: stores: 2 (0 errors)
+; FILL: Cache server statistics:
+; FILL-NEXT: lookups: 2 (0 hits, 2 misses)
+; FILL-NEXT: stores: 2
+
+; The second link gets them from the server, and adds them to its local cache.
+; RUN: llvm-lto-cache-server -socket=%t.sock -cache-dir=%t.server -print-stats \
+; RUN:  -- llvm-lto2 run -o %t2.o %t2.bc %t.bc -cache-server=%t.sock \
+; RUN:  -cache-dir=%t.local -print-cache-stats \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx | FileCheck %s --check-prefix=HIT
+; RUN: ls %t.local/llvmcache-* | count 2
+; RUN: cmp %t1.o.1 %t2.o.1
+; RUN: cmp %t1.o.2 %t2.o.2
+
+; HIT: lookups: 2 (2 hits, 0 misses, 0 errors)
+; HIT: stores: 0 (0 errors)
+; HIT: Cache server statistics:
+; HIT-NEXT: lookups: 2 (2 hits, 0 misses)
+; HIT-NEXT: stores: 0
+
+; The third link only uses its local cache.
+; RUN: llvm-lto-cache-server -socket=%t.sock -cache-dir=%t.server -print-stats \
+; RUN:  -- llvm-lto2 run -o %t3.o %t2.bc %t.bc -cache-server=%t.sock \
+; RUN:  -cache-dir=%t.local -print-cache-stats \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx | FileCheck %s --check-prefix=LOCAL
+
+; LOCAL: lookups: 0 (0 hits, 0 misses, 0 errors)
+; LOCAL: Cache server statistics:
+; LOCAL-NEXT: lookups: 0 (0 hits, 0 misses)
+
+; A link whose server is unreachable builds everything itself.
+; RUN: llvm-lto2 run -o %t4.o %t2.bc %t.bc -cache-server=%t.sock \
+; RUN:  -print-cache-stats \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx | FileCheck %s --check-prefix=DOWN
+; RUN: cmp %t1.o.1 %t4.o.1
+
+; DOWN: lookups: 2 (0 hits, 0 misses, 2 errors)
+; DOWN: stores: 2 (2 errors)
+
+; Requests with a length the server won't allocate are rejected, and the
+; server keeps running.
+; RUN: llvm-lto-cache-server -socket=%t.sock -cache-dir=%t.server -print-stats \
+; RUN:  -- %python %p/Inputs/cache-server-request.py %t.sock key \
+; RUN:  | FileCheck %s --check-prefix=BADLEN
+; RUN: llvm-lto-cache-server -socket=%t.sock -cache-dir=%t.server -print-stats \
+; RUN:  -max-object-size=1048576 \
+; RUN:  -- %python %p/Inputs/cache-server-request.py %t.sock object \
+; RUN:  | FileCheck %s --check-prefix=BADLEN
+
+; BADLEN: status: 2
+; BADLEN: Cache server statistics:
+; BADLEN: failed requests: 1
+
+; A lookup whose answer is larger than the client accepts fails, and the link
+; builds the object itself.
+; RUN: %python %p/Inputs/cache-server-huge-response.py %t.sock \
+; RUN:  -- llvm-lto2 run -o %t5.o %t2.bc %t.bc -cache-server=%t.sock \
+; RUN:  -print-cache-stats \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx | FileCheck %s --check-prefix=HUGE
+; RUN: cmp %t1.o.1 %t5.o.1
+
+; HUGE: lookups: 2 (0 hits, 0 misses, 2 errors)
+; HUGE: stores: 2 (2 errors)
+
+target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-apple-macosx10.11.0"
+
+define void @globalfunc() #0 {
+entry:
+  ret void
+}
@@ -40,8 +40,17 @@
 ; RUN:  -r=%t2.bc,_main,plx \
 ; RUN:  -r=%t2.bc,_globalfunc,lx \
 ; RUN:  -r=%t.bc,_globalfunc,plx
-; RUN: ls %t.cache | count 2
+; RUN: ls %t.cache | count 4
 ; RUN: ls %t.cache/llvmcache-* | count 2
+; RUN: ls %t.cache/llvmcache.manifest
+; RUN: grep -c '^+ ' %t.cache/llvmcache.journal | FileCheck %s --check-prefix=INSERTS
+
+; Verify that cache hits are recorded in the journal of the manifest.
+; RUN: llvm-lto2 run -o %t.o %t2.bc %t.bc -cache-dir %t.cache \
+; RUN:  -r=%t2.bc,_main,plx \
+; RUN:  -r=%t2.bc,_globalfunc,lx \
+; RUN:  -r=%t.bc,_globalfunc,plx
+; RUN: grep -c '^= ' %t.cache/llvmcache.journal | FileCheck %s --check-prefix=HITS
 
 ; Verify that caches with a timestamp older than the pruning interval
 ; will be pruned
@@ -114,6 +123,9 @@
 ; RUN: not ls %t.cache/llvmcache-foo-1024
 ; RUN: not ls %t.cache/llvmcache-foo-77
 
+; INSERTS: {{^}}2{{$}}
+; HITS: {{^}}2{{$}}
+
 target datalayout = "e-m:o-i64:64-f80:128-n8:16:32:64-S128"
 target triple = "x86_64-apple-macosx10.11.0"
 
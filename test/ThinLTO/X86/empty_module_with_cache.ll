@@ -11,7 +11,7 @@
 ; RUN: rm -Rf %t.cache
 ; RUN: llvm-lto2 run -o %t.o %t2.bc  %t.bc -cache-dir %t.cache \
 ; RUN:  -r=%t2.bc,_main,plx
-; RUN: ls %t.cache | count 2
+; RUN: ls %t.cache | count 4
 
 ; Same, but without hash, the index will be empty and caching should not happen
 
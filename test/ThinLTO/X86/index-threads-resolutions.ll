@@ -0,0 +1,79 @@
+; Check that the summaries that are changed after a read, for linker
+; redefined symbols (--wrap, --defsym) and symbols resolved to a local
+; definition, and the aliases of the modules, are read the same on several
+; threads as serially.
+
+; RUN: opt -module-summary %s -o %t0.bc
+; RUN: sed -e s/NUM/1/g %p/Inputs/index-threads-resolutions.ll \
+; RUN:     | opt -module-summary -o %t1.bc
+; RUN: sed -e s/NUM/2/g %p/Inputs/index-threads-resolutions.ll \
+; RUN:     | opt -module-summary -o %t2.bc
+; RUN: sed -e s/NUM/3/g %p/Inputs/index-threads-resolutions.ll \
+; RUN:     | opt -module-summary -o %t3.bc
+; RUN: sed -e s/NUM/4/g %p/Inputs/index-threads-resolutions.ll \
+; RUN:     | opt -module-summary -o %t4.bc
+
+; RUN: llvm-lto2 run %t0.bc %t1.bc %t2.bc %t3.bc %t4.bc -o %t.serial \
+; RUN:     -save-temps \
+; RUN:     -r=%t0.bc,main,plx -r=%t0.bc,call1, -r=%t0.bc,call2, \
+; RUN:     -r=%t0.bc,call3, -r=%t0.bc,call4, \
+; RUN:     -r=%t1.bc,alias1,pl -r=%t1.bc,wrap1,pr -r=%t1.bc,local1,pl \
+; RUN:     -r=%t1.bc,call1,pl \
+; RUN:     -r=%t2.bc,alias2,pl -r=%t2.bc,wrap2,pr -r=%t2.bc,local2,pl \
+; RUN:     -r=%t2.bc,call2,pl \
+; RUN:     -r=%t3.bc,alias3,pl -r=%t3.bc,wrap3,pr -r=%t3.bc,local3,pl \
+; RUN:     -r=%t3.bc,call3,pl \
+; RUN:     -r=%t4.bc,alias4,pl -r=%t4.bc,wrap4,pr -r=%t4.bc,local4,pl \
+; RUN:     -r=%t4.bc,call4,pl
+; RUN: llvm-lto2 run %t0.bc %t1.bc %t2.bc %t3.bc %t4.bc -o %t.threads \
+; RUN:     -save-temps -thinlto-index-threads=4 \
+; RUN:     -r=%t0.bc,main,plx -r=%t0.bc,call1, -r=%t0.bc,call2, \
+; RUN:     -r=%t0.bc,call3, -r=%t0.bc,call4, \
+; RUN:     -r=%t1.bc,alias1,pl -r=%t1.bc,wrap1,pr -r=%t1.bc,local1,pl \
+; RUN:     -r=%t1.bc,call1,pl \
+; RUN:     -r=%t2.bc,alias2,pl -r=%t2.bc,wrap2,pr -r=%t2.bc,local2,pl \
+; RUN:     -r=%t2.bc,call2,pl \
+; RUN:     -r=%t3.bc,alias3,pl -r=%t3.bc,wrap3,pr -r=%t3.bc,local3,pl \
+; RUN:     -r=%t3.bc,call3,pl \
+; RUN:     -r=%t4.bc,alias4,pl -r=%t4.bc,wrap4,pr -r=%t4.bc,local4,pl \
+; RUN:     -r=%t4.bc,call4,pl
+
+; RUN: llvm-dis < %t.serial.1.3.import.bc -o %t0.serial.ll
+; RUN: llvm-dis < %t.threads.1.3.import.bc -o %t0.threads.ll
+; RUN: diff %t0.serial.ll %t0.threads.ll
+; RUN: FileCheck %s --check-prefix=MOD0 < %t0.threads.ll
+; RUN: llvm-dis < %t.serial.5.3.import.bc -o %t4.serial.ll
+; RUN: llvm-dis < %t.threads.5.3.import.bc -o %t4.threads.ll
+; RUN: diff %t4.serial.ll %t4.threads.ll
+; RUN: FileCheck %s --check-prefix=MOD4 < %t4.threads.ll
+
+; The redefined symbols are not imported, the local ones and the aliases are.
+; MOD0: define available_externally dso_local void @local1()
+; MOD0: define available_externally dso_local void @call1()
+; MOD0: declare void @wrap1()
+; MOD0: define available_externally dso_local void @alias1()
+; MOD0: define available_externally dso_local void @local4()
+; MOD0: define available_externally dso_local void @call4()
+; MOD0: declare void @wrap4()
+; MOD0: define available_externally dso_local void @alias4()
+
+; The redefined symbol is weak in the module that defines it.
+; MOD4: @alias4 = dso_local alias void (), void ()* @impl4
+; MOD4: define weak void @wrap4()
+; MOD4: define dso_local void @local4()
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare void @call1()
+declare void @call2()
+declare void @call3()
+declare void @call4()
+
+define i32 @main() {
+  call void @call1()
+  call void @call2()
+  call void @call3()
+  call void @call4()
+  ret i32 0
+}
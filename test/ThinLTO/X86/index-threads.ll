@@ -0,0 +1,91 @@
+; Check that reading the summaries and running the thin link analyses on
+; several threads gives the same result as doing it serially.
+
+; RUN: opt -module-summary %s -o %t1.bc
+; RUN: opt -module-summary %p/Inputs/index-threads1.ll -o %t2.bc
+; RUN: opt -module-summary %p/Inputs/index-threads2.ll -o %t3.bc
+
+; RUN: llvm-lto2 run %t1.bc %t2.bc %t3.bc -o %t.serial \
+; RUN:     -thinlto-distributed-indexes \
+; RUN:     -r=%t1.bc,main,plx -r=%t1.bc,foo, -r=%t1.bc,bar, \
+; RUN:     -r=%t1.bc,baz, -r=%t1.bc,odr,plx -r=%t1.bc,dead,pl \
+; RUN:     -r=%t2.bc,foo,pl -r=%t2.bc,odr,l -r=%t2.bc,var,pl \
+; RUN:     -r=%t3.bc,bar,pl -r=%t3.bc,odr,l -r=%t3.bc,baz,pl \
+; RUN:     -r=%t3.bc,var,
+; RUN: mv %t1.bc.thinlto.bc %t1.serial.thinlto.bc
+; RUN: mv %t2.bc.thinlto.bc %t2.serial.thinlto.bc
+; RUN: mv %t3.bc.thinlto.bc %t3.serial.thinlto.bc
+; RUN: mv %t1.bc.imports %t1.serial.imports
+
+; RUN: llvm-lto2 run %t1.bc %t2.bc %t3.bc -o %t.threads \
+; RUN:     -thinlto-index-threads=4 \
+; RUN:     -thinlto-distributed-indexes \
+; RUN:     -r=%t1.bc,main,plx -r=%t1.bc,foo, -r=%t1.bc,bar, \
+; RUN:     -r=%t1.bc,baz, -r=%t1.bc,odr,plx -r=%t1.bc,dead,pl \
+; RUN:     -r=%t2.bc,foo,pl -r=%t2.bc,odr,l -r=%t2.bc,var,pl \
+; RUN:     -r=%t3.bc,bar,pl -r=%t3.bc,odr,l -r=%t3.bc,baz,pl \
+; RUN:     -r=%t3.bc,var,
+; RUN: cmp %t1.serial.thinlto.bc %t1.bc.thinlto.bc
+; RUN: cmp %t2.serial.thinlto.bc %t2.bc.thinlto.bc
+; RUN: cmp %t3.serial.thinlto.bc %t3.bc.thinlto.bc
+; RUN: cmp %t1.serial.imports %t1.bc.imports
+; RUN: FileCheck %s --check-prefix=IMPORTS < %t1.bc.imports
+
+; IMPORTS-DAG: index-threads.ll.tmp2.bc
+; IMPORTS-DAG: index-threads.ll.tmp3.bc
+
+; The in-process backends see the same linkages, imports and dead symbols.
+; RUN: llvm-lto2 run %t1.bc %t2.bc %t3.bc -o %t.o -save-temps \
+; RUN:     -r=%t1.bc,main,plx -r=%t1.bc,foo, -r=%t1.bc,bar, \
+; RUN:     -r=%t1.bc,baz, -r=%t1.bc,odr,plx -r=%t1.bc,dead,pl \
+; RUN:     -r=%t2.bc,foo,pl -r=%t2.bc,odr,l -r=%t2.bc,var,pl \
+; RUN:     -r=%t3.bc,bar,pl -r=%t3.bc,odr,l -r=%t3.bc,baz,pl \
+; RUN:     -r=%t3.bc,var,
+; RUN: llvm-dis %t.o.1.3.import.bc -o %t1.serial.ll
+; RUN: llvm-dis %t.o.3.3.import.bc -o %t3.serial.ll
+; RUN: llvm-lto2 run %t1.bc %t2.bc %t3.bc -o %t.o -save-temps \
+; RUN:     -thinlto-index-threads=4 \
+; RUN:     -r=%t1.bc,main,plx -r=%t1.bc,foo, -r=%t1.bc,bar, \
+; RUN:     -r=%t1.bc,baz, -r=%t1.bc,odr,plx -r=%t1.bc,dead,pl \
+; RUN:     -r=%t2.bc,foo,pl -r=%t2.bc,odr,l -r=%t2.bc,var,pl \
+; RUN:     -r=%t3.bc,bar,pl -r=%t3.bc,odr,l -r=%t3.bc,baz,pl \
+; RUN:     -r=%t3.bc,var,
+; RUN: llvm-dis %t.o.1.3.import.bc -o %t1.threads.ll
+; RUN: llvm-dis %t.o.3.3.import.bc -o %t3.threads.ll
+; RUN: diff %t1.serial.ll %t1.threads.ll
+; RUN: diff %t3.serial.ll %t3.threads.ll
+; RUN: FileCheck %s --check-prefix=MOD1 < %t1.threads.ll
+; RUN: FileCheck %s --check-prefix=MOD3 < %t3.threads.ll
+
+; MOD1-DAG: define weak_odr dso_local void @odr()
+; MOD1-DAG: define available_externally dso_local i32 @foo()
+; MOD1-DAG: define available_externally dso_local void @bar()
+; MOD1-DAG: define available_externally dso_local void @baz()
+; MOD1-NOT: @dead
+
+; MOD3-DAG: define available_externally dso_local void @odr()
+; MOD3-DAG: define dso_local void @bar()
+; MOD3-DAG: @baz = dso_local alias
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+declare i32 @foo()
+declare void @bar()
+declare void @baz()
+
+define i32 @main() {
+  call void @odr()
+  call void @bar()
+  call void @baz()
+  %1 = call i32 @foo()
+  ret i32 %1
+}
+
+define linkonce_odr void @odr() {
+  ret void
+}
+
+define void @dead() {
+  ret void
+}
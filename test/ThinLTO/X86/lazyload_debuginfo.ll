@@ -0,0 +1,78 @@
+; Do setup work for all below tests: generate bitcode and combined index
+; RUN: opt -module-summary %s -o %t.bc -bitcode-mdindex-threshold=0
+; RUN: opt -module-summary %p/Inputs/lazyload_debuginfo.ll -o %t2.bc
+; RUN: llvm-lto -thinlto-action=thinlink -o %t3.bc %t.bc %t2.bc
+; REQUIRES: asserts
+
+; Check that importing @foo loads neither the enums, retained types, globals
+; and macros of its compile unit, nor the imported entities that aren't local
+; to a function, nor the types that only these refer to.
+
+; RUN: llvm-lto -thinlto-action=import %t2.bc -thinlto-index=%t3.bc \
+; RUN:          -o /dev/null -stats \
+; RUN:  2>&1 | FileCheck %s -check-prefix=LAZY
+; LAZY: 67 bitcode-reader  - Number of Metadata records loaded
+; LAZY: 7 bitcode-reader  - Number of MDStrings loaded
+
+; RUN: llvm-lto -thinlto-action=import %t2.bc -thinlto-index=%t3.bc \
+; RUN:          -o /dev/null -disable-ondemand-mds-loading -stats \
+; RUN:  2>&1 | FileCheck %s -check-prefix=NOTLAZY
+; NOTLAZY: 93 bitcode-reader  - Number of Metadata records loaded
+; NOTLAZY: 20 bitcode-reader  - Number of MDStrings loaded
+
+; The imported compile unit is the same either way.
+; RUN: llvm-lto -thinlto-action=import %t2.bc -thinlto-index=%t3.bc -o - \
+; RUN:   | llvm-dis -o - | FileCheck %s
+; CHECK: DICompileUnit(
+; CHECK-NOT: enums:
+; CHECK-NOT: retainedTypes:
+; CHECK-NOT: globals:
+; CHECK-NOT: macros:
+; CHECK-SAME: imports: ![[IMP:[0-9]+]]
+; CHECK-NOT: DICompositeType
+; CHECK: ![[IMP]] = !{![[LOCAL:[0-9]+]]}
+; CHECK: ![[LOCAL]] = !DIImportedEntity({{.*}}name: "local"
+; CHECK-NOT: DICompositeType
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define void @foo() !dbg !20 {
+  ret void, !dbg !21
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!30, !31}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C_plus_plus, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: FullDebug, enums: !2, retainedTypes: !6, globals: !9, imports: !12, macros: !17)
+!1 = !DIFile(filename: "a.cc", directory: "")
+!2 = !{!3}
+!3 = !DICompositeType(tag: DW_TAG_enumeration_type, name: "E", scope: !5, file: !1, line: 1, size: 32, elements: !4, identifier: "_ZTSN1N1EE")
+!4 = !{!40, !41}
+!5 = !DINamespace(name: "N", scope: null)
+!6 = !{!7}
+!7 = !DICompositeType(tag: DW_TAG_structure_type, name: "S", scope: !5, file: !1, line: 2, size: 32, elements: !8, identifier: "_ZTSN1N1SE")
+!8 = !{!42}
+!9 = !{!10}
+!10 = !DIGlobalVariableExpression(var: !11, expr: !DIExpression())
+!11 = distinct !DIGlobalVariable(name: "g", scope: !5, file: !1, line: 3, type: !7, isLocal: false, isDefinition: true)
+!12 = !{!13, !16}
+!13 = !DIImportedEntity(tag: DW_TAG_imported_declaration, scope: !5, entity: !14, file: !1, line: 4)
+!14 = !DISubprogram(name: "d", linkageName: "_ZN1N1dEv", scope: !5, file: !1, line: 4, type: !15, isLocal: false, isDefinition: false, flags: DIFlagPrototyped, isOptimized: false)
+!15 = !DISubroutineType(types: !43)
+!16 = !DIImportedEntity(tag: DW_TAG_imported_module, name: "local", scope: !20, entity: !5, file: !1, line: 6)
+!17 = !{!18}
+!18 = !DIMacroFile(file: !1, nodes: !19)
+!19 = !{!44}
+!20 = distinct !DISubprogram(name: "foo", scope: !1, file: !1, line: 5, type: !22, isLocal: false, isDefinition: true, scopeLine: 5, isOptimized: false, unit: !0, variables: !23)
+!21 = !DILocation(line: 6, column: 1, scope: !20)
+!22 = !DISubroutineType(types: !23)
+!23 = !{}
+!30 = !{i32 2, !"Dwarf Version", i32 4}
+!31 = !{i32 2, !"Debug Info Version", i32 3}
+!40 = !DIEnumerator(name: "A", value: 0)
+!41 = !DIEnumerator(name: "B", value: 1)
+!42 = !DIDerivedType(tag: DW_TAG_member, name: "m", scope: !7, file: !1, baseType: !45, size: 32)
+!43 = !{null, !7}
+!44 = !DIMacro(type: DW_MACINFO_define, line: 1, name: "X", value: "1")
+!45 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
@@ -0,0 +1,37 @@
+; RUN: opt -disable-verify -module-summary %s -o %t.bc \
+; RUN:     -bitcode-mdindex-threshold=0
+; RUN: opt -module-summary %p/Inputs/lazyload_debuginfo.ll -o %t2.bc
+; RUN: llvm-lto -thinlto-action=thinlink -o %t3.bc %t.bc %t2.bc
+
+; Check that importing @foo doesn't crash when the imported entities of its
+; compile unit refer to something that isn't an imported entity. The loader
+; keeps it, and the verifier drops the invalid debug info.
+
+; RUN: llvm-lto -thinlto-action=import %t2.bc -thinlto-index=%t3.bc \
+; RUN:          -o %t4.bc 2>&1 | FileCheck %s
+; CHECK: invalid imported entity ref
+; CHECK: warning: ignoring invalid debug info
+; RUN: llvm-dis %t4.bc -o - | FileCheck %s -check-prefix=IMPORT
+; IMPORT: define available_externally void @foo()
+; IMPORT-NOT: DICompileUnit
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define void @foo() !dbg !4 {
+  ret void, !dbg !5
+}
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!8, !9}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C_plus_plus, file: !1, producer: "clang", isOptimized: true, runtimeVersion: 0, emissionKind: FullDebug, imports: !2)
+!1 = !DIFile(filename: "a.cc", directory: "")
+!2 = !{!3, !"not an entity"}
+!3 = !DIImportedEntity(tag: DW_TAG_imported_module, name: "local", scope: !4, entity: !1, file: !1, line: 6)
+!4 = distinct !DISubprogram(name: "foo", scope: !1, file: !1, line: 5, type: !6, isLocal: false, isDefinition: true, scopeLine: 5, isOptimized: false, unit: !0, variables: !7)
+!5 = !DILocation(line: 6, column: 1, scope: !4)
+!6 = !DISubroutineType(types: !7)
+!7 = !{}
+!8 = !{i32 2, !"Dwarf Version", i32 4}
+!9 = !{i32 2, !"Debug Info Version", i32 3}
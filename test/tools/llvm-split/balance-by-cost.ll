@@ -0,0 +1,55 @@
+; RUN: llvm-split -balance-by-cost -o %t %s
+; RUN: llvm-dis -o - %t0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-dis -o - %t1 | FileCheck --check-prefix=CHECK1 %s
+
+; @big and @small1 keep the functions that only they call. The partitions are
+; balanced by cost, and the most expensive one comes first.
+
+; CHECK0: declare i32 @big(i32)
+; CHECK1: define i32 @big(i32 %x)
+define i32 @big(i32 %x) {
+  %a = add i32 %x, 1
+  %b = add i32 %a, 2
+  %c = add i32 %b, 3
+  %d = add i32 %c, 4
+  %e = call i32 @helper(i32 %d)
+  ret i32 %e
+}
+
+; CHECK0: declare i32 @helper(i32)
+; CHECK1: define i32 @helper(i32 %x)
+define i32 @helper(i32 %x) {
+  %a = add i32 %x, 1
+  ret i32 %a
+}
+
+; CHECK0: define void @small1()
+; CHECK1: declare void @small1()
+define void @small1() {
+  call void @small2()
+  ret void
+}
+
+; CHECK0: define void @small2()
+; CHECK1: declare void @small2()
+define void @small2() {
+  ret void
+}
+
+; CHECK0: define void @small3()
+; CHECK1: declare void @small3()
+define void @small3() {
+  ret void
+}
+
+; CHECK0: define void @small4()
+; CHECK1: declare void @small4()
+define void @small4() {
+  ret void
+}
+
+; CHECK0: define void @small5()
+; CHECK1: declare void @small5()
+define void @small5() {
+  ret void
+}
@@ -227,6 +227,11 @@ class DeclContext {
   uint32_t LastSeenCompileUnitID = 0;
   uint32_t CanonicalDIEOffset = 0;
 
+  /// When the objects are cloned in parallel, the canonical DIE is picked
+  /// before cloning, see pickCanonicalDIEs(). This is its position in the
+  /// order in which the DIEs are cloned, or 0 if none was picked.
+  uint64_t CanonicalDIEOrder = 0;
+
 public:
   using Map = DenseSet<DeclContext *, DeclMapInfo>;
 
@@ -246,6 +251,15 @@ public:
   uint32_t getCanonicalDIEOffset() const { return CanonicalDIEOffset; }
   void setCanonicalDIEOffset(uint32_t Offset) { CanonicalDIEOffset = Offset; }
 
+  uint64_t getCanonicalDIEOrder() const { return CanonicalDIEOrder; }
+  void setCanonicalDIEOrder(uint64_t Order) { CanonicalDIEOrder = Order; }
+
+  /// \returns whether this context has a canonical DIE in the objects linked
+  /// so far, be it already cloned or only picked.
+  bool hasCanonicalDIE() const {
+    return CanonicalDIEOffset || CanonicalDIEOrder;
+  }
+
   bool isDefinedInClangModule() const { return DefinedInClangModule; }
   void setDefinedInClangModule(bool Val) { DefinedInClangModule = Val; }
 
@@ -1510,9 +1524,23 @@ private:
     /// cheap lookup during the root DIE selection and during DIE cloning.
     unsigned NextValidReloc = 0;
 
+    /// The warnings about the relocations of the current DebugMapObject. They
+    /// are found on a thread of their own when linking with several threads,
+    /// and are only reported by reportWarnings(), in the order of the objects.
+    std::vector<std::string> Warnings;
+
+    void addWarning(const Twine &Warning) { Warnings.push_back(Warning.str()); }
+
   public:
     RelocationManager(DwarfLinker &Linker) : Linker(Linker) {}
 
+    /// Report the warnings of findValidRelocsInDebugInfo() for \p DMO.
+    void reportWarnings(const DebugMapObject &DMO) {
+      for (const std::string &Warning : Warnings)
+        Linker.reportWarning(Warning, DMO);
+      Warnings.clear();
+    }
+
     bool hasValidRelocs() const { return !ValidRelocs.empty(); }
 
     /// Reset the NextValidReloc counter.
@@ -1541,6 +1569,61 @@ private:
                           bool isLittleEndian);
   };
 
+  /// The state of an object that is cloned concurrently with the others. The
+  /// DIECloner records here what depends on the objects before (string
+  /// offsets, abbreviation numbers, DIE offsets) instead of doing it, and
+  /// finishDeferredClone() does it in object order, so that the output is the
+  /// same as the one of a serial link.
+  struct DeferredClone {
+    /// Storage for the DIEs of this object, in place of the linker's.
+    BumpPtrAllocator DIEAlloc;
+    std::vector<DIELoc *> DIELocs;
+    std::vector<DIEBlock *> DIEBlocks;
+
+    /// Position of the last DIE cloned in the order of a serial link, see
+    /// pickCanonicalDIEs().
+    uint64_t DIEOrder = 0;
+
+    /// The strings, in the order a serial link gives them offsets.
+    std::vector<DwarfStringPoolEntryRef> Strings;
+
+    /// DW_FORM_strp attributes to set to the offset of their string.
+    std::vector<std::pair<PatchLocation, DwarfStringPoolEntryRef>>
+        StringAttributes;
+
+    /// The abbreviations in the order a serial link numbers them: the one of
+    /// a DIE, or a copy of an input abbreviation (see copyAbbrev()).
+    struct AbbrevUse {
+      DIE *Die;
+      const DWARFAbbreviationDeclaration *Copy;
+      bool HasODR;
+    };
+    std::vector<AbbrevUse> Abbrevs;
+
+    /// The DIEs picked as the canonical DIE of their context.
+    std::vector<std::tuple<DeclContext *, const DIE *, const CompileUnit *>>
+        CanonicalDIEs;
+
+    /// ref_addr attributes to set to the offset of the canonical DIE of a
+    /// context.
+    std::vector<std::pair<PatchLocation, const DeclContext *>>
+        CanonicalReferences;
+
+    /// ref_addr attributes to set to the offset of a DIE cloned before them.
+    std::vector<std::tuple<PatchLocation, const DIE *, const CompileUnit *>>
+        BackwardReferences;
+
+    /// The warnings about this object, reported once it is finished.
+    std::vector<std::pair<std::string, DWARFDie>> Warnings;
+
+    ~DeferredClone() {
+      for (DIEBlock *Block : DIEBlocks)
+        Block->~DIEBlock();
+      for (DIELoc *Loc : DIELocs)
+        Loc->~DIELoc();
+    }
+  };
+
   /// Keeps track of data associated with one object during linking.
   struct LinkContext {
     DebugMapObject &DMO;
@@ -1551,6 +1634,16 @@ private:
     RangesTy Ranges;
     UnitListTy CompileUnits;
 
+    /// Set once prepareDebugObject() ran for this object.
+    bool Prepared = false;
+
+    /// Whether the debug info has relocations against debug map entries.
+    bool HasValidRelocs = false;
+
+    /// Set when the object is cloned concurrently with the others, see
+    /// cloneObjectsInParallel().
+    std::unique_ptr<DeferredClone> Deferred;
+
     LinkContext(const DebugMap &Map, DwarfLinker &Linker, DebugMapObject &DMO,
                 bool Verbose = false)
         : DMO(DMO), BinHolder(Verbose), RelocMgr(Linker) {
@@ -1566,12 +1659,42 @@ private:
     }
   };
 
+  /// Find the valid relocations of \p Context's debug info and parse all of
+  /// its DIEs. This only touches state owned by \p Context, so it can run
+  /// concurrently for different objects. Its warnings are kept in
+  /// \p Context's RelocationManager until they are reported.
+  void prepareDebugObject(LinkContext &Context);
+
   /// Called at the start of a debug object link.
   void startDebugObject(LinkContext &Context);
 
   /// Called at the end of a debug object link.
   void endDebugObject(LinkContext &Context);
 
+  /// Link the loaded objects of \p ObjectContexts, analyzing them on a thread
+  /// and cloning them on another.
+  void cloneObjects(std::vector<LinkContext> &ObjectContexts,
+                    UniquingStringPool &UniquingStringPool,
+                    OffsetsStringPool &OffsetsStringPool,
+                    DeclContextTree &ODRContexts);
+
+  /// Link the loaded objects of \p ObjectContexts, cloning their DIEs on
+  /// Options.Threads threads. The output is the same as the one of a serial
+  /// link.
+  void cloneObjectsInParallel(std::vector<LinkContext> &ObjectContexts,
+                              UniquingStringPool &UniquingStringPool,
+                              OffsetsStringPool &OffsetsStringPool,
+                              DeclContextTree &ODRContexts);
+
+  /// Finish the link of the DIEs that DIECloner::cloneAllCompileUnitDIEs()
+  /// cloned for \p Context. This must be called in object order.
+  void finishDeferredClone(LinkContext &Context,
+                           OffsetsStringPool &StringPool);
+
+  /// While the objects to clone in parallel are analyzed, the warnings are
+  /// kept with the object they are about, until it is finished.
+  DeferredClone *AnalyzedClone = nullptr;
+
   /// \defgroup FindRootDIEs Find DIEs corresponding to debug map entries.
   ///
   /// @{
@@ -1659,13 +1782,16 @@ private:
     std::vector<std::unique_ptr<CompileUnit>> &CompileUnits;
     LinkOptions Options;
 
+    /// Set when the object is cloned concurrently with the others.
+    DeferredClone *Deferred;
+
   public:
     DIECloner(DwarfLinker &Linker, RelocationManager &RelocMgr,
               BumpPtrAllocator &DIEAlloc,
               std::vector<std::unique_ptr<CompileUnit>> &CompileUnits,
-              LinkOptions &Options)
+              LinkOptions &Options, DeferredClone *Deferred = nullptr)
         : Linker(Linker), RelocMgr(RelocMgr), DIEAlloc(DIEAlloc),
-          CompileUnits(CompileUnits), Options(Options) {}
+          CompileUnits(CompileUnits), Options(Options), Deferred(Deferred) {}
 
     /// Recursively clone \p InputDIE into an tree of DIE objects
     /// where useless (as decided by lookForDIEsToKeep()) bits have been
@@ -1690,6 +1816,12 @@ private:
                               const DebugMapObject &DMO, RangesTy &Ranges,
                               OffsetsStringPool &StringPool);
 
+    /// Clone the DIE trees of all the compile units, recording in Deferred
+    /// what cloneAllCompileUnits() does with the state shared between objects.
+    /// DwarfLinker::finishDeferredClone() does the rest.
+    void cloneAllCompileUnitDIEs(const DebugMapObject &DMO,
+                                 OffsetsStringPool &StringPool);
+
   private:
     using AttributeSpec = DWARFAbbreviationDeclaration::AttributeSpec;
 
@@ -1782,6 +1914,22 @@ private:
     /// Create a copy of abbreviation Abbrev.
     void copyAbbrev(const DWARFAbbreviationDeclaration &Abbrev, bool hasODR);
 
+    /// Get the string pool entry for \p S. When cloning in parallel, the entry
+    /// only gets its offset in DwarfLinker::finishDeferredClone().
+    DwarfStringPoolEntryRef getStringEntry(OffsetsStringPool &StringPool,
+                                           StringRef S);
+
+    /// Like ::resolveDIEReference(), but with the warning reported by
+    /// reportWarning().
+    DWARFDie resolveDIEReference(const DebugMapObject &DMO,
+                                 const DWARFFormValue &RefValue,
+                                 const DWARFDie &DIE, CompileUnit *&RefCU);
+
+    /// Report a warning now, or when the object is finished if it is cloned
+    /// in parallel.
+    void reportWarning(const Twine &Warning, const DebugMapObject &DMO,
+                       const DWARFDie *DIE = nullptr) const;
+
     uint32_t hashFullyQualifiedName(DWARFDie DIE, CompileUnit &U,
                                     const DebugMapObject &DMO,
                                     int RecurseDepth = 0);
@@ -1795,6 +1943,11 @@ private:
   /// Assign an abbreviation number to \p Abbrev
   void AssignAbbrev(DIEAbbrev &Abbrev);
 
+  /// Emit the cloned \p CompileUnits of an object, with their line tables,
+  /// accelerator entries, ranges and locations.
+  void emitCompileUnits(UnitListTy &CompileUnits, DWARFContext &DwarfContext,
+                        const DebugMapObject &DMO, RangesTy &Ranges);
+
   /// Compute and emit debug_ranges section for \p Unit, and
   /// patch the attributes referencing it.
   void patchRangesForUnit(const CompileUnit &Unit, DWARFContext &Dwarf,
@@ -1889,14 +2042,11 @@ getUnitForOffset(std::vector<std::unique_ptr<CompileUnit>> &Units,
   return CU != Units.end() ? CU->get() : nullptr;
 }
 
-/// Resolve the DIE attribute reference that has been extracted in \p RefValue.
-/// The resulting DIE might be in another CompileUnit which is stored into \p
-/// ReferencedCU. \returns null if resolving fails for any reason.
+/// Find the DIE that the reference extracted in \p RefValue points to, like
+/// resolveDIEReference(), but without reporting a warning when there is none.
 static DWARFDie
-resolveDIEReference(const DwarfLinker &Linker, const DebugMapObject &DMO,
-                    std::vector<std::unique_ptr<CompileUnit>> &Units,
-                    const DWARFFormValue &RefValue, const DWARFUnit &Unit,
-                    const DWARFDie &DIE, CompileUnit *&RefCU) {
+findReferencedDIE(std::vector<std::unique_ptr<CompileUnit>> &Units,
+                  const DWARFFormValue &RefValue, CompileUnit *&RefCU) {
   assert(RefValue.isFormClass(DWARFFormValue::FC_Reference));
   uint64_t RefOffset = *RefValue.getAsReference();
 
@@ -1907,6 +2057,19 @@ resolveDIEReference(const DwarfLinker &Linker, const DebugMapObject &DMO,
       if (!RefDie.isNULL())
         return RefDie;
     }
+  return DWARFDie();
+}
+
+/// Resolve the DIE attribute reference that has been extracted in \p RefValue.
+/// The resulting DIE might be in another CompileUnit which is stored into \p
+/// ReferencedCU. \returns null if resolving fails for any reason.
+static DWARFDie
+resolveDIEReference(const DwarfLinker &Linker, const DebugMapObject &DMO,
+                    std::vector<std::unique_ptr<CompileUnit>> &Units,
+                    const DWARFFormValue &RefValue, const DWARFUnit &Unit,
+                    const DWARFDie &DIE, CompileUnit *&RefCU) {
+  if (auto RefDie = findReferencedDIE(Units, RefValue, RefCU))
+    return RefDie;
 
   Linker.reportWarning("could not find referenced DIE", DMO, &DIE);
   return DWARFDie();
@@ -2135,17 +2298,17 @@ bool DwarfLinker::DIECloner::getDIENames(const DWARFDie &Die,
   // short name.
   if (!Info.MangledName)
     if (const char *MangledName = Die.getName(DINameKind::LinkageName))
-      Info.MangledName = StringPool.getEntry(MangledName);
+      Info.MangledName = getStringEntry(StringPool, MangledName);
 
   if (!Info.Name)
     if (const char *Name = Die.getName(DINameKind::ShortName))
-      Info.Name = StringPool.getEntry(Name);
+      Info.Name = getStringEntry(StringPool, Name);
 
   if (StripTemplate && Info.Name && Info.MangledName != Info.Name) {
     // FIXME: dsymutil compatibility. This is wrong for operator<
     auto Split = Info.Name.getString().split('<');
     if (!Split.second.empty())
-      Info.NameWithoutTemplate = StringPool.getEntry(Split.first);
+      Info.NameWithoutTemplate = getStringEntry(StringPool, Split.first);
   }
 
   return Info.Name || Info.MangledName;
@@ -2155,6 +2318,12 @@ bool DwarfLinker::DIECloner::getDIENames(const DWARFDie &Die,
 /// specific \p DIE related to the warning.
 void DwarfLinker::reportWarning(const Twine &Warning, const DebugMapObject &DMO,
                                 const DWARFDie *DIE) const {
+  if (AnalyzedClone) {
+    AnalyzedClone->Warnings.emplace_back(Warning.str(),
+                                         DIE ? *DIE : DWARFDie());
+    return;
+  }
+
   StringRef Context = DMO.getObjectFilename();
   warn(Warning, Context);
 
@@ -2258,6 +2427,26 @@ static bool dieNeedsChildrenToBeMeaningful(uint32_t Tag) {
   llvm_unreachable("Invalid Tag");
 }
 
+void DwarfLinker::prepareDebugObject(LinkContext &Context) {
+  if (Context.Prepared)
+    return;
+  Context.Prepared = true;
+
+  if (Context.DMO.getType() == MachO::N_AST || !Context.ObjectFile)
+    return;
+
+  if (LLVM_LIKELY(!Options.Update))
+    Context.HasValidRelocs = Context.RelocMgr.findValidRelocsInDebugInfo(
+        *Context.ObjectFile, Context.DMO);
+
+  if (!Context.DwarfContext || (!Context.HasValidRelocs && !Options.Update))
+    return;
+
+  // Extracting the DIEs is what makes the first analysis of a unit expensive.
+  for (const auto &CU : Context.DwarfContext->compile_units())
+    CU->getNumDIEs();
+}
+
 void DwarfLinker::startDebugObject(LinkContext &Context) {
   // Iterate over the debug map entries and put all the ones that are
   // functions (because they have a size) into the Ranges map. This map is
@@ -2340,16 +2529,14 @@ void DwarfLinker::RelocationManager::findValidRelocsMachO(
     if (isMachOPairedReloc(Obj.getAnyRelocationType(MachOReloc),
                            Obj.getArch())) {
       SkipNext = true;
-      Linker.reportWarning("unsupported relocation in debug_info section.",
-                           DMO);
+      addWarning("unsupported relocation in debug_info section.");
       continue;
     }
 
     unsigned RelocSize = 1 << Obj.getAnyRelocationLength(MachOReloc);
     uint64_t Offset64 = Reloc.getOffset();
     if ((RelocSize != 4 && RelocSize != 8)) {
-      Linker.reportWarning("unsupported relocation in debug_info section.",
-                           DMO);
+      addWarning("unsupported relocation in debug_info section.");
       continue;
     }
     uint32_t Offset = Offset64;
@@ -2374,7 +2561,7 @@ void DwarfLinker::RelocationManager::findValidRelocsMachO(
       Expected<StringRef> SymbolName = Sym->getName();
       if (!SymbolName) {
         consumeError(SymbolName.takeError());
-        Linker.reportWarning("error getting relocation symbol name.", DMO);
+        addWarning("error getting relocation symbol name.");
         continue;
       }
       if (const auto *Mapping = DMO.lookupSymbol(*SymbolName))
@@ -2397,8 +2584,7 @@ bool DwarfLinker::RelocationManager::findValidRelocs(
   if (auto *MachOObj = dyn_cast<object::MachOObjectFile>(&Obj))
     findValidRelocsMachO(Section, *MachOObj, DMO);
   else
-    Linker.reportWarning(
-        Twine("unsupported object file type: ") + Obj.getFileName(), DMO);
+    addWarning(Twine("unsupported object file type: ") + Obj.getFileName());
 
   if (ValidRelocs.empty())
     return false;
@@ -2685,7 +2871,7 @@ void DwarfLinker::keepDIEAndDependencies(RelocationManager &RelocMgr,
                                           ReferencedCU)) {
       uint32_t RefIdx = ReferencedCU->getOrigUnit().getDIEIndex(RefDie);
       CompileUnit::DIEInfo &Info = ReferencedCU->getInfo(RefIdx);
-      bool IsModuleRef = Info.Ctxt && Info.Ctxt->getCanonicalDIEOffset() &&
+      bool IsModuleRef = Info.Ctxt && Info.Ctxt->hasCanonicalDIE() &&
                          Info.Ctxt->isDefinedInClangModule();
       // If the referenced DIE has a DeclContext that has already been
       // emitted, then do not keep the one in this CU. We'll link to
@@ -2698,12 +2884,12 @@ void DwarfLinker::keepDIEAndDependencies(RelocationManager &RelocMgr,
       if (AttrSpec.Form != dwarf::DW_FORM_ref_addr && (UseODR || IsModuleRef) &&
           Info.Ctxt &&
           Info.Ctxt != ReferencedCU->getInfo(Info.ParentIdx).Ctxt &&
-          Info.Ctxt->getCanonicalDIEOffset() && isODRAttribute(AttrSpec.Attr))
+          Info.Ctxt->hasCanonicalDIE() && isODRAttribute(AttrSpec.Attr))
         continue;
 
       // Keep a module forward declaration if there is no definition.
       if (!(isODRAttribute(AttrSpec.Attr) && Info.Ctxt &&
-            Info.Ctxt->getCanonicalDIEOffset()))
+            Info.Ctxt->hasCanonicalDIE()))
         Info.Prune = false;
 
       unsigned ODRFlag = UseODR ? TF_ODR : 0;
@@ -2826,7 +3012,7 @@ unsigned DwarfLinker::DIECloner::cloneStringAttribute(
     const DWARFUnit &U, OffsetsStringPool &StringPool, AttributesInfo &Info) {
   // Switch everything to out of line strings.
   const char *String = *Val.getAsCString();
-  auto StringEntry = StringPool.getEntry(String);
+  auto StringEntry = getStringEntry(StringPool, String);
 
   // Update attributes info.
   if (AttrSpec.Attr == dwarf::DW_AT_name)
@@ -2835,6 +3021,14 @@ unsigned DwarfLinker::DIECloner::cloneStringAttribute(
            AttrSpec.Attr == dwarf::DW_AT_linkage_name)
     Info.MangledName = StringEntry;
 
+  if (Deferred) {
+    Deferred->StringAttributes.emplace_back(
+        Die.addValue(DIEAlloc, dwarf::Attribute(AttrSpec.Attr),
+                     dwarf::DW_FORM_strp, DIEInteger(0)),
+        StringEntry);
+    return 4;
+  }
+
   Die.addValue(DIEAlloc, dwarf::Attribute(AttrSpec.Attr), dwarf::DW_FORM_strp,
                DIEInteger(StringEntry.getOffset()));
 
@@ -2851,8 +3045,7 @@ unsigned DwarfLinker::DIECloner::cloneDieReferenceAttribute(
   CompileUnit *RefUnit = nullptr;
   DeclContext *Ctxt = nullptr;
 
-  DWARFDie RefDie =
-      resolveDIEReference(Linker, DMO, CompileUnits, Val, U, InputDIE, RefUnit);
+  DWARFDie RefDie = resolveDIEReference(DMO, Val, InputDIE, RefUnit);
 
   // If the referenced DIE is not found,  drop the attribute.
   if (!RefDie || AttrSpec.Attr == dwarf::DW_AT_sibling)
@@ -2865,7 +3058,18 @@ unsigned DwarfLinker::DIECloner::cloneDieReferenceAttribute(
   // at it.
   if (isODRAttribute(AttrSpec.Attr)) {
     Ctxt = RefInfo.Ctxt;
-    if (Ctxt && Ctxt->getCanonicalDIEOffset()) {
+    if (Deferred && Ctxt && Ctxt->getCanonicalDIEOrder()) {
+      // The canonical DIE was picked before cloning. It is emitted before
+      // this DIE if it comes first in the order of a serial link. Its offset
+      // is only known once its object is finished.
+      if (Ctxt->getCanonicalDIEOrder() <= Deferred->DIEOrder) {
+        Deferred->CanonicalReferences.emplace_back(
+            Die.addValue(DIEAlloc, dwarf::Attribute(AttrSpec.Attr),
+                         dwarf::DW_FORM_ref_addr, DIEInteger(0xBADDEF)),
+            Ctxt);
+        return U.getRefAddrByteSize();
+      }
+    } else if (Ctxt && Ctxt->getCanonicalDIEOffset()) {
       DIEInteger Attr(Ctxt->getCanonicalDIEOffset());
       Die.addValue(DIEAlloc, dwarf::Attribute(AttrSpec.Attr),
                    dwarf::DW_FORM_ref_addr, Attr);
@@ -2889,7 +3093,14 @@ unsigned DwarfLinker::DIECloner::cloneDieReferenceAttribute(
     // FIXME: we should be able to design DIEEntry reliance on
     // DwarfDebug away.
     uint64_t Attr;
-    if (Ref < InputDIE.getOffset()) {
+    if (Ref < InputDIE.getOffset() && Deferred) {
+      // We must have already cloned that DIE, but its offset is only known
+      // once the object is finished.
+      Deferred->BackwardReferences.emplace_back(
+          Die.addValue(DIEAlloc, dwarf::Attribute(AttrSpec.Attr),
+                       dwarf::DW_FORM_ref_addr, DIEInteger(0xBADDEF)),
+          NewRefDie, RefUnit);
+    } else if (Ref < InputDIE.getOffset()) {
       // We must have already cloned that DIE.
       uint32_t NewRefOffset =
           RefUnit->getStartOffset() + NewRefDie->getOffset();
@@ -2923,10 +3134,10 @@ unsigned DwarfLinker::DIECloner::cloneBlockAttribute(DIE &Die,
   // Just copy the block data over.
   if (AttrSpec.Form == dwarf::DW_FORM_exprloc) {
     Loc = new (DIEAlloc) DIELoc;
-    Linker.DIELocs.push_back(Loc);
+    (Deferred ? Deferred->DIELocs : Linker.DIELocs).push_back(Loc);
   } else {
     Block = new (DIEAlloc) DIEBlock;
-    Linker.DIEBlocks.push_back(Block);
+    (Deferred ? Deferred->DIEBlocks : Linker.DIEBlocks).push_back(Block);
   }
   Attr = Loc ? static_cast<DIEValueList *>(Loc)
              : static_cast<DIEValueList *>(Block);
@@ -3017,9 +3228,8 @@ unsigned DwarfLinker::DIECloner::cloneScalarAttribute(
     else if (auto OptionalValue = Val.getAsSectionOffset())
       Value = *OptionalValue;
     else {
-      Linker.reportWarning(
-          "Unsupported scalar attribute form. Dropping attribute.", DMO,
-          &InputDIE);
+      reportWarning("Unsupported scalar attribute form. Dropping attribute.",
+                    DMO, &InputDIE);
       return 0;
     }
     if (AttrSpec.Attr == dwarf::DW_AT_declaration && Value)
@@ -3042,9 +3252,8 @@ unsigned DwarfLinker::DIECloner::cloneScalarAttribute(
   else if (auto OptionalValue = Val.getAsUnsignedConstant())
     Value = *OptionalValue;
   else {
-    Linker.reportWarning(
-        "Unsupported scalar attribute form. Dropping attribute.", DMO,
-        &InputDIE);
+    reportWarning("Unsupported scalar attribute form. Dropping attribute.", DMO,
+                  &InputDIE);
     return 0;
   }
   PatchLocation Patch =
@@ -3107,9 +3316,8 @@ unsigned DwarfLinker::DIECloner::cloneAttribute(
     return cloneScalarAttribute(Die, InputDIE, DMO, Unit, AttrSpec, Val,
                                 AttrSize, Info);
   default:
-    Linker.reportWarning(
-        "Unsupported attribute form in cloneAttribute. Dropping.", DMO,
-        &InputDIE);
+    reportWarning("Unsupported attribute form in cloneAttribute. Dropping.",
+                  DMO, &InputDIE);
   }
 
   return 0;
@@ -3216,25 +3424,28 @@ void DwarfLinker::DIECloner::addObjCAccelerator(CompileUnit &Unit,
     return;
 
   StringRef Selector(SelectorStart.data(), SelectorStart.size() - 1);
-  Unit.addNameAccelerator(Die, StringPool.getEntry(Selector), SkipPubSection);
+  Unit.addNameAccelerator(Die, getStringEntry(StringPool, Selector),
+                          SkipPubSection);
 
   // Add an entry for the class name that points to this
   // method/class function.
   StringRef ClassName(ClassNameStart.data(), FirstSpace);
-  Unit.addObjCAccelerator(Die, StringPool.getEntry(ClassName), SkipPubSection);
+  Unit.addObjCAccelerator(Die, getStringEntry(StringPool, ClassName),
+                          SkipPubSection);
 
   if (ClassName[ClassName.size() - 1] == ')') {
     size_t OpenParens = ClassName.find('(');
     if (OpenParens != StringRef::npos) {
       StringRef ClassNameNoCategory(ClassName.data(), OpenParens);
-      Unit.addObjCAccelerator(Die, StringPool.getEntry(ClassNameNoCategory),
-                              SkipPubSection);
+      Unit.addObjCAccelerator(
+          Die, getStringEntry(StringPool, ClassNameNoCategory), SkipPubSection);
 
       std::string MethodNameNoCategory(Name.getString().data(), OpenParens + 2);
       // FIXME: The missing space here may be a bug, but
       //        dsymutil-classic also does it this way.
       MethodNameNoCategory.append(SelectorStart);
-      Unit.addNameAccelerator(Die, StringPool.getEntry(MethodNameNoCategory),
+      Unit.addNameAccelerator(Die,
+                              getStringEntry(StringPool, MethodNameNoCategory),
                               SkipPubSection);
     }
   }
@@ -3264,6 +3475,48 @@ shouldSkipAttribute(DWARFAbbreviationDeclaration::AttributeSpec AttrSpec,
   }
 }
 
+/// Pick, in the order in which a serial link clones the DIEs of \p Unit, the
+/// ones that become the canonical DIE of their context, like cloneDIE() does.
+/// \p Order is the position of the last DIE in that order.
+static void pickCanonicalDIEs(CompileUnit &Unit, const DWARFDie &InputDIE,
+                              uint64_t &Order) {
+  unsigned Idx = Unit.getOrigUnit().getDIEIndex(InputDIE);
+  CompileUnit::DIEInfo &Info = Unit.getInfo(Idx);
+  if (!Info.Keep)
+    return;
+
+  ++Order;
+  if ((Unit.hasODR() || Unit.isClangModule()) && !Info.Incomplete &&
+      InputDIE.getTag() != dwarf::DW_TAG_namespace && Info.Ctxt &&
+      Info.Ctxt != Unit.getInfo(Info.ParentIdx).Ctxt &&
+      !Info.Ctxt->hasCanonicalDIE())
+    Info.Ctxt->setCanonicalDIEOrder(Order);
+
+  for (auto Child : InputDIE.children())
+    pickCanonicalDIEs(Unit, Child, Order);
+}
+
+/// Set the offsets and sizes of \p Die and its children, starting at \p
+/// Offset, once their abbreviation numbers are known. The DIEs of an object
+/// cloned in parallel have sizes that leave out the abbreviation numbers.
+/// \returns the offset that follows \p Die.
+static uint32_t layOutDIE(DIE &Die, uint32_t Offset) {
+  uint32_t AttributesSize = Die.getSize();
+  for (DIE &Child : Die.children())
+    AttributesSize -= Child.getSize();
+  if (Die.hasChildren())
+    AttributesSize -= sizeof(int8_t);
+
+  Die.setOffset(Offset);
+  Offset += getULEB128Size(Die.getAbbrevNumber()) + AttributesSize;
+  for (DIE &Child : Die.children())
+    Offset = layOutDIE(Child, Offset);
+  if (Die.hasChildren())
+    Offset += sizeof(int8_t);
+  Die.setSize(Offset - Die.getOffset());
+  return Offset;
+}
+
 DIE *DwarfLinker::DIECloner::cloneDIE(const DWARFDie &InputDIE,
                                       const DebugMapObject &DMO,
                                       CompileUnit &Unit,
@@ -3290,7 +3543,12 @@ DIE *DwarfLinker::DIECloner::cloneDIE(const DWARFDie &InputDIE,
 
   assert(Die->getTag() == InputDIE.getTag());
   Die->setOffset(OutOffset);
-  if ((Unit.hasODR() || Unit.isClangModule()) && !Info.Incomplete &&
+  if (Deferred) {
+    // The canonical DIEs were picked before cloning, see pickCanonicalDIEs().
+    uint64_t Order = ++Deferred->DIEOrder;
+    if (Info.Ctxt && Info.Ctxt->getCanonicalDIEOrder() == Order)
+      Deferred->CanonicalDIEs.emplace_back(Info.Ctxt, Die, &Unit);
+  } else if ((Unit.hasODR() || Unit.isClangModule()) && !Info.Incomplete &&
       Die->getTag() != dwarf::DW_TAG_namespace && Info.Ctxt &&
       Info.Ctxt != Unit.getInfo(Info.ParentIdx).Ctxt &&
       !Info.Ctxt->getCanonicalDIEOffset()) {
@@ -3403,7 +3661,7 @@ DIE *DwarfLinker::DIECloner::cloneDIE(const DWARFDie &InputDIE,
 
   } else if (Tag == dwarf::DW_TAG_namespace) {
     if (!AttrInfo.Name)
-      AttrInfo.Name = StringPool.getEntry("(anonymous namespace)");
+      AttrInfo.Name = getStringEntry(StringPool, "(anonymous namespace)");
     Unit.addNamespaceAccelerator(Die, AttrInfo.Name);
   } else if (isTypeTag(Tag) && !AttrInfo.IsDeclaration &&
              getDIENames(InputDIE, AttrInfo, StringPool) && AttrInfo.Name &&
@@ -3431,15 +3689,21 @@ DIE *DwarfLinker::DIECloner::cloneDIE(const DWARFDie &InputDIE,
     }
   }
 
-  DIEAbbrev NewAbbrev = Die->generateAbbrev();
-  if (HasChildren)
-    NewAbbrev.setChildrenFlag(dwarf::DW_CHILDREN_yes);
-  // Assign a permanent abbrev number
-  Linker.AssignAbbrev(NewAbbrev);
-  Die->setAbbrevNumber(NewAbbrev.getNumber());
-
-  // Add the size of the abbreviation number to the output offset.
-  OutOffset += getULEB128Size(Die->getAbbrevNumber());
+  if (Deferred) {
+    // The abbreviation number is assigned by finishDeferredClone(), which
+    // then adds its size to the offsets, see layOutDIE().
+    Deferred->Abbrevs.push_back({Die, nullptr, false});
+  } else {
+    DIEAbbrev NewAbbrev = Die->generateAbbrev();
+    if (HasChildren)
+      NewAbbrev.setChildrenFlag(dwarf::DW_CHILDREN_yes);
+    // Assign a permanent abbrev number
+    Linker.AssignAbbrev(NewAbbrev);
+    Die->setAbbrevNumber(NewAbbrev.getNumber());
+
+    // Add the size of the abbreviation number to the output offset.
+    OutOffset += getULEB128Size(Die->getAbbrevNumber());
+  }
 
   if (!HasChildren) {
     // Update our size.
@@ -3821,8 +4085,9 @@ void DwarfLinker::patchFrameInfoForObject(const DebugMapObject &DMO,
   }
 }
 
-void DwarfLinker::DIECloner::copyAbbrev(
-    const DWARFAbbreviationDeclaration &Abbrev, bool hasODR) {
+/// \returns a copy of the input abbreviation \p Abbrev, see copyAbbrev().
+static DIEAbbrev getAbbrevCopy(const DWARFAbbreviationDeclaration &Abbrev,
+                               bool hasODR) {
   DIEAbbrev Copy(dwarf::Tag(Abbrev.getTag()),
                  dwarf::Form(Abbrev.hasChildren()));
 
@@ -3832,10 +4097,50 @@ void DwarfLinker::DIECloner::copyAbbrev(
       Form = dwarf::DW_FORM_ref_addr;
     Copy.AddAttribute(dwarf::Attribute(Attr.Attr), dwarf::Form(Form));
   }
+  return Copy;
+}
+
+void DwarfLinker::DIECloner::copyAbbrev(
+    const DWARFAbbreviationDeclaration &Abbrev, bool hasODR) {
+  if (Deferred) {
+    Deferred->Abbrevs.push_back({nullptr, &Abbrev, hasODR});
+    return;
+  }
 
+  DIEAbbrev Copy = getAbbrevCopy(Abbrev, hasODR);
   Linker.AssignAbbrev(Copy);
 }
 
+DwarfStringPoolEntryRef
+DwarfLinker::DIECloner::getStringEntry(OffsetsStringPool &StringPool,
+                                       StringRef S) {
+  if (!Deferred)
+    return StringPool.getEntry(S);
+
+  DwarfStringPoolEntryRef Entry = StringPool.internEntry(S);
+  Deferred->Strings.push_back(Entry);
+  return Entry;
+}
+
+DWARFDie DwarfLinker::DIECloner::resolveDIEReference(
+    const DebugMapObject &DMO, const DWARFFormValue &RefValue,
+    const DWARFDie &DIE, CompileUnit *&RefCU) {
+  if (auto RefDie = findReferencedDIE(CompileUnits, RefValue, RefCU))
+    return RefDie;
+
+  reportWarning("could not find referenced DIE", DMO, &DIE);
+  return DWARFDie();
+}
+
+void DwarfLinker::DIECloner::reportWarning(const Twine &Warning,
+                                           const DebugMapObject &DMO,
+                                           const DWARFDie *DIE) const {
+  if (Deferred)
+    Deferred->Warnings.emplace_back(Warning.str(), DIE ? *DIE : DWARFDie());
+  else
+    Linker.reportWarning(Warning, DMO, DIE);
+}
+
 uint32_t DwarfLinker::DIECloner::hashFullyQualifiedName(
     DWARFDie DIE, CompileUnit &U, const DebugMapObject &DMO, int RecurseDepth) {
   const char *Name = nullptr;
@@ -3855,8 +4160,7 @@ uint32_t DwarfLinker::DIECloner::hashFullyQualifiedName(
       break;
 
     CompileUnit *RefCU;
-    if (auto RefDIE = resolveDIEReference(Linker, DMO, CompileUnits, *Ref,
-                                          U.getOrigUnit(), DIE, RefCU)) {
+    if (auto RefDIE = resolveDIEReference(DMO, *Ref, DIE, RefCU)) {
       CU = RefCU;
       OrigUnit = &RefCU->getOrigUnit();
       DIE = RefDIE;
@@ -4087,151 +4391,217 @@ void DwarfLinker::DIECloner::cloneAllCompileUnits(
                11 /* Unit Header size */, 0, CurrentUnit->getOutputUnitDIE());
     }
     Linker.OutputDebugInfoSize = CurrentUnit->computeNextUnitOffset();
-    if (Linker.Options.NoOutput)
+  }
+
+  Linker.emitCompileUnits(CompileUnits, DwarfContext, DMO, Ranges);
+}
+
+void DwarfLinker::DIECloner::cloneAllCompileUnitDIEs(
+    const DebugMapObject &DMO, OffsetsStringPool &StringPool) {
+  for (auto &CurrentUnit : CompileUnits) {
+    if (!CurrentUnit->getInfo(0).Keep)
       continue;
+    CurrentUnit->createOutputDIE();
+    cloneDIE(CurrentUnit->getOrigUnit().getUnitDIE(), DMO, *CurrentUnit,
+             StringPool, 0 /* PC offset */, 11 /* Unit Header size */, 0,
+             CurrentUnit->getOutputUnitDIE());
+  }
+}
 
-    if (LLVM_LIKELY(!Linker.Options.Update)) {
+void DwarfLinker::emitCompileUnits(UnitListTy &CompileUnits,
+                                   DWARFContext &DwarfContext,
+                                   const DebugMapObject &DMO,
+                                   RangesTy &Ranges) {
+  if (Options.NoOutput)
+    return;
+
+  for (auto &CurrentUnit : CompileUnits) {
+    if (LLVM_LIKELY(!Options.Update)) {
       // FIXME: for compatibility with the classic dsymutil, we emit an empty
       // line table for the unit, even if the unit doesn't actually exist in
       // the DIE tree.
-      Linker.patchLineTableForUnit(*CurrentUnit, DwarfContext, Ranges, DMO);
-      Linker.emitAcceleratorEntriesForUnit(*CurrentUnit);
-      Linker.patchRangesForUnit(*CurrentUnit, DwarfContext, DMO);
-      Linker.Streamer->emitLocationsForUnit(*CurrentUnit, DwarfContext);
+      patchLineTableForUnit(*CurrentUnit, DwarfContext, Ranges, DMO);
+      emitAcceleratorEntriesForUnit(*CurrentUnit);
+      patchRangesForUnit(*CurrentUnit, DwarfContext, DMO);
+      Streamer->emitLocationsForUnit(*CurrentUnit, DwarfContext);
     } else {
-      Linker.emitAcceleratorEntriesForUnit(*CurrentUnit);
+      emitAcceleratorEntriesForUnit(*CurrentUnit);
     }
   }
 
-  if (Linker.Options.NoOutput)
-    return;
-
   // Emit all the compile unit's debug information.
   for (auto &CurrentUnit : CompileUnits) {
-    if (LLVM_LIKELY(!Linker.Options.Update))
-      Linker.generateUnitRanges(*CurrentUnit);
+    if (LLVM_LIKELY(!Options.Update))
+      generateUnitRanges(*CurrentUnit);
     CurrentUnit->fixupForwardReferences();
-    Linker.Streamer->emitCompileUnitHeader(*CurrentUnit);
+    Streamer->emitCompileUnitHeader(*CurrentUnit);
     if (!CurrentUnit->getOutputUnitDIE())
       continue;
-    Linker.Streamer->emitDIE(*CurrentUnit->getOutputUnitDIE());
+    Streamer->emitDIE(*CurrentUnit->getOutputUnitDIE());
   }
 }
 
-bool DwarfLinker::link(const DebugMap &Map) {
-  if (!createStreamer(Map.getTriple(), OutFile))
-    return false;
-
-  // Size of the DIEs (and headers) generated for the linked output.
-  OutputDebugInfoSize = 0;
-  // A unique ID that identifies each compile unit.
-  unsigned UnitID = 0;
-  DebugMap ModuleMap(Map.getTriple(), Map.getBinaryPath());
+void DwarfLinker::finishDeferredClone(LinkContext &Context,
+                                      OffsetsStringPool &StringPool) {
+  DeferredClone &Deferred = *Context.Deferred;
+
+  // Give the strings and abbreviations of the object their offsets and
+  // numbers, in the order of a serial link.
+  for (DwarfStringPoolEntryRef String : Deferred.Strings)
+    StringPool.getEntry(String.getString());
+  for (const auto &Attr : Deferred.StringAttributes)
+    Attr.first.set(Attr.second.getOffset());
+
+  for (const DeferredClone::AbbrevUse &Use : Deferred.Abbrevs) {
+    if (Use.Copy) {
+      DIEAbbrev Copy = getAbbrevCopy(*Use.Copy, Use.HasODR);
+      AssignAbbrev(Copy);
+      continue;
+    }
+    DIEAbbrev NewAbbrev = Use.Die->generateAbbrev();
+    AssignAbbrev(NewAbbrev);
+    Use.Die->setAbbrevNumber(NewAbbrev.getNumber());
+  }
 
-  // First populate the data structure we need for each iteration of the
-  // parallel loop.
-  unsigned NumObjects = Map.getNumberOfObjects();
-  std::vector<LinkContext> ObjectContexts;
-  ObjectContexts.reserve(NumObjects);
-  for (const auto &Obj : Map.objects())
-    ObjectContexts.emplace_back(Map, *this, *Obj.get(), Options.Verbose);
+  // Now the DIEs can be laid out, and the references to them set.
+  for (auto &CurrentUnit : Context.CompileUnits) {
+    CurrentUnit->setStartOffset(OutputDebugInfoSize);
+    if (DIE *UnitDie = CurrentUnit->getOutputUnitDIE())
+      layOutDIE(*UnitDie, 11 /* Unit Header size */);
+    OutputDebugInfoSize = CurrentUnit->computeNextUnitOffset();
+  }
 
-  // This Dwarf string pool which is only used for uniquing. This one should
-  // never be used for offsets as its not thread-safe or predictable.
-  UniquingStringPool UniquingStringPool;
+  for (const auto &Canonical : Deferred.CanonicalDIEs) {
+    const DIE *Die;
+    const CompileUnit *Unit;
+    DeclContext *Ctxt;
+    std::tie(Ctxt, Die, Unit) = Canonical;
+    Ctxt->setCanonicalDIEOffset(Die->getOffset() + Unit->getStartOffset());
+  }
+  for (const auto &Ref : Deferred.CanonicalReferences)
+    Ref.first.set(Ref.second->getCanonicalDIEOffset());
+  for (const auto &Ref : Deferred.BackwardReferences) {
+    const DIE *Die;
+    const CompileUnit *Unit;
+    PatchLocation Attr;
+    std::tie(Attr, Die, Unit) = Ref;
+    Attr.set(Unit->getStartOffset() + Die->getOffset());
+  }
 
-  // This Dwarf string pool which is used for emission. It must be used
-  // serially as the order of calling getStringOffset matters for
-  // reproducibility.
-  OffsetsStringPool OffsetsStringPool;
+  emitCompileUnits(Context.CompileUnits, *Context.DwarfContext, Context.DMO,
+                   Context.Ranges);
+}
 
-  // ODR Contexts for the link.
-  DeclContextTree ODRContexts;
+void DwarfLinker::cloneObjectsInParallel(
+    std::vector<LinkContext> &ObjectContexts,
+    UniquingStringPool &UniquingStringPool,
+    OffsetsStringPool &OffsetsStringPool, DeclContextTree &ODRContexts) {
+  // What is kept of an object depends on the canonical DIEs of the objects
+  // before it. Decide it for every object first: cloneDIE() would set the
+  // canonical DIEs, so they are picked in the same order instead.
+  for (LinkContext &LinkContext : ObjectContexts)
+    if (LinkContext.ObjectFile)
+      for (auto &CurrentUnit : LinkContext.CompileUnits)
+        analyzeContextInfo(CurrentUnit->getOrigUnit().getUnitDIE(), 0,
+                           *CurrentUnit, &ODRContexts.getRoot(),
+                           UniquingStringPool, ODRContexts);
 
+  uint64_t DIEOrder = 0;
   for (LinkContext &LinkContext : ObjectContexts) {
-    if (Options.Verbose)
-      outs() << "DEBUG MAP OBJECT: " << LinkContext.DMO.getObjectFilename()
-             << "\n";
-
-    // N_AST objects (swiftmodule files) should get dumped directly into the
-    // appropriate DWARF section.
-    if (LinkContext.DMO.getType() == MachO::N_AST) {
-      StringRef File = LinkContext.DMO.getObjectFilename();
-      auto ErrorOrMem = MemoryBuffer::getFile(File);
-      if (!ErrorOrMem) {
-        warn("Could not open '" + File + "'\n");
-        continue;
-      }
-      sys::fs::file_status Stat;
-      if (auto Err = sys::fs::status(File, Stat)) {
-        warn(Err.message());
-        continue;
-      }
-      if (!Options.NoTimestamp &&
-          Stat.getLastModificationTime() !=
-              sys::TimePoint<>(LinkContext.DMO.getTimestamp())) {
-        // Not using the helper here as we can easily stream TimePoint<>.
-        warn_ostream() << "Timestamp mismatch for " << File << ": "
-                       << Stat.getLastModificationTime() << " and "
-                       << sys::TimePoint<>(LinkContext.DMO.getTimestamp())
-                       << "\n";
-        continue;
-      }
-
-      // Copy the module into the .swift_ast section.
-      if (!Options.NoOutput)
-        Streamer->emitSwiftAST((*ErrorOrMem)->getBuffer());
-      continue;
-    }
-
     if (!LinkContext.ObjectFile)
-
       continue;
 
-    // Look for relocations that correspond to debug map entries.
+    LinkContext.Deferred = llvm::make_unique<DeferredClone>();
+    AnalyzedClone = LinkContext.Deferred.get();
+    if (LLVM_UNLIKELY(Options.Update)) {
+      for (auto &CurrentUnit : LinkContext.CompileUnits)
+        CurrentUnit->markEverythingAsKept();
+    } else {
+      for (auto &CurrentUnit : LinkContext.CompileUnits)
+        lookForDIEsToKeep(LinkContext.RelocMgr, LinkContext.Ranges,
+                          LinkContext.CompileUnits,
+                          CurrentUnit->getOrigUnit().getUnitDIE(),
+                          LinkContext.DMO, *CurrentUnit, 0);
+    }
+    AnalyzedClone = nullptr;
 
-    if (LLVM_LIKELY(!Options.Update) &&
-        !LinkContext.RelocMgr.findValidRelocsInDebugInfo(
-            *LinkContext.ObjectFile, LinkContext.DMO)) {
-      if (Options.Verbose)
-        outs() << "No valid relocations found. Skipping.\n";
+    LinkContext.Deferred->DIEOrder = DIEOrder;
+    if (Streamer && (LinkContext.RelocMgr.hasValidRelocs() ||
+                     LLVM_UNLIKELY(Options.Update)))
+      for (auto &CurrentUnit : LinkContext.CompileUnits)
+        pickCanonicalDIEs(*CurrentUnit,
+                          CurrentUnit->getOrigUnit().getUnitDIE(), DIEOrder);
+  }
 
-      // Clear this ObjFile entry as a signal to other loops that we should not
-      // process this iteration.
-      LinkContext.ObjectFile = nullptr;
-      continue;
+  // Then clone the objects in parallel, and finish them in order. An object's
+  // cloned DIEs are only released once it is finished, so only a window of
+  // objects, one per thread, starting at the one being finished is cloned at
+  // a time. This bounds the peak memory of the cloned DIEs by the window rather
+  // than by the number of objects, however slow one of them is.
+  ThreadPool Pool(Options.Threads);
+  const unsigned Window = Options.Threads;
+  std::vector<std::shared_future<void>> Clones(ObjectContexts.size());
+  unsigned NextClone = 0;
+  unsigned NumInFlight = 0;
+  auto DispatchClones = [&]() {
+    for (unsigned E = ObjectContexts.size();
+         NextClone != E && NumInFlight != Window; ++NextClone) {
+      LinkContext &LinkContext = ObjectContexts[NextClone];
+      if (!LinkContext.ObjectFile || !Streamer ||
+          !(LinkContext.RelocMgr.hasValidRelocs() ||
+            LLVM_UNLIKELY(Options.Update)))
+        continue;
+      ++NumInFlight;
+      Clones[NextClone] = Pool.async([&]() {
+        // The calls to applyValidRelocs inside cloneDIE will walk the reloc
+        // array again (in the same way findValidRelocsInDebugInfo() did).
+        LinkContext.RelocMgr.resetValidRelocs();
+        DIECloner(*this, LinkContext.RelocMgr, LinkContext.Deferred->DIEAlloc,
+                  LinkContext.CompileUnits, Options,
+                  LinkContext.Deferred.get())
+            .cloneAllCompileUnitDIEs(LinkContext.DMO, OffsetsStringPool);
+      });
     }
+  };
+  DispatchClones();
 
-    // Setup access to the debug info.
-    if (!LinkContext.DwarfContext)
+  for (unsigned I = 0, E = ObjectContexts.size(); I != E; ++I) {
+    LinkContext &LinkContext = ObjectContexts[I];
+    if (!LinkContext.ObjectFile)
       continue;
 
-    startDebugObject(LinkContext);
-
-    // In a first phase, just read in the debug info and load all clang modules.
-    LinkContext.CompileUnits.reserve(
-        LinkContext.DwarfContext->getNumCompileUnits());
-    for (const auto &CU : LinkContext.DwarfContext->compile_units()) {
-      auto CUDie = CU->getUnitDIE(false);
-      if (Options.Verbose) {
-        outs() << "Input compilation unit:";
-        DIDumpOptions DumpOpts;
-        DumpOpts.RecurseDepth = 0;
-        DumpOpts.Verbose = Options.Verbose;
-        CUDie.dump(outs(), 0, DumpOpts);
-      }
-
-      if (!CUDie || LLVM_UNLIKELY(Options.Update) ||
-          !registerModuleReference(CUDie, *CU, ModuleMap, LinkContext.DMO,
-                                   LinkContext.Ranges, OffsetsStringPool,
-                                   UniquingStringPool, ODRContexts, UnitID)) {
-        LinkContext.CompileUnits.push_back(llvm::make_unique<CompileUnit>(
-            *CU, UnitID++, !Options.NoODR && !Options.Update, ""));
-        maybeUpdateMaxDwarfVersion(CU->getVersion());
-      }
+    if (LLVM_UNLIKELY(Options.Update))
+      Streamer->copyInvariantDebugSection(*LinkContext.ObjectFile, Options);
+
+    if (Clones[I].valid())
+      Clones[I].wait();
+    for (const auto &Warning : LinkContext.Deferred->Warnings)
+      reportWarning(Warning.first, LinkContext.DMO,
+                    Warning.second ? &Warning.second : nullptr);
+    if (Clones[I].valid())
+      finishDeferredClone(LinkContext, OffsetsStringPool);
+
+    if (!Options.NoOutput && !LinkContext.CompileUnits.empty() &&
+        LLVM_LIKELY(!Options.Update))
+      patchFrameInfoForObject(
+          LinkContext.DMO, LinkContext.Ranges, *LinkContext.DwarfContext,
+          LinkContext.CompileUnits[0]->getOrigUnit().getAddressByteSize());
+
+    endDebugObject(LinkContext);
+    LinkContext.Deferred.reset();
+    if (Clones[I].valid()) {
+      Clones[I] = std::shared_future<void>();
+      --NumInFlight;
+      DispatchClones();
     }
   }
+}
 
+void DwarfLinker::cloneObjects(std::vector<LinkContext> &ObjectContexts,
+                               UniquingStringPool &UniquingStringPool,
+                               OffsetsStringPool &OffsetsStringPool,
+                               DeclContextTree &ODRContexts) {
+  unsigned NumObjects = ObjectContexts.size();
   ThreadPool pool(2);
 
   // These variables manage the list of processed object files.
@@ -4318,19 +4688,152 @@ bool DwarfLinker::link(const DebugMap &Map) {
       // Clean-up before starting working on the next object.
       endDebugObject(LinkContext);
     }
-
-    // Emit everything that's global.
-    if (!Options.NoOutput) {
-      Streamer->emitAbbrevs(Abbreviations, MaxDwarfVersion);
-      Streamer->emitStrings(OffsetsStringPool);
-      Streamer->emitAppleNames(AppleNames);
-      Streamer->emitAppleNamespaces(AppleNamespaces);
-      Streamer->emitAppleTypes(AppleTypes);
-      Streamer->emitAppleObjc(AppleObjc);
-    }
   });
 
   pool.wait();
+}
+
+bool DwarfLinker::link(const DebugMap &Map) {
+  if (!createStreamer(Map.getTriple(), OutFile))
+    return false;
+
+  // Size of the DIEs (and headers) generated for the linked output.
+  OutputDebugInfoSize = 0;
+  // A unique ID that identifies each compile unit.
+  unsigned UnitID = 0;
+  DebugMap ModuleMap(Map.getTriple(), Map.getBinaryPath());
+
+  // First populate the data structure we need for each iteration of the
+  // parallel loop.
+  unsigned NumObjects = Map.getNumberOfObjects();
+  std::vector<LinkContext> ObjectContexts;
+  ObjectContexts.reserve(NumObjects);
+  for (const auto &Obj : Map.objects())
+    ObjectContexts.emplace_back(Map, *this, *Obj.get(), Options.Verbose);
+
+  // This Dwarf string pool which is only used for uniquing. This one should
+  // never be used for offsets as they are not predictable.
+  UniquingStringPool UniquingStringPool;
+
+  // This Dwarf string pool which is used for emission. The order of the
+  // calls that give offsets to its strings matters for reproducibility, so
+  // they are made in object order, even when cloning in parallel.
+  OffsetsStringPool OffsetsStringPool;
+
+  // ODR Contexts for the link.
+  DeclContextTree ODRContexts;
+
+  // Relocation scanning and DIE extraction are independent between objects.
+  // Everything that depends on the order in which objects are processed (ODR
+  // uniquing, string offsets, output offsets) is done in object order, so the
+  // output doesn't depend on the number of threads.
+  if (Options.Threads > 1) {
+    ThreadPool Pool(Options.Threads);
+    for (LinkContext &LinkContext : ObjectContexts)
+      Pool.async([&]() { prepareDebugObject(LinkContext); });
+    Pool.wait();
+  }
+
+  for (LinkContext &LinkContext : ObjectContexts) {
+    if (Options.Verbose)
+      outs() << "DEBUG MAP OBJECT: " << LinkContext.DMO.getObjectFilename()
+             << "\n";
+
+    // N_AST objects (swiftmodule files) should get dumped directly into the
+    // appropriate DWARF section.
+    if (LinkContext.DMO.getType() == MachO::N_AST) {
+      StringRef File = LinkContext.DMO.getObjectFilename();
+      auto ErrorOrMem = MemoryBuffer::getFile(File);
+      if (!ErrorOrMem) {
+        warn("Could not open '" + File + "'\n");
+        continue;
+      }
+      sys::fs::file_status Stat;
+      if (auto Err = sys::fs::status(File, Stat)) {
+        warn(Err.message());
+        continue;
+      }
+      if (!Options.NoTimestamp &&
+          Stat.getLastModificationTime() !=
+              sys::TimePoint<>(LinkContext.DMO.getTimestamp())) {
+        // Not using the helper here as we can easily stream TimePoint<>.
+        warn_ostream() << "Timestamp mismatch for " << File << ": "
+                       << Stat.getLastModificationTime() << " and "
+                       << sys::TimePoint<>(LinkContext.DMO.getTimestamp())
+                       << "\n";
+        continue;
+      }
+
+      // Copy the module into the .swift_ast section.
+      if (!Options.NoOutput)
+        Streamer->emitSwiftAST((*ErrorOrMem)->getBuffer());
+      continue;
+    }
+
+    if (!LinkContext.ObjectFile)
+
+      continue;
+
+    // Look for relocations that correspond to debug map entries.
+    prepareDebugObject(LinkContext);
+    LinkContext.RelocMgr.reportWarnings(LinkContext.DMO);
+
+    if (LLVM_LIKELY(!Options.Update) && !LinkContext.HasValidRelocs) {
+      if (Options.Verbose)
+        outs() << "No valid relocations found. Skipping.\n";
+
+      // Clear this ObjFile entry as a signal to other loops that we should not
+      // process this iteration.
+      LinkContext.ObjectFile = nullptr;
+      continue;
+    }
+
+    // Setup access to the debug info.
+    if (!LinkContext.DwarfContext)
+      continue;
+
+    startDebugObject(LinkContext);
+
+    // In a first phase, just read in the debug info and load all clang modules.
+    LinkContext.CompileUnits.reserve(
+        LinkContext.DwarfContext->getNumCompileUnits());
+    for (const auto &CU : LinkContext.DwarfContext->compile_units()) {
+      auto CUDie = CU->getUnitDIE(false);
+      if (Options.Verbose) {
+        outs() << "Input compilation unit:";
+        DIDumpOptions DumpOpts;
+        DumpOpts.RecurseDepth = 0;
+        DumpOpts.Verbose = Options.Verbose;
+        CUDie.dump(outs(), 0, DumpOpts);
+      }
+
+      if (!CUDie || LLVM_UNLIKELY(Options.Update) ||
+          !registerModuleReference(CUDie, *CU, ModuleMap, LinkContext.DMO,
+                                   LinkContext.Ranges, OffsetsStringPool,
+                                   UniquingStringPool, ODRContexts, UnitID)) {
+        LinkContext.CompileUnits.push_back(llvm::make_unique<CompileUnit>(
+            *CU, UnitID++, !Options.NoODR && !Options.Update, ""));
+        maybeUpdateMaxDwarfVersion(CU->getVersion());
+      }
+    }
+  }
+
+  if (Options.Threads > 1)
+    cloneObjectsInParallel(ObjectContexts, UniquingStringPool,
+                           OffsetsStringPool, ODRContexts);
+  else
+    cloneObjects(ObjectContexts, UniquingStringPool, OffsetsStringPool,
+                 ODRContexts);
+
+  // Emit everything that's global.
+  if (!Options.NoOutput) {
+    Streamer->emitAbbrevs(Abbreviations, MaxDwarfVersion);
+    Streamer->emitStrings(OffsetsStringPool);
+    Streamer->emitAppleNames(AppleNames);
+    Streamer->emitAppleNamespaces(AppleNamespaces);
+    Streamer->emitAppleTypes(AppleTypes);
+    Streamer->emitAppleObjc(AppleObjc);
+  }
 
   return Options.NoOutput ? true : Streamer->finish(Map);
 }
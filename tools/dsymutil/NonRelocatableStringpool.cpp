@@ -13,6 +13,7 @@ namespace llvm {
 namespace dsymutil {
 
 DwarfStringPoolEntryRef NonRelocatableStringpool::getEntry(StringRef S) {
+  std::lock_guard<std::mutex> Lock(Mutex);
   if (S.empty() && !Strings.empty())
     return EmptyString;
 
@@ -28,14 +29,20 @@ DwarfStringPoolEntryRef NonRelocatableStringpool::getEntry(StringRef S) {
 }
 
 StringRef NonRelocatableStringpool::internString(StringRef S) {
+  return internEntry(S).getString();
+}
+
+DwarfStringPoolEntryRef NonRelocatableStringpool::internEntry(StringRef S) {
+  std::lock_guard<std::mutex> Lock(Mutex);
   DwarfStringPoolEntry Entry{nullptr, 0, -1U};
   auto InsertResult = Strings.insert({S, Entry});
-  return InsertResult.first->getKey();
+  return DwarfStringPoolEntryRef(*InsertResult.first);
 }
 
 std::vector<DwarfStringPoolEntryRef>
 NonRelocatableStringpool::getEntries() const {
   std::vector<DwarfStringPoolEntryRef> Result;
+  std::lock_guard<std::mutex> Lock(Mutex);
   Result.reserve(Strings.size());
   for (const auto &E : Strings)
     Result.emplace_back(E);
@@ -15,6 +15,7 @@
 #include "llvm/CodeGen/DwarfStringPoolEntry.h"
 #include "llvm/Support/Allocator.h"
 #include <cstdint>
+#include <mutex>
 #include <vector>
 
 namespace llvm {
@@ -25,6 +26,10 @@ namespace dsymutil {
 /// We are doing a final link, no need for a string table that has relocation
 /// entries for every reference to it. This class provides this ability by just
 /// associating offsets with strings.
+///
+/// The pool can be used from several threads. The offsets still depend on the
+/// order of the getEntry() calls, so the callers that need a reproducible
+/// output must make these calls in a deterministic order.
 class NonRelocatableStringpool {
 public:
   /// Entries are stored into the StringMap and simply linked together through
@@ -51,12 +56,20 @@ public:
   /// in place of \p S.
   StringRef internString(StringRef S);
 
-  uint64_t getSize() { return CurrentEndOffset; }
+  /// Like internString(), but return the entry for \p S. If it doesn't have
+  /// an offset yet, it gets one at the first getEntry() call for \p S.
+  DwarfStringPoolEntryRef internEntry(StringRef S);
+
+  uint64_t getSize() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return CurrentEndOffset;
+  }
 
   std::vector<DwarfStringPoolEntryRef> getEntries() const;
 
 private:
   MapTy Strings;
+  mutable std::mutex Mutex;
   uint32_t CurrentEndOffset = 0;
   unsigned NumEntries = 0;
   DwarfStringPoolEntryRef EmptyString;
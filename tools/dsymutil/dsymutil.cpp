@@ -99,7 +99,9 @@ static alias UpdateA("u", desc("Alias for --update"), aliasopt(Update));
 static opt<unsigned> NumThreads(
     "num-threads",
     desc("Specifies the maximum number (n) of simultaneous threads to use\n"
-         "when linking multiple architectures."),
+         "when linking. Threads are first distributed across architectures,\n"
+         "the remaining ones are used to prepare and clone the object files\n"
+         "of each link in parallel."),
     value_desc("n"), init(0), cat(DsymCategory));
 static alias NumThreadsA("j", desc("Alias for --num-threads"),
                          aliasopt(NumThreads));
@@ -472,6 +474,8 @@ int main(int argc, char **argv) {
       NumThreads = llvm::thread::hardware_concurrency();
     if (DumpDebugMap || Verbose)
       NumThreads = 1;
+    OptionsOrErr->Threads =
+        std::max<unsigned>(1, NumThreads / DebugMapPtrsOrErr->size());
     NumThreads = std::min<unsigned>(NumThreads, DebugMapPtrsOrErr->size());
 
     llvm::ThreadPool Threads(NumThreads);
@@ -48,6 +48,10 @@ struct LinkOptions {
   /// Do not check swiftmodule timestamp
   bool NoTimestamp = false;
 
+  /// Number of threads a single link uses to prepare and clone the DIEs of its
+  /// object files
+  unsigned Threads = 1;
+
   /// -oso-prepend-path
   std::string PrependPath;
 
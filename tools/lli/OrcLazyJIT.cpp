@@ -8,13 +8,26 @@
 //===----------------------------------------------------------------------===//
 
 #include "OrcLazyJIT.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/Orc/Legacy.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -22,6 +35,10 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "lli"
+
+STATISTIC(NumTieredUp, "Number of functions recompiled by -orc-lazy-tiered");
+
 namespace {
 
 enum class DumpKind {
@@ -51,6 +68,40 @@ static cl::opt<bool> OrcInlineStubs("orc-lazy-inline-stubs",
                                     cl::desc("Try to inline stubs"),
                                     cl::init(true), cl::Hidden);
 
+static cl::opt<bool> OrcSpeculate(
+    "orc-lazy-speculate",
+    cl::desc("Compile the direct callees of compiled functions on a "
+             "background thread"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> OrcSlabMemory(
+    "orc-lazy-slab-memory",
+    cl::desc("Pack the sections of compiled partitions into large mappings"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> OrcHugePages(
+    "orc-lazy-huge-pages",
+    cl::desc("Ask for transparent huge pages for -orc-lazy-slab-memory"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> OrcTiered(
+    "orc-lazy-tiered",
+    cl::desc("Compile functions at -O0 first, and recompile the hot ones at "
+             "-O2 on a background thread"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<unsigned> OrcTierUpThreshold(
+    "orc-lazy-tier-up-threshold",
+    cl::desc("Number of calls after which -orc-lazy-tiered recompiles a "
+             "function"),
+    cl::init(1000), cl::Hidden);
+
+static cl::opt<bool> OrcSyncTierUp(
+    "orc-lazy-sync-tier-up",
+    cl::desc("Recompile a function for -orc-lazy-tiered on the thread that "
+             "calls it past the threshold, instead of on a background thread"),
+    cl::init(false), cl::Hidden);
+
 OrcLazyJIT::TransformFtor OrcLazyJIT::createDebugDumper() {
   switch (OrcDumpKind) {
   case DumpKind::NoDump:
@@ -99,14 +150,270 @@ OrcLazyJIT::TransformFtor OrcLazyJIT::createDebugDumper() {
   llvm_unreachable("Unknown DumpKind");
 }
 
-// Defined in lli.cpp.
-CodeGenOpt::Level getOptLevel();
-
 template <typename PtrTy>
 static PtrTy fromTargetAddress(JITTargetAddress Addr) {
   return reinterpret_cast<PtrTy>(static_cast<uintptr_t>(Addr));
 }
 
+template <typename PtrTy>
+static JITTargetAddress toTargetAddress(PtrTy *P) {
+  return static_cast<JITTargetAddress>(reinterpret_cast<uintptr_t>(P));
+}
+
+void OrcLazyJIT::enableTiering(std::unique_ptr<TargetMachine> OptTM,
+                               uint64_t TierUpThreshold, bool Synchronous) {
+  this->OptTM = std::move(OptTM);
+  this->TierUpThreshold = TierUpThreshold;
+  SynchronousTierUp = Synchronous;
+  OptCompiler = llvm::make_unique<orc::SimpleCompiler>(*this->OptTM);
+
+  // Instrument the partitions after the debug dumper has seen them.
+  TransformFtor DebugDump = std::move(IRDumpLayer.getTransform());
+  IRDumpLayer.getTransform() = [this, DebugDump](std::unique_ptr<Module> M) {
+    return instrumentForTierUp(DebugDump(std::move(M)));
+  };
+
+  if (!SynchronousTierUp)
+    TierUpThread = std::thread([this]() { runTierUpLoop(); });
+}
+
+Error OrcLazyJIT::enableObjectCache(StringRef CacheDir) {
+  auto CacheOrErr = orc::OnDiskObjectCache::create(CacheDir, *TM);
+  if (!CacheOrErr)
+    return CacheOrErr.takeError();
+  ObjCache = std::move(*CacheOrErr);
+  CompileLayer.getCompiler().setObjectCache(ObjCache.get());
+
+  // The optimized tier's objects are keyed by its own TargetMachine.
+  if (OptCompiler) {
+    auto OptCacheOrErr = orc::OnDiskObjectCache::create(CacheDir, *OptTM);
+    if (!OptCacheOrErr)
+      return OptCacheOrErr.takeError();
+    OptObjCache = std::move(*OptCacheOrErr);
+    OptCompiler->setObjectCache(OptObjCache.get());
+  }
+
+  return Error::success();
+}
+
+std::unique_ptr<Module>
+OrcLazyJIT::instrumentForTierUp(std::unique_ptr<Module> M) {
+  // Static constructors and destructors only run once, and the globals module
+  // has no functions, so neither is worth recompiling.
+  TierUpCandidate C;
+  for (auto &F : *M)
+    if (!F.isDeclaration() && !F.hasAvailableExternallyLinkage() &&
+        !F.getName().startswith("$static_ctor.") &&
+        !F.getName().startswith("$static_dtor."))
+      C.FnNames.push_back(F.getName());
+  if (C.FnNames.empty())
+    return M;
+
+  // Keep an uninstrumented copy to recompile, and count the calls of each
+  // function in a hidden global that the tier-up thread can look up.
+  {
+    raw_svector_ostream OS(C.Bitcode);
+    WriteBitcodeToFile(*M, OS);
+  }
+  LLVMContext &Ctx = M->getContext();
+  Type *Int64Ty = Type::getInt64Ty(Ctx);
+  for (auto &Name : C.FnNames) {
+    Function &F = *M->getFunction(Name);
+    auto *Counter = new GlobalVariable(
+        *M, Int64Ty, false, GlobalValue::ExternalLinkage,
+        ConstantInt::get(Int64Ty, 0), Name + "$calls");
+    Counter->setVisibility(GlobalValue::HiddenVisibility);
+    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    Value *Calls = Builder.CreateAtomicRMW(AtomicRMWInst::Add, Counter,
+                                           Builder.getInt64(1),
+                                           AtomicOrdering::Monotonic);
+    C.CounterNames.push_back(mangle(Counter->getName()));
+
+    // In synchronous mode, the call that takes the count past the threshold
+    // recompiles the hot functions, through the hook that searchTierUpHooks
+    // resolves. Both are looked up by name, so that cached objects stay valid
+    // in other processes.
+    if (SynchronousTierUp) {
+      Type *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+      Constant *Hook = M->getOrInsertFunction(
+          "$orc_lazy_tier_up", Type::getVoidTy(Ctx), Int8PtrTy);
+      Constant *JIT =
+          M->getOrInsertGlobal("$orc_lazy_jit", Type::getInt8Ty(Ctx));
+      Value *AtThreshold =
+          Builder.CreateICmpEQ(Calls, Builder.getInt64(TierUpThreshold));
+      Builder.SetInsertPoint(SplitBlockAndInsertIfThen(
+          AtThreshold, &*Builder.GetInsertPoint(), false));
+      Builder.CreateCall(Hook, JIT);
+    }
+  }
+
+  std::lock_guard<std::mutex> Lock(TierUpCandidatesMutex);
+  TierUpCandidates.push_back(std::move(C));
+  return M;
+}
+
+void OrcLazyJIT::runTierUpLoop() {
+  std::unique_lock<std::mutex> Lock(TierUpMutex);
+  while (!TierUpCV.wait_for(Lock, std::chrono::milliseconds(10),
+                            [this]() { return StopTierUp; })) {
+    Lock.unlock();
+    tierUpHotCandidates();
+    Lock.lock();
+  }
+}
+
+void OrcLazyJIT::tierUpHotCandidates() {
+  std::lock_guard<std::mutex> Lock(TierUpMutex);
+
+  // Take the candidates out of the list while they are scanned, since
+  // recompiling them waits for the CODLayer, under whose lock new candidates
+  // are added.
+  std::list<TierUpCandidate> Candidates;
+  {
+    std::lock_guard<std::mutex> CandidatesLock(TierUpCandidatesMutex);
+    Candidates.swap(TierUpCandidates);
+  }
+
+  for (auto I = Candidates.begin(), E = Candidates.end(); I != E;) {
+    if (!isHot(*I)) {
+      ++I;
+      continue;
+    }
+    if (auto Err = tierUp(*I))
+      logAllUnhandledErrors(std::move(Err), errs(),
+                            "OrcLazyJIT tier-up error: ");
+    I = Candidates.erase(I);
+  }
+
+  std::lock_guard<std::mutex> CandidatesLock(TierUpCandidatesMutex);
+  TierUpCandidates.splice(TierUpCandidates.begin(), Candidates);
+}
+
+bool OrcLazyJIT::isHot(TierUpCandidate &C) {
+  // Look the counters up once the partition has been emitted. Their
+  // addresses are computed by the object layer, so lock the CODLayer.
+  if (C.Counters.empty()) {
+    auto CODLock = CODLayer.lock();
+    std::vector<const std::atomic<uint64_t> *> Counters;
+    for (auto &Name : C.CounterNames) {
+      auto Sym = CODLayer.findSymbol(Name, false);
+      if (!Sym) {
+        consumeError(Sym.takeError());
+        return false;
+      }
+      auto AddrOrErr = Sym.getAddress();
+      if (!AddrOrErr) {
+        consumeError(AddrOrErr.takeError());
+        return false;
+      }
+      Counters.push_back(
+          fromTargetAddress<const std::atomic<uint64_t> *>(*AddrOrErr));
+    }
+    C.Counters = std::move(Counters);
+  }
+
+  uint64_t Calls = 0;
+  for (auto *Counter : C.Counters)
+    Calls += Counter->load(std::memory_order_relaxed);
+  return Calls > TierUpThreshold;
+}
+
+Error OrcLazyJIT::tierUp(TierUpCandidate &C) {
+  LLVMContext Ctx;
+  MemoryBufferRef Bitcode(StringRef(C.Bitcode.data(), C.Bitcode.size()),
+                          "tier-up");
+  auto MOrErr = parseBitcodeFile(Bitcode, Ctx);
+  if (!MOrErr)
+    return MOrErr.takeError();
+  Module &M = **MOrErr;
+
+  // Rename the functions, so that the new bodies don't clash with the first
+  // tier's in the object layer.
+  for (auto &Name : C.FnNames)
+    M.getFunction(Name)->setName(Name + "$opt");
+
+  {
+    legacy::FunctionPassManager FPM(&M);
+    legacy::PassManager MPM;
+    FPM.add(createTargetTransformInfoWrapperPass(OptTM->getTargetIRAnalysis()));
+    MPM.add(createTargetTransformInfoWrapperPass(OptTM->getTargetIRAnalysis()));
+
+    PassManagerBuilder Builder;
+    Builder.OptLevel = 2;
+    Builder.Inliner = createFunctionInliningPass(2, 0, false);
+    OptTM->adjustPassManager(Builder);
+    Builder.populateFunctionPassManager(FPM);
+    Builder.populateModulePassManager(MPM);
+
+    FPM.doInitialization();
+    for (auto &F : M)
+      FPM.run(F);
+    FPM.doFinalization();
+    MPM.run(M);
+  }
+
+  // Only the object layer is shared with the CODLayer's compiles.
+  auto Obj = (*OptCompiler)(M);
+  auto CODLock = CODLayer.lock();
+
+  // The new bodies call the other functions through their stubs, like the
+  // first tier does.
+  auto K = ES.allocateVModule();
+  assert(!Resolvers.count(K) && "Resolver already present");
+  Resolvers[K] = orc::createLegacyLookupResolver(
+      [this](const std::string &Name) -> JITSymbol {
+        if (auto Sym = CODLayer.findSymbol(Name, false))
+          return Sym;
+        else if (auto Err = Sym.takeError())
+          return std::move(Err);
+        if (auto Sym = CXXRuntimeOverrides.searchOverrides(Name))
+          return Sym;
+        if (auto Addr = RTDyldMemoryManager::getSymbolAddressInProcess(Name))
+          return JITSymbol(Addr, JITSymbolFlags::Exported);
+        return nullptr;
+      },
+      [](Error Err) {
+        logAllUnhandledErrors(std::move(Err), errs(),
+                              "OrcLazyJIT tier-up lookupFlags error: ");
+      });
+
+  if (auto Err = ObjectLayer.addObject(K, std::move(Obj)))
+    return Err;
+
+  for (auto &Name : C.FnNames) {
+    auto Sym = ObjectLayer.findSymbolIn(K, mangle(Name + "$opt"), false);
+    if (!Sym) {
+      if (auto Err = Sym.takeError())
+        return Err;
+      continue;
+    }
+    auto AddrOrErr = Sym.getAddress();
+    if (!AddrOrErr)
+      return AddrOrErr.takeError();
+    if (auto Err = CODLayer.updatePointer(Name, *AddrOrErr))
+      return Err;
+    ++NumTieredUp;
+  }
+
+  return Error::success();
+}
+
+JITSymbol OrcLazyJIT::searchTierUpHooks(const std::string &Name) {
+  if (!SynchronousTierUp)
+    return nullptr;
+  if (Name == mangle("$orc_lazy_tier_up"))
+    return JITSymbol(toTargetAddress(&tierUpHook), JITSymbolFlags::Exported);
+  if (Name == mangle("$orc_lazy_jit"))
+    return JITSymbol(toTargetAddress(this), JITSymbolFlags::Exported);
+  return nullptr;
+}
+
+void OrcLazyJIT::tierUpHook(OrcLazyJIT *J) { J->tierUpHotCandidates(); }
+
+// Defined in lli.cpp.
+CodeGenOpt::Level getOptLevel();
+std::string getPersistentObjectCacheDir();
+
 int llvm::runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
                         const std::vector<std::string> &Args) {
   // Add the program's symbols into the JIT's search space.
@@ -117,8 +424,10 @@ int llvm::runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
 
   // Grab a target machine and try to build a factory function for the
   // target-specific Orc callback manager.
+  // In tiered mode the first tier is compiled at -O0, which also selects
+  // FastISel.
   EngineBuilder EB;
-  EB.setOptLevel(getOptLevel());
+  EB.setOptLevel(OrcTiered ? CodeGenOpt::None : getOptLevel());
   auto TM = std::unique_ptr<TargetMachine>(EB.selectTarget());
   Triple T(TM->getTargetTriple());
   auto CompileCallbackMgr = orc::createLocalCompileCallbackManager(T, 0);
@@ -144,6 +453,30 @@ int llvm::runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
   OrcLazyJIT J(std::move(TM), std::move(CompileCallbackMgr),
                std::move(IndirectStubsMgrBuilder),
                OrcInlineStubs);
+  if (OrcSpeculate)
+    J.enableSpeculation();
+
+  if (OrcSlabMemory)
+    J.enableSlabMemory(OrcHugePages);
+
+  if (OrcTiered) {
+    if (!llvm_is_multithreaded()) {
+      errs() << "-orc-lazy-tiered requires LLVM to be built with threads.\n";
+      return 1;
+    }
+    EngineBuilder OptEB;
+    OptEB.setOptLevel(CodeGenOpt::Default);
+    J.enableTiering(std::unique_ptr<TargetMachine>(OptEB.selectTarget()),
+                    OrcTierUpThreshold, OrcSyncTierUp);
+  }
+
+  std::string CacheDir = getPersistentObjectCacheDir();
+  if (!CacheDir.empty())
+    if (auto Err = J.enableObjectCache(CacheDir)) {
+      logAllUnhandledErrors(std::move(Err), errs(),
+                            "Could not create the object cache: ");
+      return 1;
+    }
 
   // Add the module, look up main and run it.
   for (auto &M : Ms)
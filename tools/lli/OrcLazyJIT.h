@@ -17,6 +17,7 @@
 
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
 #include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
@@ -26,6 +27,7 @@
 #include "llvm/ExecutionEngine/Orc/IRTransformLayer.h"
 #include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/OnDiskObjectCache.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
@@ -33,13 +35,19 @@
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace llvm {
@@ -70,7 +78,8 @@ public:
                       auto Resolver = std::move(ResolverI->second);
                       Resolvers.erase(ResolverI);
                       return ObjLayerT::Resources{
-                          std::make_shared<SectionMemoryManager>(),
+                          std::make_shared<SectionMemoryManager>(
+                              MemMapper.get()),
                           std::move(Resolver)};
                     }),
         CompileLayer(ObjectLayer, orc::SimpleCompiler(*this->TM)),
@@ -95,6 +104,22 @@ public:
             [this](const std::string &S) { return mangle(S); }) {}
 
   ~OrcLazyJIT() {
+    // Stop recompiling hot functions.
+    if (TierUpThread.joinable()) {
+      {
+        std::lock_guard<std::mutex> Lock(TierUpMutex);
+        StopTierUp = true;
+      }
+      TierUpCV.notify_one();
+      TierUpThread.join();
+    }
+
+    // Drop the speculative compilations that haven't started yet.
+    if (SpeculationThread) {
+      ShuttingDown = true;
+      SpeculationThread->wait();
+    }
+
     // Run any destructors registered with __cxa_atexit.
     CXXRuntimeOverrides.runDestructors();
     // Run any IR destructors.
@@ -106,6 +131,43 @@ public:
       }
   }
 
+  /// Compile the functions that a compiled function calls directly on a
+  /// background thread, ahead of their first call.
+  void enableSpeculation() {
+    SpeculationThread = llvm::make_unique<ThreadPool>(1);
+    CODLayer.setSpeculation(orc::speculateDirectCallees,
+                            [this](std::function<void()> Compile) {
+                              SpeculationThread->async([this, Compile]() {
+                                if (!ShuttingDown)
+                                  Compile();
+                              });
+                            });
+  }
+
+  /// Pack the sections of all compiled partitions into large slabs of
+  /// memory, optionally backed by transparent huge pages, instead of mapping
+  /// pages for each partition. Must be called before any modules are added.
+  void enableSlabMemory(bool UseHugePages) {
+    MemMapper = llvm::make_unique<SlabMemoryMapper>(32 * 1024 * 1024,
+                                                    UseHugePages);
+  }
+
+  /// Compile the functions with this JIT's TargetMachine first, counting
+  /// their calls, and recompile the functions that are called more than
+  /// TierUpThreshold times with OptTM on a background thread. The stubs of
+  /// the recompiled functions are then pointed at the new bodies. If
+  /// Synchronous is true, a function is instead recompiled by the thread that
+  /// calls it for the (TierUpThreshold + 1)th time, before that call
+  /// proceeds. Must be called before any modules are added.
+  void enableTiering(std::unique_ptr<TargetMachine> OptTM,
+                     uint64_t TierUpThreshold, bool Synchronous);
+
+  /// Keep the objects compiled by the JIT in CacheDir, so that later runs
+  /// compiling the same IR for the same target load them instead. Must be
+  /// called after enableTiering, if tiering is enabled, and before any modules
+  /// are added.
+  Error enableObjectCache(StringRef CacheDir);
+
   Error addModule(std::unique_ptr<Module> M) {
     if (M->getDataLayout().isDefault())
       M->setDataLayout(DL);
@@ -142,7 +204,9 @@ public:
           return Sym;
         else if (auto Err = Sym.takeError())
           return std::move(Err);
-        return CXXRuntimeOverrides.searchOverrides(Name);
+        if (auto Sym = CXXRuntimeOverrides.searchOverrides(Name))
+          return Sym;
+        return searchTierUpHooks(Name);
       };
 
       auto LegacyLookup =
@@ -223,6 +287,27 @@ private:
 
   static TransformFtor createDebugDumper();
 
+  // A partition compiled by the first tier, waiting to be recompiled.
+  struct TierUpCandidate {
+    // The partition's bitcode, written before it was instrumented. It is
+    // recompiled in a context of its own, so that the recompile doesn't have
+    // to lock the CODLayer, whose compiles use the partitions' context.
+    SmallVector<char, 0> Bitcode;
+    // The functions defined by the partition, and the names of their call
+    // counters. The counters are looked up once the partition is emitted.
+    std::vector<std::string> FnNames;
+    std::vector<std::string> CounterNames;
+    std::vector<const std::atomic<uint64_t> *> Counters;
+  };
+
+  std::unique_ptr<Module> instrumentForTierUp(std::unique_ptr<Module> M);
+  void runTierUpLoop();
+  void tierUpHotCandidates();
+  bool isHot(TierUpCandidate &C);
+  Error tierUp(TierUpCandidate &C);
+  JITSymbol searchTierUpHooks(const std::string &Name);
+  static void tierUpHook(OrcLazyJIT *J);
+
   orc::SymbolStringPool SSP;
   orc::ExecutionSession ES;
 
@@ -231,6 +316,8 @@ private:
   std::unique_ptr<TargetMachine> TM;
   DataLayout DL;
   SectionMemoryManager CCMgrMemMgr;
+  // Must outlive the object layer's memory managers.
+  std::unique_ptr<SlabMemoryMapper> MemMapper;
 
   std::unique_ptr<CompileCallbackMgr> CCMgr;
   ObjLayerT ObjectLayer;
@@ -241,6 +328,27 @@ private:
   orc::LocalCXXRuntimeOverrides CXXRuntimeOverrides;
   std::vector<orc::CtorDtorRunner<CODLayerT>> IRStaticDestructorRunners;
   llvm::Optional<orc::VModuleKey> ModulesKey;
+
+  std::atomic<bool> ShuttingDown{false};
+  std::unique_ptr<ThreadPool> SpeculationThread;
+
+  std::unique_ptr<orc::OnDiskObjectCache> ObjCache;
+
+  // Tiered compilation. The candidates are added by the IR transform, which
+  // runs under the CODLayer's lock, so TierUpCandidatesMutex is never held
+  // while waiting for the CODLayer. TierUpMutex serializes the tier-up scans
+  // and guards StopTierUp.
+  std::unique_ptr<TargetMachine> OptTM;
+  std::unique_ptr<orc::SimpleCompiler> OptCompiler;
+  std::unique_ptr<orc::OnDiskObjectCache> OptObjCache;
+  uint64_t TierUpThreshold = 0;
+  bool SynchronousTierUp = false;
+  std::list<TierUpCandidate> TierUpCandidates;
+  std::mutex TierUpCandidatesMutex;
+  std::mutex TierUpMutex;
+  std::condition_variable TierUpCV;
+  bool StopTierUp = false;
+  std::thread TierUpThread;
 };
 
 int runOrcLazyJIT(std::vector<std::unique_ptr<Module>> Ms,
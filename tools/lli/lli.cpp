@@ -25,6 +25,7 @@
 #include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
 #include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/OnDiskObjectCache.h"
 #include "llvm/ExecutionEngine/Orc/OrcRemoteTargetClient.h"
 #include "llvm/ExecutionEngine/OrcMCJITReplacement.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
@@ -157,6 +158,13 @@ namespace {
                            "(must be user writable)"),
                   cl::init(""));
 
+  cl::opt<std::string>
+  PersistentObjectCache("persistent-object-cache",
+                        cl::desc("Directory to keep compiled objects in, "
+                                 "keyed by a hash of the module and the "
+                                 "target, across runs"),
+                        cl::value_desc("directory"), cl::init(""));
+
   cl::opt<std::string>
   FakeArgv0("fake-argv0",
             cl::desc("Override the 'argv[0]' value passed into the executing"
@@ -306,6 +314,8 @@ CodeGenOpt::Level getOptLevel() {
   llvm_unreachable("Unrecognized opt level.");
 }
 
+std::string getPersistentObjectCacheDir() { return PersistentObjectCache; }
+
 LLVM_ATTRIBUTE_NORETURN
 static void reportError(SMDiagnostic Err, const char *ProgName) {
   Err.print(ProgName, errs());
@@ -435,6 +445,20 @@ int main(int argc, char **argv, char * const *envp) {
     EE->setObjectCache(CacheManager.get());
   }
 
+  std::unique_ptr<orc::OnDiskObjectCache> PersistentCache;
+  if (!PersistentObjectCache.empty()) {
+    if (EnableCacheManager || !EE->getTargetMachine()) {
+      errs() << argv[0] << ": -persistent-object-cache can't be used with "
+                           "-enable-cache-manager or the interpreter.\n";
+      exit(1);
+    }
+    ExitOnError ExitOnErr(std::string(*argv) +
+                          ": could not create the object cache: ");
+    PersistentCache = ExitOnErr(orc::OnDiskObjectCache::create(
+        PersistentObjectCache, *EE->getTargetMachine()));
+    EE->setObjectCache(PersistentCache.get());
+  }
+
   // Load any additional modules specified on the command line.
   for (unsigned i = 0, e = ExtraModules.size(); i != e; ++i) {
     std::unique_ptr<Module> XMod = parseIRFile(ExtraModules[i], Err, Context);
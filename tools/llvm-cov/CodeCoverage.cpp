@@ -13,6 +13,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "CoverageExporterBinary.h"
 #include "CoverageExporterJson.h"
 #include "CoverageFilters.h"
 #include "CoverageReport.h"
@@ -345,7 +346,8 @@ std::unique_ptr<CoverageMapping> CodeCoverageTool::load() {
       warning("profile data may be out of date - object is newer",
               ObjectFilename);
   auto CoverageOrErr =
-      CoverageMapping::load(ObjectFilenames, PGOFilename, CoverageArches);
+      CoverageMapping::load(ObjectFilenames, PGOFilename, CoverageArches,
+                            ViewOpts.NumThreads);
   if (Error E = CoverageOrErr.takeError()) {
     error("Failed to load coverage: " + toString(std::move(E)),
           join(ObjectFilenames.begin(), ObjectFilenames.end(), ", "));
@@ -566,7 +568,11 @@ int CodeCoverageTool::run(Command Cmd, int argc, const char **argv) {
       cl::values(clEnumValN(CoverageViewOptions::OutputFormat::Text, "text",
                             "Text output"),
                  clEnumValN(CoverageViewOptions::OutputFormat::HTML, "html",
-                            "HTML output")),
+                            "HTML output"),
+                 clEnumValN(CoverageViewOptions::OutputFormat::Binary,
+                            "binary",
+                            "Binary export, which can be merged with "
+                            "'llvm-cov merge-exports'")),
       cl::init(CoverageViewOptions::OutputFormat::Text));
 
   cl::opt<std::string> PathRemap(
@@ -639,7 +645,7 @@ int CodeCoverageTool::run(Command Cmd, int argc, const char **argv) {
 
   cl::opt<unsigned> NumThreads(
       "num-threads", cl::init(0),
-      cl::desc("Number of merge threads to use (default: autodetect)"));
+      cl::desc("Number of threads to use (default: autodetect)"));
   cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
                         cl::aliasopt(NumThreads));
 
@@ -668,6 +674,9 @@ int CodeCoverageTool::run(Command Cmd, int argc, const char **argv) {
         errs() << "Color output cannot be disabled when generating html.\n";
       ViewOpts.Colors = true;
       break;
+    case CoverageViewOptions::OutputFormat::Binary:
+      ViewOpts.Colors = false;
+      break;
     }
 
     // If path-equivalence was given and is a comma seperated pair then set
@@ -820,6 +829,11 @@ int CodeCoverageTool::doShow(int argc, const char **argv,
   if (Err)
     return Err;
 
+  if (ViewOpts.Format == CoverageViewOptions::OutputFormat::Binary) {
+    error("Binary output is only supported by 'llvm-cov export'.");
+    return 1;
+  }
+
   ViewOpts.ShowLineNumbers = true;
   ViewOpts.ShowLineStats = ShowLineExecutionCounts.getNumOccurrences() != 0 ||
                            !ShowRegions || ShowBestLineRegionsCounts;
@@ -951,6 +965,11 @@ int CodeCoverageTool::doReport(int argc, const char **argv,
     return 1;
   }
 
+  if (ViewOpts.Format == CoverageViewOptions::OutputFormat::Binary) {
+    error("Binary output is only supported by 'llvm-cov export'.");
+    return 1;
+  }
+
   auto Coverage = load();
   if (!Coverage)
     return 1;
@@ -980,8 +999,8 @@ int CodeCoverageTool::doExport(int argc, const char **argv,
   if (Err)
     return Err;
 
-  if (ViewOpts.Format != CoverageViewOptions::OutputFormat::Text) {
-    error("Coverage data can only be exported as textual JSON.");
+  if (ViewOpts.Format == CoverageViewOptions::OutputFormat::HTML) {
+    error("Coverage data can only be exported as textual JSON or binary.");
     return 1;
   }
 
@@ -991,12 +1010,21 @@ int CodeCoverageTool::doExport(int argc, const char **argv,
     return 1;
   }
 
-  auto Exporter = CoverageExporterJson(*Coverage.get(), ViewOpts, outs());
+  std::unique_ptr<CoverageExporter> Exporter;
+  if (ViewOpts.Format == CoverageViewOptions::OutputFormat::Binary) {
+    // Don't let Windows translate the newlines in the binary data.
+    sys::ChangeStdoutToBinary();
+    Exporter = llvm::make_unique<CoverageExporterBinary>(*Coverage.get(),
+                                                         ViewOpts, outs());
+  } else {
+    Exporter = llvm::make_unique<CoverageExporterJson>(*Coverage.get(),
+                                                       ViewOpts, outs());
+  }
 
   if (SourceFiles.empty())
-    Exporter.renderRoot();
+    Exporter->renderRoot();
   else
-    Exporter.renderRoot(SourceFiles);
+    Exporter->renderRoot(SourceFiles);
 
   return 0;
 }
@@ -0,0 +1,331 @@
+//===- CoverageExporterBinary.cpp - Code coverage binary export -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements export of code coverage data to a compact binary
+// format. Unlike the JSON export, which has segments and summaries that can't
+// be combined, it keeps the evaluated function records, so that exports of
+// several shards can be merged, and the files that changed can be replaced.
+//
+//===----------------------------------------------------------------------===//
+
+//===----------------------------------------------------------------------===//
+//
+// The binary coverage export has the following format. Numbers are ULEB128
+// encoded unless noted otherwise, and strings are a size and their bytes.
+//
+// Header: "llvmcovx", version
+// NumFiles, then for each file, ordered by hash:
+// -- Hash: u64 little endian => MD5 hash of Filename
+// -- Filename
+// -- NumFunctions, then for each function:
+// ---- Name
+// ---- NumFilenames, then the filenames
+// ---- NumRegions, then for each region:
+// ------ FileID, ExpandedFileID, LineStart, ColumnStart, LineEnd, ColumnEnd
+// ------ Kind, ExecutionCount
+//
+//===----------------------------------------------------------------------===//
+
+#include "CoverageExporterBinary.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MathExtras.h"
+
+/// \brief Identifies a binary coverage export.
+#define LLVM_COVERAGE_EXPORT_BINARY_MAGIC "llvmcovx"
+
+/// \brief The version of the binary coverage export format.
+#define LLVM_COVERAGE_EXPORT_BINARY_VERSION 1
+
+using namespace llvm;
+using namespace coverage;
+
+static void writeString(raw_ostream &OS, StringRef S) {
+  encodeULEB128(S.size(), OS);
+  OS << S;
+}
+
+static void writeHeader(raw_ostream &OS, uint64_t NumFiles) {
+  OS << LLVM_COVERAGE_EXPORT_BINARY_MAGIC;
+  encodeULEB128(LLVM_COVERAGE_EXPORT_BINARY_VERSION, OS);
+  encodeULEB128(NumFiles, OS);
+}
+
+static void writeFile(raw_ostream &OS, uint64_t Hash, StringRef Filename,
+                      ArrayRef<const FunctionRecord *> Functions) {
+  support::endian::Writer<support::little>(OS).write<uint64_t>(Hash);
+  writeString(OS, Filename);
+  encodeULEB128(Functions.size(), OS);
+  for (const FunctionRecord *Function : Functions) {
+    writeString(OS, Function->Name);
+    encodeULEB128(Function->Filenames.size(), OS);
+    for (StringRef Filename : Function->Filenames)
+      writeString(OS, Filename);
+    encodeULEB128(Function->CountedRegions.size(), OS);
+    for (const CountedRegion &Region : Function->CountedRegions) {
+      encodeULEB128(Region.FileID, OS);
+      encodeULEB128(Region.ExpandedFileID, OS);
+      encodeULEB128(Region.LineStart, OS);
+      encodeULEB128(Region.ColumnStart, OS);
+      encodeULEB128(Region.LineEnd, OS);
+      encodeULEB128(Region.ColumnEnd, OS);
+      encodeULEB128(Region.Kind, OS);
+      encodeULEB128(Region.ExecutionCount, OS);
+    }
+  }
+}
+
+namespace {
+
+/// \brief Reads the values written above, and remembers whether it ran out of
+/// data.
+class ExportReader {
+  const uint8_t *Cur;
+  const uint8_t *End;
+  bool Malformed = false;
+
+public:
+  ExportReader(StringRef Data)
+      : Cur(Data.bytes_begin()), End(Data.bytes_end()) {}
+
+  bool isMalformed() const { return Malformed; }
+  bool atEnd() const { return Cur == End; }
+
+  uint64_t readULEB() {
+    if (Malformed)
+      return 0;
+    unsigned N = 0;
+    const char *ErrorMsg = nullptr;
+    uint64_t Value = decodeULEB128(Cur, &N, End, &ErrorMsg);
+    if (ErrorMsg) {
+      Malformed = true;
+      return 0;
+    }
+    Cur += N;
+    return Value;
+  }
+
+  uint64_t readU64() {
+    if (Malformed || End - Cur < 8) {
+      Malformed = true;
+      return 0;
+    }
+    uint64_t Value = support::endian::read64le(Cur);
+    Cur += 8;
+    return Value;
+  }
+
+  StringRef readString() {
+    uint64_t Size = readULEB();
+    if (Malformed || uint64_t(End - Cur) < Size) {
+      Malformed = true;
+      return StringRef();
+    }
+    StringRef S(reinterpret_cast<const char *>(Cur), Size);
+    Cur += Size;
+    return S;
+  }
+};
+
+} // end anonymous namespace
+
+static Error readFunction(ExportReader &R,
+                          std::vector<FunctionRecord> &Functions) {
+  StringRef Name = R.readString();
+  uint64_t NumFilenames = R.readULEB();
+  std::vector<StringRef> Filenames;
+  for (uint64_t I = 0; I < NumFilenames && !R.isMalformed(); ++I)
+    Filenames.push_back(R.readString());
+  FunctionRecord Function(Name, Filenames);
+
+  uint64_t NumRegions = R.readULEB();
+  if (!NumRegions)
+    return make_error<CoverageMapError>(coveragemap_error::malformed);
+  for (uint64_t I = 0; I < NumRegions && !R.isMalformed(); ++I) {
+    uint64_t FileID = R.readULEB();
+    uint64_t ExpandedFileID = R.readULEB();
+    uint64_t LineStart = R.readULEB();
+    uint64_t ColumnStart = R.readULEB();
+    uint64_t LineEnd = R.readULEB();
+    uint64_t ColumnEnd = R.readULEB();
+    uint64_t Kind = R.readULEB();
+    uint64_t ExecutionCount = R.readULEB();
+    // The rest of llvm-cov relies on the file IDs being in range.
+    if (FileID >= Filenames.size() || ExpandedFileID >= Filenames.size() ||
+        Kind > CounterMappingRegion::GapRegion || LineStart > UINT32_MAX ||
+        ColumnStart > UINT32_MAX || LineEnd > UINT32_MAX ||
+        ColumnEnd > UINT32_MAX)
+      return make_error<CoverageMapError>(coveragemap_error::malformed);
+    Function.pushRegion(
+        CounterMappingRegion(Counter::getZero(), FileID, ExpandedFileID,
+                             LineStart, ColumnStart, LineEnd, ColumnEnd,
+                             CounterMappingRegion::RegionKind(Kind)),
+        ExecutionCount);
+  }
+  if (R.isMalformed())
+    return make_error<CoverageMapError>(coveragemap_error::malformed);
+  Functions.push_back(std::move(Function));
+  return Error::success();
+}
+
+Expected<BinaryCoverageExport> BinaryCoverageExport::read(StringRef Data) {
+  StringRef Magic = LLVM_COVERAGE_EXPORT_BINARY_MAGIC;
+  if (!Data.startswith(Magic))
+    return make_error<CoverageMapError>(coveragemap_error::malformed);
+  ExportReader R(Data.drop_front(Magic.size()));
+  if (R.readULEB() != LLVM_COVERAGE_EXPORT_BINARY_VERSION)
+    return make_error<CoverageMapError>(
+        R.isMalformed() ? coveragemap_error::malformed
+                        : coveragemap_error::unsupported_version);
+
+  BinaryCoverageExport Result;
+  uint64_t NumFiles = R.readULEB();
+  for (uint64_t I = 0; I < NumFiles && !R.isMalformed(); ++I) {
+    uint64_t Hash = R.readU64();
+    File &F = Result.Files[Hash];
+    F.Filename = R.readString();
+    if (Hash != MD5Hash(F.Filename))
+      return make_error<CoverageMapError>(coveragemap_error::malformed);
+    uint64_t NumFunctions = R.readULEB();
+    for (uint64_t J = 0; J < NumFunctions && !R.isMalformed(); ++J)
+      if (Error E = readFunction(R, F.Functions))
+        return std::move(E);
+  }
+  if (R.isMalformed() || !R.atEnd())
+    return make_error<CoverageMapError>(coveragemap_error::malformed);
+  return std::move(Result);
+}
+
+void BinaryCoverageExport::write(raw_ostream &OS) const {
+  writeHeader(OS, Files.size());
+  std::vector<const FunctionRecord *> Functions;
+  for (const auto &HashAndFile : Files) {
+    Functions.clear();
+    for (const FunctionRecord &Function : HashAndFile.second.Functions)
+      Functions.push_back(&Function);
+    writeFile(OS, HashAndFile.first, HashAndFile.second.Filename, Functions);
+  }
+}
+
+static Error checkSameFile(const BinaryCoverageExport::File &A,
+                           const BinaryCoverageExport::File &B) {
+  if (A.Filename == B.Filename)
+    return Error::success();
+  return make_error<StringError>("files '" + A.Filename + "' and '" +
+                                     B.Filename + "' have the same hash",
+                                 inconvertibleErrorCode());
+}
+
+/// \brief Return true if \p A and \p B are records of the same code, so that
+/// their counts can be summed.
+static bool haveSameRegions(const FunctionRecord &A, const FunctionRecord &B) {
+  if (A.Filenames != B.Filenames ||
+      A.CountedRegions.size() != B.CountedRegions.size())
+    return false;
+  for (unsigned I = 0, E = A.CountedRegions.size(); I < E; ++I) {
+    const CountedRegion &RA = A.CountedRegions[I];
+    const CountedRegion &RB = B.CountedRegions[I];
+    if (RA.startLoc() != RB.startLoc() || RA.endLoc() != RB.endLoc() ||
+        RA.FileID != RB.FileID || RA.ExpandedFileID != RB.ExpandedFileID ||
+        RA.Kind != RB.Kind)
+      return false;
+  }
+  return true;
+}
+
+Error BinaryCoverageExport::merge(BinaryCoverageExport &&Other) {
+  for (auto &HashAndFile : Other.Files) {
+    auto It = Files.find(HashAndFile.first);
+    if (It == Files.end()) {
+      Files.insert(std::move(HashAndFile));
+      continue;
+    }
+    File &Dst = It->second;
+    File &Src = HashAndFile.second;
+    if (Error E = checkSameFile(Dst, Src))
+      return E;
+
+    StringMap<unsigned> FunctionIndices;
+    for (unsigned I = 0, E = Dst.Functions.size(); I < E; ++I)
+      FunctionIndices.insert({Dst.Functions[I].Name, I});
+    for (FunctionRecord &Function : Src.Functions) {
+      auto Found = FunctionIndices.insert({Function.Name,
+                                           Dst.Functions.size()});
+      if (Found.second) {
+        Dst.Functions.push_back(std::move(Function));
+        continue;
+      }
+      FunctionRecord &Existing = Dst.Functions[Found.first->second];
+      if (!haveSameRegions(Existing, Function))
+        continue;
+      for (unsigned I = 0, E = Function.CountedRegions.size(); I < E; ++I) {
+        uint64_t &Count = Existing.CountedRegions[I].ExecutionCount;
+        Count = SaturatingAdd(Count, Function.CountedRegions[I].ExecutionCount);
+      }
+      Existing.ExecutionCount = Existing.CountedRegions.front().ExecutionCount;
+    }
+  }
+  return Error::success();
+}
+
+Error BinaryCoverageExport::update(BinaryCoverageExport &&Other) {
+  for (auto &HashAndFile : Other.Files) {
+    auto It = Files.find(HashAndFile.first);
+    if (It == Files.end()) {
+      Files.insert(std::move(HashAndFile));
+      continue;
+    }
+    if (Error E = checkSameFile(It->second, HashAndFile.second))
+      return E;
+    It->second = std::move(HashAndFile.second);
+  }
+  return Error::success();
+}
+
+std::vector<FunctionRecord> BinaryCoverageExport::takeFunctions() {
+  std::vector<FunctionRecord> Functions;
+  for (auto &HashAndFile : Files)
+    for (FunctionRecord &Function : HashAndFile.second.Functions)
+      Functions.push_back(std::move(Function));
+  Files.clear();
+  return Functions;
+}
+
+void CoverageExporterBinary::renderRoot() {
+  std::vector<std::string> SourceFiles;
+  for (StringRef SF : Coverage.getUniqueSourceFiles())
+    SourceFiles.emplace_back(SF);
+  renderRoot(SourceFiles);
+}
+
+void CoverageExporterBinary::renderRoot(
+    const std::vector<std::string> &SourceFiles) {
+  StringSet<> Exported;
+  for (const std::string &SF : SourceFiles)
+    Exported.insert(SF);
+
+  std::map<uint64_t, std::pair<StringRef, std::vector<const FunctionRecord *>>>
+      Files;
+  for (const FunctionRecord &Function : Coverage.getCoveredFunctions()) {
+    StringRef Filename = Function.Filenames.front();
+    if (!Exported.count(Filename))
+      continue;
+    auto &File = Files[MD5Hash(Filename)];
+    File.first = Filename;
+    File.second.push_back(&Function);
+  }
+
+  writeHeader(OS, Files.size());
+  for (const auto &HashAndFile : Files)
+    writeFile(OS, HashAndFile.first, HashAndFile.second.first,
+              HashAndFile.second.second);
+}
@@ -0,0 +1,71 @@
+//===- CoverageExporterBinary.h - Code coverage binary exporter -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This class implements a code coverage exporter for a compact binary format,
+// which can be merged and updated without the binaries and profiles that it
+// was exported from.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_COV_COVERAGEEXPORTERBINARY_H
+#define LLVM_COV_COVERAGEEXPORTERBINARY_H
+
+#include "CoverageExporter.h"
+#include <map>
+
+namespace llvm {
+
+/// \brief The contents of a binary coverage export: the evaluated function
+/// records of each source file, keyed by the MD5 hash of the file's name.
+/// A function belongs to the first file it lists, which is the file it is
+/// defined in.
+struct BinaryCoverageExport {
+  struct File {
+    std::string Filename;
+    std::vector<coverage::FunctionRecord> Functions;
+  };
+
+  std::map<uint64_t, File> Files;
+
+  /// \brief Read an export written by CoverageExporterBinary.
+  static Expected<BinaryCoverageExport> read(StringRef Data);
+
+  /// \brief Write the export in the format read by read().
+  void write(raw_ostream &OS) const;
+
+  /// \brief Add the records of \p Other, e.g. an export of another shard of
+  /// the same project. The counts of functions that are in both exports with
+  /// the same regions are summed; otherwise the records of this export win.
+  Error merge(BinaryCoverageExport &&Other);
+
+  /// \brief Replace the records of each file in \p Other with its records in
+  /// \p Other, e.g. to update the files that a change affected.
+  Error update(BinaryCoverageExport &&Other);
+
+  /// \brief Move all of the function records out of the export, grouped by
+  /// file.
+  std::vector<coverage::FunctionRecord> takeFunctions();
+};
+
+class CoverageExporterBinary : public CoverageExporter {
+public:
+  CoverageExporterBinary(const coverage::CoverageMapping &CoverageMapping,
+                         const CoverageViewOptions &Options, raw_ostream &OS)
+      : CoverageExporter(CoverageMapping, Options, OS) {}
+
+  /// \brief Render the CoverageMapping object.
+  void renderRoot() override;
+
+  /// \brief Render the CoverageMapping object for specified source files.
+  void renderRoot(const std::vector<std::string> &SourceFiles) override;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_COV_COVERAGEEXPORTERBINARY_H
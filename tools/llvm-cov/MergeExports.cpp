@@ -0,0 +1,114 @@
+//===- MergeExports.cpp - Merge binary coverage exports -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The 'merge-exports' command merges binary coverage exports, e.g. of the
+// shards of a test run, and writes the result as a JSON or binary export. The
+// binaries and profiles that they were exported from aren't needed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CoverageExporterBinary.h"
+#include "CoverageExporterJson.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace coverage;
+
+static int error(const Twine &Message, StringRef Whence = "") {
+  errs() << "error: ";
+  if (!Whence.empty())
+    errs() << Whence << ": ";
+  errs() << Message << "\n";
+  return 1;
+}
+
+static Expected<BinaryCoverageExport> readExport(StringRef Filename) {
+  auto BufferOrErr = MemoryBuffer::getFileOrSTDIN(
+      Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = BufferOrErr.getError())
+    return errorCodeToError(EC);
+  return BinaryCoverageExport::read((*BufferOrErr)->getBuffer());
+}
+
+int mergeExportsMain(int argc, const char *argv[]) {
+  cl::list<std::string> InputFilenames(cl::Positional, cl::OneOrMore,
+                                       cl::desc("<binary exports>"));
+
+  cl::list<std::string> UpdateFilenames(
+      "update", cl::ZeroOrMore,
+      cl::desc("Binary export whose files replace those files in the merged "
+               "exports"),
+      cl::value_desc("export"));
+
+  cl::opt<std::string> OutputFilename("o", cl::init("-"),
+                                      cl::desc("Output file"),
+                                      cl::value_desc("filename"));
+
+  cl::opt<CoverageViewOptions::OutputFormat> Format(
+      "format", cl::desc("Output format"),
+      cl::values(clEnumValN(CoverageViewOptions::OutputFormat::Text, "text",
+                            "JSON, as written by 'llvm-cov export'"),
+                 clEnumValN(CoverageViewOptions::OutputFormat::Binary,
+                            "binary", "Binary export")),
+      cl::init(CoverageViewOptions::OutputFormat::Text));
+
+  cl::opt<bool> SummaryOnly(
+      "summary-only", cl::Optional,
+      cl::desc("Export only summary information for each source file"));
+
+  cl::opt<unsigned> NumThreads(
+      "num-threads", cl::init(0),
+      cl::desc("Number of threads to use (default: autodetect)"));
+  cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                        cl::aliasopt(NumThreads));
+
+  cl::ParseCommandLineOptions(argc, argv,
+                              "LLVM code coverage export merge tool\n");
+
+  // Shards are summed in order, then the updates replace whole files.
+  BinaryCoverageExport Merged;
+  for (const std::string &Filename : InputFilenames) {
+    Expected<BinaryCoverageExport> Input = readExport(Filename);
+    if (!Input)
+      return error(toString(Input.takeError()), Filename);
+    if (Error E = Merged.merge(std::move(*Input)))
+      return error(toString(std::move(E)), Filename);
+  }
+  for (const std::string &Filename : UpdateFilenames) {
+    Expected<BinaryCoverageExport> Input = readExport(Filename);
+    if (!Input)
+      return error(toString(Input.takeError()), Filename);
+    if (Error E = Merged.update(std::move(*Input)))
+      return error(toString(std::move(E)), Filename);
+  }
+
+  bool IsBinary = Format == CoverageViewOptions::OutputFormat::Binary;
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC,
+                     IsBinary ? sys::fs::F_None : sys::fs::F_Text);
+  if (EC)
+    return error(EC.message(), OutputFilename);
+
+  if (IsBinary) {
+    Merged.write(Out.os());
+  } else {
+    CoverageViewOptions ViewOpts = CoverageViewOptions();
+    ViewOpts.Format = Format;
+    ViewOpts.ExportSummaryOnly = SummaryOnly;
+    ViewOpts.NumThreads = NumThreads;
+    auto Coverage = CoverageMapping::create(Merged.takeFunctions());
+    CoverageExporterJson(*Coverage, ViewOpts, Out.os()).renderRoot();
+  }
+  Out.keep();
+  return 0;
+}
@@ -79,6 +79,9 @@ CoveragePrinter::create(const CoverageViewOptions &Opts) {
     return llvm::make_unique<CoveragePrinterText>(Opts);
   case CoverageViewOptions::OutputFormat::HTML:
     return llvm::make_unique<CoveragePrinterHTML>(Opts);
+  case CoverageViewOptions::OutputFormat::Binary:
+    // CodeCoverage.cpp only accepts this format for exports.
+    break;
   }
   llvm_unreachable("Unknown coverage output format!");
 }
@@ -142,6 +145,8 @@ SourceCoverageView::create(StringRef SourceName, const MemoryBuffer &File,
   case CoverageViewOptions::OutputFormat::HTML:
     return llvm::make_unique<SourceCoverageViewHTML>(
         SourceName, File, Options, std::move(CoverageInfo));
+  case CoverageViewOptions::OutputFormat::Binary:
+    break;
   }
   llvm_unreachable("Unknown coverage output format!");
 }
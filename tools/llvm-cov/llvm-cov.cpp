@@ -33,6 +33,9 @@ int reportMain(int argc, const char *argv[]);
 /// \brief The main entry point for the 'export' subcommand.
 int exportMain(int argc, const char *argv[]);
 
+/// \brief The main entry point for the 'merge-exports' subcommand.
+int mergeExportsMain(int argc, const char *argv[]);
+
 /// \brief The main entry point for the 'convert-for-testing' subcommand.
 int convertForTestingMain(int argc, const char *argv[]);
 
@@ -41,13 +44,16 @@ int gcovMain(int argc, const char *argv[]);
 
 /// \brief Top level help.
 static int helpMain(int argc, const char *argv[]) {
-  errs() << "Usage: llvm-cov {export|gcov|report|show} [OPTION]...\n\n"
+  errs() << "Usage: llvm-cov {export|gcov|merge-exports|report|show} "
+            "[OPTION]...\n\n"
          << "Shows code coverage information.\n\n"
          << "Subcommands:\n"
-         << "  export: Export instrprof file to structured format.\n"
-         << "  gcov:   Work with the gcov format.\n"
-         << "  report: Summarize instrprof style coverage information.\n"
-         << "  show:   Annotate source files using instrprof style coverage.\n";
+         << "  export:        Export instrprof file to structured format.\n"
+         << "  gcov:          Work with the gcov format.\n"
+         << "  merge-exports: Merge binary exports.\n"
+         << "  report:        Summarize instrprof style coverage information.\n"
+         << "  show:          Annotate source files using instrprof style "
+            "coverage.\n";
 
   return 0;
 }
@@ -75,6 +81,7 @@ int main(int argc, const char **argv) {
                             .Case("convert-for-testing", convertForTestingMain)
                             .Case("export", exportMain)
                             .Case("gcov", gcovMain)
+                            .Case("merge-exports", mergeExportsMain)
                             .Case("report", reportMain)
                             .Case("show", showMain)
                             .Cases("-h", "-help", "--help", helpMain)
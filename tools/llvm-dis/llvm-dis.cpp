@@ -150,7 +150,8 @@ static ExitOnError ExitOnErr;
 
 static std::unique_ptr<Module> openInputFile(LLVMContext &Context) {
   std::unique_ptr<MemoryBuffer> MB =
-      ExitOnErr(errorOrToExpected(MemoryBuffer::getFileOrSTDIN(InputFilename)));
+      ExitOnErr(errorOrToExpected(MemoryBuffer::getFileOrSTDIN(
+          InputFilename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false)));
   std::unique_ptr<Module> M = ExitOnErr(getOwningLazyBitcodeModule(
       std::move(MB), Context,
       /*ShouldLazyLoadMetadata=*/true, SetImporting));
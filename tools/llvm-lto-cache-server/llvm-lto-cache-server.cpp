@@ -0,0 +1,292 @@
+//===-- llvm-lto-cache-server: reference ThinLTO cache server -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program serves a directory of ThinLTO native objects to the links that
+// connect to it on a Unix domain socket (see llvm/LTO/SharedCache.h). It is a
+// reference for the protocol, and a stand-in for a cache shared by several
+// machines.
+//
+// If a command is given after "--", the server runs it, serves requests until
+// it exits, and exits with its status.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/LTO/SharedCache.h"
+#include "llvm/Support/CacheManifest.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/PrettyStackTrace.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <mutex>
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+using namespace lto;
+
+static cl::opt<std::string> SocketPath("socket", cl::Required,
+                                       cl::desc("Unix domain socket to listen "
+                                                "on"),
+                                       cl::value_desc("path"));
+
+static cl::opt<std::string> CacheDir("cache-dir", cl::Required,
+                                     cl::desc("Directory to store objects in"),
+                                     cl::value_desc("directory"));
+
+static cl::opt<std::string>
+    PrunePolicy("prune-policy",
+                cl::desc("Pruning policy for the cache directory (see "
+                         "parseCachePruningPolicy())"),
+                cl::value_desc("policy"));
+
+static cl::opt<unsigned>
+    Threads("threads", cl::init(0),
+            cl::desc("Number of requests served concurrently (0 = number of "
+                     "hardware threads)"));
+
+static cl::opt<unsigned long long>
+    MaxObjectSize("max-object-size", cl::init(DefaultMaxCacheObjectSize),
+                  cl::desc("Largest object accepted from a client, in bytes"),
+                  cl::value_desc("bytes"));
+
+static cl::opt<bool> PrintStats("print-stats",
+                                cl::desc("Print statistics on exit"));
+
+static cl::list<std::string> Command(cl::Positional, cl::ZeroOrMore,
+                                     cl::desc("[-- <command> <args>...]"));
+
+static ExitOnError ExitOnErr;
+
+namespace {
+
+class CacheServer {
+public:
+  CacheServer(StringRef Dir, Optional<CachePruningPolicy> Policy)
+      : Dir(Dir), Policy(Policy) {}
+
+  /// Serves the request sent on the connection \p FD.
+  void serve(int FD);
+
+  void printStats(raw_ostream &OS) const {
+    OS << "Cache server statistics:\n"
+       << "  lookups: " << Hits + Misses << " (" << Hits << " hits, "
+       << Misses << " misses)\n"
+       << "  stores: " << Stores << '\n'
+       << "  failed requests: " << Failures << '\n';
+  }
+
+private:
+  std::string getEntryPath(StringRef Key) const {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, "llvmcache-" + Key);
+    return Path.str();
+  }
+
+  cacheserver::Status get(StringRef Key, int FD);
+  cacheserver::Status put(StringRef Key, StringRef Object);
+
+  std::string Dir;
+  Optional<CachePruningPolicy> Policy;
+  std::mutex PruneMutex;
+  std::atomic<uint64_t> Hits{0}, Misses{0}, Stores{0}, Failures{0};
+};
+
+} // end anonymous namespace
+
+#ifdef LLVM_ON_UNIX
+
+void CacheServer::serve(int FD) {
+  Expected<cacheserver::Request> R =
+      cacheserver::readRequest(FD, MaxObjectSize);
+  if (!R) {
+    consumeError(R.takeError());
+    ++Failures;
+    // The client may still be listening, e.g. after a request was rejected
+    // for its size.
+    consumeError(cacheserver::writeResponse(FD, cacheserver::Failure));
+    return;
+  }
+  if (!cacheserver::isValidKey(R->Key)) {
+    ++Failures;
+    consumeError(cacheserver::writeResponse(FD, cacheserver::Failure));
+    return;
+  }
+
+  if (R->Op == cacheserver::Get) {
+    cacheserver::Status S = get(R->Key, FD);
+    if (S != cacheserver::Success)
+      consumeError(cacheserver::writeResponse(FD, S));
+    return;
+  }
+  consumeError(cacheserver::writeResponse(FD, put(R->Key, R->Object)));
+}
+
+cacheserver::Status CacheServer::get(StringRef Key, int FD) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getFile(getEntryPath(Key), /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
+  if (!MBOrErr) {
+    if (MBOrErr.getError() != errc::no_such_file_or_directory) {
+      ++Failures;
+      return cacheserver::Failure;
+    }
+    ++Misses;
+    return cacheserver::NotFound;
+  }
+  ++Hits;
+  CacheManifest::recordAccess(Dir, Key, (*MBOrErr)->getBufferSize());
+  consumeError(cacheserver::writeObjectResponse(FD, (*MBOrErr)->getBuffer()));
+  return cacheserver::Success;
+}
+
+cacheserver::Status CacheServer::put(StringRef Key, StringRef Object) {
+  SmallString<128> TempModel(Dir);
+  sys::path::append(TempModel, "Server-%%%%%%.tmp.o");
+  Expected<sys::fs::TempFile> Temp = sys::fs::TempFile::create(TempModel);
+  if (!Temp) {
+    consumeError(Temp.takeError());
+    ++Failures;
+    return cacheserver::Failure;
+  }
+  {
+    raw_fd_ostream OS(Temp->FD, /*shouldClose=*/false);
+    OS << Object;
+    OS.flush();
+    if (OS.has_error()) {
+      OS.clear_error();
+      consumeError(Temp->discard());
+      ++Failures;
+      return cacheserver::Failure;
+    }
+  }
+  if (Error E = Temp->keep(getEntryPath(Key))) {
+    consumeError(std::move(E));
+    ++Failures;
+    return cacheserver::Failure;
+  }
+  CacheManifest::recordInsert(Dir, Key, Object.size());
+  ++Stores;
+
+  // The policy's interval keeps this cheap.
+  if (Policy) {
+    std::lock_guard<std::mutex> Lock(PruneMutex);
+    pruneCache(Dir, *Policy);
+  }
+  return cacheserver::Success;
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  PrettyStackTraceProgram X(argc, argv);
+  llvm_shutdown_obj Y;
+  ExitOnErr.setBanner(std::string(argv[0]) + ": ");
+  cl::ParseCommandLineOptions(argc, argv, "ThinLTO cache server\n");
+
+  Optional<CachePruningPolicy> Policy;
+  if (!PrunePolicy.empty())
+    Policy = ExitOnErr(parseCachePruningPolicy(PrunePolicy));
+
+  if (std::error_code EC = sys::fs::create_directories(CacheDir))
+    ExitOnErr(errorCodeToError(EC));
+  if (!CacheManifest::exists(CacheDir))
+    ExitOnErr(CacheManifest::create(CacheDir));
+
+  // A client going away while we answer it must not kill the server.
+  ::signal(SIGPIPE, SIG_IGN);
+
+  int ListenFD = ExitOnErr(cacheserver::listen(SocketPath));
+
+  sys::ProcessInfo Child;
+  if (!Command.empty()) {
+    std::string Program = Command[0];
+    if (!sys::path::is_absolute(Program)) {
+      if (ErrorOr<std::string> P = sys::findProgramByName(Program))
+        Program = *P;
+    }
+    std::vector<const char *> Args;
+    for (const std::string &Arg : Command)
+      Args.push_back(Arg.c_str());
+    Args.push_back(nullptr);
+    std::string ErrMsg;
+    bool ExecutionFailed = false;
+    Child = sys::ExecuteNoWait(Program, Args.data(), nullptr, {}, 0, &ErrMsg,
+                               &ExecutionFailed);
+    if (ExecutionFailed) {
+      errs() << argv[0] << ": error: " << ErrMsg << '\n';
+      return 1;
+    }
+  }
+
+  CacheServer Server(CacheDir, Policy);
+  ThreadPool Pool(Threads ? Threads : hardware_concurrency());
+  int ExitCode = 0;
+  while (true) {
+    // Without a command, serve until killed. With one, check on it regularly.
+    pollfd PFD = {ListenFD, POLLIN, 0};
+    int Ready = ::poll(&PFD, 1, Command.empty() ? -1 : 50);
+    if (Ready < 0 && errno != EINTR) {
+      errs() << argv[0] << ": error: poll failed\n";
+      ExitCode = 1;
+      break;
+    }
+    if (Ready > 0) {
+      int FD = ::accept(ListenFD, nullptr, nullptr);
+      if (FD >= 0)
+        Pool.async([&Server, FD] {
+          Server.serve(FD);
+          ::close(FD);
+        });
+    }
+    if (!Command.empty()) {
+      sys::ProcessInfo PI = sys::Wait(Child, 0, /*WaitUntilTerminates=*/false);
+      if (PI.Pid != 0) {
+        ExitCode = PI.ReturnCode;
+        break;
+      }
+    }
+  }
+
+  ::close(ListenFD);
+  ::unlink(SocketPath.c_str());
+  Pool.wait();
+  if (PrintStats)
+    Server.printStats(outs());
+  return ExitCode;
+}
+
+#else
+
+void CacheServer::serve(int FD) {}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "ThinLTO cache server\n");
+  errs() << argv[0] << ": error: cache servers are only supported on Unix "
+         << "hosts\n";
+  return 1;
+}
+
+#endif
@@ -210,6 +210,11 @@ static cl::opt<bool> SetMergedModule(
 static cl::opt<unsigned> Parallelism("j", cl::Prefix, cl::init(1),
                                      cl::desc("Number of backend threads"));
 
+static cl::opt<unsigned> CodeGenThreads(
+    "codegen-threads", cl::init(0),
+    cl::desc("Number of threads the -j partitions are generated on "
+             "(default: one per partition)"));
+
 static cl::opt<bool> RestoreGlobalsLinkage(
     "restore-linkage", cl::init(false),
     cl::desc("Restore original linkage of globals prior to CodeGen"));
@@ -306,7 +311,8 @@ static std::unique_ptr<LTOModule>
 getLocalLTOModule(StringRef Path, std::unique_ptr<MemoryBuffer> &Buffer,
                   const TargetOptions &Options) {
   ErrorOr<std::unique_ptr<MemoryBuffer>> BufferOrErr =
-      MemoryBuffer::getFile(Path);
+      MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                            /*RequiresNullTerminator=*/false);
   error(BufferOrErr, "error loading file '" + Path + "'");
   Buffer = std::move(BufferOrErr.get());
   CurrentActivity = ("loading file '" + Path + "'").str();
@@ -381,7 +387,8 @@ static void createCombinedModuleSummaryIndex() {
   for (auto &Filename : InputFilenames) {
     ExitOnError ExitOnErr("llvm-lto: error loading file '" + Filename + "': ");
     std::unique_ptr<MemoryBuffer> MB =
-        ExitOnErr(errorOrToExpected(MemoryBuffer::getFileOrSTDIN(Filename)));
+        ExitOnErr(errorOrToExpected(MemoryBuffer::getFileOrSTDIN(
+            Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false)));
     ExitOnErr(readModuleSummaryIndex(*MB, CombinedIndex, ++NextModuleId));
   }
   std::error_code EC;
@@ -433,7 +440,8 @@ loadAllFilesForIndex(const ModuleSummaryIndex &Index) {
   for (auto &ModPath : Index.modulePaths()) {
     const auto &Filename = ModPath.first();
     std::string CurrentActivity = ("loading file '" + Filename + "'").str();
-    auto InputOrErr = MemoryBuffer::getFile(Filename);
+    auto InputOrErr = MemoryBuffer::getFile(
+        Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
     error(InputOrErr, "error " + CurrentActivity);
     InputBuffers.push_back(std::move(*InputOrErr));
   }
@@ -528,7 +536,8 @@ private:
     for (unsigned i = 0; i < InputFilenames.size(); ++i) {
       auto &Filename = InputFilenames[i];
       std::string CurrentActivity = "loading file '" + Filename + "'";
-      auto InputOrErr = MemoryBuffer::getFile(Filename);
+      auto InputOrErr = MemoryBuffer::getFile(
+          Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
       error(InputOrErr, "error " + CurrentActivity);
       InputBuffers.push_back(std::move(*InputOrErr));
       ThinGenerator.addModule(Filename, InputBuffers.back()->getBuffer());
@@ -723,7 +732,8 @@ private:
     std::vector<std::unique_ptr<MemoryBuffer>> InputBuffers;
     for (auto &Filename : InputFilenames) {
       LLVMContext Ctx;
-      auto InputOrErr = MemoryBuffer::getFile(Filename);
+      auto InputOrErr = MemoryBuffer::getFile(
+          Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
       error(InputOrErr, "error " + CurrentActivity);
       InputBuffers.push_back(std::move(*InputOrErr));
       ThinGenerator.addModule(Filename, InputBuffers.back()->getBuffer());
@@ -762,7 +772,8 @@ private:
     for (unsigned i = 0; i < InputFilenames.size(); ++i) {
       auto &Filename = InputFilenames[i];
       std::string CurrentActivity = "loading file '" + Filename + "'";
-      auto InputOrErr = MemoryBuffer::getFile(Filename);
+      auto InputOrErr = MemoryBuffer::getFile(
+          Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
       error(InputOrErr, "error " + CurrentActivity);
       InputBuffers.push_back(std::move(*InputOrErr));
       ThinGenerator.addModule(Filename, InputBuffers.back()->getBuffer());
@@ -833,7 +844,8 @@ int main(int argc, char **argv) {
       ExitOnError ExitOnErr(std::string(*argv) + ": error loading file '" +
                             Filename + "': ");
       std::unique_ptr<MemoryBuffer> BufferOrErr =
-          ExitOnErr(errorOrToExpected(MemoryBuffer::getFile(Filename)));
+          ExitOnErr(errorOrToExpected(MemoryBuffer::getFile(
+              Filename, /*FileSize=*/-1, /*RequiresNullTerminator=*/false)));
       auto Buffer = std::move(BufferOrErr.get());
       if (ExitOnErr(isBitcodeContainingObjCCategory(*Buffer)))
         outs() << "Bitcode " << Filename << " contains ObjC\n";
@@ -873,6 +885,7 @@ int main(int argc, char **argv) {
   CodeGen.setDebugInfo(LTO_DEBUG_MODEL_DWARF);
   CodeGen.setTargetOptions(Options);
   CodeGen.setShouldRestoreGlobalsLinkage(RestoreGlobalsLinkage);
+  CodeGen.setCodeGenThreads(CodeGenThreads);
 
   StringSet<MallocAllocator> DSOSymbolsSet;
   for (unsigned i = 0; i < DSOSymbols.size(); ++i)
@@ -21,6 +21,7 @@
 #include "llvm/IR/DiagnosticPrinter.h"
 #include "llvm/LTO/Caching.h"
 #include "llvm/LTO/LTO.h"
+#include "llvm/LTO/SharedCache.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/TargetSelect.h"
@@ -49,6 +50,16 @@ static cl::opt<std::string> OutputFilename("o", cl::Required,
 static cl::opt<std::string> CacheDir("cache-dir", cl::desc("Cache Directory"),
                                      cl::value_desc("directory"));
 
+static cl::opt<std::string>
+    CacheServer("cache-server",
+                cl::desc("Share native objects through the cache server "
+                         "listening on this Unix domain socket"),
+                cl::value_desc("socket"));
+
+static cl::opt<bool>
+    PrintCacheStats("print-cache-stats",
+                    cl::desc("Print statistics about the -cache-server cache"));
+
 static cl::opt<std::string> OptPipeline("opt-pipeline",
                                         cl::desc("Optimizer Pipeline"),
                                         cl::value_desc("pipeline"));
@@ -68,6 +79,15 @@ static cl::opt<bool>
 static cl::opt<int> Threads("thinlto-threads",
                             cl::init(llvm::heavyweight_hardware_concurrency()));
 
+static cl::opt<unsigned>
+    Partitions("lto-partitions", cl::init(1),
+               cl::desc("Number of partitions for regular LTO codegen"));
+
+static cl::opt<unsigned> CodeGenThreads(
+    "lto-codegen-threads", cl::init(0),
+    cl::desc("Number of threads the regular LTO partitions are generated on "
+             "(default: one per partition)"));
+
 static cl::list<std::string> SymbolResolutions(
     "r",
     cl::desc("Specify a symbol resolution: filename,symbolname,resolution\n"
@@ -250,11 +270,16 @@ static int run(int argc, char **argv) {
                                             /* OnWrite */ {});
   else
     Backend = createInProcessThinBackend(Threads);
-  LTO Lto(std::move(Conf), std::move(Backend));
+  Conf.CodeGenThreads = CodeGenThreads;
+
+  LTO Lto(std::move(Conf), std::move(Backend), Partitions);
 
   bool HasErrors = false;
   for (std::string F : InputFilenames) {
-    std::unique_ptr<MemoryBuffer> MB = check(MemoryBuffer::getFile(F), F);
+    std::unique_ptr<MemoryBuffer> MB = check(
+        MemoryBuffer::getFile(F, /*FileSize=*/-1,
+                              /*RequiresNullTerminator=*/false),
+        F);
     std::unique_ptr<InputFile> Input =
         check(InputFile::create(MB->getMemBufferRef()), F);
 
@@ -308,13 +333,30 @@ static int run(int argc, char **argv) {
   if (!CacheDir.empty())
     Cache = check(localCache(CacheDir, AddBuffer), "failed to create cache");
 
+  SharedCacheStats Stats;
+  if (!CacheServer.empty()) {
+    std::shared_ptr<SharedCacheStore> Store =
+        check(connectToCacheServer(CacheServer), "failed to create cache");
+    Cache = check(sharedCache(std::move(Store), AddBuffer, std::move(Cache),
+                              &Stats),
+                  "failed to create cache");
+  }
+
   check(Lto.run(AddStream, Cache), "LTO::run failed");
+
+  // Wait for the objects to be stored in the shared cache.
+  Cache = nullptr;
+  if (PrintCacheStats)
+    Stats.print(outs());
   return 0;
 }
 
 static int dumpSymtab(int argc, char **argv) {
   for (StringRef F : make_range(argv + 1, argv + argc)) {
-    std::unique_ptr<MemoryBuffer> MB = check(MemoryBuffer::getFile(F), F);
+    std::unique_ptr<MemoryBuffer> MB = check(
+        MemoryBuffer::getFile(F, /*FileSize=*/-1,
+                              /*RequiresNullTerminator=*/false),
+        F);
     BitcodeFileContents BFC = check(getBitcodeFileContents(*MB), F);
 
     if (BFC.Symtab.size() >= sizeof(irsymtab::storage::Header)) {
@@ -122,16 +122,24 @@ typedef SmallVector<WeightedFile, 5> WeightedFileVector;
 /// Keep track of merged data and reported errors.
 struct WriterContext {
   std::mutex Lock;
-  InstrProfWriter Writer;
+  bool IsSparse;
+  std::unique_ptr<InstrProfWriter> Writer;
   Error Err;
   std::string ErrWhence;
   std::mutex &ErrLock;
   SmallSet<instrprof_error, 4> &WriterErrorCodes;
 
+  /// When merging under a memory limit, the merged data is written to a
+  /// temporary profile whenever it gets larger than SpillThreshold bytes.
+  uint64_t SpillThreshold = 0;
+  std::vector<std::string> SpillFiles;
+
   WriterContext(bool IsSparse, std::mutex &ErrLock,
                 SmallSet<instrprof_error, 4> &WriterErrorCodes)
-      : Lock(), Writer(IsSparse), Err(Error::success()), ErrWhence(""),
-        ErrLock(ErrLock), WriterErrorCodes(WriterErrorCodes) {}
+      : Lock(), IsSparse(IsSparse),
+        Writer(llvm::make_unique<InstrProfWriter>(IsSparse)),
+        Err(Error::success()), ErrWhence(""), ErrLock(ErrLock),
+        WriterErrorCodes(WriterErrorCodes) {}
 };
 
 /// Determine whether an error is fatal for profile merging.
@@ -150,6 +158,41 @@ static bool isFatalError(instrprof_error IPE) {
   }
 }
 
+/// Write the merged data of \p WC to a temporary indexed profile, and start
+/// over with an empty writer.
+static void spillWriterContext(WriterContext *WC) {
+  int FD;
+  SmallString<128> Path;
+  if (std::error_code EC = sys::fs::createTemporaryFile("llvm-profdata",
+                                                        "profdata", FD, Path)) {
+    sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Path);
+    WC->ErrWhence = Path.str();
+    WC->Err = errorCodeToError(EC);
+    return;
+  }
+  sys::RemoveFileOnSignal(Path);
+  WC->SpillFiles.push_back(Path.str());
+
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  WC->Writer->write(OS);
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    WC->ErrWhence = Path.str();
+    WC->Err = errorCodeToError(make_error_code(errc::io_error));
+    return;
+  }
+  WC->Writer = llvm::make_unique<InstrProfWriter>(WC->IsSparse);
+}
+
+/// Remove the temporary profiles \p Paths.
+static void removeSpillFiles(ArrayRef<std::string> Paths) {
+  for (const std::string &Path : Paths) {
+    sys::fs::remove(Path);
+    sys::DontRemoveFileOnSignal(Path);
+  }
+}
+
 /// Load an input into a writer context.
 static void loadInput(const WeightedFile &Input, WriterContext *WC) {
   std::unique_lock<std::mutex> CtxGuard{WC->Lock};
@@ -174,7 +217,7 @@ static void loadInput(const WeightedFile &Input, WriterContext *WC) {
 
   auto Reader = std::move(ReaderOrErr.get());
   bool IsIRProfile = Reader->isIRLevelProfile();
-  if (WC->Writer.setIsIRLevelProfile(IsIRProfile)) {
+  if (WC->Writer->setIsIRLevelProfile(IsIRProfile)) {
     WC->Err = make_error<StringError>(
         "Merge IR generated profile with Clang generated profile.",
         std::error_code());
@@ -184,7 +227,7 @@ static void loadInput(const WeightedFile &Input, WriterContext *WC) {
   for (auto &I : *Reader) {
     const StringRef FuncName = I.Name;
     bool Reported = false;
-    WC->Writer.addRecord(std::move(I), Input.Weight, [&](Error E) {
+    WC->Writer->addRecord(std::move(I), Input.Weight, [&](Error E) {
       if (Reported) {
         consumeError(std::move(E));
         return;
@@ -205,6 +248,10 @@ static void loadInput(const WeightedFile &Input, WriterContext *WC) {
         WC->Err = make_error<InstrProfError>(IPE);
     }
   }
+
+  if (!WC->Err && WC->SpillThreshold &&
+      WC->Writer->getApproximateSize() > WC->SpillThreshold)
+    spillWriterContext(WC);
 }
 
 /// Merge the \p Src writer context into \p Dst.
@@ -215,7 +262,7 @@ static void mergeWriterContexts(WriterContext *Dst, WriterContext *Src) {
     return;
 
   bool Reported = false;
-  Dst->Writer.mergeRecordsFromWriter(std::move(Src->Writer), [&](Error E) {
+  Dst->Writer->mergeRecordsFromWriter(std::move(*Src->Writer), [&](Error E) {
     if (Reported) {
       consumeError(std::move(E));
       return;
@@ -225,10 +272,78 @@ static void mergeWriterContexts(WriterContext *Dst, WriterContext *Src) {
   });
 }
 
+/// Merge the data of \p Contexts, some of which has been written to temporary
+/// profiles, into the first context. The temporary profiles are merged
+/// pairwise in parallel (~ lg(N) serial steps), so only the last step holds
+/// all of the data in memory.
+static void
+mergeSpilledContexts(SmallVectorImpl<std::unique_ptr<WriterContext>> &Contexts,
+                     unsigned NumThreads) {
+  std::vector<std::string> Files;
+  bool Failed = false;
+  for (std::unique_ptr<WriterContext> &WC : Contexts) {
+    if (!WC->Err && WC->Writer->getApproximateSize())
+      spillWriterContext(WC.get());
+    if (WC->Err)
+      Failed = true;
+    Files.insert(Files.end(), WC->SpillFiles.begin(), WC->SpillFiles.end());
+    WC->SpillFiles.clear();
+  }
+  // Hard errors are reported by the caller.
+  if (Failed) {
+    removeSpillFiles(Files);
+    return;
+  }
+
+  WriterContext *Dst = Contexts[0].get();
+  Dst->SpillThreshold = 0;
+  ThreadPool Pool(NumThreads);
+  while (Files.size() > 2) {
+    SmallVector<std::unique_ptr<WriterContext>, 4> Merged;
+    for (size_t I = 0; I + 1 < Files.size(); I += 2) {
+      Merged.emplace_back(llvm::make_unique<WriterContext>(
+          Dst->IsSparse, Dst->ErrLock, Dst->WriterErrorCodes));
+      WriterContext *WC = Merged.back().get();
+      Pool.async([WC, &Files, I] {
+        loadInput({Files[I], 1}, WC);
+        loadInput({Files[I + 1], 1}, WC);
+        if (!WC->Err)
+          spillWriterContext(WC);
+      });
+    }
+    Pool.wait();
+
+    std::vector<std::string> NextFiles;
+    for (std::unique_ptr<WriterContext> &WC : Merged)
+      NextFiles.insert(NextFiles.end(), WC->SpillFiles.begin(),
+                       WC->SpillFiles.end());
+    // An odd file out is merged in the next step.
+    if (Files.size() & 1) {
+      NextFiles.push_back(Files.back());
+      Files.pop_back();
+    }
+    removeSpillFiles(Files);
+    Files = std::move(NextFiles);
+
+    for (std::unique_ptr<WriterContext> &WC : Merged) {
+      if (!WC->Err)
+        continue;
+      removeSpillFiles(Files);
+      Dst->Err = std::move(WC->Err);
+      Dst->ErrWhence = WC->ErrWhence;
+      return;
+    }
+  }
+
+  for (const std::string &File : Files)
+    loadInput({File, 1}, Dst);
+  removeSpillFiles(Files);
+}
+
 static void mergeInstrProfile(const WeightedFileVector &Inputs,
                               StringRef OutputFilename,
                               ProfileFormat OutputFormat, bool OutputSparse,
-                              unsigned NumThreads) {
+                              unsigned NumThreads, uint64_t MemoryLimit) {
   if (OutputFilename.compare("-") == 0)
     exitWithError("Cannot write indexed profdata format to stdout.");
 
@@ -250,9 +365,13 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
 
   // Initialize the writer contexts.
   SmallVector<std::unique_ptr<WriterContext>, 4> Contexts;
-  for (unsigned I = 0; I < NumThreads; ++I)
+  for (unsigned I = 0; I < NumThreads; ++I) {
     Contexts.emplace_back(llvm::make_unique<WriterContext>(
         OutputSparse, ErrorLock, WriterErrorCodes));
+    if (MemoryLimit)
+      Contexts.back()->SpillThreshold =
+          std::max<uint64_t>(MemoryLimit / NumThreads, 1);
+  }
 
   if (NumThreads == 1) {
     for (const auto &Input : Inputs)
@@ -267,6 +386,15 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
       Ctx = (Ctx + 1) % NumThreads;
     }
     Pool.wait();
+  }
+
+  if (llvm::any_of(Contexts, [](std::unique_ptr<WriterContext> &WC) {
+        return !WC->SpillFiles.empty();
+      })) {
+    // Part of the data is on disk, so merge through temporary profiles.
+    mergeSpilledContexts(Contexts, NumThreads);
+  } else if (NumThreads > 1) {
+    ThreadPool Pool(NumThreads);
 
     // Merge the writer contexts together (~ lg(NumThreads) serial steps).
     unsigned Mid = Contexts.size() / 2;
@@ -302,7 +430,7 @@ static void mergeInstrProfile(const WeightedFileVector &Inputs,
            WC->ErrWhence);
   }
 
-  InstrProfWriter &Writer = Contexts[0]->Writer;
+  InstrProfWriter &Writer = *Contexts[0]->Writer;
   if (OutputFormat == PF_Text) {
     if (Error E = Writer.writeText(Output))
       exitWithError(std::move(E));
@@ -369,6 +497,29 @@ static WeightedFile parseWeightedFile(const StringRef &WeightedFilename) {
   return {FileName, Weight};
 }
 
+/// Parse a size in bytes, with an optional k, m or g suffix.
+static uint64_t parseMemoryLimit(StringRef Limit) {
+  if (Limit.empty())
+    return 0;
+  uint64_t Multiplier = 1;
+  switch (Limit.back()) {
+  case 'g':
+    Multiplier *= 1024;
+    LLVM_FALLTHROUGH;
+  case 'm':
+    Multiplier *= 1024;
+    LLVM_FALLTHROUGH;
+  case 'k':
+    Multiplier *= 1024;
+    Limit = Limit.drop_back();
+    break;
+  }
+  uint64_t Size;
+  if (Limit.getAsInteger(10, Size) || Size == 0)
+    exitWithError("Memory limit must be a positive size.");
+  return Size * Multiplier;
+}
+
 static std::unique_ptr<MemoryBuffer>
 getInputFilenamesFileBuf(const StringRef &InputFilenamesFile) {
   if (InputFilenamesFile == "")
@@ -472,6 +623,12 @@ static int merge_main(int argc, const char *argv[]) {
       cl::desc("Number of merge threads to use (default: autodetect)"));
   cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
                         cl::aliasopt(NumThreads));
+  cl::opt<std::string> MemoryLimit(
+      "memory-limit", cl::value_desc("size"),
+      cl::desc("Approximate limit on the memory used for merged data while "
+               "reading the inputs, in bytes or with a k, m or g suffix. Data "
+               "over the limit is merged through temporary files (only "
+               "meaningful for -instr)"));
 
   cl::ParseCommandLineOptions(argc, argv, "LLVM profile data merger\n");
 
@@ -498,7 +655,7 @@ static int merge_main(int argc, const char *argv[]) {
 
   if (ProfileKind == instr)
     mergeInstrProfile(WeightedInputs, OutputFilename, OutputFormat,
-                      OutputSparse, NumThreads);
+                      OutputSparse, NumThreads, parseMemoryLimit(MemoryLimit));
   else
     mergeSampleProfile(WeightedInputs, OutputFilename, OutputFormat);
 
@@ -26,10 +26,12 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <vector>
 
 using namespace llvm;
 using namespace symbolize;
@@ -92,6 +94,22 @@ static cl::opt<int> ClPrintSourceContextLines(
 static cl::opt<bool> ClVerbose("verbose", cl::init(false),
                                cl::desc("Print verbose line info"));
 
+static cl::opt<std::string>
+    ClIndexDirectory("index-dir", cl::init(""),
+                     cl::desc("Directory of per-build-ID symbolization "
+                              "indexes to answer code lookups from (created "
+                              "on demand)"));
+
+static cl::opt<bool>
+    ClBatch("batch", cl::init(false),
+            cl::desc("Read all input before printing anything, and "
+                     "symbolize code addresses on several threads"));
+
+static cl::opt<unsigned>
+    ClThreads("threads", cl::init(0),
+              cl::desc("Number of threads to use in batch mode (0 = number "
+                       "of hardware threads)"));
+
 template<typename T>
 static bool error(Expected<T> &ResOrErr) {
   if (ResOrErr)
@@ -144,6 +162,68 @@ static bool parseCommand(StringRef InputString, bool &IsData,
   return !StringRef(pos, offset_length).getAsInteger(0, ModuleOffset);
 }
 
+static void printAddress(uint64_t ModuleOffset) {
+  outs() << "0x";
+  outs().write_hex(ModuleOffset);
+  StringRef Delimiter = (ClPrettyPrint == true) ? ": " : "\n";
+  outs() << Delimiter;
+}
+
+// Reads all of stdin, symbolizes its code addresses with the batch API and
+// prints the results in input order, like the line-by-line loop in main().
+static void symbolizeBatch(LLVMSymbolizer &Symbolizer, DIPrinter &Printer) {
+  std::vector<std::string> Lines;
+  std::vector<LLVMSymbolizer::CodeRequest> Requests;
+  const int kMaxInputStringLength = 1024;
+  char InputString[kMaxInputStringLength];
+  while (fgets(InputString, sizeof(InputString), stdin)) {
+    Lines.push_back(InputString);
+    bool IsData = false;
+    std::string ModuleName;
+    uint64_t ModuleOffset = 0;
+    if (parseCommand(StringRef(InputString), IsData, ModuleName,
+                     ModuleOffset) &&
+        !IsData)
+      Requests.emplace_back(ModuleName, ModuleOffset);
+  }
+
+  unsigned Threads =
+      ClThreads ? ClThreads : llvm::hardware_concurrency();
+  std::vector<Expected<DIInliningInfo>> InlinedResults;
+  std::vector<Expected<DILineInfo>> CodeResults;
+  if (ClPrintInlining)
+    InlinedResults =
+        Symbolizer.symbolizeInlinedCodeBatch(Requests, Threads, ClDwpName);
+  else
+    CodeResults = Symbolizer.symbolizeCodeBatch(Requests, Threads, ClDwpName);
+
+  size_t NextResult = 0;
+  for (const std::string &Line : Lines) {
+    bool IsData = false;
+    std::string ModuleName;
+    uint64_t ModuleOffset = 0;
+    if (!parseCommand(Line, IsData, ModuleName, ModuleOffset)) {
+      outs() << Line;
+      continue;
+    }
+
+    if (ClPrintAddress)
+      printAddress(ModuleOffset);
+    if (IsData) {
+      auto ResOrErr = Symbolizer.symbolizeData(ModuleName, ModuleOffset);
+      Printer << (error(ResOrErr) ? DIGlobal() : ResOrErr.get());
+    } else if (ClPrintInlining) {
+      auto &ResOrErr = InlinedResults[NextResult++];
+      Printer << (error(ResOrErr) ? DIInliningInfo() : ResOrErr.get());
+    } else {
+      auto &ResOrErr = CodeResults[NextResult++];
+      Printer << (error(ResOrErr) ? DILineInfo() : ResOrErr.get());
+    }
+    outs() << "\n";
+  }
+  outs().flush();
+}
+
 int main(int argc, char **argv) {
   // Print stack trace if we signal out.
   sys::PrintStackTraceOnErrorSignal(argv[0]);
@@ -155,6 +235,7 @@ int main(int argc, char **argv) {
   cl::ParseCommandLineOptions(argc, argv, "llvm-symbolizer\n");
   LLVMSymbolizer::Options Opts(ClPrintFunctions, ClUseSymbolTable, ClDemangle,
                                ClUseRelativeAddress, ClDefaultArch);
+  Opts.IndexDirectory = ClIndexDirectory;
 
   for (const auto &hint : ClDsymHint) {
     if (sys::path::extension(hint) == ".dSYM") {
@@ -169,6 +250,11 @@ int main(int argc, char **argv) {
   DIPrinter Printer(outs(), ClPrintFunctions != FunctionNameKind::None,
                     ClPrettyPrint, ClPrintSourceContextLines, ClVerbose);
 
+  if (ClBatch) {
+    symbolizeBatch(Symbolizer, Printer);
+    return 0;
+  }
+
   const int kMaxInputStringLength = 1024;
   char InputString[kMaxInputStringLength];
 
@@ -185,12 +271,8 @@ int main(int argc, char **argv) {
       continue;
     }
 
-    if (ClPrintAddress) {
-      outs() << "0x";
-      outs().write_hex(ModuleOffset);
-      StringRef Delimiter = (ClPrettyPrint == true) ? ": " : "\n";
-      outs() << Delimiter;
-    }
+    if (ClPrintAddress)
+      printAddress(ModuleOffset);
     if (IsData) {
       auto ResOrErr = Symbolizer.symbolizeData(ModuleName, ModuleOffset);
       Printer << (error(ResOrErr) ? DIGlobal() : ResOrErr.get());
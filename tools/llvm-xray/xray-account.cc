@@ -21,6 +21,7 @@
 #include "xray-registry.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/XRay/InstrumentationMap.h"
 #include "llvm/XRay/Trace.h"
 
@@ -45,6 +46,11 @@ static cl::alias
     AccountDeduceSiblingCalls2("d", cl::aliasopt(AccountDeduceSiblingCalls),
                                cl::desc("Alias for -deduce_sibling_calls"),
                                cl::sub(Account));
+static cl::opt<bool> AccountExactPercentiles(
+    "exact",
+    cl::desc("Keep every latency to report exact percentiles; memory use then "
+             "grows with the number of function calls in the trace"),
+    cl::sub(Account), cl::init(false));
 static cl::opt<std::string>
     AccountOutput("output", cl::value_desc("output file"), cl::init("-"),
                   cl::desc("output file; use '-' for stdout"),
@@ -134,6 +140,52 @@ template <class T> T diff(T L, T R) { return std::max(L, R) - std::min(L, R); }
 
 } // namespace
 
+void LatencySummary::add(uint64_t Latency, bool KeepExact) {
+  if (Count == 0) {
+    Min = Latency;
+    Max = Latency;
+  } else {
+    Min = std::min(Min, Latency);
+    Max = std::max(Max, Latency);
+  }
+  ++Count;
+  Sum += Latency;
+  ++Buckets[bucketIndex(Latency)];
+  if (KeepExact)
+    Latencies.push_back(Latency);
+}
+
+uint64_t LatencySummary::approximateNth(uint64_t N) const {
+  assert(N < Count && "position out of range");
+  uint64_t Seen = 0;
+  for (const auto &B : Buckets) {
+    Seen += B.second;
+    if (Seen > N)
+      return std::min(Max, std::max(Min, bucketLowerBound(B.first)));
+  }
+  llvm_unreachable("bucket counts do not add up to the latency count");
+}
+
+// Latencies below 2^SignificantBits get a bucket each. Above that, each power
+// of two is split into 2^(SignificantBits - 1) buckets of equal width.
+uint32_t LatencySummary::bucketIndex(uint64_t Latency) {
+  const uint64_t Exact = 1ULL << SignificantBits;
+  const uint64_t PerOctave = Exact / 2;
+  if (Latency < Exact)
+    return Latency;
+  unsigned Shift = Log2_64(Latency) - (SignificantBits - 1);
+  return Exact + (Shift - 1) * PerOctave + ((Latency >> Shift) - PerOctave);
+}
+
+uint64_t LatencySummary::bucketLowerBound(uint32_t Index) {
+  const uint64_t Exact = 1ULL << SignificantBits;
+  const uint64_t PerOctave = Exact / 2;
+  if (Index < Exact)
+    return Index;
+  unsigned Shift = (Index - Exact) / PerOctave + 1;
+  return (PerOctave + (Index - Exact) % PerOctave) << Shift;
+}
+
 bool LatencyAccountant::accountRecord(const XRayRecord &Record) {
   setMinMax(PerThreadMinMaxTSC[Record.TId], Record.TSC);
   setMinMax(PerCPUMinMaxTSC[Record.CPU], Record.TSC);
@@ -230,24 +282,31 @@ struct ResultRow {
   std::string Function;
 };
 
-ResultRow getStats(std::vector<uint64_t> &Timings) {
-  assert(!Timings.empty());
+ResultRow getStats(const LatencySummary &Latencies) {
+  assert(Latencies.Count != 0);
   ResultRow R;
-  R.Sum = std::accumulate(Timings.begin(), Timings.end(), 0.0);
-  auto MinMax = std::minmax_element(Timings.begin(), Timings.end());
-  R.Min = *MinMax.first;
-  R.Max = *MinMax.second;
-  R.Count = Timings.size();
+  R.Sum = Latencies.Sum;
+  R.Min = Latencies.Min;
+  R.Max = Latencies.Max;
+  R.Count = Latencies.Count;
+
+  auto MedianOff = Latencies.Count / 2;
+  auto Pct90Off = std::floor(Latencies.Count * 0.9);
+  auto Pct99Off = std::floor(Latencies.Count * 0.99);
+  if (Latencies.Latencies.empty()) {
+    R.Median = Latencies.approximateNth(MedianOff);
+    R.Pct90 = Latencies.approximateNth(Pct90Off);
+    R.Pct99 = Latencies.approximateNth(Pct99Off);
+    return R;
+  }
 
-  auto MedianOff = Timings.size() / 2;
+  std::vector<uint64_t> Timings = Latencies.Latencies;
   std::nth_element(Timings.begin(), Timings.begin() + MedianOff, Timings.end());
   R.Median = Timings[MedianOff];
 
-  auto Pct90Off = std::floor(Timings.size() * 0.9);
   std::nth_element(Timings.begin(), Timings.begin() + Pct90Off, Timings.end());
   R.Pct90 = Timings[Pct90Off];
 
-  auto Pct99Off = std::floor(Timings.size() * 0.99);
   std::nth_element(Timings.begin(), Timings.begin() + Pct99Off, Timings.end());
   R.Pct99 = Timings[Pct99Off];
   return R;
@@ -260,10 +319,10 @@ void LatencyAccountant::exportStats(const XRayFileHeader &Header, F Fn) const {
   using TupleType = std::tuple<int32_t, uint64_t, ResultRow>;
   std::vector<TupleType> Results;
   Results.reserve(FunctionLatencies.size());
-  for (auto FT : FunctionLatencies) {
+  for (const auto &FT : FunctionLatencies) {
     const auto &FuncId = FT.first;
-    auto &Timings = FT.second;
-    Results.emplace_back(FuncId, Timings.size(), getStats(Timings));
+    const auto &Latencies = FT.second;
+    Results.emplace_back(FuncId, Latencies.Count, getStats(Latencies));
     auto &Row = std::get<2>(Results.back());
     if (Header.CycleFrequency) {
       double CycleFrequency = Header.CycleFrequency;
@@ -460,8 +519,12 @@ static CommandRegistration Unused(&Account, []() -> Error {
   symbolize::LLVMSymbolizer Symbolizer(Opts);
   llvm::xray::FuncIdConversionHelper FuncIdHelper(AccountInstrMap, Symbolizer,
                                                   FunctionAddresses);
-  xray::LatencyAccountant FCA(FuncIdHelper, AccountDeduceSiblingCalls);
-  auto TraceOrErr = loadTraceFile(AccountInput);
+  xray::LatencyAccountant FCA(FuncIdHelper, AccountDeduceSiblingCalls,
+                              AccountExactPercentiles);
+  // Stream the records through the accountant rather than loading the whole
+  // trace. Unless -exact is given, the accountant only keeps a bounded
+  // histogram of the latencies of each function.
+  auto TraceOrErr = openTraceFile(AccountInput);
   if (!TraceOrErr)
     return joinErrors(
         make_error<StringError>(
@@ -469,8 +532,9 @@ static CommandRegistration Unused(&Account, []() -> Error {
             std::make_error_code(std::errc::executable_format_error)),
         TraceOrErr.takeError());
 
-  auto &T = *TraceOrErr;
-  for (const auto &Record : T) {
+  auto &T = **TraceOrErr;
+  Error Err = Error::success();
+  for (const auto &Record : T.records(Err)) {
     if (FCA.accountRecord(Record))
       continue;
     errs()
@@ -491,12 +555,21 @@ static CommandRegistration Unused(&Account, []() -> Error {
         errs() << "  #" << Level-- << "\t"
                << FuncIdHelper.SymbolOrNumber(Entry.first) << '\n';
     }
-    if (!AccountKeepGoing)
+    if (!AccountKeepGoing) {
+      consumeError(std::move(Err));
       return make_error<StringError>(
           Twine("Failed accounting function calls in file '") + AccountInput +
               "'.",
           std::make_error_code(std::errc::executable_format_error));
+    }
   }
+  if (Err)
+    return joinErrors(
+        make_error<StringError>(
+            Twine("Failed loading input file '") + AccountInput + "'",
+            std::make_error_code(std::errc::executable_format_error)),
+        std::move(Err));
+
   switch (AccountOutputFormat) {
   case AccountOutputFormats::TEXT:
     FCA.exportStatsAsText(OS, T.getFileHeader());
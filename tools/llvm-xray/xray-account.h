@@ -26,9 +26,37 @@
 namespace llvm {
 namespace xray {
 
+/// Summarises the latencies recorded for one function. The count, sum, minimum
+/// and maximum are exact. The latencies themselves go into a histogram whose
+/// buckets keep the top SignificantBits bits of a latency, so a function takes
+/// at most a few thousand buckets however often it is called. Latencies below
+/// 2^SignificantBits are counted exactly and larger ones to within 1/128 of
+/// their value. In exact mode every latency is kept as well, so that the
+/// percentiles can be computed exactly.
+struct LatencySummary {
+  static constexpr unsigned SignificantBits = 8;
+
+  uint64_t Count = 0;
+  uint64_t Min = 0;
+  uint64_t Max = 0;
+  double Sum = 0;
+  std::map<uint32_t, uint64_t> Buckets;
+  std::vector<uint64_t> Latencies;
+
+  void add(uint64_t Latency, bool KeepExact);
+
+  /// Returns an estimate of the latency at position N (counting from 0) of the
+  /// sorted latencies: the lowest value of the histogram bucket it falls into,
+  /// clamped to the minimum and maximum.
+  uint64_t approximateNth(uint64_t N) const;
+
+  static uint32_t bucketIndex(uint64_t Latency);
+  static uint64_t bucketLowerBound(uint32_t Index);
+};
+
 class LatencyAccountant {
 public:
-  typedef std::map<int32_t, std::vector<uint64_t>> FunctionLatencyMap;
+  typedef std::map<int32_t, LatencySummary> FunctionLatencyMap;
   typedef std::map<llvm::sys::ProcessInfo::ProcessId,
                    std::pair<uint64_t, uint64_t>>
       PerThreadMinMaxTSCMap;
@@ -45,16 +73,19 @@ private:
   FuncIdConversionHelper &FuncIdHelper;
 
   bool DeduceSiblingCalls = false;
+  bool ExactPercentiles = false;
   uint64_t CurrentMaxTSC = 0;
 
   void recordLatency(int32_t FuncId, uint64_t Latency) {
-    FunctionLatencies[FuncId].push_back(Latency);
+    FunctionLatencies[FuncId].add(Latency, ExactPercentiles);
   }
 
 public:
   explicit LatencyAccountant(FuncIdConversionHelper &FuncIdHelper,
-                             bool DeduceSiblingCalls)
-      : FuncIdHelper(FuncIdHelper), DeduceSiblingCalls(DeduceSiblingCalls) {}
+                             bool DeduceSiblingCalls,
+                             bool ExactPercentiles = false)
+      : FuncIdHelper(FuncIdHelper), DeduceSiblingCalls(DeduceSiblingCalls),
+        ExactPercentiles(ExactPercentiles) {}
 
   const FunctionLatencyMap &getFunctionLatencies() const {
     return FunctionLatencies;
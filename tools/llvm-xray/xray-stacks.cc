@@ -16,7 +16,6 @@
 //===----------------------------------------------------------------------===//
 
 #include <forward_list>
-#include <numeric>
 
 #include "func-id-helper.h"
 #include "trie-node.h"
@@ -251,33 +250,35 @@ private:
 ///   |
 ///   +--> c
 ///
-/// We maintain a sequence of durations on the leaves and in the internal nodes
-/// as we go through and process every record from the XRay trace. We also
+/// We maintain the count and the sum of the durations on the leaves and in the
+/// internal nodes as we go through and process every record from the XRay
+/// trace, so memory use does not grow with the length of the trace. We also
 /// maintain an index of unique functions, and provide a means of iterating
 /// through all the instrumented call stacks which we know about.
 
+struct DurationSum {
+  uint64_t Count = 0;
+  uint64_t Sum = 0;
+
+  void add(uint64_t Duration) {
+    ++Count;
+    Sum += Duration;
+  }
+};
+
 struct StackDuration {
-  llvm::SmallVector<int64_t, 4> TerminalDurations;
-  llvm::SmallVector<int64_t, 4> IntermediateDurations;
+  DurationSum Terminal;
+  DurationSum Intermediate;
 };
 
 StackDuration mergeStackDuration(const StackDuration &Left,
                                  const StackDuration &Right) {
   StackDuration Data{};
-  Data.TerminalDurations.reserve(Left.TerminalDurations.size() +
-                                 Right.TerminalDurations.size());
-  Data.IntermediateDurations.reserve(Left.IntermediateDurations.size() +
-                                     Right.IntermediateDurations.size());
   // Aggregate the durations.
-  for (auto duration : Left.TerminalDurations)
-    Data.TerminalDurations.push_back(duration);
-  for (auto duration : Right.TerminalDurations)
-    Data.TerminalDurations.push_back(duration);
-
-  for (auto duration : Left.IntermediateDurations)
-    Data.IntermediateDurations.push_back(duration);
-  for (auto duration : Right.IntermediateDurations)
-    Data.IntermediateDurations.push_back(duration);
+  Data.Terminal.Count = Left.Terminal.Count + Right.Terminal.Count;
+  Data.Terminal.Sum = Left.Terminal.Sum + Right.Terminal.Sum;
+  Data.Intermediate.Count = Left.Intermediate.Count + Right.Intermediate.Count;
+  Data.Intermediate.Sum = Left.Intermediate.Sum + Right.Intermediate.Sum;
   return Data;
 }
 
@@ -291,10 +292,7 @@ std::size_t GetValueForStack(const StackTrieNode *Node);
 template <>
 std::size_t
 GetValueForStack<AggregationType::TOTAL_TIME>(const StackTrieNode *Node) {
-  auto TopSum = std::accumulate(Node->ExtraData.TerminalDurations.begin(),
-                                Node->ExtraData.TerminalDurations.end(), 0uLL);
-  return std::accumulate(Node->ExtraData.IntermediateDurations.begin(),
-                         Node->ExtraData.IntermediateDurations.end(), TopSum);
+  return Node->ExtraData.Terminal.Sum + Node->ExtraData.Intermediate.Sum;
 }
 
 // Calculates how many times a function was invoked.
@@ -302,8 +300,7 @@ GetValueForStack<AggregationType::TOTAL_TIME>(const StackTrieNode *Node) {
 template <>
 std::size_t
 GetValueForStack<AggregationType::INVOCATION_COUNT>(const StackTrieNode *Node) {
-  return Node->ExtraData.TerminalDurations.size() +
-         Node->ExtraData.IntermediateDurations.size();
+  return Node->ExtraData.Terminal.Count + Node->ExtraData.Intermediate.Count;
 }
 
 // Make sure there are implementations for each enum value.
@@ -427,14 +424,14 @@ public:
       }
       auto I = FunctionEntryMatch.base();
       for (auto &E : make_range(I, TS.end() - 1))
-        E.first->ExtraData.IntermediateDurations.push_back(
+        E.first->ExtraData.Intermediate.add(
             std::max(E.second, R.TSC) - std::min(E.second, R.TSC));
       auto &Deepest = TS.back();
       if (wasLastRecordExit)
-        Deepest.first->ExtraData.IntermediateDurations.push_back(
+        Deepest.first->ExtraData.Intermediate.add(
             std::max(Deepest.second, R.TSC) - std::min(Deepest.second, R.TSC));
       else
-        Deepest.first->ExtraData.TerminalDurations.push_back(
+        Deepest.first->ExtraData.Terminal.add(
             std::max(Deepest.second, R.TSC) - std::min(Deepest.second, R.TSC));
       TS.erase(I, TS.end());
       return status;
@@ -457,22 +454,18 @@ public:
                   "count", "sum");
     for (auto *F :
          reverse(make_range(CurrentStack.begin() + 1, CurrentStack.end()))) {
-      auto Sum = std::accumulate(F->ExtraData.IntermediateDurations.begin(),
-                                 F->ExtraData.IntermediateDurations.end(), 0LL);
       auto FuncId = FN.SymbolOrNumber(F->FuncId);
       OS << formatv("#{0,-4} {1,-60} {2,+12} {3,+16}\n", Level++,
                     FuncId.size() > 60 ? FuncId.substr(0, 57) + "..." : FuncId,
-                    F->ExtraData.IntermediateDurations.size(), Sum);
+                    F->ExtraData.Intermediate.Count,
+                    F->ExtraData.Intermediate.Sum);
     }
     auto *Leaf = *CurrentStack.begin();
-    auto LeafSum =
-        std::accumulate(Leaf->ExtraData.TerminalDurations.begin(),
-                        Leaf->ExtraData.TerminalDurations.end(), 0LL);
     auto LeafFuncId = FN.SymbolOrNumber(Leaf->FuncId);
     OS << formatv("#{0,-4} {1,-60} {2,+12} {3,+16}\n", Level++,
                   LeafFuncId.size() > 60 ? LeafFuncId.substr(0, 57) + "..."
                                          : LeafFuncId,
-                  Leaf->ExtraData.TerminalDurations.size(), LeafSum);
+                  Leaf->ExtraData.Terminal.Count, Leaf->ExtraData.Terminal.Sum);
     OS << "\n";
   }
 
@@ -624,11 +617,9 @@ public:
 
         // We only start printing the stack (by walking up the parent pointers)
         // when we get to a leaf function.
-        if (!Top->ExtraData.TerminalDurations.empty()) {
+        if (Top->ExtraData.Terminal.Count != 0) {
           ++UniqueStacks;
-          auto TopSum =
-              std::accumulate(Top->ExtraData.TerminalDurations.begin(),
-                              Top->ExtraData.TerminalDurations.end(), 0uLL);
+          auto TopSum = Top->ExtraData.Terminal.Sum;
           {
             auto E = std::make_pair(Top, TopSum);
             TopStacksBySum.insert(std::lower_bound(TopStacksBySum.begin(),
@@ -639,8 +630,7 @@ public:
               TopStacksBySum.pop_back();
           }
           {
-            auto E =
-                std::make_pair(Top, Top->ExtraData.TerminalDurations.size());
+            auto E = std::make_pair(Top, Top->ExtraData.Terminal.Count);
             TopStacksByCount.insert(std::lower_bound(TopStacksByCount.begin(),
                                                      TopStacksByCount.end(), E,
                                                      greater_second),
@@ -726,7 +716,7 @@ static CommandRegistration Unused(&Stack, []() -> Error {
   // TODO: Someday, support output to files instead of just directly to
   // standard output.
   for (const auto &Filename : StackInputs) {
-    auto TraceOrErr = loadTraceFile(Filename);
+    auto TraceOrErr = openTraceFile(Filename);
     if (!TraceOrErr) {
       if (!StackKeepGoing)
         return joinErrors(
@@ -737,19 +727,31 @@ static CommandRegistration Unused(&Stack, []() -> Error {
       logAllUnhandledErrors(TraceOrErr.takeError(), errs(), "");
       continue;
     }
-    auto &T = *TraceOrErr;
+    auto &T = **TraceOrErr;
     StackTrie::AccountRecordState AccountRecordState =
         StackTrie::AccountRecordState::CreateInitialState();
-    for (const auto &Record : T) {
+    Error Err = Error::success();
+    for (const auto &Record : T.records(Err)) {
       auto error = ST.accountRecord(Record, &AccountRecordState);
       if (error != StackTrie::AccountRecordStatus::OK) {
-        if (!StackKeepGoing)
+        if (!StackKeepGoing) {
+          consumeError(std::move(Err));
           return make_error<StringError>(
               CreateErrorMessage(error, Record, FuncIdHelper),
               make_error_code(errc::illegal_byte_sequence));
+        }
         errs() << CreateErrorMessage(error, Record, FuncIdHelper);
       }
     }
+    if (Err) {
+      if (!StackKeepGoing)
+        return joinErrors(
+            make_error<StringError>(
+                Twine("Failed loading input file '") + Filename + "'",
+                std::make_error_code(std::errc::invalid_argument)),
+            std::move(Err));
+      logAllUnhandledErrors(std::move(Err), errs(), "");
+    }
   }
   if (ST.isEmpty()) {
     return make_error<StringError>(
@@ -191,4 +191,40 @@ TEST(BitReaderTest, MaterializeFunctionsForBlockAddrInFunctionAfter) {
   EXPECT_FALSE(verifyModule(*M, &dbgs()));
 }
 
+// Tests that a module is read in place from a region of a larger buffer, such
+// as an archive member, which is neither aligned nor null terminated.
+TEST(BitReaderTest, ReadFromUnalignedSlice) {
+  SmallString<1024> BC;
+  LLVMContext Context;
+  writeModuleToBuffer(parseAssembly(Context, "define i32 @f() {\n"
+                                             "  ret i32 42\n"
+                                             "}\n"),
+                      BC);
+
+  SmallString<1024> Archive;
+  Archive.append(3, '!');
+  Archive.append(BC.begin(), BC.end());
+  Archive.append(5, '\xff');
+  MemoryBufferRef Member(StringRef(Archive.data() + 3, BC.size()), "member");
+
+  Expected<std::vector<BitcodeModule>> ModsOrErr =
+      getBitcodeModuleList(Member);
+  ASSERT_TRUE(bool(ModsOrErr));
+  ASSERT_EQ(1u, ModsOrErr->size());
+  StringRef ModuleBuffer = (*ModsOrErr)[0].getBuffer();
+  EXPECT_GE(ModuleBuffer.begin(), Member.getBufferStart());
+  EXPECT_LE(ModuleBuffer.end(), Member.getBufferEnd());
+
+  LLVMContext ReadContext;
+  Expected<std::unique_ptr<Module>> ModuleOrErr =
+      (*ModsOrErr)[0].getLazyModule(ReadContext,
+                                    /*ShouldLazyLoadMetadata=*/true,
+                                    /*IsImporting=*/false);
+  ASSERT_TRUE(bool(ModuleOrErr));
+  Function *F = (*ModuleOrErr)->getFunction("f");
+  ASSERT_FALSE(F->materialize());
+  EXPECT_FALSE(F->empty());
+  EXPECT_FALSE(verifyModule(**ModuleOrErr, &dbgs()));
+}
+
 } // end namespace
@@ -8,7 +8,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/Process.h"
 #include "gtest/gtest.h"
+#include <cstring>
 
 using namespace llvm;
 
@@ -166,5 +168,78 @@ TEST(MCJITMemoryManagerTest, ManyVariedAllocations) {
   }
 }
 
+TEST(MCJITMemoryManagerTest, SlabAllocations) {
+  SlabMemoryMapper Mapper(1024 * 1024);
+  const uintptr_t PageSize = sys::Process::getPageSize();
+
+  // Give each of three modules its own memory manager, as the JITs do.
+  std::unique_ptr<SectionMemoryManager> MemMgrs[3];
+  uint8_t *Code[3];
+  for (unsigned I = 0; I != 3; ++I) {
+    MemMgrs[I].reset(new SectionMemoryManager(&Mapper));
+    Code[I] = MemMgrs[I]->allocateCodeSection(256, 0, 1, "");
+    uint8_t *ROData = MemMgrs[I]->allocateDataSection(256, 0, 2, "", true);
+    uint8_t *RWData = MemMgrs[I]->allocateDataSection(256, 0, 3, "", false);
+    ASSERT_NE((uint8_t *)nullptr, Code[I]);
+    ASSERT_NE((uint8_t *)nullptr, ROData);
+    ASSERT_NE((uint8_t *)nullptr, RWData);
+    memset(Code[I], 0xC3, 256);
+    memset(ROData, 1, 256);
+    memset(RWData, 2, 256);
+    std::string Error;
+    EXPECT_FALSE(MemMgrs[I]->finalizeMemory(&Error));
+  }
+
+  // The code of the three modules is packed into consecutive pages of a
+  // single slab, and each purpose has one slab.
+  EXPECT_EQ(3u, Mapper.getNumSlabs());
+  EXPECT_EQ((uintptr_t)Code[0] + PageSize, (uintptr_t)Code[1]);
+  EXPECT_EQ((uintptr_t)Code[1] + PageSize, (uintptr_t)Code[2]);
+  EXPECT_EQ(9 * PageSize, Mapper.getAllocatedSize());
+
+  // Freeing a module's memory makes it available to the next module, while
+  // the code of the others is left alone.
+  MemMgrs[1].reset();
+  EXPECT_EQ(6 * PageSize, Mapper.getAllocatedSize());
+  SectionMemoryManager NewMemMgr(&Mapper);
+  EXPECT_EQ(Code[1], NewMemMgr.allocateCodeSection(256, 0, 1, ""));
+  EXPECT_EQ(0xC3, Code[0][255]);
+  EXPECT_EQ(0xC3, Code[2][0]);
+  EXPECT_EQ(3u, Mapper.getNumSlabs());
+}
+
+TEST(MCJITMemoryManagerTest, SlabLargeAllocations) {
+  SlabMemoryMapper Mapper(64 * 1024);
+
+  // Allocations that don't fit in a slab get a slab of their own.
+  SectionMemoryManager MemMgr(&Mapper);
+  uint8_t *SmallCode = MemMgr.allocateCodeSection(16, 0, 1, "");
+  uint8_t *LargeCode = MemMgr.allocateCodeSection(0x100000, 0, 2, "");
+  ASSERT_NE((uint8_t *)nullptr, LargeCode);
+  ASSERT_NE((uint8_t *)nullptr, SmallCode);
+  memset(LargeCode, 1, 0x100000);
+  memset(SmallCode, 2, 16);
+  EXPECT_EQ(1, LargeCode[0xFFFFF]);
+  EXPECT_EQ(2u, Mapper.getNumSlabs());
+
+  std::string Error;
+  EXPECT_FALSE(MemMgr.finalizeMemory(&Error));
+}
+
+TEST(MCJITMemoryManagerTest, SlabHugePages) {
+  SlabMemoryMapper Mapper(1024 * 1024, /*UseHugePages=*/true);
+
+  // Slabs start on a huge page boundary whether or not the system backs them
+  // with huge pages.
+  SectionMemoryManager MemMgr(&Mapper);
+  uint8_t *Code = MemMgr.allocateCodeSection(256, 0, 1, "");
+  ASSERT_NE((uint8_t *)nullptr, Code);
+  EXPECT_EQ(0u, (uintptr_t)Code % (2 * 1024 * 1024));
+  memset(Code, 0xC3, 256);
+
+  std::string Error;
+  EXPECT_FALSE(MemMgr.finalizeMemory(&Error));
+}
+
 } // Namespace
 
@@ -9,6 +9,12 @@
 
 #include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "OrcTestCommon.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/Legacy.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/Mangler.h"
 #include "gtest/gtest.h"
 
 using namespace llvm;
@@ -81,4 +87,117 @@ TEST(CompileOnDemandLayerTest, FindSymbol) {
   EXPECT_TRUE(!!Sym) << "CompileOnDemand::findSymbol should call findSymbol in "
                         "the base layer.";
 }
+
+class CompileOnDemandLayerExecutionTest : public testing::Test,
+                                          public OrcExecutionTest {};
+
+// With a dispatcher that runs each speculative compile right away, compiling
+// a function compiles its direct callees too, so their stubs already point at
+// their bodies when they are first called.
+TEST_F(CompileOnDemandLayerExecutionTest, SpeculateDirectCallees) {
+  if (!TM)
+    return;
+
+  ModuleBuilder MB(Context, TM->getTargetTriple().str(), "");
+  MB.getModule()->setDataLayout(TM->createDataLayout());
+  Function *Callee = MB.createFunctionDecl<int(int)>("callee");
+  Function *Caller = MB.createFunctionDecl<int(int)>("caller");
+  {
+    IRBuilder<> B(BasicBlock::Create(Context, "entry", Callee));
+    B.CreateRet(B.CreateAdd(&*Callee->arg_begin(), B.getInt32(1)));
+  }
+  {
+    // caller(0) returns 0 without calling callee.
+    Value *X = &*Caller->arg_begin();
+    BasicBlock *Entry = BasicBlock::Create(Context, "entry", Caller);
+    BasicBlock *Call = BasicBlock::Create(Context, "call", Caller);
+    BasicBlock *Ret = BasicBlock::Create(Context, "ret", Caller);
+    IRBuilder<> B(Entry);
+    B.CreateCondBr(B.CreateIsNull(X), Ret, Call);
+    B.SetInsertPoint(Call);
+    B.CreateRet(B.CreateCall(Callee, X));
+    B.SetInsertPoint(Ret);
+    B.CreateRet(B.getInt32(0));
+  }
+
+  SymbolStringPool SSP;
+  ExecutionSession ES(SSP);
+  std::map<VModuleKey, std::shared_ptr<SymbolResolver>> Resolvers;
+  auto TakeResolver = [&](VModuleKey K) {
+    auto Resolver = std::move(Resolvers[K]);
+    Resolvers.erase(K);
+    return Resolver;
+  };
+
+  RTDyldObjectLinkingLayer ObjLayer(ES, [&](VModuleKey K) {
+    return RTDyldObjectLinkingLayer::Resources{
+        std::make_shared<SectionMemoryManager>(), TakeResolver(K)};
+  });
+  IRCompileLayer<decltype(ObjLayer), SimpleCompiler> CompileLayer(
+      ObjLayer, SimpleCompiler(*TM));
+
+  auto CallbackMgr =
+      createLocalCompileCallbackManager(TM->getTargetTriple(), 0);
+  auto CreateStubsMgr =
+      createLocalIndirectStubsManagerBuilder(TM->getTargetTriple());
+  IndirectStubsManager *StubsMgr = nullptr;
+
+  CompileOnDemandLayer<decltype(CompileLayer)> COD(
+      ES, CompileLayer, TakeResolver,
+      [&](VModuleKey K, std::shared_ptr<SymbolResolver> R) {
+        Resolvers[K] = std::move(R);
+      },
+      [](Function &F) { return std::set<Function *>{&F}; }, *CallbackMgr,
+      [&]() {
+        auto Mgr = CreateStubsMgr();
+        StubsMgr = Mgr.get();
+        return Mgr;
+      },
+      false);
+
+  unsigned NumSpeculativeCompiles = 0;
+  COD.setSpeculation(speculateDirectCallees,
+                     [&](std::function<void()> Compile) {
+                       ++NumSpeculativeCompiles;
+                       Compile();
+                     });
+
+  auto K = ES.allocateVModule();
+  Resolvers[K] = createLegacyLookupResolver(
+      [&](const std::string &Name) { return COD.findSymbol(Name, false); },
+      [](Error Err) { cantFail(std::move(Err), "lookupFlags failed"); });
+  cantFail(COD.addModule(K, MB.takeModule()));
+
+  auto Mangle = [&](StringRef Name) {
+    std::string MangledName;
+    raw_string_ostream MangledNameStream(MangledName);
+    Mangler::getNameWithPrefix(MangledNameStream, Name,
+                               TM->createDataLayout());
+    return MangledNameStream.str();
+  };
+  EXPECT_FALSE(CompileLayer.findSymbol(Mangle("callee"), false))
+      << "callee should not be compiled before caller";
+
+  using FnTy = int (*)(int);
+  auto CallerSym = COD.findSymbol(Mangle("caller"), true);
+  ASSERT_TRUE(!!CallerSym) << "caller should have a stub";
+  auto CallerFn = reinterpret_cast<FnTy>(
+      static_cast<uintptr_t>(cantFail(CallerSym.getAddress())));
+  EXPECT_EQ(0, CallerFn(0));
+  EXPECT_EQ(1u, NumSpeculativeCompiles);
+
+  auto CalleeBody = CompileLayer.findSymbol(Mangle("callee"), false);
+  ASSERT_TRUE(!!CalleeBody) << "callee should be compiled speculatively";
+  auto CalleePtr = StubsMgr->findPointer(Mangle("callee"));
+  ASSERT_TRUE(!!CalleePtr) << "callee should have a stub";
+  void *StubTarget = *reinterpret_cast<void **>(
+      static_cast<uintptr_t>(cantFail(CalleePtr.getAddress())));
+  EXPECT_EQ(cantFail(CalleeBody.getAddress()),
+            static_cast<JITTargetAddress>(
+                reinterpret_cast<uintptr_t>(StubTarget)))
+      << "callee's stub should point at its body before callee is called";
+
+  EXPECT_EQ(6, CallerFn(5));
+  EXPECT_EQ(1u, NumSpeculativeCompiles);
+}
 }
@@ -414,4 +414,130 @@ TEST(CoreAPIsTest, TestLookupWithThreadedMaterialization) {
 #endif
 }
 
+TEST(CoreAPIsTest, TestLookupWithThreadPoolMaterialization) {
+  constexpr unsigned NumSymbols = 64;
+  constexpr JITTargetAddress FakeBaseAddr = 0x10000;
+  constexpr JITTargetAddress FakeBarAddr = 0xcafef00d;
+  constexpr JITTargetAddress FakeBazAddr = 0xdeadbeef;
+
+  SymbolStringPool SSP;
+  ExecutionSession ES(SSP);
+  MaterializeOnThreadPool Dispatcher(ES, 4);
+  VSO V;
+
+  SymbolNameSet Names;
+  for (unsigned I = 0; I != NumSymbols; ++I) {
+    auto Name = SSP.intern(("foo" + Twine(I)).str());
+    JITEvaluatedSymbol Sym(FakeBaseAddr + I, JITSymbolFlags::Exported);
+    Names.insert(Name);
+    cantFail(V.defineLazy(llvm::make_unique<SimpleMaterializationUnit>(
+        [=]() { return SymbolFlagsMap({{Name, JITSymbolFlags::Exported}}); },
+        [=](VSO &V) -> Error {
+          V.resolve({{Name, Sym}});
+          V.finalize({Name});
+          return Error::success();
+        },
+        [](VSO &V, SymbolStringPtr Name) {
+          llvm_unreachable("Not expecting a discard");
+        })));
+  }
+
+  // Bar looks up Baz while it is materialized, which dispatches the
+  // materializer of Baz from a thread of the pool.
+  auto Bar = SSP.intern("bar");
+  auto Baz = SSP.intern("baz");
+  JITEvaluatedSymbol BarSym(FakeBarAddr, JITSymbolFlags::Exported);
+  JITEvaluatedSymbol BazSym(FakeBazAddr, JITSymbolFlags::Exported);
+  cantFail(V.defineLazy(llvm::make_unique<SimpleMaterializationUnit>(
+      [=]() { return SymbolFlagsMap({{Baz, JITSymbolFlags::Exported}}); },
+      [&](VSO &V) -> Error {
+        V.resolve({{Baz, BazSym}});
+        V.finalize({Baz});
+        return Error::success();
+      },
+      [](VSO &V, SymbolStringPtr Name) {
+        llvm_unreachable("Not expecting a discard");
+      })));
+  cantFail(V.defineLazy(llvm::make_unique<SimpleMaterializationUnit>(
+      [=]() { return SymbolFlagsMap({{Bar, JITSymbolFlags::Exported}}); },
+      [&](VSO &V) -> Error {
+        auto BazLookupResult = lookup({&V}, Baz, Dispatcher);
+        if (!BazLookupResult)
+          return BazLookupResult.takeError();
+        EXPECT_EQ(BazLookupResult->getAddress(), FakeBazAddr)
+            << "Nested lookup returned an incorrect address";
+        V.resolve({{Bar, BarSym}});
+        V.finalize({Bar});
+        return Error::success();
+      },
+      [](VSO &V, SymbolStringPtr Name) {
+        llvm_unreachable("Not expecting a discard");
+      })));
+  Names.insert(Bar);
+
+  auto Result = cantFail(lookup({&V}, Names, Dispatcher));
+  Dispatcher.wait();
+
+  EXPECT_EQ(Result.size(), NumSymbols + 1)
+      << "lookup returned an incorrect number of symbols";
+  for (unsigned I = 0; I != NumSymbols; ++I)
+    EXPECT_EQ(Result[SSP.intern(("foo" + Twine(I)).str())].getAddress(),
+              FakeBaseAddr + I)
+        << "lookup returned an incorrect address";
+  EXPECT_EQ(Result[Bar].getAddress(), FakeBarAddr)
+      << "lookup returned an incorrect address for bar";
+}
+
+TEST(CoreAPIsTest, TestChainedLookupsOnThreadPool) {
+  // Each symbol looks up the next one while it is materialized. The chain is
+  // longer than the pool has threads, and every materializer is queued on the
+  // pool by the first lookup, so the threads waiting for the next symbol must
+  // run the queued materializers themselves.
+  constexpr unsigned NumThreads = 4;
+  constexpr unsigned NumSymbols = NumThreads + 1;
+  constexpr JITTargetAddress FakeBaseAddr = 0x10000;
+
+  SymbolStringPool SSP;
+  ExecutionSession ES(SSP);
+  MaterializeOnThreadPool Dispatcher(ES, NumThreads);
+  VSO V;
+
+  std::vector<SymbolStringPtr> Chain;
+  for (unsigned I = 0; I != NumSymbols; ++I)
+    Chain.push_back(SSP.intern(("link" + Twine(I)).str()));
+
+  SymbolNameSet Names;
+  for (unsigned I = 0; I != NumSymbols; ++I) {
+    auto Name = Chain[I];
+    bool HasNext = I + 1 != NumSymbols;
+    auto Next = HasNext ? Chain[I + 1] : Name;
+    JITEvaluatedSymbol Sym(FakeBaseAddr + I, JITSymbolFlags::Exported);
+    Names.insert(Name);
+    cantFail(V.defineLazy(llvm::make_unique<SimpleMaterializationUnit>(
+        [=]() { return SymbolFlagsMap({{Name, JITSymbolFlags::Exported}}); },
+        [=, &Dispatcher](VSO &V) -> Error {
+          if (HasNext) {
+            auto NextLookupResult = lookup({&V}, Next, Dispatcher);
+            if (!NextLookupResult)
+              return NextLookupResult.takeError();
+          }
+          V.resolve({{Name, Sym}});
+          V.finalize({Name});
+          return Error::success();
+        },
+        [](VSO &V, SymbolStringPtr Name) {
+          llvm_unreachable("Not expecting a discard");
+        })));
+  }
+
+  auto Result = cantFail(lookup({&V}, Names, Dispatcher));
+  Dispatcher.wait();
+
+  EXPECT_EQ(Result.size(), NumSymbols)
+      << "lookup returned an incorrect number of symbols";
+  for (unsigned I = 0; I != NumSymbols; ++I)
+    EXPECT_EQ(Result[Chain[I]].getAddress(), FakeBaseAddr + I)
+        << "lookup returned an incorrect address";
+}
+
 } // namespace
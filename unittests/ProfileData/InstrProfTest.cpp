@@ -14,6 +14,10 @@
 #include "llvm/ProfileData/InstrProfReader.h"
 #include "llvm/ProfileData/InstrProfWriter.h"
 #include "llvm/Support/Compression.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Testing/Support/Error.h"
 #include "llvm/Testing/Support/SupportHelpers.h"
 #include "gtest/gtest.h"
@@ -197,6 +201,43 @@ TEST_F(InstrProfTest, get_profile_summary) {
   delete PSFromMD;
 }
 
+TEST_F(InstrProfTest, map_page_sized_profile_from_file) {
+  for (unsigned I = 0; I != 1000; ++I)
+    Writer.addRecord({"foo" + std::to_string(I), I, {I, 1}}, Err);
+  auto Profile = Writer.writeBuffer();
+
+  // Pad the file to a multiple of the page size that is large enough to be
+  // mapped. A buffer with a null terminator can't be mapped for such a file,
+  // so the file is only mapped if the reader doesn't ask for one.
+  SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(
+      sys::fs::createTemporaryFile("instrprof", "profdata", FD, Path));
+  FileRemover Remover(Path);
+  {
+    size_t Size = Profile->getBufferSize();
+    size_t PaddedSize = alignTo(std::max<size_t>(Size, 4 * 4096),
+                                sys::Process::getPageSize());
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Profile->getBuffer();
+    OS << std::string(PaddedSize - Size, '\0');
+  }
+
+  auto ReaderOrErr = IndexedInstrProfReader::create(Path);
+  ASSERT_THAT_ERROR(ReaderOrErr.takeError(), Succeeded());
+  Reader = std::move(ReaderOrErr.get());
+  ASSERT_EQ(MemoryBuffer::MemoryBuffer_MMap, Reader->getBufferKind());
+
+  Expected<InstrProfRecord> R = Reader->getInstrProfRecord("foo123", 123);
+  ASSERT_THAT_ERROR(R.takeError(), Succeeded());
+  ASSERT_EQ(2U, R->Counts.size());
+  ASSERT_EQ(123U, R->Counts[0]);
+  ASSERT_EQ(1U, R->Counts[1]);
+
+  R = Reader->getInstrProfRecord("foo1000", 1000);
+  ASSERT_TRUE(ErrorEquals(instrprof_error::unknown_function, R.takeError()));
+}
+
 TEST_F(InstrProfTest, test_writer_merge) {
   Writer.addRecord({"func1", 0x1234, {42}}, Err);
 
@@ -220,6 +261,35 @@ TEST_F(InstrProfTest, test_writer_merge) {
   ASSERT_EQ(0U, R->Counts[1]);
 }
 
+TEST_F(InstrProfTest, test_writer_approximate_size) {
+  ASSERT_EQ(0U, Writer.getApproximateSize());
+
+  Writer.addRecord({"func1", 0x1234, {1, 2}}, Err);
+  uint64_t Size = Writer.getApproximateSize();
+  ASSERT_LT(0U, Size);
+
+  // Merging into an existing record doesn't take more memory.
+  Writer.addRecord({"func1", 0x1234, {3, 4}}, Err);
+  ASSERT_EQ(Size, Writer.getApproximateSize());
+
+  // A new record takes memory for its counters and value data.
+  NamedInstrProfRecord Record("func1", 0x1235, {1, 2, 3, 4});
+  Record.reserveSites(IPVK_IndirectCallTarget, 1);
+  InstrProfValueData VD[] = {{1, 1}, {2, 2}};
+  Record.addValueData(IPVK_IndirectCallTarget, 0, VD, 2, nullptr);
+  Writer.addRecord(std::move(Record), Err);
+  ASSERT_LT(Size, Writer.getApproximateSize());
+  Size = Writer.getApproximateSize();
+
+  // New values grow the record.
+  NamedInstrProfRecord Record2("func1", 0x1235, {1, 2, 3, 4});
+  Record2.reserveSites(IPVK_IndirectCallTarget, 1);
+  InstrProfValueData VD2[] = {{3, 1}};
+  Record2.addValueData(IPVK_IndirectCallTarget, 0, VD2, 1, nullptr);
+  Writer.addRecord(std::move(Record2), Err);
+  ASSERT_LT(Size, Writer.getApproximateSize());
+}
+
 static const char callee1[] = "callee1";
 static const char callee2[] = "callee2";
 static const char callee3[] = "callee3";
@@ -0,0 +1,330 @@
+//===- CacheManifestTest.cpp ----------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CacheManifest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+class CacheManifestTest : public testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(sys::fs::createUniqueDirectory("cache-manifest-test", Dir));
+  }
+
+  void TearDown() override { sys::fs::remove_directories(Dir); }
+
+  std::string path(StringRef Name) {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, Name);
+    return Path.str();
+  }
+
+  void writeFile(StringRef Name, size_t Size) {
+    std::error_code EC;
+    raw_fd_ostream OS(path(Name), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << std::string(Size, 'x');
+  }
+
+  void insert(StringRef Key, size_t Size) {
+    writeFile(("llvmcache-" + Key).str(), Size);
+    CacheManifest::recordInsert(Dir, Key, Size);
+  }
+
+  void setModificationTime(StringRef Name, std::time_t Time) {
+    int FD;
+    ASSERT_FALSE(sys::fs::openFileForWrite(path(Name), FD, sys::fs::F_Append));
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    EXPECT_FALSE(sys::fs::setLastModificationAndAccessTime(
+        FD, sys::toTimePoint(Time)));
+  }
+
+  bool exists(StringRef Name) { return sys::fs::exists(path(Name)); }
+
+  SmallString<128> Dir;
+};
+
+TEST_F(CacheManifestTest, CreateFromDirectory) {
+  writeFile("llvmcache-a", 10);
+  writeFile("llvmcache-b", 20);
+  writeFile("foo", 40);
+  EXPECT_FALSE(CacheManifest::exists(Dir));
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  EXPECT_TRUE(CacheManifest::exists(Dir));
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  EXPECT_EQ(2u, M->getNumEntries());
+  EXPECT_EQ(30u, M->getTotalSize());
+}
+
+TEST_F(CacheManifestTest, LeastRecentlyUsed) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  insert("a", 10);
+  insert("b", 20);
+  insert("c", 30);
+  CacheManifest::recordAccess(Dir, "a", 10);
+  CacheManifest::recordAccess(Dir, "unknown", 5);
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+
+  // The access of the unknown entry is evicted last.
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-b"));
+  EXPECT_TRUE(exists("llvmcache-c"));
+  EXPECT_EQ(45u, M->getTotalSize());
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-c"));
+  EXPECT_TRUE(exists("llvmcache-a"));
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-a"));
+
+  // Evictions are recorded, so they are visible to the next reader.
+  // The unknown entry is only counted once the (empty) snapshot was read.
+  Expected<CacheManifest> M2 = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M2));
+  EXPECT_FALSE(M2->empty());
+  EXPECT_EQ(1u, M2->getNumEntries());
+  EXPECT_EQ(5u, M2->getTotalSize());
+}
+
+TEST_F(CacheManifestTest, ReplaceEntry) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  insert("a", 10);
+  insert("a", 15);
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  EXPECT_EQ(1u, M->getNumEntries());
+  EXPECT_EQ(15u, M->getTotalSize());
+}
+
+TEST_F(CacheManifestTest, MalformedRecords) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  insert("a", 10);
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(path("llvmcache.journal"), EC, sys::fs::F_Append);
+    ASSERT_FALSE(EC);
+    OS << "+ b ten 0\n? c\n+ d 5";
+  }
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  EXPECT_EQ(1u, M->getNumEntries());
+  EXPECT_EQ(10u, M->getTotalSize());
+}
+
+TEST_F(CacheManifestTest, InvalidHeader) {
+  writeFile("llvmcache.manifest", 10);
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  EXPECT_FALSE(bool(M));
+  consumeError(M.takeError());
+}
+
+TEST_F(CacheManifestTest, Compact) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  insert("a", 10);
+  insert("b", 20);
+  for (int I = 0; I != 2000; ++I)
+    CacheManifest::recordAccess(Dir, "a", 10);
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  M->compactIfNeeded();
+  EXPECT_EQ(2u, M->getNumEntries());
+  EXPECT_EQ(30u, M->getTotalSize());
+
+  // The journal was folded into the snapshot.
+  EXPECT_FALSE(exists("llvmcache.journal"));
+  EXPECT_FALSE(exists("llvmcache.journal.compacting"));
+  auto MB = MemoryBuffer::getFile(path("llvmcache.manifest"));
+  ASSERT_TRUE(bool(MB));
+  EXPECT_EQ(3u, (*MB)->getBuffer().count('\n'));
+
+  // Records appended afterwards go to a new journal.
+  insert("c", 30);
+  Expected<CacheManifest> M2 = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M2));
+  EXPECT_EQ(3u, M2->getNumEntries());
+  EXPECT_EQ(60u, M2->getTotalSize());
+
+  // "b" was used before "a" and must still be evicted first.
+  M2->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-b"));
+  EXPECT_TRUE(exists("llvmcache-a"));
+  EXPECT_TRUE(exists("llvmcache-c"));
+}
+
+TEST_F(CacheManifestTest, UnfinishedCompaction) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  insert("a", 10);
+  insert("b", 20);
+  for (int I = 0; I != 2000; ++I)
+    CacheManifest::recordAccess(Dir, "a", 10);
+  // A compaction set the journal aside, and died before folding it in.
+  ASSERT_FALSE(sys::fs::rename(path("llvmcache.journal"),
+                               path("llvmcache.journal.compacting")));
+  insert("c", 30);
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  EXPECT_EQ(3u, M->getNumEntries());
+  EXPECT_EQ(60u, M->getTotalSize());
+
+  // The next compaction folds in the journal that was set aside, and leaves
+  // the current one for later.
+  M->compactIfNeeded();
+  EXPECT_FALSE(exists("llvmcache.journal.compacting"));
+  EXPECT_TRUE(exists("llvmcache.journal"));
+  EXPECT_EQ(3u, M->getNumEntries());
+  EXPECT_EQ(60u, M->getTotalSize());
+
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-b"));
+}
+
+TEST_F(CacheManifestTest, EvictMissingEntry) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  // Recorded, but removed behind the manifest's back.
+  insert("a", 10);
+  ASSERT_FALSE(sys::fs::remove(path("llvmcache-a")));
+  insert("b", 20);
+
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  EXPECT_EQ(2u, M->getNumEntries());
+  M->evictLeastRecentlyUsed();
+  EXPECT_EQ(1u, M->getNumEntries());
+  EXPECT_EQ(20u, M->getTotalSize());
+  EXPECT_TRUE(exists("llvmcache-b"));
+}
+
+TEST_F(CacheManifestTest, LazyLoad) {
+  std::time_t Now = sys::toTimeT(std::chrono::system_clock::now());
+  writeFile("llvmcache-a", 10);
+  writeFile("llvmcache-b", 25);
+  writeFile("llvmcache-c", 30);
+  writeFile("llvmcache-x", 5);
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(path("llvmcache.manifest"), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "llvmcache-manifest v2 3 60 " << uint64_t(Now) << "\n"
+       << "+ a 10 100\n+ b 20 200\n+ c 30 300\n";
+  }
+  CacheManifest::recordAccess(Dir, "a", 10);
+  CacheManifest::recordInsert(Dir, "b", 25);
+  CacheManifest::recordAccess(Dir, "x", 5);
+
+  // Before the snapshot is read, the reinserted entry counts twice.
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  EXPECT_EQ(4u, M->getNumEntries());
+  EXPECT_EQ(85u, M->getTotalSize());
+
+  // The snapshot's entries are older than the journal's; those that the
+  // journal supersedes are skipped, and the counts are exact once the whole
+  // snapshot was read.
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-c"));
+  EXPECT_FALSE(M->empty());
+  EXPECT_EQ(3u, M->getNumEntries());
+  EXPECT_EQ(40u, M->getTotalSize());
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-a"));
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-b"));
+  EXPECT_TRUE(exists("llvmcache-x"));
+  EXPECT_EQ(1u, M->getNumEntries());
+  EXPECT_EQ(5u, M->getTotalSize());
+  EXPECT_FALSE(M->empty());
+  M->evictLeastRecentlyUsed();
+  EXPECT_TRUE(M->empty());
+}
+
+TEST_F(CacheManifestTest, Rescan) {
+  writeFile("llvmcache-a", 10);
+  writeFile("llvmcache-b", 20);
+  {
+    std::error_code EC;
+    raw_fd_ostream OS(path("llvmcache.manifest"), EC, sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "llvmcache-manifest v2 2 30 0\n+ a 10 100\n+ b 20 200\n";
+  }
+  // Written by a process that died before recording it, long enough ago that
+  // no process can still be about to record it.
+  writeFile("llvmcache-c", 30);
+  setModificationTime("llvmcache-c", 50);
+  // Written just now, and about to be recorded.
+  writeFile("llvmcache-d", 40);
+  ASSERT_FALSE(sys::fs::remove(path("llvmcache-b")));
+
+  // The last walk of the directory is more than a day old, so compaction walks
+  // it again even though the journal is short.
+  Expected<CacheManifest> M = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M));
+  M->compactIfNeeded();
+  EXPECT_EQ(2u, M->getNumEntries());
+  EXPECT_EQ(40u, M->getTotalSize());
+
+  // Unrecorded entries are evicted first.
+  M->evictLeastRecentlyUsed();
+  EXPECT_FALSE(exists("llvmcache-c"));
+  EXPECT_TRUE(exists("llvmcache-a"));
+  EXPECT_TRUE(exists("llvmcache-d"));
+
+  // The walk isn't repeated for another day.
+  writeFile("llvmcache-e", 50);
+  setModificationTime("llvmcache-e", 50);
+  Expected<CacheManifest> M2 = CacheManifest::load(Dir);
+  ASSERT_TRUE(bool(M2));
+  M2->compactIfNeeded();
+  EXPECT_EQ(1u, M2->getNumEntries());
+  EXPECT_EQ(10u, M2->getTotalSize());
+}
+
+TEST_F(CacheManifestTest, PruneCache) {
+  ASSERT_FALSE(bool(CacheManifest::create(Dir)));
+  insert("a", 10);
+  insert("b", 20);
+  insert("c", 30);
+  CacheManifest::recordAccess(Dir, "a", 10);
+  writeFile("foo", 40);
+
+  CachePruningPolicy Policy;
+  Policy.Interval = std::chrono::seconds(0);
+  Policy.Expiration = std::chrono::seconds(0);
+  Policy.MaxSizePercentageOfAvailableSpace = 0;
+  Policy.MaxSizeFiles = 2;
+  EXPECT_TRUE(pruneCache(Dir, Policy));
+  EXPECT_FALSE(exists("llvmcache-b"));
+  EXPECT_TRUE(exists("llvmcache-c"));
+  EXPECT_TRUE(exists("llvmcache-a"));
+  EXPECT_TRUE(exists("foo"));
+
+  Policy.MaxSizeFiles = 0;
+  Policy.MaxSizeBytes = 15;
+  EXPECT_TRUE(pruneCache(Dir, Policy));
+  EXPECT_FALSE(exists("llvmcache-c"));
+  EXPECT_TRUE(exists("llvmcache-a"));
+  EXPECT_TRUE(exists("foo"));
+}
+
+} // end anonymous namespace
@@ -347,6 +347,24 @@ TEST_P(MappedMemoryTest, UnalignedNear) {
   EXPECT_FALSE(Memory::releaseMappedMemory(M1));
 }
 
+TEST_P(MappedMemoryTest, HugeHint) {
+  std::error_code EC;
+  MemoryBlock M1 = Memory::allocateMappedMemory(
+      4 * PageSize, nullptr, Flags | Memory::MF_HUGE_HINT, EC);
+  EXPECT_EQ(std::error_code(), EC);
+  EXPECT_NE((void*)nullptr, M1.base());
+  EXPECT_LE(4U * PageSize, M1.size());
+
+  // The hint is accepted, and ignored, when changing the protection too.
+  EXPECT_FALSE(Memory::protectMappedMemory(
+      M1, getTestableEquivalent(Flags) | Memory::MF_HUGE_HINT));
+  int *x = (int*)M1.base();
+  *x = 1;
+  EXPECT_EQ(1, *x);
+
+  EXPECT_FALSE(Memory::releaseMappedMemory(M1));
+}
+
 // Note that Memory::MF_WRITE is not supported exclusively across
 // operating systems and architectures and can imply MF_READ|MF_WRITE
 unsigned MemoryFlags[] = {
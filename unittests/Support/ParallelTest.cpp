@@ -15,6 +15,7 @@
 #include "llvm/Support/Parallel.h"
 #include "gtest/gtest.h"
 #include <array>
+#include <atomic>
 #include <random>
 
 uint32_t array[1024 * 1024];
@@ -50,4 +51,16 @@ TEST(Parallel, parallel_for) {
   ASSERT_EQ(range[2049], 1u);
 }
 
+TEST(Parallel, nested_for_each) {
+  // Every outer task waits on an inner task group. With a blocking wait this
+  // would deadlock as soon as all workers are busy with outer tasks.
+  std::atomic<unsigned> Count{0};
+  for_each_n(parallel::par, 0, 64, [&](size_t) {
+    for_each_n(parallel::par, 0, 64, [&](size_t) {
+      for_each_n(parallel::par, 0, 16, [&](size_t) { ++Count; });
+    });
+  });
+  ASSERT_EQ(Count, 64u * 64u * 16u);
+}
+
 #endif
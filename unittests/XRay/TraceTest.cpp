@@ -0,0 +1,250 @@
+//===- llvm/unittest/XRay/TraceTest.cpp - XRay Trace unit tests -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/XRay/Trace.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace xray;
+
+namespace {
+
+// Builds the bytes of a little-endian XRay log.
+class LogBuilder {
+  std::string Bytes;
+
+public:
+  LogBuilder &u8(uint8_t V) {
+    Bytes.push_back(static_cast<char>(V));
+    return *this;
+  }
+  LogBuilder &u16(uint16_t V) { return u8(V).u8(V >> 8); }
+  LogBuilder &u32(uint32_t V) { return u16(V).u16(V >> 16); }
+  LogBuilder &u64(uint64_t V) { return u32(V).u32(V >> 32); }
+  LogBuilder &pad(size_t N) {
+    Bytes.append(N, '\0');
+    return *this;
+  }
+
+  // The 32 byte file header. FDR mode logs keep their buffer size in the free
+  // form data.
+  LogBuilder &header(uint16_t Version, uint16_t Type, uint64_t BufferSize) {
+    return u16(Version).u16(Type).u32(3).u64(2000000000).u64(BufferSize).pad(
+        8);
+  }
+
+  // A 32 byte "naive" mode function record.
+  LogBuilder &naiveRecord(uint8_t Type, int32_t FuncId, uint64_t TSC,
+                          uint32_t TId) {
+    return u16(0).u8(1).u8(Type).u32(FuncId).u64(TSC).u32(TId).pad(12);
+  }
+
+  // A 32 byte "naive" mode argument payload of the preceding function record.
+  LogBuilder &naiveArg(int32_t FuncId, uint32_t TId, uint64_t Arg) {
+    return u16(1).pad(2).u32(FuncId).u32(TId).pad(4).u64(Arg).pad(8);
+  }
+
+  // The first byte of a 16 byte FDR mode metadata record of kind \p Kind. The
+  // callers below add the payload and padding.
+  LogBuilder &fdrMetadata(uint8_t Kind) { return u8(Kind << 1 | 1); }
+  LogBuilder &fdrBufferExtents(uint64_t Size) {
+    return fdrMetadata(7).u64(Size).pad(7);
+  }
+  LogBuilder &fdrNewBuffer(uint16_t TId) {
+    return fdrMetadata(0).u16(TId).pad(13);
+  }
+  LogBuilder &fdrWallTime() { return fdrMetadata(4).u64(1).u32(2).pad(3); }
+  LogBuilder &fdrNewCPUId(uint16_t CPU, uint64_t TSC) {
+    return fdrMetadata(2).u16(CPU).u64(TSC).pad(5);
+  }
+  LogBuilder &fdrCallArgument(uint64_t Arg) {
+    return fdrMetadata(6).u64(Arg).pad(7);
+  }
+
+  // An 8 byte FDR mode function record.
+  LogBuilder &fdrFunction(uint8_t Type, uint32_t FuncId, uint32_t TSCDelta) {
+    return u32(FuncId << 4 | Type << 1).u32(TSCDelta);
+  }
+
+  const std::string &str() const { return Bytes; }
+};
+
+class TraceTest : public testing::Test {
+protected:
+  SmallString<128> Path;
+  std::unique_ptr<FileRemover> Remover;
+
+  void writeLog(const LogBuilder &Log) {
+    int FD;
+    ASSERT_FALSE(sys::fs::createTemporaryFile("xray-trace", "xray", FD, Path));
+    Remover = llvm::make_unique<FileRemover>(Path);
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Log.str();
+  }
+
+  // Reads the log with loadTraceFile and with a TraceStream, and checks that
+  // both give the same records.
+  std::vector<XRayRecord> readLog() {
+    auto TraceOrErr = loadTraceFile(Path);
+    EXPECT_TRUE(bool(TraceOrErr));
+    if (!TraceOrErr) {
+      consumeError(TraceOrErr.takeError());
+      return {};
+    }
+    std::vector<XRayRecord> Loaded(TraceOrErr->begin(), TraceOrErr->end());
+
+    auto StreamOrErr = openTraceFile(Path);
+    EXPECT_TRUE(bool(StreamOrErr));
+    if (!StreamOrErr) {
+      consumeError(StreamOrErr.takeError());
+      return {};
+    }
+    std::vector<XRayRecord> Streamed;
+    Error Err = Error::success();
+    for (const XRayRecord &R : (*StreamOrErr)->records(Err))
+      Streamed.push_back(R);
+    EXPECT_FALSE(bool(Err));
+    consumeError(std::move(Err));
+
+    EXPECT_EQ(Loaded.size(), Streamed.size());
+    for (size_t I = 0; I < Loaded.size() && I < Streamed.size(); ++I) {
+      EXPECT_EQ(Loaded[I].RecordType, Streamed[I].RecordType);
+      EXPECT_EQ(Loaded[I].CPU, Streamed[I].CPU);
+      EXPECT_EQ(Loaded[I].Type, Streamed[I].Type);
+      EXPECT_EQ(Loaded[I].FuncId, Streamed[I].FuncId);
+      EXPECT_EQ(Loaded[I].TSC, Streamed[I].TSC);
+      EXPECT_EQ(Loaded[I].TId, Streamed[I].TId);
+      EXPECT_EQ(Loaded[I].CallArgs, Streamed[I].CallArgs);
+    }
+    return Streamed;
+  }
+};
+
+// Naive mode logs are streamed 4096 records at a time. Put argument payloads
+// after the last record of the first chunk and the first record of the second
+// one, and at the end of the log.
+TEST_F(TraceTest, NaiveLogArgumentsAcrossChunks) {
+  const unsigned NumRecords = 10000, ChunkSize = 4096;
+  LogBuilder Log;
+  Log.header(1, 0, 0);
+  for (unsigned I = 0; I < NumRecords; ++I) {
+    bool HasArgs =
+        I == ChunkSize - 1 || I == ChunkSize || I == NumRecords - 1;
+    Log.naiveRecord(HasArgs ? 3 : I % 2, I, 100 + I, I % 3);
+    if (HasArgs)
+      Log.naiveArg(I, I % 3, 1000 + I).naiveArg(I, I % 3, 2000 + I);
+  }
+  writeLog(Log);
+
+  std::vector<XRayRecord> Records = readLog();
+  ASSERT_EQ(NumRecords, Records.size());
+  for (unsigned I = 0; I < NumRecords; ++I) {
+    EXPECT_EQ(static_cast<int32_t>(I), Records[I].FuncId);
+    EXPECT_EQ(100u + I, Records[I].TSC);
+  }
+  for (unsigned I : {ChunkSize - 1, ChunkSize, NumRecords - 1}) {
+    EXPECT_EQ(RecordTypes::ENTER_ARG, Records[I].Type);
+    EXPECT_EQ(std::vector<uint64_t>({1000u + I, 2000u + I}),
+              Records[I].CallArgs);
+  }
+  EXPECT_TRUE(Records[ChunkSize + 1].CallArgs.empty());
+}
+
+// Version 2 FDR mode logs are streamed one thread buffer at a time, as given by
+// their BufferExtents records. The TSC carries over within a buffer, and a
+// buffer that only holds metadata is skipped.
+TEST_F(TraceTest, FDRVersion2MultipleBuffers) {
+  LogBuilder Log;
+  Log.header(2, 1, 4096);
+
+  Log.fdrBufferExtents(3 * 16 + 3 * 8 + 16)
+      .fdrNewBuffer(1)
+      .fdrWallTime()
+      .fdrNewCPUId(7, 1000)
+      .fdrFunction(0, 1, 10)
+      .fdrCallArgument(42)
+      .fdrFunction(0, 2, 10)
+      .fdrFunction(1, 2, 5);
+
+  Log.fdrBufferExtents(3 * 16).fdrNewBuffer(2).fdrWallTime().fdrNewCPUId(
+      8, 2000);
+
+  Log.fdrBufferExtents(4 * 16 + 2 * 8)
+      .fdrNewBuffer(3)
+      .fdrWallTime()
+      .fdrNewCPUId(9, 3000)
+      .fdrFunction(2, 1, 1)
+      .fdrNewCPUId(10, 5000)
+      .fdrFunction(1, 3, 2);
+  writeLog(Log);
+
+  std::vector<XRayRecord> Records = readLog();
+  ASSERT_EQ(5u, Records.size());
+
+  EXPECT_EQ(RecordTypes::ENTER_ARG, Records[0].Type);
+  EXPECT_EQ(1, Records[0].FuncId);
+  EXPECT_EQ(1010u, Records[0].TSC);
+  EXPECT_EQ(std::vector<uint64_t>({42}), Records[0].CallArgs);
+  EXPECT_EQ(RecordTypes::ENTER, Records[1].Type);
+  EXPECT_EQ(1020u, Records[1].TSC);
+  EXPECT_EQ(RecordTypes::EXIT, Records[2].Type);
+  EXPECT_EQ(1025u, Records[2].TSC);
+  for (unsigned I = 0; I < 3; ++I) {
+    EXPECT_EQ(1u, Records[I].TId);
+    EXPECT_EQ(7u, Records[I].CPU);
+  }
+
+  EXPECT_EQ(RecordTypes::TAIL_EXIT, Records[3].Type);
+  EXPECT_EQ(3u, Records[3].TId);
+  EXPECT_EQ(9u, Records[3].CPU);
+  EXPECT_EQ(3001u, Records[3].TSC);
+  EXPECT_EQ(3, Records[4].FuncId);
+  EXPECT_EQ(10u, Records[4].CPU);
+  EXPECT_EQ(5002u, Records[4].TSC);
+}
+
+// An error in a later thread buffer ends the iteration after the records of
+// the buffers before it, and is reported through the Error.
+TEST_F(TraceTest, FDRVersion2ErrorInLaterBuffer) {
+  LogBuilder Log;
+  Log.header(2, 1, 4096);
+  Log.fdrBufferExtents(3 * 16 + 8)
+      .fdrNewBuffer(1)
+      .fdrWallTime()
+      .fdrNewCPUId(1, 100)
+      .fdrFunction(0, 1, 1);
+  // A function record before the buffer's CPU record.
+  Log.fdrBufferExtents(2 * 16 + 8).fdrNewBuffer(2).fdrWallTime().fdrFunction(
+      0, 2, 1);
+  writeLog(Log);
+
+  auto StreamOrErr = openTraceFile(Path);
+  ASSERT_TRUE(bool(StreamOrErr));
+  unsigned NumRecords = 0;
+  Error Err = Error::success();
+  for (const XRayRecord &R : (*StreamOrErr)->records(Err)) {
+    EXPECT_EQ(1, R.FuncId);
+    ++NumRecords;
+  }
+  EXPECT_TRUE(bool(Err));
+  consumeError(std::move(Err));
+  EXPECT_EQ(1u, NumRecords);
+
+  auto TraceOrErr = loadTraceFile(Path);
+  EXPECT_FALSE(bool(TraceOrErr));
+  consumeError(TraceOrErr.takeError());
+}
+
+} // end anonymous namespace